@@ -0,0 +1,42 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the benchmark allocation
+ * counter.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench_allocs.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+// Some middlewares allocate from their own threads
+static _Atomic uint64_t bench_allocs = 0;
+
+void *__wrap_malloc(size_t size) {
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  return __real_realloc(ptr, size);
+}
+
+uint64_t get_bench_allocs(void) {
+  return atomic_load_explicit(&bench_allocs, memory_order_relaxed);
+}
@@ -0,0 +1,28 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the benchmark allocation counter.
+ *
+ * The benchmark is linked with --wrap=malloc, --wrap=calloc and
+ * --wrap=realloc, so the allocations of the statically linked edgesec
+ * libraries are counted. The allocations inside shared libraries (e.g.
+ * libsqlite3.so) are not counted.
+ */
+
+#ifndef BENCH_ALLOCS_H
+#define BENCH_ALLOCS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Returns the number of allocations since the start of the process
+ *
+ * @return uint64_t The number of malloc, calloc and realloc calls
+ */
+uint64_t get_bench_allocs(void);
+
+#endif
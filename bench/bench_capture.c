@@ -0,0 +1,722 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief A tool to benchmark the capture decoder, middlewares and sinks
+ *
+ * The packets of a pcap file and of a synthetic traffic corpus are replayed
+ * from memory through extract_packets(), the process() function of every
+ * compiled middleware and the sqlite, pcap and protobuf sinks. The results
+ * are printed as JSON.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <pcap.h>
+#include <sqlite3.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <eloop.h>
+#include <utarray.h>
+
+#include "capture/middlewares/header_middleware/packet_decoder.h"
+#include "capture/middlewares/header_middleware/packet_queue.h"
+#include "capture/middlewares/header_middleware/sqlite_header.h"
+#include "capture/middlewares/pcap_middleware/pcap_segment.h"
+#include "capture/middlewares/pcap_middleware/sqlite_pcap.h"
+#include "capture/middlewares_list.h"
+#include "capture/pcap_service.h"
+#ifdef WITH_PROTOBUF_MIDDLEWARE
+#include "capture/middlewares/protobuf_middleware/protobuf_writer.h"
+#endif
+#include "utils/allocs.h"
+#include "utils/attributes.h"
+#include "utils/log.h"
+#include "utils/os.h"
+#include "version.h"
+
+#include "bench_allocs.h"
+#include "traffic_gen.h"
+
+#define BENCH_IFNAME "bench0"
+#define BENCH_DB_NAME "bench.sqlite"
+#define BENCH_PCAP_FOLDER "bench_pcap"
+#define BENCH_WORK_DIR "/tmp"
+#define BENCH_ROUNDS 3
+#define BENCH_SNAPLEN 65535
+#define BENCH_SQLITE_BATCH_SIZE 1000 // Same as the header middleware
+#define BENCH_PCAP_SEGMENT_SIZE 1024ULL * 1024 * 1024 // Never rotates
+
+#define OPT_STRING ":p:n:m:s:l:r:w:o:Sdhv"
+
+#define USAGE_STRING                                                           \
+  "\t%s [-p filename] [-n packets] [-m mix] [-s min-max] [-l flows] "         \
+  "[-r rounds] [-w folder] [-o filename] [-S] [-d] [-h] [-v]\n"
+
+#define DESCRIPTION_STRING                                                     \
+  "\nBenchmark the capture decoder, middlewares and sinks with a pcap file "  \
+  "and synthetic traffic, and output the results as JSON.\n"
+
+struct bench_options {
+  char *pcap_path;
+  char *work_dir;
+  char *out_path;
+  struct traffic_config traffic;
+  unsigned int rounds;
+  bool skip_synthetic;
+  uint8_t verbosity;
+};
+
+struct bench_result {
+  char stage[64];      /**< The stage name */
+  uint64_t packets;    /**< Number of packets processed */
+  uint64_t elapsed_ns; /**< The stage time in nanoseconds */
+  uint64_t allocs;     /**< Number of allocations in the stage */
+  long peak_rss_kb;    /**< The process peak RSS at the end of the stage */
+};
+
+struct bench_timer {
+  uint64_t elapsed_ns;
+  uint64_t allocs;
+  struct timespec start;
+  uint64_t start_allocs;
+};
+
+static const UT_icd bench_result_icd = {sizeof(struct bench_result), NULL,
+                                        NULL, NULL};
+static const UT_icd tp_list_icd = {sizeof(struct tuple_packet), NULL, NULL,
+                                   free_packet};
+
+void show_app_version(void) {
+  fprintf(stdout, "edgesec-bench app version %s\n", EDGESEC_VERSION);
+}
+
+void show_app_help(char *app_name) {
+  show_app_version();
+  fprintf(stdout, "Usage:\n");
+  fprintf(stdout, USAGE_STRING, basename(app_name));
+  fprintf(stdout, DESCRIPTION_STRING);
+  fprintf(stdout, "\nOptions:\n");
+  fprintf(stdout, "\t-p filename\t Path to the pcap file to replay.\n");
+  fprintf(stdout, "\t-n packets\t Number of synthetic packets (default: "
+                  "100000).\n");
+  fprintf(stdout, "\t-m mix\t\t Synthetic protocol mix, e.g. "
+                  "tcp=60,udp=20,icmp=2,dns=10,mdns=5,arp=3.\n");
+  fprintf(stdout, "\t-s min-max\t Synthetic packet sizes in bytes (default: "
+                  "64-1514).\n");
+  fprintf(stdout, "\t-l flows\t Number of synthetic flows (default: 256).\n");
+  fprintf(stdout, "\t-r rounds\t Number of replays of each corpus (default: "
+                  "3).\n");
+  fprintf(stdout, "\t-w folder\t Folder for the benchmark db and pcap files "
+                  "(default: /tmp).\n");
+  fprintf(stdout, "\t-o filename\t Path to the JSON output (default: "
+                  "stdout).\n");
+  fprintf(stdout, "\t-S\t\t Skip the synthetic traffic.\n");
+  fprintf(stdout,
+          "\t-d\t\t Verbosity level (use multiple -dd... to increase)\n");
+  fprintf(stdout, "\t-h\t\t Show help\n");
+  fprintf(stdout, "\t-v\t\t Show app version\n\n");
+  fprintf(stdout, "Copyright NQMCyber Ltd\n\n");
+  exit(EXIT_SUCCESS);
+}
+
+/* Diagnose an error in command-line arguments and
+   terminate the process */
+PRINTF_FORMAT(1, 2) void log_cmdline_error(const char *format, ...) {
+  va_list argList;
+
+  fflush(stdout); /* Flush any pending stdout */
+  fflush(stderr);
+
+  fprintf(stderr, "Command-line usage error: ");
+  va_start(argList, format);
+  vfprintf(stderr, format, argList);
+  va_end(argList);
+
+  fflush(stderr); /* In case stderr is not line-buffered */
+  exit(EXIT_FAILURE);
+}
+
+void process_app_options(int argc, char *argv[], struct bench_options *opts) {
+  int opt;
+  long value;
+  unsigned long min_size, max_size;
+
+  while ((opt = getopt(argc, argv, OPT_STRING)) != -1) {
+    switch (opt) {
+      case 'h':
+        show_app_help(argv[0]);
+        break;
+      case 'v':
+        show_app_version();
+        exit(EXIT_SUCCESS);
+        break;
+      case 'p':
+        opts->pcap_path = optarg;
+        break;
+      case 'n':
+        if ((value = strtol(optarg, NULL, 10)) <= 0) {
+          log_cmdline_error("Invalid number of packets %s\n", optarg);
+        }
+        opts->traffic.packets = (size_t)value;
+        break;
+      case 'm':
+        if (parse_traffic_mix(optarg, &opts->traffic) < 0) {
+          log_cmdline_error("Invalid protocol mix %s\n", optarg);
+        }
+        break;
+      case 's':
+        if (sscanf(optarg, "%lu-%lu", &min_size, &max_size) != 2 ||
+            min_size < TRAFFIC_MIN_SIZE || max_size > BENCH_SNAPLEN ||
+            min_size > max_size) {
+          log_cmdline_error("Invalid packet sizes %s\n", optarg);
+        }
+        opts->traffic.min_size = (uint32_t)min_size;
+        opts->traffic.max_size = (uint32_t)max_size;
+        break;
+      case 'l':
+        if ((value = strtol(optarg, NULL, 10)) <= 0) {
+          log_cmdline_error("Invalid number of flows %s\n", optarg);
+        }
+        opts->traffic.flows = (uint32_t)value;
+        break;
+      case 'r':
+        if ((value = strtol(optarg, NULL, 10)) <= 0) {
+          log_cmdline_error("Invalid number of rounds %s\n", optarg);
+        }
+        opts->rounds = (unsigned int)value;
+        break;
+      case 'w':
+        opts->work_dir = optarg;
+        break;
+      case 'o':
+        opts->out_path = optarg;
+        break;
+      case 'S':
+        opts->skip_synthetic = true;
+        break;
+      case 'd':
+        opts->verbosity++;
+        break;
+      case ':':
+        log_cmdline_error("Missing argument for -%c\n", optopt);
+        break;
+      case '?':
+        log_cmdline_error("Unrecognized option -%c\n", optopt);
+        break;
+      default:
+        show_app_help(argv[0]);
+    }
+  }
+}
+
+static void start_bench_timer(struct bench_timer *timer) {
+  timer->start_allocs = get_bench_allocs();
+  clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+static void stop_bench_timer(struct bench_timer *timer) {
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  timer->allocs += get_bench_allocs() - timer->start_allocs;
+  timer->elapsed_ns += (uint64_t)(end.tv_sec - timer->start.tv_sec) *
+                           1000000000ULL +
+                       (uint64_t)end.tv_nsec - (uint64_t)timer->start.tv_nsec;
+}
+
+static void add_bench_result(UT_array *results, const char *stage,
+                             const struct bench_timer *timer,
+                             uint64_t packets) {
+  struct bench_result result;
+  struct rusage usage;
+
+  os_memset(&result, 0, sizeof(result));
+  os_strlcpy(result.stage, stage, sizeof(result.stage));
+  result.packets = packets;
+  result.elapsed_ns = timer->elapsed_ns;
+  result.allocs = timer->allocs;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    result.peak_rss_kb = usage.ru_maxrss;
+  }
+
+  utarray_push_back(results, &result);
+  log_info("%s: %" PRIu64 " packets in %" PRIu64 " ns", stage, packets,
+           timer->elapsed_ns);
+}
+
+static int decode_corpus_round(const struct traffic_corpus *corpus,
+                               UT_array *tp_array) {
+  for (size_t idx = 0; idx < corpus->count; idx++) {
+    struct middleware_packet *mp = &corpus->packets[idx];
+    if (extract_packets(corpus->ltype, &mp->header, mp->packet, BENCH_IFNAME,
+                        PACKET_DECODE_ALL, tp_array) < 0) {
+      log_error("extract_packets fail");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int bench_decode(const struct traffic_corpus *corpus,
+                        unsigned int rounds, UT_array *results) {
+  struct bench_timer timer = {0};
+  UT_array *tp_array = NULL;
+
+  utarray_new(tp_array, &tp_list_icd);
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    start_bench_timer(&timer);
+    for (size_t idx = 0; idx < corpus->count; idx++) {
+      struct middleware_packet *mp = &corpus->packets[idx];
+      if (extract_packets(corpus->ltype, &mp->header, mp->packet,
+                          BENCH_IFNAME, PACKET_DECODE_ALL, tp_array) < 0) {
+        log_error("extract_packets fail");
+      }
+      utarray_clear(tp_array);
+    }
+    stop_bench_timer(&timer);
+  }
+
+  utarray_free(tp_array);
+  add_bench_result(results, "decode", &timer, corpus->count * rounds);
+  return 0;
+}
+
+static int bench_middlewares(const struct traffic_corpus *corpus,
+                             unsigned int rounds, sqlite3 *db,
+                             char *db_path, UT_array *results) {
+  struct middleware_handlers *handler = NULL;
+  struct eloop_data *eloop = NULL;
+  struct pcap_context pc;
+  UT_array *handlers = NULL;
+  char stage[64];
+  int ret = 0;
+
+  if ((eloop = edge_eloop_init()) == NULL) {
+    log_error("edge_eloop_init fail");
+    return -1;
+  }
+
+  os_memset(&pc, 0, sizeof(pc));
+  pc.pcap_fd = -1;
+  os_strlcpy(pc.ifname, BENCH_IFNAME, IF_NAMESIZE);
+  if ((pc.pd = pcap_open_dead(pcap_datalink_name_to_val(corpus->ltype),
+                              BENCH_SNAPLEN)) == NULL) {
+    log_error("pcap_open_dead fail");
+    edge_eloop_free(eloop);
+    return -1;
+  }
+
+  handlers = assign_middlewares();
+
+  // Every middleware is benchmarked on its own
+  while ((handler = (struct middleware_handlers *)utarray_next(handlers,
+                                                               handler))) {
+    struct bench_timer timer = {0};
+
+    if ((handler->context =
+             handler->f.init(db, db_path, eloop, &pc, NULL)) == NULL) {
+      log_warn("Skipping %s, init fail", handler->f.name);
+      continue;
+    }
+
+    for (unsigned int round = 0; round < rounds; round++) {
+      start_bench_timer(&timer);
+      for (size_t idx = 0; idx < corpus->count; idx++) {
+        struct middleware_packet *mp = &corpus->packets[idx];
+        if (handler->f.process(handler->context, corpus->ltype, &mp->header,
+                               mp->packet, BENCH_IFNAME) < 0) {
+          log_error("%s process fail", handler->f.name);
+          ret = -1;
+        }
+      }
+      stop_bench_timer(&timer);
+    }
+
+    handler->f.free(handler->context);
+    handler->context = NULL;
+
+    snprintf(stage, sizeof(stage), "middleware:%s", handler->f.name);
+    add_bench_result(results, stage, &timer, corpus->count * rounds);
+  }
+
+  utarray_free(handlers);
+  pcap_close(pc.pd);
+  edge_eloop_free(eloop);
+  return ret;
+}
+
+static int bench_sqlite_sink(const struct traffic_corpus *corpus,
+                             unsigned int rounds, sqlite3 *db,
+                             UT_array *results) {
+  struct bench_timer timer = {0};
+  struct sqlite_header_writer *writer = NULL;
+  struct tuple_packet *p = NULL;
+  UT_array *tp_array = NULL;
+  int ret = 0;
+
+  if (init_sqlite_header_db(db) < 0) {
+    log_error("init_sqlite_header_db fail");
+    return -1;
+  }
+
+  if ((writer = init_sqlite_header_writer(db, BENCH_SQLITE_BATCH_SIZE)) ==
+      NULL) {
+    log_error("init_sqlite_header_writer fail");
+    return -1;
+  }
+
+  utarray_new(tp_array, &tp_list_icd);
+
+  // The packets are decoded for every round, so they get new ids
+  for (unsigned int round = 0; round < rounds && !ret; round++) {
+    if ((ret = decode_corpus_round(corpus, tp_array)) < 0) {
+      break;
+    }
+
+    start_bench_timer(&timer);
+    while ((p = (struct tuple_packet *)utarray_next(tp_array, p)) != NULL) {
+      if (save_sqlite_header_packet(writer, p) < 0) {
+        log_error("save_sqlite_header_packet fail");
+        ret = -1;
+      }
+    }
+    if (commit_sqlite_header_writer(writer) < 0) {
+      log_error("commit_sqlite_header_writer fail");
+      ret = -1;
+    }
+    stop_bench_timer(&timer);
+
+    utarray_clear(tp_array);
+  }
+
+  utarray_free(tp_array);
+  free_sqlite_header_writer(writer);
+
+  add_bench_result(results, "sink:sqlite", &timer, corpus->count * rounds);
+  return ret;
+}
+
+static int bench_pcap_sink(const struct traffic_corpus *corpus,
+                           unsigned int rounds, sqlite3 *db,
+                           const char *work_dir, UT_array *results) {
+  struct bench_timer timer = {0};
+  struct pcap_segment *segment = NULL;
+  pcap_t *pd = NULL;
+  char *pcap_path = NULL;
+  int ret = 0;
+
+  if (init_sqlite_pcap_db(db) < 0) {
+    log_error("init_sqlite_pcap_db fail");
+    return -1;
+  }
+
+  if ((pcap_path = construct_path(work_dir, BENCH_PCAP_FOLDER)) == NULL) {
+    log_error("construct_path fail");
+    return -1;
+  }
+
+  if (create_dir(pcap_path, S_IRWXU | S_IRWXG) < 0) {
+    log_error("create_dir fail");
+    os_free(pcap_path);
+    return -1;
+  }
+
+  if ((pd = pcap_open_dead(pcap_datalink_name_to_val(corpus->ltype),
+                           BENCH_SNAPLEN)) == NULL) {
+    log_error("pcap_open_dead fail");
+    os_free(pcap_path);
+    return -1;
+  }
+
+  if ((segment = init_pcap_segment(pd, pcap_path, BENCH_PCAP_SEGMENT_SIZE,
+                                   UINT64_MAX)) == NULL) {
+    log_error("init_pcap_segment fail");
+    pcap_close(pd);
+    os_free(pcap_path);
+    return -1;
+  }
+
+  // Same per packet work as the pcap middleware timer handler
+  for (unsigned int round = 0; round < rounds; round++) {
+    start_bench_timer(&timer);
+    for (size_t idx = 0; idx < corpus->count; idx++) {
+      struct middleware_packet *mp = &corpus->packets[idx];
+      uint64_t timestamp = 0, offset = 0;
+
+      os_to_timestamp(mp->header.ts, &timestamp);
+      if (write_pcap_segment(segment, &mp->header, mp->packet, &offset) < 0) {
+        log_error("write_pcap_segment fail");
+        ret = -1;
+        continue;
+      }
+
+      if (save_sqlite_pcap_entry(db, segment->name, timestamp, offset,
+                                 mp->header.caplen, mp->header.len) < 0) {
+        log_error("save_sqlite_pcap_entry fail");
+        ret = -1;
+      }
+    }
+    if (flush_pcap_segment(segment) < 0) {
+      log_error("flush_pcap_segment fail");
+      ret = -1;
+    }
+    stop_bench_timer(&timer);
+  }
+
+  char *segment_path = construct_path(pcap_path, segment->name);
+  free_pcap_segment(segment);
+  if (segment_path != NULL) {
+    remove(segment_path);
+    os_free(segment_path);
+  }
+  rmdir(pcap_path);
+  os_free(pcap_path);
+  pcap_close(pd);
+
+  add_bench_result(results, "sink:pcap", &timer, corpus->count * rounds);
+  return ret;
+}
+
+#ifdef WITH_PROTOBUF_MIDDLEWARE
+static int bench_protobuf_sink(const struct traffic_corpus *corpus,
+                               unsigned int rounds, UT_array *results) {
+  struct bench_timer timer = {0};
+  struct protobuf_writer *writer = NULL;
+  struct tuple_packet *p = NULL;
+  UT_array *tp_array = NULL;
+  int ret = 0;
+
+  // /dev/null never blocks, so only the encoding and buffering is measured
+  if ((writer = init_protobuf_writer("/dev/null",
+                                     PROTOBUF_WRITER_BUFFER_SIZE)) == NULL) {
+    log_error("init_protobuf_writer fail");
+    return -1;
+  }
+
+  utarray_new(tp_array, &tp_list_icd);
+
+  for (unsigned int round = 0; round < rounds && !ret; round++) {
+    if ((ret = decode_corpus_round(corpus, tp_array)) < 0) {
+      break;
+    }
+
+    start_bench_timer(&timer);
+    while ((p = (struct tuple_packet *)utarray_next(tp_array, p)) != NULL) {
+      if (write_protobuf_writer(writer, p) < 0) {
+        log_error("write_protobuf_writer fail");
+        ret = -1;
+      }
+    }
+    if (flush_protobuf_writer(writer) < 0) {
+      log_error("flush_protobuf_writer fail");
+      ret = -1;
+    }
+    stop_bench_timer(&timer);
+
+    utarray_clear(tp_array);
+  }
+
+  utarray_free(tp_array);
+  free_protobuf_writer(writer);
+
+  add_bench_result(results, "sink:protobuf", &timer, corpus->count * rounds);
+  return ret;
+}
+#endif
+
+static int bench_corpus(const struct traffic_corpus *corpus,
+                        const struct bench_options *opts, UT_array *results) {
+  sqlite3 *db = NULL;
+  char *db_path = NULL;
+  int ret = 0;
+
+  if ((db_path = construct_path(opts->work_dir, BENCH_DB_NAME)) == NULL) {
+    log_error("construct_path fail");
+    return -1;
+  }
+
+  // Start from an empty db, so the results do not depend on older runs
+  remove(db_path);
+
+  if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+    log_error("sqlite3_open fail: %s", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    os_free(db_path);
+    return -1;
+  }
+
+  if (bench_decode(corpus, opts->rounds, results) < 0) {
+    log_error("bench_decode fail");
+    ret = -1;
+  }
+
+  if (bench_middlewares(corpus, opts->rounds, db, db_path, results) < 0) {
+    log_error("bench_middlewares fail");
+    ret = -1;
+  }
+
+  if (bench_sqlite_sink(corpus, opts->rounds, db, results) < 0) {
+    log_error("bench_sqlite_sink fail");
+    ret = -1;
+  }
+
+  if (bench_pcap_sink(corpus, opts->rounds, db, opts->work_dir, results) <
+      0) {
+    log_error("bench_pcap_sink fail");
+    ret = -1;
+  }
+
+#ifdef WITH_PROTOBUF_MIDDLEWARE
+  if (bench_protobuf_sink(corpus, opts->rounds, results) < 0) {
+    log_error("bench_protobuf_sink fail");
+    ret = -1;
+  }
+#endif
+
+  sqlite3_close(db);
+  remove(db_path);
+  os_free(db_path);
+  return ret;
+}
+
+static void print_json_string(FILE *fp, const char *str) {
+  fputc('"', fp);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fprintf(fp, "\\%c", *str);
+    } else if ((unsigned char)*str < 0x20) {
+      fprintf(fp, "\\u%04x", (unsigned char)*str);
+    } else {
+      fputc(*str, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+static void print_bench_corpus(FILE *fp, const struct traffic_corpus *corpus,
+                               UT_array *results, bool last) {
+  struct bench_result *result = NULL;
+
+  fprintf(fp, "    {\n      \"name\": ");
+  print_json_string(fp, corpus->name);
+  fprintf(fp,
+          ",\n      \"packets\": %zu,\n      \"bytes\": %" PRIu64
+          ",\n      \"stages\": [\n",
+          corpus->count, corpus->bytes);
+
+  while ((result = (struct bench_result *)utarray_next(results, result)) !=
+         NULL) {
+    double packets = (result->packets) ? (double)result->packets : 1;
+    double seconds = (double)result->elapsed_ns / 1e9;
+
+    fprintf(fp, "        {\"stage\": ");
+    print_json_string(fp, result->stage);
+    fprintf(fp,
+            ", \"packets\": %" PRIu64 ", \"elapsed_ns\": %" PRIu64
+            ", \"packets_per_sec\": %.1f, \"ns_per_packet\": %.1f"
+            ", \"allocs_per_packet\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+            result->packets, result->elapsed_ns,
+            (seconds > 0) ? (double)result->packets / seconds : 0,
+            (double)result->elapsed_ns / packets,
+            (double)result->allocs / packets, result->peak_rss_kb,
+            (utarray_next(results, result) != NULL) ? "," : "");
+  }
+
+  fprintf(fp, "      ]\n    }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char *argv[]) {
+  int exit_code = EXIT_SUCCESS;
+  uint8_t level = 0;
+  struct traffic_corpus *corpora[2] = {NULL, NULL};
+  UT_array *results[2] = {NULL, NULL};
+  size_t count = 0;
+  FILE *fp = stdout;
+  struct bench_options opts = {.pcap_path = NULL,
+                               .work_dir = BENCH_WORK_DIR,
+                               .out_path = NULL,
+                               .rounds = BENCH_ROUNDS,
+                               .skip_synthetic = false,
+                               .verbosity = 0};
+
+  default_traffic_config(&opts.traffic);
+  process_app_options(argc, argv, &opts);
+
+  if (opts.verbosity > MAX_LOG_LEVELS) {
+    level = 0;
+  } else if (!opts.verbosity) {
+    level = MAX_LOG_LEVELS - 1;
+  } else {
+    level = MAX_LOG_LEVELS - opts.verbosity;
+  }
+
+  log_set_level(level);
+
+  if (opts.pcap_path == NULL && opts.skip_synthetic) {
+    log_cmdline_error("Nothing to benchmark, use -p or remove -S\n");
+  }
+
+  if (opts.pcap_path != NULL) {
+    if ((corpora[count] = load_traffic_corpus(opts.pcap_path)) == NULL) {
+      fprintf(stderr, "Failed to load %s\n", opts.pcap_path);
+      return EXIT_FAILURE;
+    }
+    count++;
+  }
+
+  if (!opts.skip_synthetic) {
+    if ((corpora[count] = generate_traffic_corpus(&opts.traffic)) == NULL) {
+      fprintf(stderr, "Failed to generate the synthetic traffic\n");
+      free_traffic_corpus(corpora[0]);
+      return EXIT_FAILURE;
+    }
+    count++;
+  }
+
+  for (size_t idx = 0; idx < count; idx++) {
+    utarray_new(results[idx], &bench_result_icd);
+    if (bench_corpus(corpora[idx], &opts, results[idx]) < 0) {
+      exit_code = EXIT_FAILURE;
+    }
+  }
+
+  if (opts.out_path != NULL && (fp = fopen(opts.out_path, "w")) == NULL) {
+    perror("fopen");
+    fp = stdout;
+    exit_code = EXIT_FAILURE;
+  }
+
+  fprintf(fp, "{\n  \"version\": ");
+  print_json_string(fp, EDGESEC_VERSION);
+  fprintf(fp, ",\n  \"rounds\": %u,\n  \"corpora\": [\n", opts.rounds);
+  for (size_t idx = 0; idx < count; idx++) {
+    print_bench_corpus(fp, corpora[idx], results[idx], idx + 1 == count);
+  }
+  fprintf(fp, "  ]\n}\n");
+
+  if (fp != stdout) {
+    fclose(fp);
+  }
+
+  for (size_t idx = 0; idx < count; idx++) {
+    utarray_free(results[idx]);
+    free_traffic_corpus(corpora[idx]);
+  }
+
+  return exit_code;
+}
@@ -0,0 +1,405 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the benchmark packet corpus
+ * and the synthetic traffic generator.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/if_ether.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <pcap.h>
+
+#include "capture/pcap_reader.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+#include "traffic_gen.h"
+
+#define TRAFFIC_START_TIMESTAMP 1650000000 // In seconds
+#define TRAFFIC_PACKET_INTERVAL 10         // In microseconds
+#define TRAFFIC_TCP_PORT 443
+#define TRAFFIC_UDP_PORT 5000
+#define TRAFFIC_DNS_PORT 53
+#define TRAFFIC_MDNS_PORT 5353
+#define TRAFFIC_EPHEMERAL_PORT 32768
+
+static const char *const traffic_protocol_names[TRAFFIC_PROTOCOLS_COUNT] = {
+    [TRAFFIC_TCP] = "tcp",   [TRAFFIC_UDP] = "udp",   [TRAFFIC_ICMP] = "icmp",
+    [TRAFFIC_DNS] = "dns",   [TRAFFIC_MDNS] = "mdns", [TRAFFIC_ARP] = "arp",
+};
+
+/* The header sizes of each synthetic protocol, without the payload */
+static const uint32_t traffic_header_sizes[TRAFFIC_PROTOCOLS_COUNT] = {
+    [TRAFFIC_TCP] = sizeof(struct ether_header) + sizeof(struct ip) +
+                    sizeof(struct tcphdr),
+    [TRAFFIC_UDP] = sizeof(struct ether_header) + sizeof(struct ip) +
+                    sizeof(struct udphdr),
+    [TRAFFIC_ICMP] = sizeof(struct ether_header) + sizeof(struct ip) + 8,
+    [TRAFFIC_DNS] = sizeof(struct ether_header) + sizeof(struct ip) +
+                    sizeof(struct udphdr) + 12,
+    [TRAFFIC_MDNS] = sizeof(struct ether_header) + sizeof(struct ip) +
+                     sizeof(struct udphdr) + 12,
+    [TRAFFIC_ARP] = sizeof(struct ether_header) + sizeof(struct ether_arp),
+};
+
+void default_traffic_config(struct traffic_config *config) {
+  os_memset(config, 0, sizeof(struct traffic_config));
+
+  config->mix[TRAFFIC_TCP] = 60;
+  config->mix[TRAFFIC_UDP] = 20;
+  config->mix[TRAFFIC_ICMP] = 2;
+  config->mix[TRAFFIC_DNS] = 10;
+  config->mix[TRAFFIC_MDNS] = 5;
+  config->mix[TRAFFIC_ARP] = 3;
+  config->min_size = TRAFFIC_MIN_SIZE;
+  config->max_size = TRAFFIC_MAX_SIZE;
+  config->flows = 256;
+  config->packets = 100000;
+  config->seed = 1;
+}
+
+int parse_traffic_mix(const char *mix, struct traffic_config *config) {
+  char *str = NULL, *token = NULL, *saveptr = NULL;
+  unsigned int total = 0;
+
+  if ((str = os_strdup(mix)) == NULL) {
+    log_errno("os_strdup");
+    return -1;
+  }
+
+  os_memset(config->mix, 0, sizeof(config->mix));
+
+  for (token = strtok_r(str, ",", &saveptr); token != NULL;
+       token = strtok_r(NULL, ",", &saveptr)) {
+    char *value = strchr(token, '=');
+    size_t idx;
+
+    if (value == NULL) {
+      log_error("Missing weight for %s", token);
+      os_free(str);
+      return -1;
+    }
+    *value++ = '\0';
+
+    for (idx = 0; idx < TRAFFIC_PROTOCOLS_COUNT; idx++) {
+      if (strcmp(token, traffic_protocol_names[idx]) == 0) {
+        break;
+      }
+    }
+
+    if (idx == TRAFFIC_PROTOCOLS_COUNT) {
+      log_error("Unknown protocol %s", token);
+      os_free(str);
+      return -1;
+    }
+
+    config->mix[idx] = (unsigned int)strtoul(value, NULL, 10);
+    total += config->mix[idx];
+  }
+
+  os_free(str);
+
+  if (!total) {
+    log_error("The protocol mix is empty");
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Private implementation of free_traffic_corpus(), without its compiler
+ * attributes, so the corpus constructors can call it on failure.
+ */
+static void __free_traffic_corpus(struct traffic_corpus *corpus) {
+  if (corpus != NULL) {
+    if (corpus->packets != NULL) {
+      for (size_t idx = 0; idx < corpus->count; idx++) {
+        os_free(corpus->packets[idx].packet);
+      }
+      os_free(corpus->packets);
+    }
+    os_free(corpus);
+  }
+}
+
+void free_traffic_corpus(struct traffic_corpus *corpus) {
+  __free_traffic_corpus(corpus);
+}
+
+static enum traffic_protocol pick_traffic_protocol(const unsigned int *mix,
+                                                   unsigned int total,
+                                                   unsigned int *state) {
+  unsigned int value = (unsigned int)rand_r(state) % total;
+
+  for (size_t idx = 0; idx < TRAFFIC_PROTOCOLS_COUNT; idx++) {
+    if (value < mix[idx]) {
+      return (enum traffic_protocol)idx;
+    }
+    value -= mix[idx];
+  }
+
+  return TRAFFIC_TCP;
+}
+
+static void fill_traffic_eth(uint8_t *data, uint32_t flow, uint16_t type) {
+  struct ether_header *ethh = (struct ether_header *)data;
+
+  os_memset(ethh->ether_dhost, 0x02, ETHER_ADDR_LEN);
+  ethh->ether_shost[0] = 0x02;
+  ethh->ether_shost[1] = 0x00;
+  ethh->ether_shost[2] = (uint8_t)(flow >> 24);
+  ethh->ether_shost[3] = (uint8_t)(flow >> 16);
+  ethh->ether_shost[4] = (uint8_t)(flow >> 8);
+  ethh->ether_shost[5] = (uint8_t)flow;
+  ethh->ether_type = htons(type);
+}
+
+static void fill_traffic_ip4(uint8_t *data, uint32_t flow, uint8_t protocol,
+                             uint32_t size, bool multicast) {
+  struct ip ip4h;
+
+  os_memset(&ip4h, 0, sizeof(ip4h));
+  ip4h.ip_v = 4;
+  ip4h.ip_hl = sizeof(struct ip) / 4;
+  ip4h.ip_len = htons((uint16_t)(size - sizeof(struct ether_header)));
+  ip4h.ip_id = htons((uint16_t)flow);
+  ip4h.ip_ttl = 64;
+  ip4h.ip_p = protocol;
+  ip4h.ip_src.s_addr = htonl(0x0A000000 | (flow & 0xFFFFFF));
+  ip4h.ip_dst.s_addr = htonl(multicast ? 0xE00000FB : 0xC0A80101);
+
+  // The IP header is not aligned in the ethernet frame
+  os_memcpy(data + sizeof(struct ether_header), &ip4h, sizeof(ip4h));
+}
+
+static void fill_traffic_dns(uint8_t *data, uint32_t flow, uint32_t size) {
+  // A query for h<flow>.example.com., the rest of the payload is zero
+  static const uint8_t question[] = {7,   'e', 'x', 'a', 'm', 'p', 'l', 'e',
+                                     3,   'c', 'o', 'm', 0,   0,   1,   0,
+                                     1};
+  uint8_t header[12] = {(uint8_t)(flow >> 8), (uint8_t)flow, 0x01, 0x00, 0,
+                        1};
+  uint32_t offset = sizeof(header);
+  char label[16];
+
+  os_memcpy(data, header, sizeof(header));
+
+  int len = snprintf(label, sizeof(label), "h%u", flow);
+  if (offset + 1 + (uint32_t)len + sizeof(question) <= size) {
+    data[offset++] = (uint8_t)len;
+    os_memcpy(&data[offset], label, (size_t)len);
+    offset += (uint32_t)len;
+    os_memcpy(&data[offset], question, sizeof(question));
+  }
+}
+
+static void build_traffic_packet(uint8_t *data, enum traffic_protocol proto,
+                                 uint32_t flow, uint32_t size) {
+  uint8_t *l4 = data + sizeof(struct ether_header) + sizeof(struct ip);
+  uint16_t sport = (uint16_t)(TRAFFIC_EPHEMERAL_PORT + flow % 28000);
+
+  os_memset(data, 0, size);
+
+  if (proto == TRAFFIC_ARP) {
+    struct ether_arp arph;
+
+    fill_traffic_eth(data, flow, ETHERTYPE_ARP);
+    os_memset(&arph, 0, sizeof(arph));
+    arph.arp_hrd = htons(ARPHRD_ETHER);
+    arph.arp_pro = htons(ETHERTYPE_IP);
+    arph.arp_hln = ETHER_ADDR_LEN;
+    arph.arp_pln = 4;
+    arph.arp_op = htons(ARPOP_REQUEST);
+    os_memcpy(arph.arp_sha, ((struct ether_header *)data)->ether_shost,
+              ETHER_ADDR_LEN);
+    os_memcpy(data + sizeof(struct ether_header), &arph, sizeof(arph));
+    return;
+  }
+
+  fill_traffic_eth(data, flow, ETHERTYPE_IP);
+
+  switch (proto) {
+    case TRAFFIC_TCP: {
+      struct tcphdr tcph;
+      os_memset(&tcph, 0, sizeof(tcph));
+      tcph.th_sport = htons(sport);
+      tcph.th_dport = htons(TRAFFIC_TCP_PORT);
+      tcph.th_seq = htonl(flow);
+      tcph.th_off = sizeof(struct tcphdr) / 4;
+      tcph.th_flags = TH_ACK | TH_PUSH;
+      tcph.th_win = htons(65535);
+      fill_traffic_ip4(data, flow, IPPROTO_TCP, size, false);
+      os_memcpy(l4, &tcph, sizeof(tcph));
+      break;
+    }
+    case TRAFFIC_ICMP: {
+      fill_traffic_ip4(data, flow, IPPROTO_ICMP, size, false);
+      l4[0] = ICMP_ECHO;
+      break;
+    }
+    default: {
+      struct udphdr udph;
+      bool mdns = (proto == TRAFFIC_MDNS);
+      uint16_t dport = (proto == TRAFFIC_DNS)
+                           ? TRAFFIC_DNS_PORT
+                           : (mdns ? TRAFFIC_MDNS_PORT : TRAFFIC_UDP_PORT);
+      uint32_t len = size - sizeof(struct ether_header) - sizeof(struct ip);
+
+      os_memset(&udph, 0, sizeof(udph));
+      udph.uh_sport = htons(mdns ? TRAFFIC_MDNS_PORT : sport);
+      udph.uh_dport = htons(dport);
+      udph.uh_ulen = htons((uint16_t)len);
+      fill_traffic_ip4(data, flow, IPPROTO_UDP, size, mdns);
+      os_memcpy(l4, &udph, sizeof(udph));
+
+      if (proto != TRAFFIC_UDP) {
+        fill_traffic_dns(l4 + sizeof(struct udphdr), flow,
+                         len - sizeof(struct udphdr));
+      }
+      break;
+    }
+  }
+}
+
+struct traffic_corpus *
+generate_traffic_corpus(const struct traffic_config *config) {
+  struct traffic_corpus *corpus = NULL;
+  unsigned int total = 0, state = config->seed;
+  uint32_t max_size = config->max_size, min_size = config->min_size;
+
+  for (size_t idx = 0; idx < TRAFFIC_PROTOCOLS_COUNT; idx++) {
+    total += config->mix[idx];
+  }
+
+  if (!total || !config->flows || !config->packets || min_size > max_size) {
+    log_error("Invalid traffic configuration");
+    return NULL;
+  }
+
+  if ((corpus = os_zalloc(sizeof(struct traffic_corpus))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  snprintf(corpus->name, sizeof(corpus->name), "synthetic");
+  os_strlcpy(corpus->ltype, "EN10MB", sizeof(corpus->ltype));
+
+  if ((corpus->packets = os_calloc(config->packets,
+                                   sizeof(struct middleware_packet))) ==
+      NULL) {
+    log_errno("os_calloc");
+    __free_traffic_corpus(corpus);
+    return NULL;
+  }
+
+  for (size_t idx = 0; idx < config->packets; idx++) {
+    struct middleware_packet *mp = &corpus->packets[idx];
+    enum traffic_protocol proto =
+        pick_traffic_protocol(config->mix, total, &state);
+    uint32_t flow = (uint32_t)rand_r(&state) % config->flows;
+    uint32_t size =
+        min_size + (uint32_t)rand_r(&state) % (max_size - min_size + 1);
+    uint64_t usecs = idx * TRAFFIC_PACKET_INTERVAL;
+
+    if (size < traffic_header_sizes[proto]) {
+      size = traffic_header_sizes[proto];
+    }
+
+    if ((mp->packet = os_malloc(size)) == NULL) {
+      log_errno("os_malloc");
+      __free_traffic_corpus(corpus);
+      return NULL;
+    }
+    corpus->count++;
+
+    build_traffic_packet(mp->packet, proto, flow, size);
+    mp->header.ts.tv_sec = TRAFFIC_START_TIMESTAMP + (time_t)(usecs / 1000000);
+    mp->header.ts.tv_usec = (suseconds_t)(usecs % 1000000);
+    mp->header.caplen = size;
+    mp->header.len = size;
+    corpus->bytes += size;
+  }
+
+  return corpus;
+}
+
+struct traffic_corpus *load_traffic_corpus(const char *path) {
+  struct traffic_corpus *corpus = NULL;
+  struct pcap_reader *reader = NULL;
+  struct pcap_pkthdr header;
+  const uint8_t *packet = NULL;
+  const char *ltype = NULL;
+  size_t capacity = 0;
+  int ret;
+
+  if ((reader = open_pcap_reader(path)) == NULL) {
+    log_error("open_pcap_reader fail for %s", path);
+    return NULL;
+  }
+
+  if ((corpus = os_zalloc(sizeof(struct traffic_corpus))) == NULL) {
+    log_errno("os_zalloc");
+    close_pcap_reader(reader);
+    return NULL;
+  }
+
+  os_strlcpy(corpus->name, path, sizeof(corpus->name));
+  if ((ltype = pcap_datalink_val_to_name((int)reader->header.linktype)) !=
+      NULL) {
+    os_strlcpy(corpus->ltype, ltype, sizeof(corpus->ltype));
+  }
+
+  while ((ret = next_pcap_reader(reader, &header, &packet)) > 0) {
+    if (corpus->count == capacity) {
+      size_t size = (capacity) ? 2 * capacity : 1024;
+      struct middleware_packet *packets = os_realloc_array(
+          corpus->packets, size, sizeof(struct middleware_packet));
+      if (packets == NULL) {
+        log_errno("os_realloc_array");
+        ret = -1;
+        break;
+      }
+      corpus->packets = packets;
+      capacity = size;
+    }
+
+    struct middleware_packet *mp = &corpus->packets[corpus->count];
+    if ((mp->packet = os_malloc(header.caplen)) == NULL) {
+      log_errno("os_malloc");
+      ret = -1;
+      break;
+    }
+
+    os_memcpy(mp->packet, packet, header.caplen);
+    mp->header = header;
+    corpus->bytes += header.caplen;
+    corpus->count++;
+  }
+
+  close_pcap_reader(reader);
+
+  if (ret < 0 || !corpus->count) {
+    log_error("Failed to load the packets of %s", path);
+    __free_traffic_corpus(corpus);
+    return NULL;
+  }
+
+  return corpus;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the benchmark packet corpus and
+ * the synthetic traffic generator.
+ */
+
+#ifndef TRAFFIC_GEN_H
+#define TRAFFIC_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#include "capture/middleware.h"
+#include "utils/attributes.h"
+
+#define TRAFFIC_MIN_SIZE 64   // Minimum synthetic packet size in bytes
+#define TRAFFIC_MAX_SIZE 1514 // Maximum synthetic packet size in bytes
+
+/**
+ * @brief The synthetic protocols
+ *
+ */
+enum traffic_protocol {
+  TRAFFIC_TCP = 0,
+  TRAFFIC_UDP,
+  TRAFFIC_ICMP,
+  TRAFFIC_DNS,
+  TRAFFIC_MDNS,
+  TRAFFIC_ARP,
+  TRAFFIC_PROTOCOLS_COUNT
+};
+
+/**
+ * @brief Synthetic traffic configuration
+ *
+ */
+struct traffic_config {
+  unsigned int mix[TRAFFIC_PROTOCOLS_COUNT]; /**< The protocol weights */
+  uint32_t min_size; /**< Minimum packet size in bytes */
+  uint32_t max_size; /**< Maximum packet size in bytes */
+  uint32_t flows;    /**< Number of distinct flows */
+  size_t packets;    /**< Number of packets */
+  unsigned int seed; /**< The random generator seed */
+};
+
+/**
+ * @brief Benchmark packet corpus, the packets are stored in memory, so the
+ * file reads are not measured
+ *
+ */
+struct traffic_corpus {
+  char name[64];                    /**< The corpus name */
+  char ltype[16];                   /**< The link type name */
+  struct middleware_packet *packets; /**< The packets */
+  size_t count;                     /**< Number of packets */
+  uint64_t bytes;                   /**< Total captured bytes */
+};
+
+/**
+ * @brief Sets the default traffic configuration
+ *
+ * @param config The traffic configuration
+ */
+void default_traffic_config(struct traffic_config *config);
+
+/**
+ * @brief Parses a protocol mix, e.g. "tcp=50,udp=20,dns=10"
+ *
+ * The protocols not in the string get a weight of zero.
+ *
+ * @param mix The protocol mix string
+ * @param config The traffic configuration
+ * @return int 0 on success, -1 on failure
+ */
+int parse_traffic_mix(const char *mix, struct traffic_config *config);
+
+/**
+ * @brief Frees the packet corpus
+ *
+ * @param corpus The packet corpus
+ */
+void free_traffic_corpus(struct traffic_corpus *corpus);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_traffic_corpus()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_traffic_corpus                                             \
+  __attribute__((malloc(free_traffic_corpus, 1))) __must_check
+#else
+#define __must_free_traffic_corpus __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Generates a synthetic ethernet packet corpus
+ *
+ * @param config The traffic configuration
+ * @return struct traffic_corpus* The packet corpus, NULL on failure.
+ * You must free this using free_traffic_corpus().
+ */
+__must_free_traffic_corpus struct traffic_corpus *
+generate_traffic_corpus(const struct traffic_config *config);
+
+/**
+ * @brief Loads all the packets of a pcap file
+ *
+ * @param path The pcap file path
+ * @return struct traffic_corpus* The packet corpus, NULL on failure.
+ * You must free this using free_traffic_corpus().
+ */
+__must_free_traffic_corpus struct traffic_corpus *
+load_traffic_corpus(const char *path);
+
+#endif
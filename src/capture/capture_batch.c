@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the capture packet batch.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+
+#include "capture_batch.h"
+
+/**
+ * Private implementation of free_capture_batch(), without its compiler
+ * attributes, so init_capture_batch() can call it on failure.
+ */
+static void __free_capture_batch(struct capture_batch *batch) {
+  if (batch != NULL) {
+    os_free(batch->packets);
+    os_free(batch->data);
+    os_free(batch);
+  }
+}
+
+void free_capture_batch(struct capture_batch *batch) {
+  __free_capture_batch(batch);
+}
+
+struct capture_batch *init_capture_batch(size_t max_count, size_t data_size) {
+  struct capture_batch *batch = NULL;
+
+  if (!max_count) {
+    log_error("max_count param is zero");
+    return NULL;
+  }
+
+  if ((batch = os_zalloc(sizeof(struct capture_batch))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  batch->packets = os_calloc(max_count, sizeof(struct middleware_packet));
+  if (batch->packets == NULL) {
+    log_errno("os_calloc");
+    __free_capture_batch(batch);
+    return NULL;
+  }
+
+  if (data_size && (batch->data = os_malloc(data_size)) == NULL) {
+    log_errno("os_malloc");
+    __free_capture_batch(batch);
+    return NULL;
+  }
+
+  batch->max_count = max_count;
+  batch->data_size = data_size;
+
+  return batch;
+}
+
+int push_capture_batch(struct capture_batch *batch, char *ltype,
+                       const struct pcap_pkthdr *header,
+                       const uint8_t *packet) {
+  struct middleware_packet *el;
+
+  if (batch->count >= batch->max_count ||
+      header->caplen > batch->data_size - batch->data_len) {
+    return -1;
+  }
+
+  el = &batch->packets[batch->count++];
+  el->header = *header;
+  el->packet = batch->data + batch->data_len;
+  os_memcpy(el->packet, packet, header->caplen);
+
+  batch->data_len += header->caplen;
+  batch->ltype = ltype;
+
+  return 0;
+}
+
+int push_capture_batch_ref(struct capture_batch *batch, char *ltype,
+                           const struct pcap_pkthdr *header, uint8_t *packet) {
+  struct middleware_packet *el;
+
+  if (batch->count >= batch->max_count) {
+    return -1;
+  }
+
+  el = &batch->packets[batch->count++];
+  el->header = *header;
+  el->packet = packet;
+
+  batch->ltype = ltype;
+
+  return 0;
+}
+
+void reset_capture_batch(struct capture_batch *batch) {
+  batch->count = 0;
+  batch->data_len = 0;
+}
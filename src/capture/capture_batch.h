@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the capture packet batch.
+ *
+ * libpcap only guarantees the packet data until the capture callback
+ * returns, so the packets of a pcap_dispatch() call are copied into a
+ * reusable batch before being passed to the middlewares. The TPACKET_V3 ring
+ * keeps the packets of a block until the block is handed back to the kernel,
+ * so the ring packets are only referenced by the batch, which is run before
+ * the block is released.
+ */
+
+#ifndef CAPTURE_BATCH_H
+#define CAPTURE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#include "../utils/attributes.h"
+
+#include "middleware.h"
+
+#define CAPTURE_BATCH_SIZE 256 // Maximum number of packets in a batch
+#define CAPTURE_BATCH_DATA_SIZE                                                \
+  (1024 * 1024) // Maximum number of packet data bytes in a batch
+
+/**
+ * @brief Capture packet batch structure definition
+ *
+ */
+struct capture_batch {
+  struct middleware_packet *packets; /**< The packets array */
+  size_t count;                      /**< Number of packets in the batch */
+  size_t max_count;                  /**< Size of the packets array */
+  uint8_t *data;                     /**< The packet data buffer */
+  size_t data_len;                   /**< Number of used data bytes */
+  size_t data_size;                  /**< Size of the packet data buffer */
+  char *ltype;                       /**< The packets link type */
+};
+
+/**
+ * @brief Frees the capture batch
+ *
+ * @param batch The capture batch
+ */
+void free_capture_batch(struct capture_batch *batch);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_capture_batch()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_capture_batch                                              \
+  __attribute__((malloc(free_capture_batch, 1))) __must_check
+#else
+#define __must_free_capture_batch __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a capture batch
+ *
+ * @param max_count The maximum number of packets in the batch
+ * @param data_size The maximum number of packet data bytes in the batch
+ * @return struct capture_batch* The capture batch, NULL on failure.
+ * You must free this using free_capture_batch().
+ */
+__must_free_capture_batch struct capture_batch *
+init_capture_batch(size_t max_count, size_t data_size);
+
+/**
+ * @brief Copies a packet into the capture batch
+ *
+ * @param batch The capture batch
+ * @param ltype The packet link type
+ * @param header The pcap packet header
+ * @param packet The pcap packet data
+ * @return int 0 on success, -1 if the batch is full
+ */
+int push_capture_batch(struct capture_batch *batch, char *ltype,
+                       const struct pcap_pkthdr *header,
+                       const uint8_t *packet);
+
+/**
+ * @brief Adds a packet to the capture batch without copying its data
+ *
+ * The packet data must stay valid until the batch is reset.
+ *
+ * @param batch The capture batch
+ * @param ltype The packet link type
+ * @param header The pcap packet header
+ * @param packet The pcap packet data
+ * @return int 0 on success, -1 if the batch is full
+ */
+int push_capture_batch_ref(struct capture_batch *batch, char *ltype,
+                           const struct pcap_pkthdr *header, uint8_t *packet);
+
+/**
+ * @brief Removes all the packets from the capture batch
+ *
+ * @param batch The capture batch
+ */
+void reset_capture_batch(struct capture_batch *batch);
+
+#endif
@@ -16,15 +16,54 @@
 #define CAPTURE_CONFIG_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "../utils/os.h"
 
 #define MAX_FILTER_SIZE                                                        \
   4094 /* Maximum length of the filter string for libpcap */
 
+#define MAX_CAPTURE_SNAPLEN                                                    \
+  262144 /* Maximum number of bytes captured per packet by libpcap */
+
 #define MAX_MIDDLEWARE_PARAMS_SIZE                                             \
   4094 /* Maximum length of the middleware params string */
 
+#define DEFAULT_WRITER_RING_SIZE                                               \
+  4096 /* Default number of packets in a middleware writer ring */
+
+#define DEFAULT_CAPTURE_RING_BLOCK_SIZE                                        \
+  (1 << 20) /* Default size in bytes of a TPACKET_V3 ring block */
+
+#define DEFAULT_CAPTURE_RING_BLOCK_COUNT                                       \
+  64 /* Default number of blocks in a TPACKET_V3 ring */
+
+#define DEFAULT_CLEANER_STORE_SIZE                                             \
+  1000 /* Default capture store size in KiB of an interface */
+
+#define DEFAULT_HEADER_BATCH_SIZE                                              \
+  1000 /* Default maximum number of packets in a header transaction */
+
+#define DEFAULT_COLUMN_STORE_SIZE                                              \
+  (100 * 1024) /* Default column store size in KiB of an interface */
+
+#define DEFAULT_COLUMN_STORE_AGE                                               \
+  (24 * 3600) /* Default column store age in seconds of an interface */
+
+#define MAX_CLEANER_QUOTAS_SIZE                                                \
+  1024 /* Maximum length of the per interface cleaner quotas string */
+
+/**
+ * @brief The middleware writer backpressure policy, used when the ring of a
+ * middleware writer thread is full
+ *
+ */
+enum WRITER_BACKPRESSURE {
+  WRITER_DROP_NEWEST = 0, /**< Drop the captured packet */
+  WRITER_DROP_OLDEST,     /**< Drop the oldest packet in the ring */
+  WRITER_BLOCK,           /**< Wait until the writer thread frees a slot */
+};
+
 /**
  * @brief The capture configuration structure
  *
@@ -46,9 +85,61 @@ struct capture_conf {
                                             dbs */
   char filter[MAX_FILTER_SIZE]; /**< Specifies the filter expression or pcap lib
                                  */
+  uint32_t snaplen; /**< Specifies the maximum number of bytes captured per
+                       packet, 0 for the largest snaplen of the middlewares */
+  char payload_filter[MAX_FILTER_SIZE]; /**< Specifies the filter expression
+                                           of the packets captured in full by
+                                           a second pcap handle, when the
+                                           snaplen truncates the packets */
   char middleware_params[MAX_MIDDLEWARE_PARAMS_SIZE]; /**< Specifies the
                                                          middleware params
                                                          string*/
+  bool writer_threads; /**< Specifies whether each middleware runs in its own
+                          writer thread, fed from the capture thread through a
+                          ring buffer */
+  uint32_t writer_ring_size; /**< Specifies the number of packets in each
+                                middleware writer ring */
+  enum WRITER_BACKPRESSURE
+      writer_backpressure; /**< Specifies the policy when a middleware writer
+                              ring is full */
+  bool capture_ring; /**< Specifies whether the packets are captured with a
+                        TPACKET_V3 memory mapped ring instead of libpcap */
+  uint32_t ring_block_size;  /**< Specifies the size in bytes of a TPACKET_V3
+                                ring block, a multiple of the page size */
+  uint32_t ring_block_count; /**< Specifies the number of TPACKET_V3 ring
+                                blocks */
+  uint16_t ring_fanout_group; /**< Specifies the PACKET_FANOUT group id of the
+                                 TPACKET_V3 ring, 0 to disable the fanout */
+  uint32_t db_shards; /**< Specifies the number of capture db shards, the
+                         capture thread of an interface writes to the shard
+                         given by the interface hash, 0 to disable */
+  bool pin_threads;   /**< Specifies whether each capture thread is pinned to
+                         the allowed core given by the interface hash, the
+                         writer threads keep the process affinity */
+  uint32_t cleaner_store_size; /**< Specifies the capture store size in KiB
+                                  of an interface, 0 for no limit */
+  uint32_t cleaner_store_age;  /**< Specifies the maximum age in seconds of
+                                  the capture store segments, 0 for no limit */
+  char cleaner_quotas[MAX_CLEANER_QUOTAS_SIZE]; /**< Specifies the per
+                                                   interface quotas as
+                                                   "ifname:KiB:seconds,..." */
+  uint32_t sample_rate;       /**< Specifies that 1-in-sample_rate packets are
+                                 passed to the middlewares, 0 or 1 for all */
+  uint32_t sample_flow_bytes; /**< Specifies the number of bytes passed to the
+                                 middlewares from the start of every flow, 0
+                                 for all */
+  uint32_t sample_packet_rate; /**< Specifies the maximum number of packets per
+                                  second passed to the middlewares, 0 for no
+                                  limit */
+  uint32_t sample_burst; /**< Specifies the packet rate limit burst size, 0 for
+                            one second of traffic */
+  uint32_t header_batch_size; /**< Specifies the maximum number of packets
+                                 in a header middleware transaction, 0 to
+                                 save every packet in its own transaction */
+  uint32_t column_store_size; /**< Specifies the column store size in KiB of
+                                 an interface, 0 for no limit */
+  uint32_t column_store_age;  /**< Specifies the maximum age in seconds of the
+                                 column files, 0 for no limit */
 };
 
 #endif
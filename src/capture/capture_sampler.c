@@ -0,0 +1,328 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the capture sampler.
+ */
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../utils/allocs.h"
+#include "../utils/hash.h"
+#include "../utils/log.h"
+#include "../utils/os.h"
+#include "../utils/sqliteu.h"
+
+#include "capture_sampler.h"
+
+#define SAMPLER_ETH_HEADER_LEN 14
+#define SAMPLER_VLAN_HEADER_LEN 4
+#define SAMPLER_ETH_TYPE_VLAN 0x8100
+#define SAMPLER_ETH_TYPE_IP 0x0800
+#define SAMPLER_ETH_TYPE_IP6 0x86DD
+#define SAMPLER_IP6_HEADER_LEN 40
+
+// A flow endpoint is an address (IPv4 uses the first 4 bytes) and a port
+#define SAMPLER_ENDPOINT_LEN 18
+
+static uint16_t read_uint16(const uint8_t *data) {
+  return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static void __free_capture_sampler(struct capture_sampler *sampler) {
+  if (sampler != NULL) {
+    os_free(sampler->flows);
+    os_free(sampler);
+  }
+}
+
+void free_capture_sampler(struct capture_sampler *sampler) {
+  __free_capture_sampler(sampler);
+}
+
+struct capture_sampler *init_capture_sampler(uint32_t sample_rate,
+                                             uint32_t flow_bytes,
+                                             uint32_t packet_rate,
+                                             uint32_t burst) {
+  struct capture_sampler *sampler = NULL;
+
+  if ((sampler = os_zalloc(sizeof(struct capture_sampler))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  sampler->sample_rate = sample_rate;
+  sampler->flow_bytes = flow_bytes;
+  sampler->packet_rate = packet_rate;
+
+  if (flow_bytes) {
+    if ((sampler->flows = os_calloc(CAPTURE_SAMPLER_FLOWS,
+                                    sizeof(struct capture_sampler_flow))) ==
+        NULL) {
+      log_errno("os_calloc");
+      __free_capture_sampler(sampler);
+      return NULL;
+    }
+  }
+
+  // The bucket starts full and holds one second of traffic by default
+  burst = (burst) ? burst : packet_rate;
+  sampler->capacity = (uint64_t)((burst) ? burst : 1) * CAPTURE_SAMPLER_TOKEN;
+  sampler->tokens = sampler->capacity;
+
+  return sampler;
+}
+
+uint32_t get_capture_flow_hash(const uint8_t *packet, uint32_t caplen) {
+  uint8_t endpoints[2 * SAMPLER_ENDPOINT_LEN + 1];
+  uint8_t *first = endpoints, *second = &endpoints[SAMPLER_ENDPOINT_LEN];
+  size_t offset = SAMPLER_ETH_HEADER_LEN, addr_len, header_len;
+  const uint8_t *src, *dst;
+  uint16_t type;
+  uint8_t protocol;
+  bool has_ports;
+  uint32_t hash;
+
+  if (packet == NULL || caplen < SAMPLER_ETH_HEADER_LEN) {
+    return 0;
+  }
+
+  type = read_uint16(&packet[12]);
+  if (type == SAMPLER_ETH_TYPE_VLAN) {
+    if (caplen < SAMPLER_ETH_HEADER_LEN + SAMPLER_VLAN_HEADER_LEN) {
+      return 0;
+    }
+    type = read_uint16(&packet[16]);
+    offset += SAMPLER_VLAN_HEADER_LEN;
+  }
+
+  if (type == SAMPLER_ETH_TYPE_IP) {
+    if (caplen < offset + 20) {
+      return 0;
+    }
+    header_len = (size_t)(packet[offset] & 0x0F) * 4;
+    protocol = packet[offset + 9];
+    // Only the first fragment has the ports
+    has_ports = (read_uint16(&packet[offset + 6]) & 0x1FFF) == 0;
+    src = &packet[offset + 12];
+    dst = &packet[offset + 16];
+    addr_len = 4;
+  } else if (type == SAMPLER_ETH_TYPE_IP6) {
+    if (caplen < offset + SAMPLER_IP6_HEADER_LEN) {
+      return 0;
+    }
+    header_len = SAMPLER_IP6_HEADER_LEN;
+    protocol = packet[offset + 6];
+    has_ports = true;
+    src = &packet[offset + 8];
+    dst = &packet[offset + 24];
+    addr_len = 16;
+  } else {
+    return 0;
+  }
+
+  os_memset(endpoints, 0, sizeof(endpoints));
+  os_memcpy(first, src, addr_len);
+  os_memcpy(second, dst, addr_len);
+
+  offset += header_len;
+  if (has_ports && caplen >= offset + 4 &&
+      (protocol == IPPROTO_TCP || protocol == IPPROTO_UDP ||
+       protocol == IPPROTO_SCTP)) {
+    os_memcpy(&first[SAMPLER_ENDPOINT_LEN - 2], &packet[offset], 2);
+    os_memcpy(&second[SAMPLER_ENDPOINT_LEN - 2], &packet[offset + 2], 2);
+  }
+
+  // Order the endpoints, so both directions have the same hash
+  if (memcmp(first, second, SAMPLER_ENDPOINT_LEN) > 0) {
+    uint8_t endpoint[SAMPLER_ENDPOINT_LEN];
+    os_memcpy(endpoint, first, SAMPLER_ENDPOINT_LEN);
+    os_memcpy(first, second, SAMPLER_ENDPOINT_LEN);
+    os_memcpy(second, endpoint, SAMPLER_ENDPOINT_LEN);
+  }
+  endpoints[2 * SAMPLER_ENDPOINT_LEN] = protocol;
+
+  hash = sdbm_hash(endpoints, sizeof(endpoints));
+  return (hash != 0) ? hash : 1;
+}
+
+static bool sample_flow_head(struct capture_sampler *sampler, uint32_t hash,
+                             uint64_t timestamp, uint32_t length) {
+  struct capture_sampler_flow *flow =
+      &sampler->flows[hash & (CAPTURE_SAMPLER_FLOWS - 1)];
+
+  // An idle flow frees the slot, so a flow seen again starts again
+  if (flow->hash == 0 ||
+      timestamp > flow->last_timestamp + CAPTURE_SAMPLER_FLOW_TIMEOUT) {
+    flow->hash = hash;
+    flow->bytes = 0;
+  } else if (flow->hash != hash) {
+    // The slot keeps counting its flow, so a colliding flow can't reset it.
+    // The colliding flow isn't tracked and all its packets are kept.
+    return true;
+  }
+
+  flow->last_timestamp = timestamp;
+  if (flow->bytes >= sampler->flow_bytes) {
+    return false;
+  }
+
+  flow->bytes += length;
+  return true;
+}
+
+static bool sample_token_bucket(struct capture_sampler *sampler,
+                                uint64_t timestamp) {
+  uint64_t elapsed;
+
+  if (sampler->token_timestamp == 0) {
+    sampler->token_timestamp = timestamp;
+  }
+
+  // A token costs CAPTURE_SAMPLER_TOKEN, so packet_rate tokens are refilled
+  // every microsecond. Timestamps going backwards refill nothing.
+  if (timestamp > sampler->token_timestamp) {
+    elapsed = timestamp - sampler->token_timestamp;
+    if (elapsed >= sampler->capacity / sampler->packet_rate) {
+      sampler->tokens = sampler->capacity;
+    } else {
+      sampler->tokens += elapsed * sampler->packet_rate;
+      if (sampler->tokens > sampler->capacity) {
+        sampler->tokens = sampler->capacity;
+      }
+    }
+    sampler->token_timestamp = timestamp;
+  }
+
+  if (sampler->tokens < CAPTURE_SAMPLER_TOKEN) {
+    return false;
+  }
+
+  sampler->tokens -= CAPTURE_SAMPLER_TOKEN;
+  return true;
+}
+
+bool sample_capture_packet(struct capture_sampler *sampler, const char *ltype,
+                           const struct pcap_pkthdr *header,
+                           const uint8_t *packet) {
+  uint64_t timestamp;
+  uint32_t hash;
+
+  if (sampler == NULL) {
+    return true;
+  }
+
+  sampler->seen++;
+
+  if (sampler->sample_rate > 1 &&
+      (sampler->counter++ % sampler->sample_rate) != 0) {
+    return false;
+  }
+
+  timestamp = (uint64_t)header->ts.tv_sec * 1000000 + header->ts.tv_usec;
+
+  if (sampler->flows != NULL && ltype != NULL && strcmp(ltype, "EN10MB") == 0 &&
+      (hash = get_capture_flow_hash(packet, header->caplen)) != 0) {
+    if (!sample_flow_head(sampler, hash, timestamp, header->len)) {
+      return false;
+    }
+  }
+
+  if (sampler->packet_rate && !sample_token_bucket(sampler, timestamp)) {
+    return false;
+  }
+
+  sampler->kept++;
+  return true;
+}
+
+int init_capture_sampler_db(sqlite3 *db) {
+  if (db == NULL) {
+    log_error("db param is NULL");
+    return -1;
+  }
+
+  if (execute_sqlite_query(db, CAPTURE_SAMPLING_CREATE_TABLE) < 0) {
+    log_error("execute_sqlite_query fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int bind_sampler_int64(sqlite3_stmt *res, const char *name,
+                              uint64_t value) {
+  int column_idx = sqlite3_bind_parameter_index(res, name);
+
+  if (sqlite3_bind_int64(res, column_idx, (sqlite3_int64)value) !=
+      SQLITE_OK) {
+    log_trace("sqlite3_bind_int64 fail for %s", name);
+    return -1;
+  }
+
+  return 0;
+}
+
+int save_capture_sampler(sqlite3 *db, struct capture_sampler *sampler,
+                         const char *ifname, uint64_t timestamp) {
+  sqlite3_stmt *res = NULL;
+  int rc, column_idx;
+  uint64_t seen, kept;
+
+  if (db == NULL) {
+    log_error("db param is NULL");
+    return -1;
+  }
+
+  if (sampler == NULL) {
+    log_error("sampler param is NULL");
+    return -1;
+  }
+
+  if (ifname == NULL) {
+    log_error("ifname param is NULL");
+    return -1;
+  }
+
+  seen = sampler->seen - sampler->saved_seen;
+  kept = sampler->kept - sampler->saved_kept;
+  if (!seen) {
+    return 0;
+  }
+
+  if (sqlite3_prepare_v2(db, CAPTURE_SAMPLING_INSERT_INTO, -1, &res, 0) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
+  column_idx = sqlite3_bind_parameter_index(res, "@ifname");
+  if (sqlite3_bind_text(res, column_idx, ifname, -1, NULL) != SQLITE_OK ||
+      bind_sampler_int64(res, "@timestamp", timestamp) < 0 ||
+      bind_sampler_int64(res, "@seen", seen) < 0 ||
+      bind_sampler_int64(res, "@kept", kept) < 0 ||
+      bind_sampler_int64(res, "@sample_rate", sampler->sample_rate) < 0 ||
+      bind_sampler_int64(res, "@flow_bytes", sampler->flow_bytes) < 0 ||
+      bind_sampler_int64(res, "@packet_rate", sampler->packet_rate) < 0) {
+    log_error("sqlite3 bind fail");
+    sqlite3_finalize(res);
+    return -1;
+  }
+
+  rc = sqlite3_step(res);
+  sqlite3_finalize(res);
+
+  if (rc != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
+  sampler->saved_seen = sampler->seen;
+  sampler->saved_kept = sampler->kept;
+  return 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the capture sampler.
+ *
+ * The sampler runs in the capture thread before the packets reach the
+ * middlewares. It keeps deterministically 1-in-N packets, the first bytes of
+ * every flow and caps the packet rate of the interface with a token bucket,
+ * using only the packet timestamps. The number of seen and kept packets is
+ * periodically saved into the capture db, so the stored data can be rescaled.
+ */
+
+#ifndef CAPTURE_SAMPLER_H
+#define CAPTURE_SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+#include <sqlite3.h>
+
+#include "../utils/attributes.h"
+
+#define CAPTURE_SAMPLER_INTERVAL 10 // Sampling ratio save period in seconds
+
+#define CAPTURE_SAMPLER_FLOWS 4096 // Number of flow slots, a power of two
+#define CAPTURE_SAMPLER_FLOW_TIMEOUT                                           \
+  60000000 // Idle timeout in microseconds after which a flow starts again
+
+#define CAPTURE_SAMPLER_TOKEN 1000000 // The token bucket cost of a packet
+
+#define CAPTURE_SAMPLING_TABLE_NAME "capture_sampling"
+#define CAPTURE_SAMPLING_CREATE_TABLE                                          \
+  "CREATE TABLE IF NOT EXISTS " CAPTURE_SAMPLING_TABLE_NAME                    \
+  " (ifname TEXT NOT NULL, timestamp INTEGER NOT NULL, "                       \
+  "seen INTEGER NOT NULL, kept INTEGER NOT NULL, "                             \
+  "sample_rate INTEGER NOT NULL, flow_bytes INTEGER NOT NULL, "                \
+  "packet_rate INTEGER NOT NULL, PRIMARY KEY (ifname, timestamp));"
+#define CAPTURE_SAMPLING_INSERT_INTO                                           \
+  "INSERT OR REPLACE INTO " CAPTURE_SAMPLING_TABLE_NAME                        \
+  " VALUES(@ifname, @timestamp, @seen, @kept, @sample_rate, @flow_bytes, "     \
+  "@packet_rate);"
+
+/**
+ * @brief Sampler flow slot structure definition
+ *
+ */
+struct capture_sampler_flow {
+  uint32_t hash;           /**< The flow hash, 0 for an empty slot */
+  uint64_t bytes;          /**< Number of flow bytes seen */
+  uint64_t last_timestamp; /**< Timestamp of the last flow packet */
+};
+
+/**
+ * @brief Capture sampler structure definition
+ *
+ * A value of 0 disables the corresponding sampling mode.
+ */
+struct capture_sampler {
+  uint32_t sample_rate; /**< Keep 1-in-sample_rate packets */
+  uint32_t flow_bytes;  /**< Keep the first flow_bytes of every flow */
+  uint32_t packet_rate; /**< The maximum number of packets per second */
+  uint64_t capacity;    /**< The token bucket capacity */
+  uint64_t tokens;      /**< The token bucket level */
+  uint64_t token_timestamp; /**< Timestamp of the last token bucket refill */
+  uint64_t counter;         /**< The 1-in-N packet counter */
+  struct capture_sampler_flow *flows; /**< The flow slots */
+  uint64_t seen;       /**< Number of packets seen */
+  uint64_t kept;       /**< Number of packets kept */
+  uint64_t saved_seen; /**< Number of packets seen at the last save */
+  uint64_t saved_kept; /**< Number of packets kept at the last save */
+};
+
+/**
+ * @brief Frees the capture sampler
+ *
+ * @param sampler The capture sampler
+ */
+void free_capture_sampler(struct capture_sampler *sampler);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_capture_sampler()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_capture_sampler                                            \
+  __attribute__((malloc(free_capture_sampler, 1))) __must_check
+#else
+#define __must_free_capture_sampler __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a capture sampler
+ *
+ * @param sample_rate Keep 1-in-sample_rate packets, 0 or 1 to keep all
+ * @param flow_bytes Keep the first flow_bytes of every flow, 0 to keep all
+ * @param packet_rate The maximum number of packets per second, 0 for no limit
+ * @param burst The token bucket size in packets, 0 for one second of traffic
+ * @return struct capture_sampler* The capture sampler, NULL on failure.
+ * You must free this using free_capture_sampler().
+ */
+__must_free_capture_sampler struct capture_sampler *
+init_capture_sampler(uint32_t sample_rate, uint32_t flow_bytes,
+                     uint32_t packet_rate, uint32_t burst);
+
+/**
+ * @brief Returns the flow hash of an ethernet packet
+ *
+ * The hash is the same for both directions of a flow.
+ *
+ * @param packet The packet data
+ * @param caplen The packet capture length
+ * @return uint32_t The flow hash, 0 if the packet is not IPv4 or IPv6
+ */
+uint32_t get_capture_flow_hash(const uint8_t *packet, uint32_t caplen);
+
+/**
+ * @brief Decides whether a packet is passed to the middlewares
+ *
+ * The flow head sampling applies only to the ethernet packets. A flow whose
+ * slot is held by another active flow isn't sampled until the slot is idle.
+ *
+ * @param sampler The capture sampler
+ * @param ltype The packet link type
+ * @param header The pcap packet header
+ * @param packet The packet data
+ * @return true to keep the packet, false to drop it
+ */
+bool sample_capture_packet(struct capture_sampler *sampler, const char *ltype,
+                           const struct pcap_pkthdr *header,
+                           const uint8_t *packet);
+
+/**
+ * @brief Initialises the capture sampling table
+ *
+ * @param db The sqlite3 db
+ * @return int 0 on success, -1 on failure
+ */
+int init_capture_sampler_db(sqlite3 *db);
+
+/**
+ * @brief Saves the packets seen and kept since the previous save
+ *
+ * The ratio seen/kept of a row rescales the data stored until its timestamp.
+ * Nothing is saved if no packets were seen.
+ *
+ * @param db The sqlite3 db
+ * @param sampler The capture sampler
+ * @param ifname The capture interface
+ * @param timestamp The save timestamp in microseconds
+ * @return int 0 on success, -1 on failure
+ */
+int save_capture_sampler(sqlite3 *db, struct capture_sampler *sampler,
+                         const char *ifname, uint64_t timestamp);
+
+#endif
@@ -11,6 +11,8 @@
  * @brief File containing the implementation of the capture service.
  */
 
+#define _GNU_SOURCE /* To get defns of pthread_attr_setaffinity_np */
+
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -18,13 +20,22 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "capture_batch.h"
 #include "capture_config.h"
+#include "capture_sampler.h"
 #include "capture_service.h"
+#include "capture_shards.h"
+#include "capture_stats.h"
+#include "capture_writer.h"
 #include "pcap_service.h"
+#include "middlewares/pcap_middleware/sqlite_pcap.h"
 
 #include <eloop.h>
 #include "../utils/allocs.h"
@@ -35,16 +46,73 @@
 
 #include "middlewares_list.h"
 
+static void flush_capture_batch(struct capture_middleware_context *context) {
+  struct capture_batch *batch = context->batch;
+
+  if (batch != NULL && batch->count) {
+    process_middlewares_batch(context->handlers, batch->ltype, batch->packets,
+                              batch->count, context->ifname);
+    reset_capture_batch(batch);
+  }
+}
+
+static void flush_capture_block(const void *ctx) {
+  // The ring block is handed back to the kernel after this call, so the
+  // batched packets pointing into it must be processed now
+  flush_capture_batch((struct capture_middleware_context *)ctx);
+}
+
+static int push_capture_packet(struct capture_middleware_context *context,
+                               const struct pcap_context *pc, char *ltype,
+                               struct pcap_pkthdr *header, uint8_t *packet) {
+  if (pc->ring != NULL) {
+    return push_capture_batch_ref(context->batch, ltype, header, packet);
+  }
+
+  return push_capture_batch(context->batch, ltype, header, packet);
+}
+
 void pcap_callback(const void *ctx, const void *pcap_ctx, char *ltype,
                    struct pcap_pkthdr *header, uint8_t *packet) {
 
-  (void)pcap_ctx;
-
   struct capture_middleware_context *context =
       (struct capture_middleware_context *)ctx;
+  const struct pcap_context *pc = (const struct pcap_context *)pcap_ctx;
 
-  process_middlewares(context->handlers, ltype, header, packet,
-                      context->ifname);
+  if (context->sampler != NULL &&
+      !sample_capture_packet(context->sampler, ltype, header, packet)) {
+    return;
+  }
+
+  if (context->writers != NULL) {
+    if (dispatch_capture_writers(context->writers, ltype, header, packet) <
+        0) {
+      log_error("dispatch_capture_writers fail");
+    }
+  } else if (context->batch != NULL) {
+    if (push_capture_packet(context, pc, ltype, header, packet) < 0) {
+      flush_capture_batch(context);
+      // The packet is larger than the batch data buffer
+      if (push_capture_packet(context, pc, ltype, header, packet) < 0) {
+        process_middlewares(context->handlers, ltype, header, packet,
+                            context->ifname);
+      }
+    }
+  } else {
+    process_middlewares(context->handlers, ltype, header, packet,
+                        context->ifname);
+  }
+}
+
+static void
+free_capture_middlewares(struct capture_middleware_context *context) {
+  // The middlewares must be freed before closing the sqlite3 db
+  free_capture_writers(context->writers);
+  context->writers = NULL;
+  free_capture_batch(context->batch);
+  context->batch = NULL;
+  free_middlewares(context->handlers);
+  context->handlers = NULL;
 }
 
 void eloop_read_fd_handler(int sock, void *eloop_ctx, void *sock_ctx) {
@@ -56,12 +124,260 @@ void eloop_read_fd_handler(int sock, void *eloop_ctx, void *sock_ctx) {
   if (capture_pcap_packet(pc) < 0) {
     log_trace("capture_pcap_packet fail");
   }
+
+  // Run the middlewares once for all the packets of the pcap_dispatch() call
+  flush_capture_batch((struct capture_middleware_context *)pc->fn_ctx);
+}
+
+static void collect_capture_stats(struct capture_middleware_context *context,
+                                  struct pcap_context *pc,
+                                  struct capture_stats *stats) {
+  struct pcap_stat ps;
+  struct capture_writer_stats writer_stats;
+
+  os_memset(stats, 0, sizeof(struct capture_stats));
+  os_strlcpy(stats->ifname, context->ifname, IF_NAMESIZE);
+  os_get_timestamp(&stats->timestamp);
+
+  if (get_pcap_stats(pc, &ps) == 0) {
+    stats->ps_recv = ps.ps_recv;
+    stats->ps_drop = ps.ps_drop;
+    stats->ps_ifdrop = ps.ps_ifdrop;
+  }
+
+  if (context->payload_pc != NULL &&
+      get_pcap_stats(context->payload_pc, &ps) == 0) {
+    stats->ps_recv += ps.ps_recv;
+    stats->ps_drop += ps.ps_drop;
+    stats->ps_ifdrop += ps.ps_ifdrop;
+  }
+
+  // The middleware queues belong to the writer threads, so use their rings
+  if (context->writers != NULL) {
+    for (size_t idx = 0; idx < context->writers->count; idx++) {
+      if (get_capture_writer_stats(context->writers, idx, &writer_stats) ==
+          0) {
+        stats->queue_length += writer_stats.length;
+      }
+    }
+  } else {
+    stats->queue_length = get_middlewares_queue_length(context->handlers);
+  }
+
+  load_capture_sink_stats(&context->sink, stats);
+}
+
+void eloop_tout_stats_handler(void *eloop_ctx, void *user_ctx) {
+  struct eloop_data *eloop = (struct eloop_data *)eloop_ctx;
+  struct pcap_context *pc = (struct pcap_context *)user_ctx;
+  struct capture_middleware_context *context =
+      (struct capture_middleware_context *)pc->fn_ctx;
+  struct capture_stats stats;
+
+  collect_capture_stats(context, pc, &stats);
+  log_trace("Capture stats ifname=%s recv=%" PRIu64 " drop=%" PRIu64
+            " ifdrop=%" PRIu64 " queue=%" PRIu64,
+            stats.ifname, stats.ps_recv, stats.ps_drop, stats.ps_ifdrop,
+            stats.queue_length);
+
+  if (publish_capture_stats(context->registry, &stats) < 0) {
+    log_error("publish_capture_stats fail");
+  }
+
+  if (edge_eloop_register_timeout(eloop, CAPTURE_STATS_INTERVAL, 0,
+                                  eloop_tout_stats_handler, (void *)eloop,
+                                  user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
+void eloop_tout_sampler_handler(void *eloop_ctx, void *user_ctx) {
+  struct eloop_data *eloop = (struct eloop_data *)eloop_ctx;
+  struct capture_middleware_context *context =
+      (struct capture_middleware_context *)user_ctx;
+  uint64_t timestamp;
+
+  os_get_timestamp(&timestamp);
+  if (save_capture_sampler(context->db, context->sampler, context->ifname,
+                           timestamp) < 0) {
+    log_error("save_capture_sampler fail");
+  }
+
+  if (edge_eloop_register_timeout(eloop, CAPTURE_SAMPLER_INTERVAL, 0,
+                                  eloop_tout_sampler_handler, (void *)eloop,
+                                  user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
+static bool has_capture_sampling(const struct capture_conf *config) {
+  return config->sample_rate > 1 || config->sample_flow_bytes ||
+         config->sample_packet_rate;
+}
+
+static int init_capture_sampling(sqlite3 *db,
+                                 struct capture_middleware_context *context) {
+  const struct capture_conf *config = &context->config;
+
+  log_info("Sample rate=%" PRIu32 " flow bytes=%" PRIu32
+           " packet rate=%" PRIu32 " burst=%" PRIu32,
+           config->sample_rate, config->sample_flow_bytes,
+           config->sample_packet_rate, config->sample_burst);
+
+  if (init_capture_sampler_db(db) < 0) {
+    log_error("init_capture_sampler_db fail");
+    return -1;
+  }
+
+  if ((context->sampler = init_capture_sampler(
+           config->sample_rate, config->sample_flow_bytes,
+           config->sample_packet_rate, config->sample_burst)) == NULL) {
+    log_error("init_capture_sampler fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void free_capture_sampling(struct capture_middleware_context *context) {
+  uint64_t timestamp;
+
+  if (context->sampler != NULL) {
+    // Saves the packets sampled since the last period
+    os_get_timestamp(&timestamp);
+    if (save_capture_sampler(context->db, context->sampler, context->ifname,
+                             timestamp) < 0) {
+      log_error("save_capture_sampler fail");
+    }
+    free_capture_sampler(context->sampler);
+    context->sampler = NULL;
+  }
+}
+
+static uint32_t
+get_capture_snaplen(struct capture_middleware_context *context) {
+  if (context->config.snaplen) {
+    return context->config.snaplen;
+  }
+
+  return get_middlewares_snaplen(context->handlers);
+}
+
+static char *build_capture_filter(const char *filter,
+                                  const char *payload_filter, bool payload) {
+  size_t len = strlen(filter) + strlen(payload_filter) + 16;
+  const char *op = (payload) ? "" : "not ";
+  char *out = NULL;
+
+  if ((out = os_malloc(len)) == NULL) {
+    log_errno("os_malloc");
+    return NULL;
+  }
+
+  if (strlen(filter)) {
+    snprintf(out, len, "(%s) and %s(%s)", filter, op, payload_filter);
+  } else {
+    snprintf(out, len, "%s(%s)", op, payload_filter);
+  }
+
+  return out;
+}
+
+static int run_payload_pcap(struct eloop_data *eloop,
+                            struct capture_middleware_context *context) {
+  char *filter = NULL;
+  int ret;
+
+  if ((filter = build_capture_filter(context->config.filter,
+                                     context->config.payload_filter, true)) ==
+      NULL) {
+    log_error("build_capture_filter fail");
+    return -1;
+  }
+
+  log_info("Registering full packets pcap with filter=%s", filter);
+  ret = run_pcap(context->ifname, context->config.immediate,
+                 context->config.promiscuous,
+                 (int)context->config.buffer_timeout, 0, filter, true,
+                 pcap_callback, (void *)context, &context->payload_pc);
+  os_free(filter);
+
+  if (ret < 0) {
+    log_error("run_pcap fail");
+    return -1;
+  }
+
+  if (edge_eloop_register_read_sock(eloop, context->payload_pc->pcap_fd,
+                                    eloop_read_fd_handler,
+                                    (void *)context->payload_pc,
+                                    (void *)NULL) == -1) {
+    log_error("edge_eloop_register_read_sock fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void get_capture_quota(const struct capture_conf *config,
+                              const char *ifname, uint64_t *max_size,
+                              uint64_t *max_age) {
+  const char *entry = config->cleaner_quotas;
+  char name[IF_NAMESIZE];
+  unsigned long size, age;
+
+  *max_size = (uint64_t)config->cleaner_store_size * 1024;
+  *max_age = (uint64_t)config->cleaner_store_age * 1000000;
+
+  // The entries have the format ifname:KiB:seconds
+  while (entry != NULL && *entry) {
+    if (sscanf(entry, " %15[^:]:%lu:%lu", name, &size, &age) != 3) {
+      log_warn("Invalid cleaner quota %s", entry);
+    } else if (strcmp(name, ifname) == 0) {
+      *max_size = (uint64_t)size * 1024;
+      *max_age = (uint64_t)age * 1000000;
+      return;
+    }
+
+    if ((entry = strchr(entry, ',')) != NULL) {
+      entry++;
+    }
+  }
+}
+
+static int save_capture_quota(sqlite3 *db,
+                              struct capture_middleware_context *context) {
+  uint64_t max_size, max_age;
+
+  get_capture_quota(&context->config, context->ifname, &max_size, &max_age);
+
+  log_info("Capture store quota=%" PRIu64 " bytes, age=%" PRIu64 " us",
+           max_size, max_age);
+
+  if (init_sqlite_pcap_db(db) < 0) {
+    log_error("init_sqlite_pcap_db fail");
+    return -1;
+  }
+
+  if (backfill_sqlite_pcap_segments(db, context->ifname) < 0) {
+    log_error("backfill_sqlite_pcap_segments fail");
+    return -1;
+  }
+
+  if (save_sqlite_pcap_quota(db, context->ifname, max_size, max_age) < 0) {
+    log_error("save_sqlite_pcap_quota fail");
+    return -1;
+  }
+
+  return 0;
 }
 
 int run_capture(struct capture_middleware_context *context) {
   int ret = -1;
-  struct pcap_context *pc = NULL;
+  struct pcap_context *pc = NULL, *middleware_pc = NULL;
   struct eloop_data *eloop = NULL;
+  char *filter = context->config.filter;
+  bool payload_pcap = false;
+  uint32_t snaplen;
   sqlite3 *db;
 
   log_info("Capture db path=%s", context->config.capture_db_path);
@@ -71,6 +387,8 @@ int run_capture(struct capture_middleware_context *context) {
   log_info("Immediate mode=%d", context->config.immediate);
   log_info("Buffer timeout=%d", context->config.buffer_timeout);
   log_info("Middleware params=%s", context->config.middleware_params);
+  log_info("Writer threads=%d", context->config.writer_threads);
+  log_info("Capture ring=%d", context->config.capture_ring);
 
   ret = sqlite3_open(context->config.capture_db_path, &db);
 
@@ -82,16 +400,73 @@ int run_capture(struct capture_middleware_context *context) {
     return -1;
   }
 
+  // The sqlite3 commits and sink writes of this thread (and of its writer
+  // threads) are recorded into the context sink stats
+  set_capture_sink_stats(&context->sink);
+
+  // The quotas of the interface are read by the cleaner middleware
+  if (save_capture_quota(db, context) < 0) {
+    log_error("save_capture_quota fail");
+    goto capture_fail;
+  }
+
+  context->db = db;
+  if (has_capture_sampling(&context->config) &&
+      init_capture_sampling(db, context) < 0) {
+    log_error("init_capture_sampling fail");
+    goto capture_fail;
+  }
+
   if ((eloop = edge_eloop_init()) == NULL) {
     log_error("edge_eloop_init fail");
     goto capture_fail;
   }
 
+  context->handlers = assign_middlewares();
+
+  snaplen = get_capture_snaplen(context);
+  log_info("Snapshot length=%" PRIu32, snaplen);
+
+  // The packets matching the payload filter are captured in full by a second
+  // handle, so the truncating handle must skip them
+  if (snaplen && strlen(context->config.payload_filter)) {
+    payload_pcap = true;
+    if ((filter = build_capture_filter(context->config.filter,
+                                       context->config.payload_filter,
+                                       false)) == NULL) {
+      log_error("build_capture_filter fail");
+      goto capture_fail;
+    }
+  } else if (strlen(context->config.payload_filter)) {
+    log_warn("Payload filter ignored, the packets are not truncated");
+  }
+
   log_info("Registering pcap for ifname=%s", context->ifname);
-  if (run_pcap(context->ifname, context->config.immediate,
-               context->config.promiscuous, (int)context->config.buffer_timeout,
-               context->config.filter, true, pcap_callback, (void *)context,
-               &pc) < 0) {
+  if (context->config.capture_ring) {
+    struct pcap_ring_conf ring_conf = {
+        .block_size = context->config.ring_block_size,
+        .block_count = context->config.ring_block_count,
+        .snaplen = snaplen,
+        .timeout = (context->config.immediate)
+                       ? 1
+                       : context->config.buffer_timeout,
+        .fanout_group = context->config.ring_fanout_group,
+        .promiscuous = context->config.promiscuous,
+    };
+
+    log_info("Ring blocks=%" PRIu32 " block size=%" PRIu32
+             " fanout group=%" PRIu16,
+             ring_conf.block_count, ring_conf.block_size,
+             ring_conf.fanout_group);
+    if (run_pcap_ring(context->ifname, &ring_conf, filter, pcap_callback,
+                      flush_capture_block, (void *)context, &pc) < 0) {
+      log_error("run_pcap_ring fail");
+      goto capture_fail;
+    }
+  } else if (run_pcap(context->ifname, context->config.immediate,
+                      context->config.promiscuous,
+                      (int)context->config.buffer_timeout, snaplen, filter,
+                      true, pcap_callback, (void *)context, &pc) < 0) {
     log_error("run_pcap fail");
     goto capture_fail;
   }
@@ -107,27 +482,92 @@ int run_capture(struct capture_middleware_context *context) {
     goto capture_fail;
   }
 
-  context->handlers = assign_middlewares();
+  middleware_pc = pc;
+  if (payload_pcap) {
+    if (run_payload_pcap(eloop, context) < 0) {
+      log_error("run_payload_pcap fail");
+      goto capture_fail;
+    }
 
-  if (init_middlewares(context->handlers, db, context->config.capture_db_path,
-                       eloop, pc, context->config.middleware_params) < 0) {
+    // The middlewares dump the packets of both handles, so they use the one
+    // with the full snaplen
+    middleware_pc = context->payload_pc;
+  }
+
+  if (context->config.writer_threads) {
+    log_info("Writer ring size=%" PRIu32, context->config.writer_ring_size);
+    log_info("Writer backpressure=%d", context->config.writer_backpressure);
+    if ((context->writers = init_capture_writers(
+             context->handlers, &context->config, middleware_pc,
+             context->ifname)) ==
+        NULL) {
+      log_error("init_capture_writers fail");
+      goto capture_fail;
+    }
+  } else if (init_middlewares(context->handlers, db, eloop, middleware_pc,
+                              &context->config) < 0) {
     log_error("init_middlewares fail");
     goto capture_fail;
+  } else if (has_batch_middlewares(context->handlers)) {
+    log_info("Capture batch size=%d", CAPTURE_BATCH_SIZE);
+    if ((context->batch = init_capture_batch(CAPTURE_BATCH_SIZE,
+                                             CAPTURE_BATCH_DATA_SIZE)) ==
+        NULL) {
+      log_error("init_capture_batch fail");
+      goto capture_fail;
+    }
+  }
+
+  if (context->registry != NULL) {
+    log_info("Capture stats interval=%d s", CAPTURE_STATS_INTERVAL);
+    if (edge_eloop_register_timeout(eloop, CAPTURE_STATS_INTERVAL, 0,
+                                    eloop_tout_stats_handler, (void *)eloop,
+                                    (void *)pc) == -1) {
+      log_error("edge_eloop_register_timeout fail");
+      goto capture_fail;
+    }
+  }
+
+  if (context->sampler != NULL) {
+    if (edge_eloop_register_timeout(eloop, CAPTURE_SAMPLER_INTERVAL, 0,
+                                    eloop_tout_sampler_handler, (void *)eloop,
+                                    (void *)context) == -1) {
+      log_error("edge_eloop_register_timeout fail");
+      goto capture_fail;
+    }
   }
 
   edge_eloop_run(eloop);
   log_info("Capture ended.");
 
   /* And close the session */
+  free_capture_middlewares(context);
+  free_capture_sampling(context);
+  close_pcap(context->payload_pc);
+  context->payload_pc = NULL;
   close_pcap(pc);
   edge_eloop_free(eloop);
   sqlite3_close(db);
+  context->db = NULL;
+  set_capture_sink_stats(NULL);
+  if (payload_pcap) {
+    os_free(filter);
+  }
   return 0;
 
 capture_fail:
+  free_capture_middlewares(context);
+  free_capture_sampling(context);
+  close_pcap(context->payload_pc);
+  context->payload_pc = NULL;
   close_pcap(pc);
   edge_eloop_free(eloop);
   sqlite3_close(db);
+  context->db = NULL;
+  set_capture_sink_stats(NULL);
+  if (payload_pcap) {
+    os_free(filter);
+  }
   return -1;
 }
 
@@ -159,9 +599,45 @@ void *capture_thread(void *arg) {
   return (void *)ret;
 }
 
+static int set_capture_thread_cpu(pthread_attr_t *attr, const char *ifname) {
+  cpu_set_t allowed, cpus;
+  uint32_t idx, count;
+
+  // Only pick a core the process is allowed to run on
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+    log_errno("sched_getaffinity");
+    return -1;
+  }
+
+  if ((count = (uint32_t)CPU_COUNT(&allowed)) == 0) {
+    log_error("Empty affinity mask");
+    return -1;
+  }
+
+  idx = get_capture_shard(ifname, count);
+
+  CPU_ZERO(&cpus);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && !idx--) {
+      CPU_SET(cpu, &cpus);
+      log_info("Capture cpu=%d for ifname=%s", cpu, ifname);
+      break;
+    }
+  }
+
+  if ((errno = pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus)) != 0) {
+    log_errno("pthread_attr_setaffinity_np");
+    return -1;
+  }
+
+  return 0;
+}
+
 int run_capture_thread(char *ifname, struct capture_conf const *config,
-                       pthread_t *id) {
+                       struct capture_stats_registry *registry, pthread_t *id) {
   struct capture_middleware_context *context = NULL;
+  pthread_attr_t attr;
+  int ret;
 
   if ((context = os_zalloc(sizeof(struct capture_middleware_context))) ==
       NULL) {
@@ -171,9 +647,40 @@ int run_capture_thread(char *ifname, struct capture_conf const *config,
 
   os_strlcpy(context->ifname, ifname, IF_NAMESIZE);
   context->config = *config;
+  context->registry = registry;
+
+  // Every interface writes to its own shard, so the capture threads don't
+  // contend on the same sqlite3 db lock
+  if (config->db_shards) {
+    uint32_t shard = get_capture_shard(ifname, config->db_shards);
+    if (get_capture_shard_path(config->capture_db_path, shard,
+                               context->config.capture_db_path) < 0) {
+      log_error("get_capture_shard_path fail");
+      free_capture_context(context);
+      return -1;
+    }
+    log_info("Capture shard=%" PRIu32 " for ifname=%s", shard, ifname);
+  }
+
+  if ((errno = pthread_attr_init(&attr)) != 0) {
+    log_errno("pthread_attr_init");
+    free_capture_context(context);
+    return -1;
+  }
+
+  if (config->pin_threads && set_capture_thread_cpu(&attr, ifname) < 0) {
+    log_error("set_capture_thread_cpu fail");
+    pthread_attr_destroy(&attr);
+    free_capture_context(context);
+    return -1;
+  }
 
   log_info("Running the capture thread");
-  if (pthread_create(id, NULL, capture_thread, (void *)context) != 0) {
+  ret = pthread_create(id, &attr, capture_thread, (void *)context);
+  pthread_attr_destroy(&attr);
+
+  if (ret != 0) {
+    errno = ret;
     log_errno("pthread_create");
     free_capture_context(context);
     return -1;
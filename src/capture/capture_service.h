@@ -16,7 +16,11 @@
 
 #include <eloop.h>
 
+#include "capture_batch.h"
 #include "capture_config.h"
+#include "capture_sampler.h"
+#include "capture_stats.h"
+#include "capture_writer.h"
 #include "pcap_service.h"
 
 #define DB_BUSY_TIMEOUT 5000 // Sets the sqlite busy timeout in milliseconds
@@ -24,6 +28,14 @@
 struct capture_middleware_context {
   struct capture_conf config;
   UT_array *handlers;
+  struct capture_writers *writers;
+  struct capture_batch *batch;
+  struct capture_sampler *sampler; /**< NULL if not sampled */
+  struct pcap_context *payload_pc; /**< The full packets handle, NULL if the
+                                      payload filter is not used */
+  sqlite3 *db;                     /**< The capture db, set while capturing */
+  struct capture_stats_registry *registry; /**< NULL if not collected */
+  struct capture_sink_stats sink;
   char ifname[IF_NAMESIZE];
 };
 
@@ -66,12 +78,16 @@ void free_capture_context(struct capture_middleware_context *context);
 /**
  * @brief Runs the capture service thread
  *
+ * The capture thread publishes its statistics to the registry every
+ * CAPTURE_STATS_INTERVAL seconds.
+ *
  * @param ifname The capture interface name
  * @param config The capture service config structure
+ * @param registry The statistics registry, NULL to disable the statistics
  * @param[out] id The returned thread id
  * @return int 0 on success, -1 on error
  */
 int run_capture_thread(char *ifname, struct capture_conf const *config,
-                       pthread_t *id);
+                       struct capture_stats_registry *registry, pthread_t *id);
 
 #endif
@@ -0,0 +1,242 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the capture db shards.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sqlite3.h>
+
+#include <utarray.h>
+
+#include "../utils/hash.h"
+#include "../utils/log.h"
+#include "../utils/os.h"
+#include "../utils/sqliteu.h"
+
+#include "capture_shards.h"
+
+#define SHARD_TABLES_QUERY                                                     \
+  "SELECT name FROM %w.sqlite_master WHERE type='table';"
+
+uint32_t get_capture_shard(const char *ifname, uint32_t shards) {
+  if (ifname == NULL || !shards) {
+    return 0;
+  }
+
+  return sdbm_hash((const uint8_t *)ifname, strlen(ifname)) % shards;
+}
+
+int get_capture_shard_path(const char *db_path, uint32_t shard,
+                           char *shard_path) {
+  if (db_path == NULL) {
+    log_error("db_path param is NULL");
+    return -1;
+  }
+
+  if (shard_path == NULL) {
+    log_error("shard_path param is NULL");
+    return -1;
+  }
+
+  int ret = snprintf(shard_path, MAX_OS_PATH_LEN, "%s.%" PRIu32, db_path,
+                     shard);
+  if (ret < 0 || ret >= MAX_OS_PATH_LEN) {
+    log_error("Shard path for %s is too long", db_path);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int attach_capture_shard(sqlite3 *db, const char *db_path,
+                                uint32_t shard, char *schema) {
+  char shard_path[MAX_OS_PATH_LEN];
+  char *sql;
+  int ret;
+
+  if (get_capture_shard_path(db_path, shard, shard_path) < 0) {
+    log_error("get_capture_shard_path fail");
+    return -1;
+  }
+
+  // A shard exists only after a capture thread wrote to it
+  if (check_file_exists(shard_path, NULL) < 0) {
+    log_trace("Missing shard %s", shard_path);
+    return 0;
+  }
+
+  if ((sql = sqlite3_mprintf("ATTACH DATABASE %Q AS %Q;", shard_path,
+                             schema)) == NULL) {
+    log_error("sqlite3_mprintf fail");
+    return -1;
+  }
+
+  ret = execute_sqlite_query(db, sql);
+  sqlite3_free(sql);
+
+  return (ret < 0) ? -1 : 1;
+}
+
+static int add_shard_tables(sqlite3 *db, const char *schema,
+                            UT_array *tables) {
+  sqlite3_stmt *res = NULL;
+  char *sql;
+
+  if ((sql = sqlite3_mprintf(SHARD_TABLES_QUERY, schema)) == NULL) {
+    log_error("sqlite3_mprintf fail");
+    return -1;
+  }
+
+  if (sqlite3_prepare_v2(db, sql, -1, &res, 0) != SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    sqlite3_free(sql);
+    return -1;
+  }
+  sqlite3_free(sql);
+
+  while (sqlite3_step(res) == SQLITE_ROW) {
+    const char *table = (const char *)sqlite3_column_text(res, 0);
+    char **p = NULL;
+    bool found = false;
+
+    while ((p = (char **)utarray_next(tables, p)) != NULL) {
+      if (strcmp(*p, table) == 0) {
+        found = true;
+        break;
+      }
+    }
+
+    if (!found) {
+      utarray_push_back(tables, &table);
+    }
+  }
+
+  sqlite3_finalize(res);
+  return 0;
+}
+
+static int create_shards_view(sqlite3 *db, const char *table,
+                              UT_array *schemas) {
+  char **schema = NULL;
+  char *select = NULL;
+  char *sql;
+  int ret;
+
+  // Only union the shards that have the table
+  while ((schema = (char **)utarray_next(schemas, schema)) != NULL) {
+    char *exists = sqlite3_mprintf(
+        "SELECT 1 FROM %w.sqlite_master WHERE type='table' AND name=%Q;",
+        *schema, table);
+    sqlite3_stmt *res = NULL;
+    bool found = false;
+
+    if (exists != NULL &&
+        sqlite3_prepare_v2(db, exists, -1, &res, 0) == SQLITE_OK) {
+      found = (sqlite3_step(res) == SQLITE_ROW);
+    }
+    sqlite3_finalize(res);
+    sqlite3_free(exists);
+
+    if (!found) {
+      continue;
+    }
+
+    if (select == NULL) {
+      select = sqlite3_mprintf("SELECT * FROM %w.%w", *schema, table);
+    } else {
+      select = sqlite3_mprintf("%z UNION ALL SELECT * FROM %w.%w", select,
+                               *schema, table);
+    }
+
+    if (select == NULL) {
+      log_error("sqlite3_mprintf fail");
+      return -1;
+    }
+  }
+
+  if (select == NULL) {
+    return 0;
+  }
+
+  if ((sql = sqlite3_mprintf("CREATE TEMP VIEW %w AS %z;", table, select)) ==
+      NULL) {
+    log_error("sqlite3_mprintf fail");
+    return -1;
+  }
+
+  ret = execute_sqlite_query(db, sql);
+  sqlite3_free(sql);
+
+  return ret;
+}
+
+sqlite3 *open_capture_shards(const char *db_path, uint32_t shards) {
+  sqlite3 *db = NULL;
+  UT_array *schemas = NULL;
+  UT_array *tables = NULL;
+  char **p = NULL;
+
+  if (db_path == NULL) {
+    log_error("db_path param is NULL");
+    return NULL;
+  }
+
+  if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+    log_error("Cannot open database: %s", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return NULL;
+  }
+
+  if (shards > (uint32_t)sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1)) {
+    log_error("Too many shards %" PRIu32 " to attach", shards);
+    sqlite3_close(db);
+    return NULL;
+  }
+
+  utarray_new(schemas, &ut_str_icd);
+  utarray_new(tables, &ut_str_icd);
+
+  for (uint32_t shard = 0; shard < shards; shard++) {
+    char schema[32];
+    char *schema_ptr = schema;
+    int ret;
+
+    snprintf(schema, sizeof(schema), "shard%" PRIu32, shard);
+    if ((ret = attach_capture_shard(db, db_path, shard, schema)) < 0) {
+      log_error("attach_capture_shard fail for shard %" PRIu32, shard);
+      goto fail;
+    } else if (ret > 0) {
+      utarray_push_back(schemas, &schema_ptr);
+      if (add_shard_tables(db, schema, tables) < 0) {
+        log_error("add_shard_tables fail");
+        goto fail;
+      }
+    }
+  }
+
+  while ((p = (char **)utarray_next(tables, p)) != NULL) {
+    if (create_shards_view(db, *p, schemas) < 0) {
+      log_error("create_shards_view fail for %s", *p);
+      goto fail;
+    }
+  }
+
+  utarray_free(tables);
+  utarray_free(schemas);
+  return db;
+
+fail:
+  utarray_free(tables);
+  utarray_free(schemas);
+  sqlite3_close(db);
+  return NULL;
+}
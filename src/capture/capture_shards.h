@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the capture db shards.
+ *
+ * In sharded mode every capture thread writes to the shard db selected by
+ * the hash of its interface name, so the capture threads of different VLAN
+ * interfaces don't contend on the same sqlite3 file lock. The shards are read
+ * back through a set of views that union the tables of all the shards.
+ */
+
+#ifndef CAPTURE_SHARDS_H
+#define CAPTURE_SHARDS_H
+
+#include <stdint.h>
+#include <sqlite3.h>
+
+/**
+ * @brief Returns the shard index of a capture interface
+ *
+ * @param ifname The capture interface
+ * @param shards The number of shards
+ * @return uint32_t The shard index, 0 if shards is 0
+ */
+uint32_t get_capture_shard(const char *ifname, uint32_t shards);
+
+/**
+ * @brief Returns the path of a capture db shard, i.e. "<db_path>.<shard>"
+ *
+ * @param db_path The capture db path
+ * @param shard The shard index
+ * @param[out] shard_path The shard db path (MAX_OS_PATH_LEN bytes)
+ * @return int 0 on success, -1 on failure
+ */
+int get_capture_shard_path(const char *db_path, uint32_t shard,
+                           char *shard_path);
+
+/**
+ * @brief Opens a read view over all the capture db shards
+ *
+ * The existing shards are attached to an in-memory db, which has a temporary
+ * view for every table that unions the table rows of all the shards. The
+ * number of shards is bounded by the SQLITE_LIMIT_ATTACHED limit.
+ *
+ * @param db_path The capture db path
+ * @param shards The number of shards
+ * @return sqlite3* The sqlite3 db with the views, NULL on failure.
+ * You must close this using sqlite3_close().
+ */
+sqlite3 *open_capture_shards(const char *db_path, uint32_t shards);
+
+#endif
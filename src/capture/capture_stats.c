@@ -0,0 +1,199 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the capture statistics.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+#include "../utils/os.h"
+
+#include "capture_stats.h"
+
+// The writer threads record into the sink stats of their capture thread
+static _Thread_local struct capture_sink_stats *thread_sink = NULL;
+
+void set_capture_sink_stats(struct capture_sink_stats *sink) {
+  thread_sink = sink;
+}
+
+struct capture_sink_stats *get_capture_sink_stats(void) { return thread_sink; }
+
+size_t get_capture_latency_bucket(uint64_t latency) {
+  size_t bucket = 0;
+  uint64_t bound = CAPTURE_STATS_LATENCY_BASE;
+
+  while (latency >= bound && bucket < CAPTURE_STATS_LATENCY_BUCKETS - 1) {
+    bound <<= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+void record_capture_commit(uint64_t latency) {
+  if (thread_sink == NULL) {
+    return;
+  }
+
+  atomic_fetch_add_explicit(&thread_sink->commits, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(
+      &thread_sink->latency[get_capture_latency_bucket(latency)], 1,
+      memory_order_relaxed);
+}
+
+void record_capture_bytes(uint64_t bytes) {
+  if (thread_sink != NULL) {
+    atomic_fetch_add_explicit(&thread_sink->bytes, bytes,
+                              memory_order_relaxed);
+  }
+}
+
+void load_capture_sink_stats(struct capture_sink_stats *sink,
+                             struct capture_stats *stats) {
+  stats->commits = atomic_load_explicit(&sink->commits, memory_order_relaxed);
+  for (size_t idx = 0; idx < CAPTURE_STATS_LATENCY_BUCKETS; idx++) {
+    stats->latency[idx] =
+        atomic_load_explicit(&sink->latency[idx], memory_order_relaxed);
+  }
+  stats->bytes = atomic_load_explicit(&sink->bytes, memory_order_relaxed);
+}
+
+int format_capture_stats(const struct capture_stats *stats, char *buf,
+                         size_t len) {
+  int ret;
+  size_t offset;
+
+  if (stats == NULL) {
+    log_error("stats param is NULL");
+    return -1;
+  }
+
+  if (buf == NULL) {
+    log_error("buf param is NULL");
+    return -1;
+  }
+
+  ret = snprintf(buf, len,
+                 "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                 " %" PRIu64 " %" PRIu64,
+                 stats->ifname, stats->timestamp, stats->ps_recv,
+                 stats->ps_drop, stats->ps_ifdrop, stats->queue_length,
+                 stats->commits, stats->bytes);
+
+  for (size_t idx = 0; idx < CAPTURE_STATS_LATENCY_BUCKETS; idx++) {
+    if (ret < 0 || (size_t)ret >= len) {
+      break;
+    }
+
+    offset = (size_t)ret;
+    if ((ret = snprintf(&buf[offset], len - offset, "%c%" PRIu64,
+                        (idx) ? ',' : ' ', stats->latency[idx])) >= 0) {
+      ret += (int)offset;
+    }
+  }
+
+  if (ret < 0 || (size_t)ret >= len) {
+    log_error("Capture stats line too long");
+    return -1;
+  }
+
+  return ret;
+}
+
+void free_capture_stats_registry(struct capture_stats_registry *registry) {
+  if (registry != NULL) {
+    pthread_mutex_destroy(&registry->mtx);
+    if (registry->stats != NULL) {
+      utarray_free(registry->stats);
+    }
+    os_free(registry);
+  }
+}
+
+struct capture_stats_registry *init_capture_stats_registry(void) {
+  struct capture_stats_registry *registry = NULL;
+
+  if ((registry = os_zalloc(sizeof(struct capture_stats_registry))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  if ((errno = pthread_mutex_init(&registry->mtx, NULL)) != 0) {
+    log_errno("pthread_mutex_init");
+    os_free(registry);
+    return NULL;
+  }
+
+  utarray_new(registry->stats, &capture_stats_icd);
+
+  return registry;
+}
+
+int publish_capture_stats(struct capture_stats_registry *registry,
+                          const struct capture_stats *stats) {
+  struct capture_stats *p = NULL;
+
+  if (registry == NULL) {
+    log_error("registry param is NULL");
+    return -1;
+  }
+
+  if (stats == NULL) {
+    log_error("stats param is NULL");
+    return -1;
+  }
+
+  pthread_mutex_lock(&registry->mtx);
+
+  // There is one capture thread per interface, so the array stays small
+  while ((p = (struct capture_stats *)utarray_next(registry->stats, p)) !=
+         NULL) {
+    if (strcmp(p->ifname, stats->ifname) == 0) {
+      *p = *stats;
+      break;
+    }
+  }
+
+  if (p == NULL) {
+    utarray_push_back(registry->stats, stats);
+  }
+
+  pthread_mutex_unlock(&registry->mtx);
+  return 0;
+}
+
+int get_capture_stats(struct capture_stats_registry *registry,
+                      UT_array *stats_arr) {
+  struct capture_stats *p = NULL;
+  int count = 0;
+
+  if (registry == NULL) {
+    log_error("registry param is NULL");
+    return -1;
+  }
+
+  if (stats_arr == NULL) {
+    log_error("stats_arr param is NULL");
+    return -1;
+  }
+
+  pthread_mutex_lock(&registry->mtx);
+  while ((p = (struct capture_stats *)utarray_next(registry->stats, p)) !=
+         NULL) {
+    utarray_push_back(stats_arr, p);
+    count++;
+  }
+  pthread_mutex_unlock(&registry->mtx);
+
+  return count;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the capture statistics.
+ *
+ * Every capture thread periodically collects the kernel drop counters of its
+ * interface, the middleware queue lengths and the sink statistics (sqlite3
+ * commit latencies and bytes written) and publishes a snapshot to the
+ * statistics registry shared with the supervisor.
+ */
+
+#ifndef CAPTURE_STATS_H
+#define CAPTURE_STATS_H
+
+#include <net/if.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utarray.h>
+
+#include "../utils/attributes.h"
+
+#define CAPTURE_STATS_INTERVAL 10 // Statistics collector period in seconds
+
+#define CAPTURE_STATS_LATENCY_BUCKETS 16 // Number of commit latency buckets
+#define CAPTURE_STATS_LATENCY_BASE                                             \
+  64 // Upper bound in microseconds of the first commit latency bucket
+
+#define MAX_CAPTURE_STATS_LINE_LEN 512 // Maximum formatted statistics length
+
+/**
+ * @brief Sink statistics, updated by the capture and writer threads
+ *
+ * The commit latency bucket 0 counts the commits faster than
+ * CAPTURE_STATS_LATENCY_BASE microseconds, bucket i counts the commits in
+ * [CAPTURE_STATS_LATENCY_BASE << (i - 1), CAPTURE_STATS_LATENCY_BASE << i)
+ * and the last bucket counts all the slower ones.
+ */
+struct capture_sink_stats {
+  _Atomic uint64_t commits; /**< Number of sqlite3 commits */
+  _Atomic uint64_t latency[CAPTURE_STATS_LATENCY_BUCKETS]; /**< Commit latency
+                                                              histogram */
+  _Atomic uint64_t bytes; /**< Number of bytes written by the sinks */
+};
+
+/**
+ * @brief Capture statistics snapshot of an interface
+ *
+ */
+struct capture_stats {
+  char ifname[IF_NAMESIZE]; /**< The capture interface */
+  uint64_t timestamp;       /**< The snapshot timestamp in microseconds */
+  uint64_t ps_recv;         /**< Number of packets received */
+  uint64_t ps_drop;         /**< Number of packets dropped by the kernel */
+  uint64_t ps_ifdrop;       /**< Number of packets dropped by the interface */
+  uint64_t queue_length;    /**< Number of packets waiting in the middlewares */
+  uint64_t commits;         /**< Number of sqlite3 commits */
+  uint64_t latency[CAPTURE_STATS_LATENCY_BUCKETS]; /**< Commit latency
+                                                      histogram */
+  uint64_t bytes; /**< Number of bytes written by the sinks */
+};
+
+/** @brief Capture stats UT_array definition */
+static const UT_icd capture_stats_icd = {sizeof(struct capture_stats), NULL,
+                                         NULL, NULL};
+
+/**
+ * @brief The statistics registry shared by the capture threads and the
+ * supervisor
+ *
+ */
+struct capture_stats_registry {
+  pthread_mutex_t mtx; /**< Protects the stats array */
+  UT_array *stats;     /**< The latest snapshot of every interface */
+};
+
+/**
+ * @brief Sets the sink statistics updated by the calling thread
+ *
+ * @param sink The sink statistics, NULL to stop recording
+ */
+void set_capture_sink_stats(struct capture_sink_stats *sink);
+
+/**
+ * @brief Returns the sink statistics updated by the calling thread
+ *
+ * @return struct capture_sink_stats* The sink statistics, NULL if not set
+ */
+struct capture_sink_stats *get_capture_sink_stats(void);
+
+/**
+ * @brief Records a sqlite3 commit of the calling thread
+ *
+ * Does nothing if the thread has no sink statistics.
+ *
+ * @param latency The commit latency in microseconds
+ */
+void record_capture_commit(uint64_t latency);
+
+/**
+ * @brief Records the bytes written by a sink of the calling thread
+ *
+ * Does nothing if the thread has no sink statistics.
+ *
+ * @param bytes The number of bytes written
+ */
+void record_capture_bytes(uint64_t bytes);
+
+/**
+ * @brief Returns the latency histogram bucket of a commit
+ *
+ * @param latency The commit latency in microseconds
+ * @return size_t The bucket index
+ */
+size_t get_capture_latency_bucket(uint64_t latency);
+
+/**
+ * @brief Copies the sink statistics to a statistics snapshot
+ *
+ * @param sink The sink statistics
+ * @param[out] stats The statistics snapshot
+ */
+void load_capture_sink_stats(struct capture_sink_stats *sink,
+                             struct capture_stats *stats);
+
+/**
+ * @brief Formats a statistics snapshot as a single text line
+ *
+ * The line has the format "ifname timestamp recv drop ifdrop queue commits
+ * bytes h0,h1,...", where h0,h1,... is the commit latency histogram.
+ *
+ * @param stats The statistics snapshot
+ * @param[out] buf The output buffer
+ * @param len The output buffer length
+ * @return int The line length on success, -1 on failure
+ */
+int format_capture_stats(const struct capture_stats *stats, char *buf,
+                         size_t len);
+
+/**
+ * @brief Frees the statistics registry
+ *
+ * @param registry The statistics registry
+ */
+void free_capture_stats_registry(struct capture_stats_registry *registry);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be
+ * free_capture_stats_registry()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_capture_stats_registry                                     \
+  __attribute__((malloc(free_capture_stats_registry, 1))) __must_check
+#else
+#define __must_free_capture_stats_registry __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises the statistics registry
+ *
+ * @return struct capture_stats_registry* The statistics registry, NULL on
+ * failure. You must free this using free_capture_stats_registry().
+ */
+__must_free_capture_stats_registry struct capture_stats_registry *
+init_capture_stats_registry(void);
+
+/**
+ * @brief Publishes the statistics snapshot of an interface
+ *
+ * Replaces the previous snapshot of the same interface.
+ *
+ * @param registry The statistics registry
+ * @param stats The statistics snapshot
+ * @return int 0 on success, -1 on failure
+ */
+int publish_capture_stats(struct capture_stats_registry *registry,
+                          const struct capture_stats *stats);
+
+/**
+ * @brief Copies the latest snapshots of all the interfaces
+ *
+ * @param registry The statistics registry
+ * @param stats_arr The array of struct capture_stats to append to
+ * @return int The number of copied snapshots, -1 on failure
+ */
+int get_capture_stats(struct capture_stats_registry *registry,
+                      UT_array *stats_arr);
+
+#endif
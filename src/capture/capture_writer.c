@@ -0,0 +1,439 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the capture writer threads.
+ */
+
+#define _GNU_SOURCE /* To get defns of pthread_attr_setaffinity_np */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pcap.h>
+#include <sqlite3.h>
+#include <unistd.h>
+
+#include <eloop.h>
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+#include "../utils/os.h"
+#include "../utils/ring_buffer.h"
+
+#include "capture_service.h"
+#include "capture_writer.h"
+
+static void release_writer_packet(struct writer_packet *cp) {
+  if (atomic_fetch_sub_explicit(&cp->refcount, 1, memory_order_acq_rel) == 1) {
+    os_free(cp);
+  }
+}
+
+static bool is_same_ltype(const char *ltype, const char *other) {
+  if (ltype == other) {
+    return true;
+  }
+
+  return ltype != NULL && other != NULL && strcmp(ltype, other) == 0;
+}
+
+static void drain_capture_writer_batch(struct capture_writer *writer) {
+  struct writer_packet *cps[WRITER_BATCH_SIZE];
+  struct middleware_packet packets[WRITER_BATCH_SIZE];
+  struct middleware_handlers *handler = writer->handler;
+  // The first packet of the next batch, popped with a different link type
+  struct writer_packet *next = NULL;
+  size_t count;
+
+  do {
+    // A batch holds packets of a single link type
+    for (count = 0; count < WRITER_BATCH_SIZE; count++) {
+      if (next != NULL) {
+        cps[count] = next;
+        next = NULL;
+      } else if ((cps[count] = (struct writer_packet *)pop_ring_buffer(
+                      writer->ring)) == NULL) {
+        break;
+      }
+
+      if (count && !is_same_ltype(cps[0]->ltype, cps[count]->ltype)) {
+        next = cps[count];
+        break;
+      }
+
+      packets[count].header = cps[count]->header;
+      packets[count].packet = cps[count]->packet;
+    }
+
+    if (count &&
+        process_middleware_batch(handler, cps[0]->ltype, packets, count,
+                                 writer->ifname) < 0) {
+      log_error("%s process_batch fail", handler->f.name);
+    }
+
+    for (size_t idx = 0; idx < count; idx++) {
+      release_writer_packet(cps[idx]);
+    }
+    atomic_fetch_add_explicit(&writer->processed, count, memory_order_relaxed);
+  } while (count == WRITER_BATCH_SIZE || next != NULL);
+}
+
+static void drain_capture_writer(struct capture_writer *writer) {
+  struct writer_packet *cp;
+  struct middleware_handlers *handler = writer->handler;
+
+  if (handler->f.process_batch != NULL) {
+    drain_capture_writer_batch(writer);
+    return;
+  }
+
+  while ((cp = (struct writer_packet *)pop_ring_buffer(writer->ring)) !=
+         NULL) {
+    if (handler->f.process(handler->context, cp->ltype, &cp->header,
+                           cp->packet, writer->ifname) < 0) {
+      log_error("%s process fail", handler->f.name);
+    }
+
+    release_writer_packet(cp);
+    atomic_fetch_add_explicit(&writer->processed, 1, memory_order_relaxed);
+  }
+}
+
+static void eloop_tout_writer_handler(void *eloop_ctx, void *user_ctx) {
+  (void)eloop_ctx;
+
+  struct capture_writer *writer = (struct capture_writer *)user_ctx;
+  // Read the flag before draining, so all the packets pushed before the stop
+  // are processed
+  bool stop = atomic_load(&writer->stop);
+
+  drain_capture_writer(writer);
+
+  if (stop) {
+    edge_eloop_terminate(writer->eloop);
+    return;
+  }
+
+  if (edge_eloop_register_timeout(writer->eloop, 0, WRITER_PROCESS_INTERVAL,
+                                  eloop_tout_writer_handler, NULL,
+                                  (void *)writer) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
+static void *capture_writer_thread(void *arg) {
+  struct capture_writer *writer = (struct capture_writer *)arg;
+
+  log_debug("Running writer thread for %s", writer->handler->f.name);
+  set_capture_sink_stats(writer->sink);
+  edge_eloop_run(writer->eloop);
+  log_debug("Writer thread for %s ended", writer->handler->f.name);
+
+  return NULL;
+}
+
+static void free_capture_writer(struct capture_writer *writer) {
+  struct writer_packet *cp;
+
+  if (writer->running) {
+    atomic_store(&writer->stop, true);
+    if (pthread_join(writer->id, NULL) != 0) {
+      log_errno("pthread_join");
+    }
+    writer->running = false;
+
+    log_info("%s writer: pushed=%" PRIu64 " dropped=%" PRIu64
+             " processed=%" PRIu64,
+             writer->handler->f.name, atomic_load(&writer->pushed),
+             atomic_load(&writer->dropped), atomic_load(&writer->processed));
+  }
+
+  // Free the middleware before closing its sqlite3 connection
+  if (writer->handler != NULL) {
+    writer->handler->f.free(writer->handler->context);
+    writer->handler->context = NULL;
+  }
+
+  if (writer->ring != NULL) {
+    while ((cp = (struct writer_packet *)pop_ring_buffer(writer->ring)) !=
+           NULL) {
+      release_writer_packet(cp);
+    }
+    free_ring_buffer(writer->ring);
+  }
+
+  edge_eloop_free(writer->eloop);
+  sqlite3_close(writer->db);
+}
+
+/**
+ * Private implementation of free_capture_writers(), without its compiler
+ * attributes, so init_capture_writers() can call it on failure.
+ */
+static void __free_capture_writers(struct capture_writers *writers) {
+  if (writers != NULL) {
+    for (size_t idx = 0; idx < writers->count; idx++) {
+      free_capture_writer(&writers->writers[idx]);
+    }
+    os_free(writers->writers);
+    os_free(writers);
+  }
+}
+
+void free_capture_writers(struct capture_writers *writers) {
+  __free_capture_writers(writers);
+}
+
+/**
+ * The capture thread may be pinned to a single core, which the threads it
+ * starts inherit. The writer threads get the affinity of the main thread
+ * instead, so they don't compete with the capture thread for its core.
+ */
+static int start_capture_writer_thread(struct capture_writer *writer,
+                                       bool reset_affinity) {
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+  int ret;
+
+  if ((errno = pthread_attr_init(&attr)) != 0) {
+    log_errno("pthread_attr_init");
+    return -1;
+  }
+
+  if (reset_affinity) {
+    if (sched_getaffinity(getpid(), sizeof(cpus), &cpus) < 0) {
+      log_errno("sched_getaffinity");
+      pthread_attr_destroy(&attr);
+      return -1;
+    }
+
+    if ((errno = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus)) !=
+        0) {
+      log_errno("pthread_attr_setaffinity_np");
+      pthread_attr_destroy(&attr);
+      return -1;
+    }
+  }
+
+  ret = pthread_create(&writer->id, &attr, capture_writer_thread,
+                       (void *)writer);
+  pthread_attr_destroy(&attr);
+
+  if (ret != 0) {
+    errno = ret;
+    log_errno("pthread_create");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int init_capture_writer(struct capture_writer *writer,
+                               struct middleware_handlers *handler,
+                               struct capture_conf *config,
+                               struct pcap_context *pc, char *ifname) {
+  writer->handler = handler;
+  writer->ifname = ifname;
+  writer->sink = get_capture_sink_stats();
+  atomic_init(&writer->stop, false);
+  atomic_init(&writer->pushed, 0);
+  atomic_init(&writer->dropped, 0);
+  atomic_init(&writer->processed, 0);
+
+  if ((writer->ring = init_ring_buffer(config->writer_ring_size)) == NULL) {
+    log_error("init_ring_buffer fail");
+    return -1;
+  }
+
+  if ((writer->eloop = edge_eloop_init()) == NULL) {
+    log_error("edge_eloop_init fail");
+    return -1;
+  }
+
+  if (sqlite3_open(config->capture_db_path, &writer->db) != SQLITE_OK) {
+    log_error("Cannot open database: %s", sqlite3_errmsg(writer->db));
+    return -1;
+  }
+
+  sqlite3_busy_timeout(writer->db, DB_BUSY_TIMEOUT);
+
+  log_trace("Initialising capture middleware: %s", handler->f.name);
+  handler->context =
+      handler->f.init(writer->db, config->capture_db_path, writer->eloop, pc,
+                      config->middleware_params, config);
+  if (handler->context == NULL) {
+    log_error("handle init error");
+    return -1;
+  }
+
+  if (edge_eloop_register_timeout(writer->eloop, 0, WRITER_PROCESS_INTERVAL,
+                                  eloop_tout_writer_handler, NULL,
+                                  (void *)writer) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+    return -1;
+  }
+
+  if (start_capture_writer_thread(writer, config->pin_threads) < 0) {
+    log_error("start_capture_writer_thread fail");
+    return -1;
+  }
+
+  writer->running = true;
+  return 0;
+}
+
+struct capture_writers *init_capture_writers(UT_array *handlers,
+                                             struct capture_conf *config,
+                                             struct pcap_context *pc,
+                                             char *ifname) {
+  struct capture_writers *writers = NULL;
+  struct middleware_handlers *handler = NULL;
+
+  if (handlers == NULL) {
+    log_error("handlers param is NULL");
+    return NULL;
+  }
+
+  if (config == NULL) {
+    log_error("config param is NULL");
+    return NULL;
+  }
+
+  if ((writers = os_zalloc(sizeof(struct capture_writers))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  writers->backpressure = config->writer_backpressure;
+
+  if (utarray_len(handlers)) {
+    writers->writers =
+        os_calloc(utarray_len(handlers), sizeof(struct capture_writer));
+    if (writers->writers == NULL) {
+      log_errno("os_calloc");
+      __free_capture_writers(writers);
+      return NULL;
+    }
+  }
+
+  while ((handler =
+              (struct middleware_handlers *)utarray_next(handlers, handler))) {
+    // Count the writer first, so a partially initialised writer is freed
+    struct capture_writer *writer = &writers->writers[writers->count++];
+    if (init_capture_writer(writer, handler, config, pc, ifname) < 0) {
+      log_error("init_capture_writer fail for %s", handler->f.name);
+      __free_capture_writers(writers);
+      return NULL;
+    }
+  }
+
+  return writers;
+}
+
+static void push_capture_writer(struct capture_writer *writer,
+                                enum WRITER_BACKPRESSURE backpressure,
+                                struct writer_packet *cp) {
+  struct writer_packet *evicted;
+
+  switch (backpressure) {
+    case WRITER_DROP_OLDEST:
+      evicted = push_overwrite_ring_buffer(writer->ring, (void *)cp);
+      if (evicted != NULL) {
+        release_writer_packet(evicted);
+        atomic_fetch_add_explicit(&writer->dropped, 1, memory_order_relaxed);
+      }
+      break;
+    case WRITER_BLOCK:
+      while (push_ring_buffer(writer->ring, (void *)cp) < 0) {
+        sched_yield();
+      }
+      break;
+    case WRITER_DROP_NEWEST:
+    default:
+      if (push_ring_buffer(writer->ring, (void *)cp) < 0) {
+        release_writer_packet(cp);
+        atomic_fetch_add_explicit(&writer->dropped, 1, memory_order_relaxed);
+        return;
+      }
+  }
+
+  atomic_fetch_add_explicit(&writer->pushed, 1, memory_order_relaxed);
+}
+
+int dispatch_capture_writers(struct capture_writers *writers, char *ltype,
+                             struct pcap_pkthdr *header, uint8_t *packet) {
+  struct writer_packet *cp = NULL;
+
+  if (writers == NULL) {
+    log_error("writers param is NULL");
+    return -1;
+  }
+
+  if (header == NULL) {
+    log_error("header param is NULL");
+    return -1;
+  }
+
+  if (packet == NULL) {
+    log_error("packet param is NULL");
+    return -1;
+  }
+
+  if (!writers->count) {
+    return 0;
+  }
+
+  // One copy of the packet is shared by all the writers
+  if ((cp = os_malloc(sizeof(struct writer_packet) + header->caplen)) ==
+      NULL) {
+    log_errno("os_malloc");
+    return -1;
+  }
+
+  atomic_init(&cp->refcount, (unsigned int)writers->count);
+  cp->ltype = ltype;
+  cp->header = *header;
+  os_memcpy(cp->packet, packet, header->caplen);
+
+  for (size_t idx = 0; idx < writers->count; idx++) {
+    push_capture_writer(&writers->writers[idx], writers->backpressure, cp);
+  }
+
+  return 0;
+}
+
+int get_capture_writer_stats(struct capture_writers *writers, size_t idx,
+                             struct capture_writer_stats *stats) {
+  struct capture_writer *writer;
+
+  if (writers == NULL) {
+    log_error("writers param is NULL");
+    return -1;
+  }
+
+  if (stats == NULL) {
+    log_error("stats param is NULL");
+    return -1;
+  }
+
+  if (idx >= writers->count) {
+    log_error("Invalid writer index %zu", idx);
+    return -1;
+  }
+
+  writer = &writers->writers[idx];
+  stats->pushed = atomic_load(&writer->pushed);
+  stats->dropped = atomic_load(&writer->dropped);
+  stats->processed = atomic_load(&writer->processed);
+  stats->length = get_ring_buffer_length(writer->ring);
+
+  return 0;
+}
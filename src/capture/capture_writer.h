@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the capture writer threads.
+ *
+ * In writer thread mode every middleware runs in its own thread with its own
+ * eloop and sqlite3 connection. The capture thread copies every captured
+ * packet once and pushes it to the ring buffer of each middleware, so a slow
+ * middleware (for example a long sqlite3 commit) doesn't stall the packet
+ * capture.
+ */
+
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pcap.h>
+#include <sqlite3.h>
+
+#include <eloop.h>
+#include <utarray.h>
+
+#include "../utils/attributes.h"
+#include "../utils/ring_buffer.h"
+
+#include "capture_config.h"
+#include "capture_stats.h"
+#include "middlewares_list.h"
+#include "pcap_service.h"
+
+#define WRITER_PROCESS_INTERVAL 1000 // In microseconds
+#define WRITER_BATCH_SIZE 64 // Maximum number of packets in a writer batch
+
+/**
+ * @brief Captured packet shared by all the writer threads
+ *
+ */
+struct writer_packet {
+  atomic_uint refcount;      /**< Number of writers still using the packet */
+  char *ltype;               /**< The packet link type */
+  struct pcap_pkthdr header; /**< The pcap header */
+  uint8_t packet[];          /**< The packet data (header.caplen bytes) */
+};
+
+/**
+ * @brief Middleware writer thread structure definition
+ *
+ */
+struct capture_writer {
+  struct middleware_handlers *handler; /**< The middleware run by the thread */
+  struct ring_buffer *ring; /**< The packets ring (capture -> writer) */
+  struct eloop_data *eloop; /**< The writer thread eloop */
+  sqlite3 *db;              /**< The writer thread sqlite3 connection */
+  char *ifname;             /**< The capture interface */
+  pthread_t id;             /**< The writer thread id */
+  bool running;             /**< True if the writer thread was started */
+  atomic_bool stop;         /**< Set to stop the writer thread */
+  _Atomic uint64_t pushed;  /**< Number of packets pushed to the ring */
+  _Atomic uint64_t dropped; /**< Number of packets dropped */
+  _Atomic uint64_t processed; /**< Number of packets processed */
+  struct capture_sink_stats *sink; /**< The capture thread sink stats */
+};
+
+/**
+ * @brief The writer threads for all the middlewares
+ *
+ */
+struct capture_writers {
+  struct capture_writer *writers;       /**< The writers array */
+  size_t count;                         /**< Number of writers */
+  enum WRITER_BACKPRESSURE backpressure; /**< The ring full policy */
+};
+
+/**
+ * @brief Middleware writer statistics
+ *
+ */
+struct capture_writer_stats {
+  uint64_t pushed;    /**< Number of packets pushed to the ring */
+  uint64_t dropped;   /**< Number of packets dropped */
+  uint64_t processed; /**< Number of packets processed */
+  size_t length;      /**< Number of packets waiting in the ring */
+};
+
+/**
+ * @brief Stops the writer threads and frees the middleware contexts
+ *
+ * The packets already in the rings are processed before the threads stop.
+ *
+ * @param writers The capture writers
+ */
+void free_capture_writers(struct capture_writers *writers);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_capture_writers()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_capture_writers                                            \
+  __attribute__((malloc(free_capture_writers, 1))) __must_check
+#else
+#define __must_free_capture_writers __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises the middlewares and starts a writer thread for each one
+ *
+ * Every middleware is initialised with the eloop and a new sqlite3 connection
+ * of its writer thread.
+ *
+ * @param handlers The list of middlewares created from assign_middlewares()
+ * @param config The capture config
+ * @param pc The pcap context
+ * @param ifname The capture interface
+ * @return struct capture_writers* The capture writers, NULL on failure.
+ * You must free this using free_capture_writers().
+ */
+__must_free_capture_writers struct capture_writers *
+init_capture_writers(UT_array *handlers, struct capture_conf *config,
+                     struct pcap_context *pc, char *ifname);
+
+/**
+ * @brief Copies a captured packet and pushes it to all the writer threads
+ *
+ * When a ring is full the packet is handled with the configured
+ * backpressure policy.
+ *
+ * @param writers The capture writers
+ * @param ltype The packet link type
+ * @param header The pcap header
+ * @param packet The pcap packet
+ * @return int 0 on success, -1 on failure
+ */
+int dispatch_capture_writers(struct capture_writers *writers, char *ltype,
+                             struct pcap_pkthdr *header, uint8_t *packet);
+
+/**
+ * @brief Returns the statistics of a writer thread
+ *
+ * @param writers The capture writers
+ * @param idx The writer index
+ * @param[out] stats The writer statistics
+ * @return int 0 on success, -1 on failure
+ */
+int get_capture_writer_stats(struct capture_writers *writers, size_t idx,
+                             struct capture_writer_stats *stats);
+
+#endif
@@ -12,12 +12,30 @@
 #ifndef MIDDLEWARE_H
 #define MIDDLEWARE_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <sqlite3.h>
 
 #include <eloop.h>
+#include "./capture_config.h"
 #include "./pcap_service.h"
 
+#define MIDDLEWARE_SNAPLEN_FULL 0 // The middleware uses the full packets
+// Covers a 576 byte IPv4 datagram behind the ethernet and VLAN headers, the
+// default size limit of DHCP and of DNS/mDNS without EDNS, and a 512 byte DNS
+// message behind the IPv6 and UDP headers
+#define MIDDLEWARE_SNAPLEN_HEADERS 640
+
+/**
+ * @brief A captured packet of a middleware batch
+ *
+ */
+struct middleware_packet {
+  struct pcap_pkthdr header; /**< The pcap packet header */
+  uint8_t *packet;           /**< The pcap packet data */
+};
+
 // params is a pointer to an already allocated string
 struct middleware_context {
   sqlite3 *db;
@@ -47,12 +65,14 @@ struct capture_middleware {
    * @param eloop The eloop structure
    * @param pc The pcap context
    * @param params The middleware params
+   * @param config The capture config, for the middleware specific keys
    * @return The middleware context on success, NULL on failure
    */
   struct middleware_context *(*const init)(sqlite3 *db, char *db_path,
                                            struct eloop_data *eloop,
                                            struct pcap_context *pc,
-                                           char *params);
+                                           char *params,
+                                           const struct capture_conf *config);
 
   /**
    * @brief Runs the middleware.
@@ -82,5 +102,49 @@ struct capture_middleware {
    * Human readable name for this middleware. Currently only used for logs.
    */
   const char *const name;
+
+  /**
+   * @brief Runs the middleware for a batch of packets (optional).
+   *
+   * The batch holds the packets read by a single pcap_dispatch() call, so a
+   * middleware can amortise its queue, sqlite3 transaction or pipe costs
+   * over the batch. The packets are only valid until the function returns.
+   * If NULL, process() is called for every packet of the batch.
+   *
+   * @param context The middleware context
+   * @param ltype The packet type
+   * @param packets The array of packets
+   * @param count The number of packets in the array
+   * @param ifname The capture interface
+   * @retval 0 on success
+   * @retval -1 on failure
+   */
+  int (*const process_batch)(struct middleware_context *context,
+                             const char *ltype,
+                             struct middleware_packet *packets, size_t count,
+                             char *ifname);
+
+  /**
+   * @brief Returns the number of packets waiting in the middleware queue
+   * (optional).
+   *
+   * Used by the capture statistics collector. If NULL, the middleware is
+   * assumed to have no queue.
+   *
+   * @param context The middleware context
+   * @return ssize_t The queue length, -1 on failure
+   */
+  ssize_t (*const queue_length)(struct middleware_context *context);
+
+  /**
+   * @brief The number of bytes of every packet used by the middleware
+   * (optional).
+   *
+   * The capture snapshot length is the largest snaplen of the middlewares,
+   * so the kernel does not copy the bytes no middleware uses. The packets
+   * can be truncated to this length. If 0 (MIDDLEWARE_SNAPLEN_FULL), the
+   * middleware uses the full packets.
+   */
+  const uint32_t snaplen;
 };
 #endif
@@ -8,17 +8,19 @@
  * @brief File containing the implementation of the capture cleaner service
  * structures.
  *
- * Defines the start function for the capturte cleaner service, which
- * removes the capture files from the database folder when it
- * reaches a given size specified in the capture_conf structure. The
- * store size is give by the parameter CLEANER_STORE_SIZE in Kb.
+ * Every tick the cleaner reads the running byte counter of its interface,
+ * kept by the pcap db triggers, and evicts the oldest pcap segments until
+ * the interface is within its size and age quotas. At most
+ * CLEANER_EVICT_LIMIT segments are evicted per tick, so the work per tick
+ * doesn't grow with the size of the pcap table.
  */
 
 #include "./cleaner_middleware.h"
 
+#include <errno.h>
 #include <libgen.h>
+#include <net/if.h>
 #include <sqlite3.h>
-#include <utarray.h>
 
 #include "../../capture_config.h"
 #include "../../capture_service.h"
@@ -26,126 +28,110 @@
 
 #include "../../../utils/allocs.h"
 #include "../../../utils/os.h"
+#include "../../../utils/sqliteu.h"
 
 #include <eloop.h>
 
 #define CLEANER_PROCESS_INTERVAL                                               \
   5 /* Frequency in sec to run the cleaner function*/
-#define CLEANER_GROUP_INTERVAL                                                 \
-  1024 /* Number of rows to sum from the pcap metadata to calculate the store  \
-          size*/
-
-#define CLEANER_STORE_SIZE 1000 /*Specifies the capture store size in KiB */
-
-static const UT_icd pcap_file_meta_icd = {sizeof(struct pcap_file_meta), NULL,
-                                          NULL, NULL};
+#define CLEANER_EVICT_LIMIT                                                    \
+  16 /* Maximum number of segments evicted in a single run */
 
 struct cleaner_middleware_context {
   char pcap_path[MAX_OS_PATH_LEN];
-  uint64_t store_size;
-  uint64_t low_timestamp;
-  uint64_t store_sum;
-  uint64_t next_timestamp;
+  char ifname[IF_NAMESIZE];
 };
 
+static bool is_over_quota(struct pcap_usage *usage, struct pcap_file_meta *p,
+                          uint64_t now) {
+  if (usage->max_size && usage->size > usage->max_size) {
+    return true;
+  }
+
+  return (usage->max_age && now > p->timestamp &&
+          now - p->timestamp > usage->max_age);
+}
+
 int clean_capture(struct middleware_context *context) {
   struct cleaner_middleware_context *cleaner_context =
       (struct cleaner_middleware_context *)context->mdata;
+  struct pcap_usage usage;
+  struct pcap_file_meta p;
+  uint64_t now = 0;
+  int res = 0, evicted = 0;
+
+  if ((res = get_sqlite_pcap_usage(context->db, cleaner_context->ifname,
+                                   &usage)) != 0) {
+    return (res < 0) ? -1 : 0;
+  }
+
+  if (!usage.max_size && !usage.max_age) {
+    return 0;
+  }
 
-  struct pcap_file_meta *p = NULL;
+  os_get_timestamp(&now);
 
-  UT_array *pcap_meta_arr = NULL;
-  uint64_t timestamp = cleaner_context->low_timestamp, lt;
-  utarray_new(pcap_meta_arr, &pcap_file_meta_icd);
+  while (evicted < CLEANER_EVICT_LIMIT) {
+    if ((res = get_oldest_pcap_segment(context->db, cleaner_context->ifname,
+                                       &p)) != 0) {
+      break;
+    }
+
+    if (!is_over_quota(&usage, &p, now)) {
+      os_free(p.name);
+      break;
+    }
 
-  while (timestamp <= cleaner_context->next_timestamp) {
-    lt = timestamp;
-    if (get_pcap_meta_array(context->db, timestamp, CLEANER_GROUP_INTERVAL,
-                            pcap_meta_arr) < 0) {
-      log_error("get_pcap_array fail");
-      utarray_free(pcap_meta_arr);
+    char *const path = construct_path(cleaner_context->pcap_path, p.name);
+    if (path == NULL) {
+      log_errno("os_malloc");
+      os_free(p.name);
       return -1;
     }
 
-    while ((p = (struct pcap_file_meta *)utarray_next(pcap_meta_arr, p)) !=
-           NULL) {
-      char *const path = construct_path(cleaner_context->pcap_path, p->name);
-      if (path == NULL) {
-        log_errno("os_malloc");
-      }
-
-      log_trace("deleting %s at timestamp=%" PRIu64, path, p->timestamp);
-      if (remove(path) < 0) {
-        log_errno("remove");
-      }
-
-      if (path != NULL) {
-        os_free(path);
-      }
-
-      if (p->name != NULL) {
-        os_free(p->name);
-      }
-      timestamp = p->timestamp;
+    log_trace("deleting %s at timestamp=%" PRIu64, path, p.timestamp);
+    if (remove(path) < 0 && errno != ENOENT) {
+      log_errno("remove");
     }
-    utarray_clear(pcap_meta_arr);
+    os_free(path);
 
-    if (delete_pcap_entries(context->db, lt, timestamp) < 0) {
-      log_error("delete_pcap_entries fail");
-      utarray_free(pcap_meta_arr);
+    // Removes the segment entries and updates the interface counter
+    res = delete_pcap_segment(context->db, p.name);
+    os_free(p.name);
+    if (res < 0) {
+      log_error("delete_pcap_segment fail");
       return -1;
     }
+
+    usage.size = (usage.size > p.size) ? usage.size - p.size : 0;
+    evicted++;
   }
 
-  utarray_free(pcap_meta_arr);
-  return 0;
+  if (evicted) {
+    log_trace("Evicted %d segments, store size=%" PRIu64 " bytes", evicted,
+              usage.size);
+  }
+
+  return (res < 0) ? -1 : 0;
 }
 
 void eloop_tout_cleaner_handler(void *eloop_ctx, void *user_ctx) {
   (void)eloop_ctx;
 
   struct middleware_context *context = (struct middleware_context *)user_ctx;
-  struct cleaner_middleware_context *cleaner_context =
-      (struct cleaner_middleware_context *)context->mdata;
-
-  int res = 0;
-  uint64_t lt, ht, sum = 0;
-  uint64_t caplen = 0;
-
-  lt = cleaner_context->next_timestamp;
 
-  if (!lt) {
-    res = get_first_pcap_entry(context->db, &lt, &caplen);
-    if (res < 0) {
-      log_error("get_first_pcap_entry fail");
-    } else if (res > 0) {
-      log_trace("No rows");
+  if (execute_sqlite_query(context->db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_warn("Failed to capture a lock on the db, ignoring.");
+  } else {
+    if (clean_capture(context) < 0) {
+      log_error("clean_capture fail");
     }
 
-    cleaner_context->low_timestamp = lt;
-    cleaner_context->store_sum = caplen;
-  }
-
-  ht = lt;
-
-  if (lt) {
-    if (sum_pcap_group(context->db, lt, CLEANER_GROUP_INTERVAL, &ht, &sum) <
-        0) {
-      log_trace("sum_pcap_group fail");
-    } else if (ht != lt) {
-      cleaner_context->store_sum += sum;
-      cleaner_context->next_timestamp = ht;
+    if (execute_sqlite_query(context->db, "COMMIT TRANSACTION") < 0) {
+      log_error("Failed to commit the cleaner changes");
     }
   }
 
-  if (cleaner_context->store_sum >= cleaner_context->store_size) {
-    log_trace("Started cleanup...");
-    clean_capture(context);
-    cleaner_context->low_timestamp = 0;
-    cleaner_context->store_sum = 0;
-    cleaner_context->next_timestamp = 0;
-  }
-
   if (edge_eloop_register_timeout(context->eloop, CLEANER_PROCESS_INTERVAL, 0,
                                   eloop_tout_cleaner_handler, NULL,
                                   (void *)user_ctx) == -1) {
@@ -166,10 +152,12 @@ void free_cleaner_middleware(struct middleware_context *context) {
   }
 }
 
-struct middleware_context *init_cleaner_middleware(sqlite3 *db, char *db_path,
-                                                   struct eloop_data *eloop,
-                                                   struct pcap_context *pc,
-                                                   char *params) {
+struct middleware_context *
+init_cleaner_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                        struct pcap_context *pc, char *params,
+                        const struct capture_conf *config) {
+  (void)config;
+
   log_info("Init cleaner middleware...");
 
   if (db == NULL) {
@@ -187,6 +175,11 @@ struct middleware_context *init_cleaner_middleware(sqlite3 *db, char *db_path,
     return NULL;
   }
 
+  if (pc == NULL) {
+    log_error("pc param is NULL");
+    return NULL;
+  }
+
   struct middleware_context *context =
       os_zalloc(sizeof(struct middleware_context));
 
@@ -215,13 +208,18 @@ struct middleware_context *init_cleaner_middleware(sqlite3 *db, char *db_path,
     return NULL;
   }
 
-  // Transform to bytes
-  cleaner_context->store_size = (uint64_t)(CLEANER_STORE_SIZE)*1024;
+  os_strlcpy(cleaner_context->ifname, pc->ifname, IF_NAMESIZE);
+
+  // The counters of the interface are kept by the pcap db triggers
+  if (init_sqlite_pcap_db(db) < 0) {
+    log_error("init_sqlite_pcap_db fail");
+    free_cleaner_middleware(context);
+    return NULL;
+  }
 
   log_info("Cleaning db_path=%s", db_path);
   log_info("Cleaning pcap_path=%s", cleaner_context->pcap_path);
-  log_info("Cleaning store_size=%" PRIu64 " bytes",
-           cleaner_context->store_size);
+  log_info("Cleaning ifname=%s", cleaner_context->ifname);
 
   if (edge_eloop_register_timeout(eloop, CLEANER_PROCESS_INTERVAL, 0,
                                   eloop_tout_cleaner_handler, NULL,
@@ -251,4 +249,6 @@ struct capture_middleware cleaner_middleware = {
     .process = process_cleaner_middleware,
     .free = free_cleaner_middleware,
     .name = "cleaner middleware",
+    // The packets are not used, so the snapshot length is not raised
+    .snaplen = MIDDLEWARE_SNAPLEN_HEADERS,
 };
@@ -16,7 +16,9 @@
 /**
  * @brief Cleaner Middleware.
  * The cleaner middleware is designed to periodically remove the oldest
- * PCAP files when the use more than `CLEANER_STORE_SIZE` KiB.
+ * PCAP files of an interface when they exceed the size or age quotas of the
+ * interface (see the `cleanerStoreSize`, `cleanerStoreAge` and
+ * `cleanerQuotas` capture config keys).
  * @authors Alexandru Mereacre, Alois Klink
  */
 extern struct capture_middleware cleaner_middleware;
@@ -0,0 +1,259 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the column middleware
+ * utilities.
+ */
+
+#include <libgen.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <pcap.h>
+#include <sqlite3.h>
+
+#include <eloop.h>
+#include "../../../utils/allocs.h"
+#include "../../../utils/log.h"
+#include "../../../utils/os.h"
+
+#include "../../pcap_service.h"
+#include "../header_middleware/packet_decoder.h"
+#include "../header_middleware/packet_queue.h"
+#include "column_middleware.h"
+#include "column_store.h"
+
+#define COLUMN_SUBFOLDER_NAME                                                  \
+  "./columns" /* Subfolder name to store the column files */
+#define COLUMN_FLUSH_INTERVAL 10 // In seconds
+#define COLUMN_FILE_MAX_AGE                                                    \
+  3600ULL * 1000000 /* Maximum age in microseconds of a column file */
+#define COLUMN_DEFAULT_IFNAME "any" // The file prefix if there is no pcap ctx
+
+static const UT_icd tp_list_icd = {sizeof(struct tuple_packet), NULL, NULL,
+                                   free_packet};
+
+static int get_column_folder_path(char *capture_db_path, char *column_path) {
+  char *db_path = NULL;
+  char *full_path = NULL;
+
+  if (!os_strnlen_s(capture_db_path, MAX_OS_PATH_LEN)) {
+    log_error("capture_db_path is empty");
+    return -1;
+  }
+
+  if ((db_path = os_strdup(capture_db_path)) == NULL) {
+    log_errno("os_strdup");
+    return -1;
+  }
+
+  if ((full_path = construct_path(dirname(db_path), COLUMN_SUBFOLDER_NAME)) ==
+      NULL) {
+    log_error("construct_path fail");
+    os_free(db_path);
+    return -1;
+  }
+
+  os_strlcpy(column_path, full_path, MAX_OS_PATH_LEN);
+  os_free(db_path);
+  os_free(full_path);
+
+  return 0;
+}
+
+static void eloop_tout_column_handler(void *eloop_ctx, void *user_ctx) {
+  (void)eloop_ctx;
+
+  struct middleware_context *context = (struct middleware_context *)user_ctx;
+  struct column_writer *writer = (struct column_writer *)context->mdata;
+
+  // Partial blocks are written, so a reader sees at most
+  // COLUMN_FLUSH_INTERVAL seconds old data
+  if (flush_column_writer(writer) < 0) {
+    log_error("flush_column_writer fail");
+  }
+
+  if (clean_column_writer(writer) < 0) {
+    log_error("clean_column_writer fail");
+  }
+
+  if (edge_eloop_register_timeout(context->eloop, COLUMN_FLUSH_INTERVAL, 0,
+                                  eloop_tout_column_handler, NULL,
+                                  (void *)user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
+static int append_column_packets(struct column_writer *writer,
+                                 UT_array *packets) {
+  struct tuple_packet *p = NULL;
+
+  while ((p = (struct tuple_packet *)utarray_next(packets, p)) != NULL) {
+    if (append_column_writer(writer, p) < 0) {
+      log_error("append_column_writer fail");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void free_column_middleware(struct middleware_context *context) {
+  if (context != NULL) {
+    free_column_writer((struct column_writer *)context->mdata);
+    context->mdata = NULL;
+    os_free(context);
+  }
+}
+
+struct middleware_context *
+init_column_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                       struct pcap_context *pc, char *params,
+                       const struct capture_conf *config) {
+  struct middleware_context *context = NULL;
+  char column_path[MAX_OS_PATH_LEN];
+
+  log_info("Init column middleware...");
+
+  if (eloop == NULL) {
+    log_error("eloop param is NULL");
+    return NULL;
+  }
+
+  if (get_column_folder_path(db_path, column_path) < 0) {
+    log_error("get_column_folder_path fail");
+    return NULL;
+  }
+
+  if (create_dir(column_path, S_IRWXU | S_IRWXG) < 0) {
+    log_error("create_dir fail");
+    return NULL;
+  }
+
+  if ((context = os_zalloc(sizeof(struct middleware_context))) == NULL) {
+    log_errno("zalloc");
+    return NULL;
+  }
+
+  context->db = db;
+  context->eloop = eloop;
+  context->pc = pc;
+  context->params = params;
+
+  context->mdata = (void *)init_column_writer(
+      column_path, (pc != NULL) ? pc->ifname : COLUMN_DEFAULT_IFNAME,
+      COLUMN_FILE_MAX_AGE);
+  if (context->mdata == NULL) {
+    log_error("init_column_writer fail");
+    free_column_middleware(context);
+    return NULL;
+  }
+
+  struct column_writer *writer = (struct column_writer *)context->mdata;
+  uint32_t store_size = DEFAULT_COLUMN_STORE_SIZE;
+  uint32_t store_age = DEFAULT_COLUMN_STORE_AGE;
+  if (config != NULL) {
+    store_size = config->column_store_size;
+    store_age = config->column_store_age;
+  }
+  writer->store_size = (uint64_t)store_size * 1024;
+  writer->store_age = (uint64_t)store_age * 1000000;
+  log_info("Column store size=%" PRIu64 " bytes, age=%" PRIu64 " us",
+           writer->store_size, writer->store_age);
+
+  // Removes the files left over by the previous runs
+  if (clean_column_writer(writer) < 0) {
+    log_error("clean_column_writer fail");
+  }
+
+  if (edge_eloop_register_timeout(eloop, COLUMN_FLUSH_INTERVAL, 0,
+                                  eloop_tout_column_handler, NULL,
+                                  (void *)context) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+    free_column_middleware(context);
+    return NULL;
+  }
+
+  return context;
+}
+
+int process_column_middleware(struct middleware_context *context,
+                              const char *ltype, struct pcap_pkthdr *header,
+                              uint8_t *packet, char *ifname) {
+  UT_array *packets = NULL;
+
+  if (context == NULL) {
+    log_error("context param is NULL");
+    return -1;
+  }
+
+  if (context->mdata == NULL) {
+    log_error("mdata param is NULL");
+    return -1;
+  }
+
+  utarray_new(packets, &tp_list_icd);
+
+  if (extract_packets(ltype, header, packet, ifname, PACKET_DECODE_ALL,
+                      packets) < 0) {
+    log_error("extract_packets fail");
+  } else if (append_column_packets((struct column_writer *)context->mdata,
+                                   packets) < 0) {
+    log_error("append_column_packets fail");
+  }
+
+  utarray_free(packets);
+
+  return 0;
+}
+
+int process_batch_column_middleware(struct middleware_context *context,
+                                    const char *ltype,
+                                    struct middleware_packet *packets,
+                                    size_t count, char *ifname) {
+  UT_array *tp_array = NULL;
+
+  if (context == NULL) {
+    log_error("context param is NULL");
+    return -1;
+  }
+
+  if (context->mdata == NULL) {
+    log_error("mdata param is NULL");
+    return -1;
+  }
+
+  utarray_new(tp_array, &tp_list_icd);
+
+  for (size_t idx = 0; idx < count; idx++) {
+    if (extract_packets(ltype, &packets[idx].header, packets[idx].packet,
+                        ifname, PACKET_DECODE_ALL, tp_array) < 0) {
+      log_error("extract_packets fail");
+    }
+  }
+
+  if (append_column_packets((struct column_writer *)context->mdata,
+                            tp_array) < 0) {
+    log_error("append_column_packets fail");
+  }
+
+  utarray_free(tp_array);
+
+  return 0;
+}
+
+struct capture_middleware column_middleware = {
+    .init = init_column_middleware,
+    .process = process_column_middleware,
+    .free = free_column_middleware,
+    .name = "column middleware",
+    .process_batch = process_batch_column_middleware,
+    .snaplen = MIDDLEWARE_SNAPLEN_HEADERS,
+};
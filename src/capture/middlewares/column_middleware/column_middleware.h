@@ -0,0 +1,27 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the column middleware utilities.
+ */
+
+#ifndef COLUMN_MIDDLEWARE_H
+#define COLUMN_MIDDLEWARE_H
+
+#include "../../middleware.h"
+
+/**
+ * @brief Column Capture Middleware.
+ * The column capture middleware appends the decoded packet headers to
+ * columnar files (see column_store.h) in the `columns` folder next to the
+ * capture db, for bulk analytics that would be too slow in sqlite. The files
+ * of an interface are removed when older than the `columnStoreAge` seconds
+ * or larger in total than the `columnStoreSize` KiB keys of the `[capture]`
+ * config section (0 disables a limit).
+ * @authors Alexandru Mereacre
+ */
+extern struct capture_middleware column_middleware;
+#endif
@@ -0,0 +1,1021 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the columnar packet store.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../../utils/allocs.h"
+#include "../../../utils/hash.h"
+#include "../../../utils/log.h"
+#include "../../../utils/os.h"
+
+#include <utarray.h>
+
+#include "column_store.h"
+
+#define COLUMN_DICT_SIZE                                                       \
+  (2 * COLUMN_BLOCK_ROWS) /* Dictionary hash table size (power of two) */
+#define COLUMN_DICT_EMPTY UINT16_MAX
+#define COLUMN_VARINT_MAX 10 /* Maximum length in bytes of a varint */
+
+#define COLUMN(schema, field, encoding)                                        \
+  {                                                                            \
+    #field, offsetof(struct schema, field),                                    \
+        sizeof(((struct schema *)0)->field), encoding                          \
+  }
+
+#define COLUMN_ALIGN_SIZE(size)                                                \
+  (((size) + COLUMN_ALIGN - 1) & ~((size_t)COLUMN_ALIGN - 1))
+
+static const struct column_def eth_columns[] = {
+    COLUMN(eth_schema, timestamp, COLUMN_DELTA),
+    COLUMN(eth_schema, id, COLUMN_DELTA),
+    COLUMN(eth_schema, caplen, COLUMN_RAW),
+    COLUMN(eth_schema, length, COLUMN_RAW),
+    COLUMN(eth_schema, ifname, COLUMN_DICT),
+    COLUMN(eth_schema, ether_dhost, COLUMN_DICT),
+    COLUMN(eth_schema, ether_shost, COLUMN_DICT),
+    COLUMN(eth_schema, ether_type, COLUMN_RAW),
+};
+
+static const struct column_def arp_columns[] = {
+    COLUMN(arp_schema, id, COLUMN_DELTA),
+    COLUMN(arp_schema, ar_hrd, COLUMN_RAW),
+    COLUMN(arp_schema, ar_pro, COLUMN_RAW),
+    COLUMN(arp_schema, ar_hln, COLUMN_RAW),
+    COLUMN(arp_schema, ar_pln, COLUMN_RAW),
+    COLUMN(arp_schema, ar_op, COLUMN_RAW),
+    COLUMN(arp_schema, arp_sha, COLUMN_DICT),
+    COLUMN(arp_schema, arp_spa, COLUMN_DICT),
+    COLUMN(arp_schema, arp_tha, COLUMN_DICT),
+    COLUMN(arp_schema, arp_tpa, COLUMN_DICT),
+};
+
+static const struct column_def ip4_columns[] = {
+    COLUMN(ip4_schema, id, COLUMN_DELTA),
+    COLUMN(ip4_schema, ip_src, COLUMN_DICT),
+    COLUMN(ip4_schema, ip_dst, COLUMN_DICT),
+    COLUMN(ip4_schema, ip_hl, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_v, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_tos, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_len, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_id, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_off, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_ttl, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_p, COLUMN_RAW),
+    COLUMN(ip4_schema, ip_sum, COLUMN_RAW),
+};
+
+static const struct column_def ip6_columns[] = {
+    COLUMN(ip6_schema, id, COLUMN_DELTA),
+    COLUMN(ip6_schema, ip6_un1_flow, COLUMN_RAW),
+    COLUMN(ip6_schema, ip6_un1_plen, COLUMN_RAW),
+    COLUMN(ip6_schema, ip6_un1_nxt, COLUMN_RAW),
+    COLUMN(ip6_schema, ip6_un1_hlim, COLUMN_RAW),
+    COLUMN(ip6_schema, ip6_un2_vfc, COLUMN_RAW),
+    COLUMN(ip6_schema, ip6_src, COLUMN_DICT),
+    COLUMN(ip6_schema, ip6_dst, COLUMN_DICT),
+};
+
+static const struct column_def tcp_columns[] = {
+    COLUMN(tcp_schema, id, COLUMN_DELTA),
+    COLUMN(tcp_schema, source, COLUMN_RAW),
+    COLUMN(tcp_schema, dest, COLUMN_RAW),
+    COLUMN(tcp_schema, seq, COLUMN_RAW),
+    COLUMN(tcp_schema, ack_seq, COLUMN_RAW),
+    COLUMN(tcp_schema, res1, COLUMN_RAW),
+    COLUMN(tcp_schema, doff, COLUMN_RAW),
+    COLUMN(tcp_schema, fin, COLUMN_RAW),
+    COLUMN(tcp_schema, syn, COLUMN_RAW),
+    COLUMN(tcp_schema, rst, COLUMN_RAW),
+    COLUMN(tcp_schema, psh, COLUMN_RAW),
+    COLUMN(tcp_schema, ack, COLUMN_RAW),
+    COLUMN(tcp_schema, urg, COLUMN_RAW),
+    COLUMN(tcp_schema, window, COLUMN_RAW),
+    COLUMN(tcp_schema, check_p, COLUMN_RAW),
+    COLUMN(tcp_schema, urg_ptr, COLUMN_RAW),
+};
+
+static const struct column_def udp_columns[] = {
+    COLUMN(udp_schema, id, COLUMN_DELTA),
+    COLUMN(udp_schema, source, COLUMN_RAW),
+    COLUMN(udp_schema, dest, COLUMN_RAW),
+    COLUMN(udp_schema, len, COLUMN_RAW),
+    COLUMN(udp_schema, check_p, COLUMN_RAW),
+};
+
+static const struct column_def icmp4_columns[] = {
+    COLUMN(icmp4_schema, id, COLUMN_DELTA),
+    COLUMN(icmp4_schema, type, COLUMN_RAW),
+    COLUMN(icmp4_schema, code, COLUMN_RAW),
+    COLUMN(icmp4_schema, checksum, COLUMN_RAW),
+    COLUMN(icmp4_schema, gateway, COLUMN_RAW),
+};
+
+static const struct column_def icmp6_columns[] = {
+    COLUMN(icmp6_schema, id, COLUMN_DELTA),
+    COLUMN(icmp6_schema, icmp6_type, COLUMN_RAW),
+    COLUMN(icmp6_schema, icmp6_code, COLUMN_RAW),
+    COLUMN(icmp6_schema, icmp6_cksum, COLUMN_RAW),
+    COLUMN(icmp6_schema, icmp6_un_data32, COLUMN_RAW),
+};
+
+static const struct column_def dns_columns[] = {
+    COLUMN(dns_schema, id, COLUMN_DELTA),
+    COLUMN(dns_schema, tid, COLUMN_RAW),
+    COLUMN(dns_schema, flags, COLUMN_RAW),
+    COLUMN(dns_schema, nqueries, COLUMN_RAW),
+    COLUMN(dns_schema, nanswers, COLUMN_RAW),
+    COLUMN(dns_schema, nauth, COLUMN_RAW),
+    COLUMN(dns_schema, nother, COLUMN_RAW),
+    COLUMN(dns_schema, qname, COLUMN_DICT),
+};
+
+static const struct column_def mdns_columns[] = {
+    COLUMN(mdns_schema, id, COLUMN_DELTA),
+    COLUMN(mdns_schema, tid, COLUMN_RAW),
+    COLUMN(mdns_schema, flags, COLUMN_RAW),
+    COLUMN(mdns_schema, nqueries, COLUMN_RAW),
+    COLUMN(mdns_schema, nanswers, COLUMN_RAW),
+    COLUMN(mdns_schema, nauth, COLUMN_RAW),
+    COLUMN(mdns_schema, nother, COLUMN_RAW),
+    COLUMN(mdns_schema, qname, COLUMN_DICT),
+};
+
+static const struct column_def dhcp_columns[] = {
+    COLUMN(dhcp_schema, id, COLUMN_DELTA),
+    COLUMN(dhcp_schema, op, COLUMN_RAW),
+    COLUMN(dhcp_schema, htype, COLUMN_RAW),
+    COLUMN(dhcp_schema, hlen, COLUMN_RAW),
+    COLUMN(dhcp_schema, hops, COLUMN_RAW),
+    COLUMN(dhcp_schema, xid, COLUMN_RAW),
+    COLUMN(dhcp_schema, secs, COLUMN_RAW),
+    COLUMN(dhcp_schema, flags, COLUMN_RAW),
+    COLUMN(dhcp_schema, ciaddr, COLUMN_DICT),
+    COLUMN(dhcp_schema, yiaddr, COLUMN_DICT),
+    COLUMN(dhcp_schema, siaddr, COLUMN_DICT),
+    COLUMN(dhcp_schema, giaddr, COLUMN_DICT),
+    COLUMN(dhcp_schema, chaddr, COLUMN_DICT),
+};
+
+struct column_schema {
+  const struct column_def *defs;
+  size_t count;
+  size_t size;
+};
+
+#define COLUMN_SCHEMA(columns, schema)                                         \
+  { columns, ARRAY_SIZE(columns), sizeof(struct schema) }
+
+static const struct column_schema column_schemas[PACKET_DHCP + 1] = {
+    [PACKET_ETHERNET] = COLUMN_SCHEMA(eth_columns, eth_schema),
+    [PACKET_ARP] = COLUMN_SCHEMA(arp_columns, arp_schema),
+    [PACKET_IP4] = COLUMN_SCHEMA(ip4_columns, ip4_schema),
+    [PACKET_IP6] = COLUMN_SCHEMA(ip6_columns, ip6_schema),
+    [PACKET_TCP] = COLUMN_SCHEMA(tcp_columns, tcp_schema),
+    [PACKET_UDP] = COLUMN_SCHEMA(udp_columns, udp_schema),
+    [PACKET_ICMP4] = COLUMN_SCHEMA(icmp4_columns, icmp4_schema),
+    [PACKET_ICMP6] = COLUMN_SCHEMA(icmp6_columns, icmp6_schema),
+    [PACKET_DNS] = COLUMN_SCHEMA(dns_columns, dns_schema),
+    [PACKET_MDNS] = COLUMN_SCHEMA(mdns_columns, mdns_schema),
+    [PACKET_DHCP] = COLUMN_SCHEMA(dhcp_columns, dhcp_schema),
+};
+
+static const struct column_schema *get_column_schema(PACKET_TYPES type) {
+  if (type <= PACKET_NONE || type > PACKET_DHCP) {
+    return NULL;
+  }
+
+  return (column_schemas[type].defs != NULL) ? &column_schemas[type] : NULL;
+}
+
+const struct column_def *get_column_defs(PACKET_TYPES type, size_t *count) {
+  const struct column_schema *schema = get_column_schema(type);
+
+  if (schema == NULL) {
+    return NULL;
+  }
+
+  if (count != NULL) {
+    *count = schema->count;
+  }
+
+  return schema->defs;
+}
+
+ssize_t get_column_index(PACKET_TYPES type, const char *name) {
+  const struct column_schema *schema = get_column_schema(type);
+
+  if (schema == NULL || name == NULL) {
+    return -1;
+  }
+
+  for (size_t idx = 0; idx < schema->count; idx++) {
+    if (strcmp(schema->defs[idx].name, name) == 0) {
+      return (ssize_t)idx;
+    }
+  }
+
+  return -1;
+}
+
+static uint64_t load_column_u64(const uint8_t *value, uint16_t width) {
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+
+  switch (width) {
+    case 1:
+      os_memcpy(&u8, value, 1);
+      return u8;
+    case 2:
+      os_memcpy(&u16, value, 2);
+      return u16;
+    case 4:
+      os_memcpy(&u32, value, 4);
+      return u32;
+    default:
+      os_memcpy(&u64, value, 8);
+      return u64;
+  }
+}
+
+static void store_column_u64(uint8_t *value, uint16_t width, uint64_t u64) {
+  uint8_t u8 = (uint8_t)u64;
+  uint16_t u16 = (uint16_t)u64;
+  uint32_t u32 = (uint32_t)u64;
+
+  switch (width) {
+    case 1:
+      os_memcpy(value, &u8, 1);
+      break;
+    case 2:
+      os_memcpy(value, &u16, 2);
+      break;
+    case 4:
+      os_memcpy(value, &u32, 4);
+      break;
+    default:
+      os_memcpy(value, &u64, 8);
+  }
+}
+
+static size_t encode_column_raw(uint8_t *data, const uint8_t *rows,
+                                size_t count, size_t stride,
+                                const struct column_def *def) {
+  for (size_t idx = 0; idx < count; idx++) {
+    os_memcpy(&data[idx * def->width], &rows[idx * stride + def->offset],
+              def->width);
+  }
+
+  return count * def->width;
+}
+
+static size_t encode_column_delta(uint8_t *data, const uint8_t *rows,
+                                  size_t count, size_t stride,
+                                  const struct column_def *def) {
+  uint64_t prev = load_column_u64(&rows[def->offset], def->width);
+  size_t length = sizeof(uint64_t);
+
+  os_memcpy(data, &prev, sizeof(uint64_t));
+
+  for (size_t idx = 1; idx < count; idx++) {
+    uint64_t value = load_column_u64(&rows[idx * stride + def->offset],
+                                     def->width);
+    int64_t delta = (int64_t)(value - prev);
+    // zigzag, so small negative deltas stay short
+    uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+    while (zigzag >= 0x80) {
+      data[length++] = (uint8_t)(zigzag | 0x80);
+      zigzag >>= 7;
+    }
+    data[length++] = (uint8_t)zigzag;
+    prev = value;
+  }
+
+  return length;
+}
+
+static size_t encode_column_dict(uint16_t *dict, uint8_t *data,
+                                 const uint8_t *rows, size_t count,
+                                 size_t stride, const struct column_def *def,
+                                 uint32_t *entries) {
+  uint16_t *indices = &dict[COLUMN_DICT_SIZE];
+  size_t length;
+
+  *entries = 0;
+  os_memset(dict, 0xFF, COLUMN_DICT_SIZE * sizeof(uint16_t));
+
+  for (size_t idx = 0; idx < count; idx++) {
+    const uint8_t *value = &rows[idx * stride + def->offset];
+    uint32_t slot = sdbm_hash(value, def->width) & (COLUMN_DICT_SIZE - 1);
+
+    // The table has twice the block rows, so there is always an empty slot
+    while (dict[slot] != COLUMN_DICT_EMPTY &&
+           memcmp(&data[dict[slot] * def->width], value, def->width) != 0) {
+      slot = (slot + 1) & (COLUMN_DICT_SIZE - 1);
+    }
+
+    if (dict[slot] == COLUMN_DICT_EMPTY) {
+      os_memcpy(&data[*entries * def->width], value, def->width);
+      dict[slot] = (uint16_t)(*entries)++;
+    }
+
+    indices[idx] = dict[slot];
+  }
+
+  length = *entries * def->width;
+  if (length % sizeof(uint16_t)) {
+    data[length++] = 0;
+  }
+
+  os_memcpy(&data[length], indices, count * sizeof(uint16_t));
+  return length + count * sizeof(uint16_t);
+}
+
+static size_t get_column_block_bound(const struct column_schema *schema,
+                                     size_t count) {
+  size_t size = sizeof(struct column_block_header);
+
+  // Upper bound of any of the encodings plus the alignment
+  for (size_t idx = 0; idx < schema->count; idx++) {
+    size += sizeof(struct column_chunk_header) +
+            count * (schema->defs[idx].width + sizeof(uint16_t) +
+                     COLUMN_VARINT_MAX) +
+            sizeof(uint64_t) + COLUMN_ALIGN;
+  }
+
+  return size;
+}
+
+static size_t encode_column_block(struct column_writer *writer,
+                                  PACKET_TYPES type) {
+  const struct column_schema *schema = get_column_schema(type);
+  const uint8_t *rows = writer->rows[type];
+  size_t count = writer->count[type];
+  struct column_block_header *header =
+      (struct column_block_header *)writer->block;
+  size_t offset = sizeof(struct column_block_header);
+
+  for (size_t idx = 0; idx < schema->count; idx++) {
+    const struct column_def *def = &schema->defs[idx];
+    struct column_chunk_header *chunk =
+        (struct column_chunk_header *)&writer->block[offset];
+    uint8_t *data = &writer->block[offset + sizeof(*chunk)];
+    size_t length;
+
+    os_memset(chunk, 0, sizeof(*chunk));
+    chunk->encoding = (uint8_t)def->encoding;
+    chunk->width = def->width;
+
+    switch (def->encoding) {
+      case COLUMN_DELTA:
+        length = encode_column_delta(data, rows, count, schema->size, def);
+        break;
+      case COLUMN_DICT:
+        length = encode_column_dict(writer->dict, data, rows, count,
+                                    schema->size, def, &chunk->entries);
+        break;
+      case COLUMN_RAW:
+      default:
+        length = encode_column_raw(data, rows, count, schema->size, def);
+    }
+
+    os_memset(&data[length], 0, COLUMN_ALIGN_SIZE(length) - length);
+    chunk->size = (uint32_t)COLUMN_ALIGN_SIZE(length);
+    offset += sizeof(*chunk) + chunk->size;
+  }
+
+  header->magic = COLUMN_BLOCK_MAGIC;
+  header->type = (uint16_t)type;
+  header->columns = (uint16_t)schema->count;
+  header->rows = (uint32_t)count;
+  header->size = (uint32_t)(offset - sizeof(struct column_block_header));
+
+  return offset;
+}
+
+static int write_column_fd(int fd, const uint8_t *data, size_t length) {
+  while (length) {
+    ssize_t ret = write(fd, data, length);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += ret;
+    length -= (size_t)ret;
+  }
+
+  return 0;
+}
+
+static void close_column_writer_fd(struct column_writer *writer) {
+  if (writer->fd >= 0) {
+    close(writer->fd);
+    writer->fd = -1;
+  }
+}
+
+static int open_column_writer_fd(struct column_writer *writer) {
+  struct column_file_header header = {.version = COLUMN_FILE_VERSION};
+  uint64_t timestamp;
+  int ret;
+
+  if (os_get_timestamp(&timestamp) < 0) {
+    log_error("os_get_timestamp fail");
+    return -1;
+  }
+
+  if (writer->fd >= 0) {
+    if (timestamp - writer->start_timestamp < writer->max_age) {
+      return 0;
+    }
+    close_column_writer_fd(writer);
+  }
+
+  ret = snprintf(writer->path, MAX_OS_PATH_LEN, "%s/%s_%" PRIu64 "%s",
+                 writer->column_path, writer->ifname, timestamp,
+                 COLUMN_EXTENSION);
+  if (ret < 0 || ret >= MAX_OS_PATH_LEN) {
+    log_error("Column file path too long");
+    return -1;
+  }
+
+  if ((writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_APPEND,
+                         S_IRUSR | S_IWUSR | S_IRGRP)) < 0) {
+    log_errno("open %s", writer->path);
+    return -1;
+  }
+
+  os_memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+  if (write_column_fd(writer->fd, (const uint8_t *)&header, sizeof(header)) <
+      0) {
+    log_errno("write %s", writer->path);
+    close_column_writer_fd(writer);
+    return -1;
+  }
+
+  writer->start_timestamp = timestamp;
+  writer->bytes += sizeof(header);
+  log_debug("Opened column file %s", writer->path);
+  return 0;
+}
+
+static int write_column_block(struct column_writer *writer,
+                              PACKET_TYPES type) {
+  const struct column_schema *schema = get_column_schema(type);
+  size_t bound, length;
+  uint8_t *block;
+
+  if (!writer->count[type]) {
+    return 0;
+  }
+
+  bound = get_column_block_bound(schema, writer->count[type]);
+  if (bound > writer->block_size) {
+    if ((block = os_realloc(writer->block, bound)) == NULL) {
+      log_errno("os_realloc");
+      return -1;
+    }
+    writer->block = block;
+    writer->block_size = bound;
+  }
+
+  length = encode_column_block(writer, type);
+  // The staged rows are released even if the write fails
+  writer->count[type] = 0;
+
+  if (open_column_writer_fd(writer) < 0) {
+    log_error("open_column_writer_fd fail");
+    return -1;
+  }
+
+  if (write_column_fd(writer->fd, writer->block, length) < 0) {
+    log_errno("write %s", writer->path);
+    close_column_writer_fd(writer);
+    return -1;
+  }
+
+  writer->blocks++;
+  writer->bytes += length;
+  return 0;
+}
+
+/**
+ * Private implementation of free_column_writer()
+ *
+ * Silences the `-Wmismatched-dealloc` warnings in init_column_writer(), since
+ * this doesn't have the compiler attributes of `free_column_writer`.
+ */
+static void __free_column_writer(struct column_writer *writer) {
+  if (writer != NULL) {
+    if (flush_column_writer(writer) < 0) {
+      log_error("flush_column_writer fail");
+    }
+
+    log_debug("column writer: blocks=%" PRIu64 " bytes=%" PRIu64,
+              writer->blocks, writer->bytes);
+
+    close_column_writer_fd(writer);
+    for (size_t idx = 0; idx < ARRAY_SIZE(writer->rows); idx++) {
+      os_free(writer->rows[idx]);
+    }
+    os_free(writer->block);
+    os_free(writer->dict);
+    os_free(writer);
+  }
+}
+
+void free_column_writer(struct column_writer *writer) {
+  __free_column_writer(writer);
+}
+
+struct column_writer *init_column_writer(const char *column_path,
+                                         const char *ifname,
+                                         uint64_t max_age) {
+  struct column_writer *writer = NULL;
+
+  if (column_path == NULL) {
+    log_error("column_path param is NULL");
+    return NULL;
+  }
+
+  if (ifname == NULL) {
+    log_error("ifname param is NULL");
+    return NULL;
+  }
+
+  if ((writer = os_zalloc(sizeof(struct column_writer))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  writer->fd = -1;
+  writer->max_age = max_age;
+  os_strlcpy(writer->column_path, column_path, MAX_OS_PATH_LEN);
+  os_strlcpy(writer->ifname, ifname, IF_NAMESIZE);
+
+  if ((writer->dict = os_malloc((COLUMN_DICT_SIZE + COLUMN_BLOCK_ROWS) *
+                                sizeof(uint16_t))) == NULL) {
+    log_errno("os_malloc");
+    __free_column_writer(writer);
+    return NULL;
+  }
+
+  return writer;
+}
+
+/**
+ * @brief A column file of the store
+ *
+ */
+struct column_store_file {
+  char *path;         /**< The file path */
+  uint64_t timestamp; /**< The file creation timestamp */
+  uint64_t size;      /**< The file size in bytes */
+};
+
+static void free_column_store_file(void *el) {
+  os_free(((struct column_store_file *)el)->path);
+}
+
+static const UT_icd column_store_file_icd = {
+    sizeof(struct column_store_file), NULL, NULL, free_column_store_file};
+
+/**
+ * @brief The column files of an interface
+ *
+ */
+struct column_store_list {
+  const struct column_writer *writer; /**< The column writer */
+  UT_array *files;                    /**< The closed column files */
+  uint64_t size; /**< The size of all the files, including the open one */
+};
+
+static bool list_column_store_file(char *path, void *args) {
+  struct column_store_list *list = (struct column_store_list *)args;
+  struct column_store_file file = {0};
+  size_t ifname_len = strlen(list->writer->ifname);
+  char *name = strrchr(path, '/');
+  char *end = NULL;
+  struct stat sb;
+
+  name = (name != NULL) ? name + 1 : path;
+
+  // Only the <ifname>_<timestamp>.col files of the writer interface
+  if (strncmp(name, list->writer->ifname, ifname_len) != 0 ||
+      name[ifname_len] != '_') {
+    return true;
+  }
+
+  errno = 0;
+  file.timestamp = strtoull(&name[ifname_len + 1], &end, 10);
+  if (errno || end == &name[ifname_len + 1] ||
+      strcmp(end, COLUMN_EXTENSION) != 0) {
+    return true;
+  }
+
+  if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+    return true;
+  }
+
+  file.size = (uint64_t)sb.st_size;
+  list->size += file.size;
+
+  if (strcmp(path, list->writer->path) == 0) {
+    return true;
+  }
+
+  if ((file.path = os_strdup(path)) == NULL) {
+    log_errno("os_strdup");
+    return false;
+  }
+
+  utarray_push_back(list->files, &file);
+  return true;
+}
+
+static int cmp_column_store_file(const void *a, const void *b) {
+  const struct column_store_file *fa = (const struct column_store_file *)a;
+  const struct column_store_file *fb = (const struct column_store_file *)b;
+
+  return (fa->timestamp > fb->timestamp) - (fa->timestamp < fb->timestamp);
+}
+
+int clean_column_writer(struct column_writer *writer) {
+  struct column_store_list list = {.writer = writer};
+  struct column_store_file *file = NULL;
+  uint64_t timestamp;
+  int removed = 0;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  if (!writer->store_size && !writer->store_age) {
+    return 0;
+  }
+
+  if (os_get_timestamp(&timestamp) < 0) {
+    log_error("os_get_timestamp fail");
+    return -1;
+  }
+
+  utarray_new(list.files, &column_store_file_icd);
+  if (list_dir(writer->column_path, list_column_store_file, &list) < 0) {
+    log_error("list_dir fail");
+    utarray_free(list.files);
+    return -1;
+  }
+
+  if (utarray_len(list.files)) {
+    utarray_sort(list.files, cmp_column_store_file);
+  }
+
+  // The files are removed from the oldest
+  while ((file = (struct column_store_file *)utarray_next(list.files,
+                                                          file)) != NULL) {
+    bool expired = writer->store_age && file->timestamp < timestamp &&
+                   timestamp - file->timestamp > writer->store_age;
+    bool oversize = writer->store_size && list.size > writer->store_size;
+
+    if (!expired && !oversize) {
+      break;
+    }
+
+    log_trace("Removing column file %s", file->path);
+    if (remove(file->path) < 0) {
+      log_errno("remove %s", file->path);
+      continue;
+    }
+
+    list.size -= file->size;
+    removed++;
+  }
+
+  utarray_free(list.files);
+  return removed;
+}
+
+int append_column_writer(struct column_writer *writer,
+                         const struct tuple_packet *tp) {
+  const struct column_schema *schema;
+  PACKET_TYPES type;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  if (tp == NULL) {
+    log_error("tp param is NULL");
+    return -1;
+  }
+
+  type = tp->type;
+  if ((schema = get_column_schema(type)) == NULL) {
+    return 0;
+  }
+
+  if (writer->rows[type] == NULL &&
+      (writer->rows[type] = os_malloc(schema->size * COLUMN_BLOCK_ROWS)) ==
+          NULL) {
+    log_errno("os_malloc");
+    return -1;
+  }
+
+  os_memcpy(&writer->rows[type][writer->count[type] * schema->size],
+            tp->packet, schema->size);
+
+  if (++writer->count[type] == COLUMN_BLOCK_ROWS) {
+    return write_column_block(writer, type);
+  }
+
+  return 0;
+}
+
+int flush_column_writer(struct column_writer *writer) {
+  int ret = 0;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  for (PACKET_TYPES type = PACKET_ETHERNET; type <= PACKET_DHCP; type++) {
+    if (get_column_schema(type) != NULL &&
+        write_column_block(writer, type) < 0) {
+      log_error("write_column_block fail");
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+/**
+ * Private implementation of close_column_file()
+ *
+ * Silences the `-Wmismatched-dealloc` warnings in open_column_file().
+ */
+static void __close_column_file(struct column_file *file) {
+  if (file != NULL) {
+    if (file->data != NULL) {
+      munmap((void *)file->data, file->size);
+    }
+    if (file->fd >= 0) {
+      close(file->fd);
+    }
+    os_free(file);
+  }
+}
+
+void close_column_file(struct column_file *file) { __close_column_file(file); }
+
+struct column_file *open_column_file(const char *path) {
+  struct column_file *file = NULL;
+  const struct column_file_header *header;
+  struct stat st;
+  void *data;
+
+  if (path == NULL) {
+    log_error("path param is NULL");
+    return NULL;
+  }
+
+  if ((file = os_zalloc(sizeof(struct column_file))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  if ((file->fd = open(path, O_RDONLY)) < 0) {
+    log_errno("open %s", path);
+    __close_column_file(file);
+    return NULL;
+  }
+
+  if (fstat(file->fd, &st) < 0) {
+    log_errno("fstat");
+    __close_column_file(file);
+    return NULL;
+  }
+
+  if ((size_t)st.st_size < sizeof(struct column_file_header)) {
+    log_error("%s is not a column file", path);
+    __close_column_file(file);
+    return NULL;
+  }
+
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, file->fd, 0);
+  if (data == MAP_FAILED) {
+    log_errno("mmap");
+    __close_column_file(file);
+    return NULL;
+  }
+
+  file->data = (const uint8_t *)data;
+  file->size = (size_t)st.st_size;
+
+  header = (const struct column_file_header *)file->data;
+  if (memcmp(header->magic, COLUMN_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != COLUMN_FILE_VERSION) {
+    log_error("%s is not a column file", path);
+    __close_column_file(file);
+    return NULL;
+  }
+
+  return file;
+}
+
+int next_column_block(const struct column_file *file, size_t *offset,
+                      struct column_block *block) {
+  const struct column_block_header *header;
+  const struct column_schema *schema;
+  size_t chunk_offset, end;
+
+  if (file == NULL || offset == NULL || block == NULL) {
+    log_error("params are NULL");
+    return -1;
+  }
+
+  if (*offset < sizeof(struct column_file_header)) {
+    *offset = sizeof(struct column_file_header);
+  }
+
+  // A truncated last block is ignored, as it is still being written
+  if (file->size - *offset < sizeof(struct column_block_header)) {
+    return 0;
+  }
+
+  header = (const struct column_block_header *)&file->data[*offset];
+  if (header->magic != COLUMN_BLOCK_MAGIC) {
+    log_error("Invalid column block at offset %zu", *offset);
+    return -1;
+  }
+
+  chunk_offset = *offset + sizeof(struct column_block_header);
+  if (file->size - chunk_offset < header->size) {
+    return 0;
+  }
+
+  schema = get_column_schema((PACKET_TYPES)header->type);
+  if (schema == NULL || header->columns != schema->count ||
+      header->rows > COLUMN_BLOCK_ROWS) {
+    log_error("Invalid column block header at offset %zu", *offset);
+    return -1;
+  }
+
+  end = chunk_offset + header->size;
+  block->type = (PACKET_TYPES)header->type;
+  block->rows = header->rows;
+  block->columns = header->columns;
+
+  for (size_t idx = 0; idx < block->columns; idx++) {
+    const struct column_chunk_header *chunk;
+
+    if (end - chunk_offset < sizeof(struct column_chunk_header)) {
+      log_error("Invalid column chunk at offset %zu", chunk_offset);
+      return -1;
+    }
+
+    chunk = (const struct column_chunk_header *)&file->data[chunk_offset];
+    chunk_offset += sizeof(struct column_chunk_header);
+
+    if (end - chunk_offset < chunk->size ||
+        chunk->width != schema->defs[idx].width) {
+      log_error("Invalid column chunk at offset %zu", chunk_offset);
+      return -1;
+    }
+
+    block->chunks[idx] = chunk;
+    chunk_offset += chunk->size;
+  }
+
+  *offset = end;
+  return 1;
+}
+
+static int decode_column_delta(const struct column_chunk_header *chunk,
+                               const uint8_t *data, size_t rows,
+                               uint8_t *values) {
+  uint64_t value;
+  size_t length = sizeof(uint64_t);
+
+  if (chunk->size < sizeof(uint64_t)) {
+    return -1;
+  }
+
+  os_memcpy(&value, data, sizeof(uint64_t));
+  store_column_u64(values, chunk->width, value);
+
+  for (size_t idx = 1; idx < rows; idx++) {
+    uint64_t zigzag = 0;
+    unsigned int shift = 0;
+
+    do {
+      if (length >= chunk->size || shift >= 64) {
+        return -1;
+      }
+      zigzag |= (uint64_t)(data[length] & 0x7F) << shift;
+      shift += 7;
+    } while (data[length++] & 0x80);
+
+    value += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+    store_column_u64(&values[idx * chunk->width], chunk->width, value);
+  }
+
+  return 0;
+}
+
+static int decode_column_dict(const struct column_chunk_header *chunk,
+                              const uint8_t *data, size_t rows,
+                              uint8_t *values) {
+  size_t length = chunk->entries * chunk->width;
+  uint16_t index;
+
+  length += length % sizeof(uint16_t);
+  if (chunk->size < length + rows * sizeof(uint16_t)) {
+    return -1;
+  }
+
+  for (size_t idx = 0; idx < rows; idx++) {
+    os_memcpy(&index, &data[length + idx * sizeof(uint16_t)],
+              sizeof(uint16_t));
+    if (index >= chunk->entries) {
+      return -1;
+    }
+    os_memcpy(&values[idx * chunk->width], &data[index * chunk->width],
+              chunk->width);
+  }
+
+  return 0;
+}
+
+int read_column_values(const struct column_block *block, size_t column,
+                       uint8_t *values) {
+  const struct column_chunk_header *chunk;
+  const uint8_t *data;
+  int ret;
+
+  if (block == NULL || values == NULL) {
+    log_error("params are NULL");
+    return -1;
+  }
+
+  if (column >= block->columns) {
+    log_error("Invalid column index %zu", column);
+    return -1;
+  }
+
+  if (!block->rows) {
+    return 0;
+  }
+
+  chunk = block->chunks[column];
+  data = (const uint8_t *)&chunk[1];
+
+  switch (chunk->encoding) {
+    case COLUMN_RAW:
+      ret = (chunk->size < block->rows * chunk->width) ? -1 : 0;
+      if (!ret) {
+        os_memcpy(values, data, block->rows * chunk->width);
+      }
+      break;
+    case COLUMN_DELTA:
+      ret = decode_column_delta(chunk, data, block->rows, values);
+      break;
+    case COLUMN_DICT:
+      ret = decode_column_dict(chunk, data, block->rows, values);
+      break;
+    default:
+      ret = -1;
+  }
+
+  if (ret < 0) {
+    log_error("Invalid column chunk encoding");
+  }
+
+  return ret;
+}
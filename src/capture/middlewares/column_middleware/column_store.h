@@ -0,0 +1,290 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the columnar packet store.
+ *
+ * A column file starts with a struct column_file_header and is followed by
+ * append only blocks. A block holds up to COLUMN_BLOCK_ROWS decoded schemas of
+ * a single packet type, stored column by column. Every column chunk is
+ * encoded as:
+ *   - COLUMN_RAW: the fixed width values
+ *   - COLUMN_DELTA: the first value followed by the zigzag varint deltas
+ *     (timestamps and packet ids)
+ *   - COLUMN_DICT: the distinct values followed by a uint16_t index per row
+ *     (MAC addresses, IP addresses and names)
+ *
+ * Chunks are 8 byte aligned and all the fields are in host byte order, so
+ * the files are meant to be mmap-ed and scanned on the gateway itself. A
+ * reader stops at a truncated last block.
+ */
+
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "../../../utils/attributes.h"
+#include "../../../utils/os.h"
+#include "../header_middleware/packet_decoder.h"
+
+#define COLUMN_EXTENSION ".col"
+#define COLUMN_FILE_MAGIC "EDGECOL1"
+#define COLUMN_BLOCK_MAGIC 0x4B4C4243 /* "CBLK" */
+#define COLUMN_FILE_VERSION 1
+
+#define COLUMN_BLOCK_ROWS 1024 /* Maximum number of rows in a block */
+#define COLUMN_MAX_COLUMNS 16  /* Maximum number of columns of a schema */
+#define COLUMN_ALIGN 8         /* Alignment in bytes of the column chunks */
+
+/**
+ * @brief The column chunk encodings
+ *
+ */
+enum COLUMN_ENCODING {
+  COLUMN_RAW = 0,
+  COLUMN_DELTA,
+  COLUMN_DICT,
+};
+
+/**
+ * @brief Schema column definition
+ *
+ */
+struct column_def {
+  const char *name;              /**< The column name */
+  size_t offset;                 /**< The field offset in the schema */
+  uint16_t width;                /**< The field width in bytes */
+  enum COLUMN_ENCODING encoding; /**< The column chunk encoding */
+};
+
+/**
+ * @brief Column file header definition
+ *
+ */
+struct column_file_header {
+  char magic[8];     /**< COLUMN_FILE_MAGIC */
+  uint32_t version;  /**< COLUMN_FILE_VERSION */
+  uint32_t reserved; /**< Reserved, set to zero */
+};
+
+/**
+ * @brief Column block header definition
+ *
+ */
+struct column_block_header {
+  uint32_t magic;   /**< COLUMN_BLOCK_MAGIC */
+  uint16_t type;    /**< The packet type (PACKET_TYPES) */
+  uint16_t columns; /**< Number of column chunks */
+  uint32_t rows;    /**< Number of rows */
+  uint32_t size;    /**< Size in bytes of the column chunks */
+};
+
+/**
+ * @brief Column chunk header definition
+ *
+ */
+struct column_chunk_header {
+  uint8_t encoding;  /**< The chunk encoding (enum COLUMN_ENCODING) */
+  uint8_t reserved;  /**< Reserved, set to zero */
+  uint16_t width;    /**< The value width in bytes */
+  uint32_t size;     /**< Size in bytes of the chunk data (aligned) */
+  uint32_t entries;  /**< Number of dictionary entries (COLUMN_DICT) */
+  uint32_t reserved2; /**< Reserved, set to zero */
+};
+
+/**
+ * @brief Column store writer structure definition
+ *
+ */
+struct column_writer {
+  char column_path[MAX_OS_PATH_LEN]; /**< The column files folder path */
+  char ifname[IF_NAMESIZE];          /**< The capture interface */
+  char path[MAX_OS_PATH_LEN];        /**< The open column file path */
+  int fd;                     /**< The open column file fd, -1 if none */
+  uint64_t max_age;           /**< Maximum file age in microseconds */
+  uint64_t start_timestamp;   /**< The open file creation timestamp */
+  uint64_t store_size; /**< Maximum size in bytes of the interface files, 0
+                          for no limit */
+  uint64_t store_age;  /**< Maximum age in microseconds of the interface
+                          files, 0 for no limit */
+  uint8_t *rows[PACKET_DHCP + 1]; /**< The staged schemas per packet type */
+  size_t count[PACKET_DHCP + 1];  /**< Number of staged schemas per type */
+  uint8_t *block;             /**< The block encoding buffer */
+  size_t block_size;          /**< The block encoding buffer size */
+  uint16_t *dict; /**< The dictionary hash table and the row indices */
+  uint64_t blocks;            /**< Number of blocks written */
+  uint64_t bytes;             /**< Number of bytes written */
+};
+
+/**
+ * @brief Mapped column file structure definition
+ *
+ */
+struct column_file {
+  int fd;              /**< The file fd */
+  const uint8_t *data; /**< The mapped file */
+  size_t size;         /**< The mapped file size */
+};
+
+/**
+ * @brief Column block structure definition
+ *
+ */
+struct column_block {
+  PACKET_TYPES type; /**< The packet type */
+  size_t rows;       /**< Number of rows */
+  size_t columns;    /**< Number of columns */
+  const struct column_chunk_header
+      *chunks[COLUMN_MAX_COLUMNS]; /**< The column chunks */
+};
+
+/**
+ * @brief Returns the column definitions of a packet type
+ *
+ * @param type The packet type
+ * @param[out] count The number of columns
+ * @return const struct column_def* The column definitions, NULL if the
+ * packet type has no schema
+ */
+const struct column_def *get_column_defs(PACKET_TYPES type, size_t *count);
+
+/**
+ * @brief Returns the index of a column
+ *
+ * @param type The packet type
+ * @param name The column name
+ * @return ssize_t The column index, -1 if not found
+ */
+ssize_t get_column_index(PACKET_TYPES type, const char *name);
+
+/**
+ * @brief Flushes the staged schemas and frees the column writer
+ *
+ * @param writer The column writer
+ */
+void free_column_writer(struct column_writer *writer);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_column_writer()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_column_writer                                              \
+  __attribute__((malloc(free_column_writer, 1))) __must_check
+#else
+#define __must_free_column_writer __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a column writer
+ *
+ * The column files are named <ifname>_<timestamp>.col, where timestamp is the
+ * file creation time in microseconds. No file is created until the first
+ * block is written.
+ *
+ * @param column_path The folder path to store the column files
+ * @param ifname The capture interface
+ * @param max_age The maximum file age in microseconds
+ * @return struct column_writer* The column writer, NULL on failure.
+ * You must free this using free_column_writer().
+ */
+__must_free_column_writer struct column_writer *
+init_column_writer(const char *column_path, const char *ifname,
+                   uint64_t max_age);
+
+/**
+ * @brief Stages a decoded schema
+ *
+ * The block of the packet type is written when it holds COLUMN_BLOCK_ROWS
+ * schemas.
+ *
+ * @param writer The column writer
+ * @param tp The tuple packet
+ * @return int 0 on success, -1 on failure
+ */
+int append_column_writer(struct column_writer *writer,
+                         const struct tuple_packet *tp);
+
+/**
+ * @brief Writes the staged schemas of all the packet types
+ *
+ * @param writer The column writer
+ * @return int 0 on success, -1 on failure
+ */
+int flush_column_writer(struct column_writer *writer);
+
+/**
+ * @brief Removes the column files of the writer interface that are older
+ * than store_age or, from the oldest, that exceed store_size
+ *
+ * The open column file is never removed, but its size is counted.
+ *
+ * @param writer The column writer
+ * @return int the number of removed files, -1 on failure
+ */
+int clean_column_writer(struct column_writer *writer);
+
+/**
+ * @brief Unmaps and closes a column file
+ *
+ * @param file The column file
+ */
+void close_column_file(struct column_file *file);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be close_column_file()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_close_column_file                                               \
+  __attribute__((malloc(close_column_file, 1))) __must_check
+#else
+#define __must_close_column_file __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Opens and maps a column file for reading
+ *
+ * @param path The column file path
+ * @return struct column_file* The column file, NULL on failure.
+ * You must close this using close_column_file().
+ */
+__must_close_column_file struct column_file *
+open_column_file(const char *path);
+
+/**
+ * @brief Reads the next block of a column file
+ *
+ * Only the block and chunk headers are read, so the column data isn't paged
+ * in until it is decoded.
+ *
+ * @param file The column file
+ * @param[in,out] offset The block offset, set to 0 for the first block
+ * @param[out] block The block
+ * @return int 1 if a block was read, 0 at the end of the file, -1 on failure
+ */
+int next_column_block(const struct column_file *file, size_t *offset,
+                      struct column_block *block);
+
+/**
+ * @brief Decodes a block column
+ *
+ * @param block The column block
+ * @param column The column index
+ * @param[out] values The decoded values, block->rows * width bytes
+ * @return int 0 on success, -1 on failure
+ */
+int read_column_values(const struct column_block *block, size_t column,
+                       uint8_t *values);
+
+#endif
@@ -22,8 +22,9 @@
 void decode_dns_questions(uint8_t *payload, struct capture_packet *cpac) {
   uint16_t idx, i = 0, j = 0;
   for (idx = 0; idx < /*cpac->dnss.nqueries*/ 1; idx++) {
-    while ((uint32_t)((&payload[i] - (uint8_t *)cpac->ethh)) < cpac->length) {
-      if (payload[i] == '\0' || j + payload[i] >= MAX_QUESTION_LEN - 1)
+    while (has_capture_bytes(cpac, &payload[i], 1)) {
+      if (payload[i] == '\0' || j + payload[i] >= MAX_QUESTION_LEN - 1 ||
+          !has_capture_bytes(cpac, &payload[i], payload[i] + 1))
         break;
       os_memcpy(&cpac->dnss.qname[j], &payload[i + 1], payload[i]);
       j += payload[i] + 1;
@@ -49,7 +50,12 @@ bool decode_dns_packet(struct capture_packet *cpac) {
   } else
     return false;
 
-  strcpy(cpac->dnss.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->dnsh, sizeof(struct dns_header))) {
+    cpac->dnsh = NULL;
+    return false;
+  }
+
+  cpac->dnss.id = cpac->id;
 
   cpac->dnss.tid = ntohs(cpac->dnsh->tid);
   cpac->dnss.flags = ntohs(cpac->dnsh->flags);
@@ -60,7 +66,7 @@ bool decode_dns_packet(struct capture_packet *cpac) {
 
   ptrdiff_t pos = ((char *)cpac->dnsh - (char *)cpac->ethh);
   // We consider only the UDP encapsulation
-  if (pos + payload_offset + sizeof(struct dns_header) <= cpac->length &&
+  if (pos + payload_offset + sizeof(struct dns_header) <= cpac->caplen &&
       !payload_offset) {
     void *payload = (char *)cpac->dnsh + sizeof(struct dns_header);
     if (cpac->dnss.nqueries)
@@ -0,0 +1,260 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the flow aggregation table.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../../utils/allocs.h"
+#include "../../../utils/hash.h"
+#include "../../../utils/log.h"
+#include "../../../utils/os.h"
+
+#include "flow_table.h"
+
+#define FLOW_TABLE_MIN_SIZE 8
+#define FLOW_TABLE_EVICT_WINDOW 8 // Slots searched for a flow to evict
+
+static bool is_flow_table_full(const struct flow_table *table) {
+  // Linear probing degrades quickly above a 3/4 load
+  return table->count >= table->size - table->size / 4;
+}
+
+static uint32_t hash_flow_key(const struct flow_key *key) {
+  uint32_t hash = sdbm_hash((const uint8_t *)key, sizeof(struct flow_key));
+
+  // 0 marks an empty slot
+  return (hash != 0) ? hash : 1;
+}
+
+static void emit_flow_slot(struct flow_table *table, size_t idx) {
+  if (table->emit != NULL) {
+    table->emit(&table->records[idx], table->emit_ctx);
+  }
+  table->emitted++;
+}
+
+static void remove_flow_slot(struct flow_table *table, size_t idx) {
+  size_t mask = table->size - 1;
+  size_t next = idx;
+
+  // Shift back the entries of the cluster that can move to the free slot
+  while (table->hashes[(next = (next + 1) & mask)] != 0) {
+    size_t home = table->hashes[next] & mask;
+    if (((next - home) & mask) >= ((next - idx) & mask)) {
+      table->hashes[idx] = table->hashes[next];
+      table->records[idx] = table->records[next];
+      idx = next;
+    }
+  }
+
+  table->hashes[idx] = 0;
+  table->count--;
+}
+
+static bool is_flow_expired(const struct flow_table *table,
+                            const struct flow_record *record,
+                            uint64_t timestamp) {
+  if (timestamp < record->last_timestamp) {
+    return false;
+  }
+
+  return (timestamp - record->last_timestamp >= table->idle_timeout) ||
+         (timestamp - record->first_timestamp >= table->active_timeout);
+}
+
+/**
+ * Returns the flow with the oldest last packet in the FLOW_TABLE_EVICT_WINDOW
+ * slots from the start slot, or in the following slots if they are all empty.
+ * The table must not be empty.
+ */
+static size_t find_flow_victim(const struct flow_table *table, size_t start) {
+  size_t mask = table->size - 1;
+  size_t victim = table->size;
+  size_t idx = start;
+
+  for (size_t slots = 0; slots < FLOW_TABLE_EVICT_WINDOW ||
+                         victim == table->size;
+       slots++, idx = (idx + 1) & mask) {
+    if (table->hashes[idx] != 0 &&
+        (victim == table->size || table->records[idx].last_timestamp <
+                                      table->records[victim].last_timestamp)) {
+      victim = idx;
+    }
+  }
+
+  return victim;
+}
+
+/**
+ * Private implementation of free_flow_table(), without its compiler
+ * attributes, so init_flow_table() can call it on failure.
+ */
+static void __free_flow_table(struct flow_table *table) {
+  if (table != NULL) {
+    os_free(table->hashes);
+    os_free(table->records);
+    os_free(table);
+  }
+}
+
+void free_flow_table(struct flow_table *table) { __free_flow_table(table); }
+
+struct flow_table *init_flow_table(size_t size, uint64_t idle_timeout,
+                                   uint64_t active_timeout, flow_emit_fn emit,
+                                   void *emit_ctx) {
+  struct flow_table *table = NULL;
+  size_t slots = FLOW_TABLE_MIN_SIZE;
+
+  while (slots < size) {
+    slots <<= 1;
+  }
+
+  if ((table = os_zalloc(sizeof(struct flow_table))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  table->size = slots;
+  table->idle_timeout = idle_timeout;
+  table->active_timeout = active_timeout;
+  table->emit = emit;
+  table->emit_ctx = emit_ctx;
+
+  if ((table->hashes = os_calloc(slots, sizeof(uint32_t))) == NULL) {
+    log_errno("os_calloc");
+    __free_flow_table(table);
+    return NULL;
+  }
+
+  if ((table->records = os_calloc(slots, sizeof(struct flow_record))) ==
+      NULL) {
+    log_errno("os_calloc");
+    __free_flow_table(table);
+    return NULL;
+  }
+
+  return table;
+}
+
+int update_flow_table(struct flow_table *table, const struct flow_key *key,
+                      uint64_t timestamp, uint64_t length, uint8_t tcp_flags) {
+  struct flow_record *record;
+  uint32_t hash;
+  size_t idx, mask;
+
+  if (table == NULL) {
+    log_error("table param is NULL");
+    return -1;
+  }
+
+  if (key == NULL) {
+    log_error("key param is NULL");
+    return -1;
+  }
+
+  hash = hash_flow_key(key);
+  mask = table->size - 1;
+
+  for (idx = hash & mask; table->hashes[idx] != 0; idx = (idx + 1) & mask) {
+    record = &table->records[idx];
+    if (table->hashes[idx] != hash ||
+        memcmp(&record->key, key, sizeof(struct flow_key)) != 0) {
+      continue;
+    }
+
+    // A long lived flow is emitted every active_timeout
+    if (timestamp >= record->first_timestamp &&
+        timestamp - record->first_timestamp >= table->active_timeout) {
+      emit_flow_slot(table, idx);
+      record->first_timestamp = timestamp;
+      record->packets = 0;
+      record->bytes = 0;
+      record->tcp_flags = 0;
+    }
+
+    if (timestamp > record->last_timestamp) {
+      record->last_timestamp = timestamp;
+    }
+    record->packets++;
+    record->bytes += length;
+    record->tcp_flags |= tcp_flags;
+    table->packets++;
+    return 0;
+  }
+
+  if (is_flow_table_full(table)) {
+    // Only the least recently seen flow near the key is emitted, the other
+    // flows keep aggregating
+    size_t victim = find_flow_victim(table, hash & mask);
+
+    log_trace("Flow table full, evicting a flow");
+    emit_flow_slot(table, victim);
+    remove_flow_slot(table, victim);
+
+    // The slots moved, so find the insert slot again
+    for (idx = hash & mask; table->hashes[idx] != 0; idx = (idx + 1) & mask) {
+    }
+  }
+
+  table->hashes[idx] = hash;
+  record = &table->records[idx];
+  record->key = *key;
+  record->first_timestamp = timestamp;
+  record->last_timestamp = timestamp;
+  record->packets = 1;
+  record->bytes = length;
+  record->tcp_flags = tcp_flags;
+  table->count++;
+  table->packets++;
+
+  return 0;
+}
+
+size_t expire_flow_table(struct flow_table *table, uint64_t timestamp) {
+  size_t emitted = 0;
+
+  if (table == NULL) {
+    log_error("table param is NULL");
+    return 0;
+  }
+
+  for (size_t idx = 0; idx < table->size && table->count; idx++) {
+    // Removing a flow can shift the next flow into the same slot
+    while (table->hashes[idx] != 0 &&
+           is_flow_expired(table, &table->records[idx], timestamp)) {
+      emit_flow_slot(table, idx);
+      remove_flow_slot(table, idx);
+      emitted++;
+    }
+  }
+
+  return emitted;
+}
+
+size_t flush_flow_table(struct flow_table *table) {
+  size_t emitted = 0;
+
+  if (table == NULL) {
+    log_error("table param is NULL");
+    return 0;
+  }
+
+  for (size_t idx = 0; idx < table->size; idx++) {
+    if (table->hashes[idx] != 0) {
+      emit_flow_slot(table, idx);
+      table->hashes[idx] = 0;
+      emitted++;
+    }
+  }
+
+  table->count = 0;
+  return emitted;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the flow aggregation table.
+ *
+ * The flow table aggregates the packets of a unidirectional flow, keyed by
+ * the capture interface and the 5-tuple, into one flow record. It is an open
+ * addressing hash table with linear probing. The key hashes are stored in
+ * their own array, so a probe scans a few cache lines of hashes and only
+ * compares the keys of the matching hashes. Removed flows are backward
+ * shifted, so there are no tombstones.
+ *
+ * A flow is emitted when it was idle for idle_timeout, or when it was active
+ * for active_timeout, in which case the next packet starts a new flow record.
+ */
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../../utils/attributes.h"
+
+#define FLOW_ADDR_LEN 16 /* Address length, IPv4 uses the first 4 bytes */
+
+#define FLOW_TCP_FIN 0x01
+#define FLOW_TCP_SYN 0x02
+#define FLOW_TCP_RST 0x04
+#define FLOW_TCP_PSH 0x08
+#define FLOW_TCP_ACK 0x10
+#define FLOW_TCP_URG 0x20
+
+/**
+ * @brief Flow key structure definition
+ *
+ * The key is hashed and compared as bytes, so it must be zeroed before the
+ * fields are set.
+ */
+struct flow_key {
+  char ifname[IF_NAMESIZE];   /**< The capture interface */
+  uint8_t src[FLOW_ADDR_LEN]; /**< The source address */
+  uint8_t dst[FLOW_ADDR_LEN]; /**< The destination address */
+  uint16_t source;  /**< The source port (ICMP type) */
+  uint16_t dest;    /**< The destination port (ICMP code) */
+  uint8_t family;   /**< The address family, AF_INET or AF_INET6 */
+  uint8_t protocol; /**< The IP protocol */
+  uint16_t reserved; /**< Reserved, set to zero */
+};
+
+/**
+ * @brief Flow record structure definition
+ *
+ */
+struct flow_record {
+  struct flow_key key;      /**< The flow key */
+  uint64_t first_timestamp; /**< Timestamp of the first packet */
+  uint64_t last_timestamp;  /**< Timestamp of the last packet */
+  uint64_t packets;         /**< Number of packets */
+  uint64_t bytes;           /**< Number of bytes */
+  uint8_t tcp_flags;        /**< Union of the FLOW_TCP_* flags */
+};
+
+/**
+ * @brief Callback for the emitted flow records
+ *
+ * @param record The flow record
+ * @param ctx The callback context
+ */
+typedef void (*flow_emit_fn)(const struct flow_record *record, void *ctx);
+
+/**
+ * @brief Flow table structure definition
+ *
+ */
+struct flow_table {
+  uint32_t *hashes;            /**< The key hashes, 0 for an empty slot */
+  struct flow_record *records; /**< The flow records */
+  size_t size;                 /**< Number of slots (a power of two) */
+  size_t count;                /**< Number of flows */
+  uint64_t idle_timeout;   /**< The idle timeout in microseconds */
+  uint64_t active_timeout; /**< The active timeout in microseconds */
+  flow_emit_fn emit;       /**< The emitted flow records callback */
+  void *emit_ctx;          /**< The emit callback context */
+  uint64_t packets;        /**< Number of packets aggregated */
+  uint64_t emitted;        /**< Number of flow records emitted */
+};
+
+/**
+ * @brief Frees the flow table, without emitting the flows
+ *
+ * @param table The flow table
+ */
+void free_flow_table(struct flow_table *table);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_flow_table()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_flow_table                                                 \
+  __attribute__((malloc(free_flow_table, 1))) __must_check
+#else
+#define __must_free_flow_table __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a flow table
+ *
+ * @param size The number of slots, rounded up to a power of two
+ * @param idle_timeout The idle timeout in microseconds
+ * @param active_timeout The active timeout in microseconds
+ * @param emit The emitted flow records callback
+ * @param emit_ctx The emit callback context
+ * @return struct flow_table* The flow table, NULL on failure.
+ * You must free this using free_flow_table().
+ */
+__must_free_flow_table struct flow_table *
+init_flow_table(size_t size, uint64_t idle_timeout, uint64_t active_timeout,
+                flow_emit_fn emit, void *emit_ctx);
+
+/**
+ * @brief Adds a packet to its flow
+ *
+ * When the table is at its maximum load, the flow with the oldest last packet
+ * among the slots following the key home slot is emitted and removed.
+ *
+ * @param table The flow table
+ * @param key The flow key
+ * @param timestamp The packet timestamp in microseconds
+ * @param length The packet length
+ * @param tcp_flags The packet FLOW_TCP_* flags
+ * @return int 0 on success, -1 on failure
+ */
+int update_flow_table(struct flow_table *table, const struct flow_key *key,
+                      uint64_t timestamp, uint64_t length, uint8_t tcp_flags);
+
+/**
+ * @brief Emits and removes the idle and the active timed out flows
+ *
+ * @param table The flow table
+ * @param timestamp The current timestamp in microseconds
+ * @return size_t The number of emitted flows
+ */
+size_t expire_flow_table(struct flow_table *table, uint64_t timestamp);
+
+/**
+ * @brief Emits and removes all the flows
+ *
+ * @param table The flow table
+ * @return size_t The number of emitted flows
+ */
+size_t flush_flow_table(struct flow_table *table);
+
+#endif
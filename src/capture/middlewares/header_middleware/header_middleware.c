@@ -10,6 +10,9 @@
  */
 #include "header_middleware.h"
 
+#include <inttypes.h>
+#include <net/if.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,16 +24,180 @@
 #include "../../../utils/allocs.h"
 #include "../../../utils/log.h"
 #include "../../../utils/os.h"
+#include "flow_table.h"
 #include "packet_decoder.h"
+#include "packet_id.h"
 #include "packet_queue.h"
 #include "sqlite_header.h"
 
 #include "../../pcap_service.h"
 
 #define HEADER_PROCESS_INTERVAL 10 * 1000 // In microseconds
+#define HEADER_SCHEMA_SLAB_CHUNK 256 // Decoded schemas per slab chunk
+
+#ifdef WITH_HEADER_FLOWS
+#define HEADER_FLOWS true
+#else
+#define HEADER_FLOWS false
+#endif
+
+#define HEADER_FLOW_TABLE_SIZE 4096 // Number of flow table slots
+#define HEADER_FLOW_IDLE_TIMEOUT                                               \
+  60ULL * 1000000 /* Flow idle timeout in microseconds */
+#define HEADER_FLOW_ACTIVE_TIMEOUT                                             \
+  300ULL * 1000000 /* Flow active timeout in microseconds */
+
+struct header_middleware_context {
+  struct packet_queue *queue;
+  struct sqlite_header_writer *writer;
+  struct os_slab *schema_slab;
+  struct packet_id_gen ids;
+  struct flow_table *flows; // NULL if the flows are disabled
+  UT_array *flow_records;   // The emitted flows waiting to be saved
+};
 
 static const UT_icd tp_list_icd = {sizeof(struct tuple_packet), NULL, NULL,
                                    NULL};
+static const UT_icd flow_record_icd = {sizeof(struct flow_record), NULL, NULL,
+                                       NULL};
+
+static void emit_header_flow(const struct flow_record *record, void *ctx) {
+  UT_array *flow_records = (UT_array *)ctx;
+
+  utarray_push_back(flow_records, record);
+}
+
+static void save_header_flows(struct header_middleware_context *header_context) {
+  struct flow_record *record = NULL;
+
+  while ((record = (struct flow_record *)utarray_next(
+              header_context->flow_records, record)) != NULL) {
+    if (save_sqlite_header_flow(header_context->writer, record) < 0) {
+      log_error("save_sqlite_header_flow fail");
+    }
+  }
+
+  utarray_clear(header_context->flow_records);
+}
+
+static uint8_t get_tcp_flags(const struct tcp_schema *tcps) {
+  return (tcps->fin ? FLOW_TCP_FIN : 0) | (tcps->syn ? FLOW_TCP_SYN : 0) |
+         (tcps->rst ? FLOW_TCP_RST : 0) | (tcps->psh ? FLOW_TCP_PSH : 0) |
+         (tcps->ack ? FLOW_TCP_ACK : 0) | (tcps->urg ? FLOW_TCP_URG : 0);
+}
+
+/**
+ * Adds the decoded tuples of one packet to its flow. Only the plain
+ * TCP/UDP/ICMP packets are aggregated, the ARP, DNS, mDNS and DHCP packets
+ * are saved as rows.
+ *
+ * Returns 1 if the packet was aggregated, 0 if its tuples have to be saved
+ * and -1 on failure.
+ */
+static int add_header_flow(struct flow_table *flows, struct tuple_packet *tps,
+                           size_t count) {
+  struct flow_key key;
+  struct eth_schema *eths = NULL;
+  bool has_l3 = false, has_l4 = false;
+  uint8_t tcp_flags = 0;
+
+  os_memset(&key, 0, sizeof(key));
+
+  for (size_t idx = 0; idx < count; idx++) {
+    switch (tps[idx].type) {
+      case PACKET_ETHERNET:
+        eths = (struct eth_schema *)tps[idx].packet;
+        break;
+      case PACKET_IP4: {
+        struct ip4_schema *ip4s = (struct ip4_schema *)tps[idx].packet;
+        key.family = AF_INET;
+        key.protocol = ip4s->ip_p;
+        os_memcpy(key.src, &ip4s->ip_src, sizeof(struct in_addr));
+        os_memcpy(key.dst, &ip4s->ip_dst, sizeof(struct in_addr));
+        has_l3 = true;
+        break;
+      }
+      case PACKET_IP6: {
+        struct ip6_schema *ip6s = (struct ip6_schema *)tps[idx].packet;
+        key.family = AF_INET6;
+        key.protocol = ip6s->ip6_un1_nxt;
+        os_memcpy(key.src, &ip6s->ip6_src, sizeof(struct in6_addr));
+        os_memcpy(key.dst, &ip6s->ip6_dst, sizeof(struct in6_addr));
+        has_l3 = true;
+        break;
+      }
+      case PACKET_TCP: {
+        struct tcp_schema *tcps = (struct tcp_schema *)tps[idx].packet;
+        key.source = tcps->source;
+        key.dest = tcps->dest;
+        tcp_flags = get_tcp_flags(tcps);
+        has_l4 = true;
+        break;
+      }
+      case PACKET_UDP: {
+        struct udp_schema *udps = (struct udp_schema *)tps[idx].packet;
+        key.source = udps->source;
+        key.dest = udps->dest;
+        has_l4 = true;
+        break;
+      }
+      case PACKET_ICMP4: {
+        struct icmp4_schema *icmp4s = (struct icmp4_schema *)tps[idx].packet;
+        key.source = icmp4s->type;
+        key.dest = icmp4s->code;
+        has_l4 = true;
+        break;
+      }
+      case PACKET_ICMP6: {
+        struct icmp6_schema *icmp6s = (struct icmp6_schema *)tps[idx].packet;
+        key.source = icmp6s->icmp6_type;
+        key.dest = icmp6s->icmp6_code;
+        has_l4 = true;
+        break;
+      }
+      default:
+        return 0;
+    }
+  }
+
+  if (eths == NULL || !has_l3 || !has_l4) {
+    return 0;
+  }
+
+  os_strlcpy(key.ifname, eths->ifname, IF_NAMESIZE);
+
+  if (update_flow_table(flows, &key, eths->timestamp, eths->length,
+                        tcp_flags) < 0) {
+    log_error("update_flow_table fail");
+    return -1;
+  }
+
+  return 1;
+}
+
+/**
+ * Aggregates the tuples of the last packet, from start to the end of
+ * tp_array, and removes them if they were added to a flow.
+ */
+static void aggregate_header_packet(struct flow_table *flows,
+                                    UT_array *tp_array, unsigned int start) {
+  unsigned int len = utarray_len(tp_array);
+
+  if (flows == NULL || len <= start) {
+    return;
+  }
+
+  struct tuple_packet *tps =
+      (struct tuple_packet *)utarray_eltptr(tp_array, start);
+  if (add_header_flow(flows, tps, len - start) < 1) {
+    return;
+  }
+
+  for (unsigned int idx = 0; idx < len - start; idx++) {
+    free_packet_tuple(&tps[idx]);
+  }
+  utarray_resize(tp_array, start);
+}
 void add_packet_queue(UT_array *tp_array, struct packet_queue *queue) {
   struct tuple_packet *p = NULL;
 
@@ -47,7 +214,8 @@ void eloop_tout_header_handler(void *eloop_ctx, void *user_ctx) {
   (void)eloop_ctx;
 
   struct middleware_context *context = (struct middleware_context *)user_ctx;
-  struct packet_queue *queue, *el;
+  struct header_middleware_context *header_context;
+  struct packet_queue *el;
 
   if (context == NULL) {
     return;
@@ -57,18 +225,35 @@ void eloop_tout_header_handler(void *eloop_ctx, void *user_ctx) {
     return;
   }
 
-  queue = (struct packet_queue *)context->mdata;
+  header_context = (struct header_middleware_context *)context->mdata;
 
   // Process all packets in the queue
-  while (is_packet_queue_empty(queue) < 1) {
-    if ((el = pop_packet_queue(queue)) != NULL) {
-      save_packet_statement(context->db, &(el->tp));
+  while (is_packet_queue_empty(header_context->queue) < 1) {
+    if ((el = pop_packet_queue(header_context->queue)) != NULL) {
+      if (save_sqlite_header_packet(header_context->writer, &(el->tp)) < 0) {
+        log_error("save_sqlite_header_packet fail");
+      }
 
       free_packet_tuple(&el->tp);
       free_packet_queue_el(el);
     }
   }
 
+  if (header_context->flows != NULL) {
+    uint64_t timestamp;
+    if (os_get_timestamp(&timestamp) < 0) {
+      log_error("os_get_timestamp fail");
+    } else {
+      expire_flow_table(header_context->flows, timestamp);
+    }
+    save_header_flows(header_context);
+  }
+
+  // Commit all packets saved in this period
+  if (commit_sqlite_header_writer(header_context->writer) < 0) {
+    log_error("commit_sqlite_header_writer fail");
+  }
+
   if (edge_eloop_register_timeout(context->eloop, 0, HEADER_PROCESS_INTERVAL,
                                   eloop_tout_header_handler, NULL,
                                   (void *)user_ctx) == -1) {
@@ -77,22 +262,49 @@ void eloop_tout_header_handler(void *eloop_ctx, void *user_ctx) {
 }
 
 void free_header_middleware(struct middleware_context *context) {
+  struct header_middleware_context *header_context;
+
   if (context != NULL) {
     if (context->mdata != NULL) {
-      free_packet_queue((struct packet_queue *)context->mdata);
+      header_context = (struct header_middleware_context *)context->mdata;
+
+      // Save the open flows before the writer commits and closes
+      if (header_context->flows != NULL && header_context->writer != NULL) {
+        flush_flow_table(header_context->flows);
+        save_header_flows(header_context);
+      }
+      free_flow_table(header_context->flows);
+      if (header_context->flow_records != NULL) {
+        utarray_free(header_context->flow_records);
+      }
+      free_sqlite_header_writer(header_context->writer);
+
+      if (header_context->schema_slab != NULL) {
+        struct os_slab_stats stats;
+        get_os_slab_stats(header_context->schema_slab, &stats);
+        log_debug("Header schema slab: high_water=%zu capacity=%zu "
+                  "allocs=%" PRIu64,
+                  stats.high_water, stats.capacity, stats.allocs);
+      }
+
+      // The queued tuples point to the schema slab, so free the queue first
+      free_packet_queue(header_context->queue);
+      free_os_slab(header_context->schema_slab);
+      os_free(header_context);
       context->mdata = NULL;
     }
     os_free(context);
   }
 }
 
-struct middleware_context *init_header_middleware(sqlite3 *db, char *db_path,
-                                                  struct eloop_data *eloop,
-                                                  struct pcap_context *pc,
-                                                  char *params) {
+struct middleware_context *
+init_header_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                       struct pcap_context *pc, char *params,
+                       const struct capture_conf *config) {
   (void)db_path;
 
   struct middleware_context *context = NULL;
+  struct header_middleware_context *header_context = NULL;
 
   log_info("Init header middleware...");
 
@@ -116,18 +328,76 @@ struct middleware_context *init_header_middleware(sqlite3 *db, char *db_path,
   context->pc = pc;
   context->params = params;
 
-  if ((context->mdata = (void *)init_packet_queue()) == NULL) {
+  if ((header_context = os_zalloc(sizeof(struct header_middleware_context))) ==
+      NULL) {
+    log_errno("zalloc");
+    free_header_middleware(context);
+    return NULL;
+  }
+
+  context->mdata = (void *)header_context;
+
+  if ((header_context->queue = init_packet_queue()) == NULL) {
     log_error("init_packet_queue fail");
     free_header_middleware(context);
     return NULL;
   }
 
+  if ((header_context->schema_slab = init_os_slab(
+           sizeof(union packet_schema), HEADER_SCHEMA_SLAB_CHUNK)) == NULL) {
+    log_error("init_os_slab fail");
+    free_header_middleware(context);
+    return NULL;
+  }
+
   if (init_sqlite_header_db(db) < 0) {
     log_error("init_sqlite_header_db fail");
     free_header_middleware(context);
     return NULL;
   }
 
+  // The interface gets its own id slot in the db and the ids continue after
+  // the stored ones, so a restarted capture doesn't reissue them
+  int slot = PACKET_ID_DEFAULT_SLOT;
+  uint64_t last_id;
+  if (pc != NULL && (slot = get_sqlite_packet_id_slot(db, pc->ifname)) < 0) {
+    log_error("get_sqlite_packet_id_slot fail");
+    free_header_middleware(context);
+    return NULL;
+  }
+
+  if (get_sqlite_header_last_id(db, &last_id) < 0) {
+    log_error("get_sqlite_header_last_id fail");
+    free_header_middleware(context);
+    return NULL;
+  }
+
+  init_packet_id_gen(&header_context->ids, (unsigned int)slot, last_id);
+
+  unsigned int batch_size =
+      (config != NULL) ? config->header_batch_size : DEFAULT_HEADER_BATCH_SIZE;
+  log_info("Header batch size=%u", batch_size);
+
+  if ((header_context->writer = init_sqlite_header_writer(db, batch_size)) ==
+      NULL) {
+    log_error("init_sqlite_header_writer fail");
+    free_header_middleware(context);
+    return NULL;
+  }
+
+  if (HEADER_FLOWS) {
+    utarray_new(header_context->flow_records, &flow_record_icd);
+
+    if ((header_context->flows = init_flow_table(
+             HEADER_FLOW_TABLE_SIZE, HEADER_FLOW_IDLE_TIMEOUT,
+             HEADER_FLOW_ACTIVE_TIMEOUT, emit_header_flow,
+             (void *)header_context->flow_records)) == NULL) {
+      log_error("init_flow_table fail");
+      free_header_middleware(context);
+      return NULL;
+    }
+  }
+
   if (edge_eloop_register_timeout(eloop, 0, HEADER_PROCESS_INTERVAL,
                                   eloop_tout_header_handler, NULL,
                                   (void *)context) == -1) {
@@ -142,7 +412,7 @@ struct middleware_context *init_header_middleware(sqlite3 *db, char *db_path,
 int process_header_middleware(struct middleware_context *context,
                               const char *ltype, struct pcap_pkthdr *header,
                               uint8_t *packet, char *ifname) {
-  struct packet_queue *queue;
+  struct header_middleware_context *header_context;
   int npackets;
   UT_array *tp_array = NULL;
 
@@ -156,25 +426,85 @@ int process_header_middleware(struct middleware_context *context,
     return -1;
   }
 
-  queue = (struct packet_queue *)context->mdata;
+  header_context = (struct header_middleware_context *)context->mdata;
 
   utarray_new(tp_array, &tp_list_icd);
 
-  npackets = extract_packets(ltype, header, packet, ifname, tp_array);
+  npackets = extract_slab_packets(
+      ltype, header, packet, ifname, &header_context->ids,
+      header_context->schema_slab, PACKET_DECODE_ALL, tp_array);
 
   if (npackets < 0) {
-    log_error("extract_packets fail");
+    log_error("extract_slab_packets fail");
   } else if (npackets > 0) {
-    add_packet_queue(tp_array, queue);
+    aggregate_header_packet(header_context->flows, tp_array, 0);
+    add_packet_queue(tp_array, header_context->queue);
+  }
+
+  utarray_free(tp_array);
+
+  return 0;
+}
+
+int process_batch_header_middleware(struct middleware_context *context,
+                                    const char *ltype,
+                                    struct middleware_packet *packets,
+                                    size_t count, char *ifname) {
+  struct header_middleware_context *header_context;
+  UT_array *tp_array = NULL;
+
+  if (context == NULL) {
+    log_error("context params is NULL");
+    return -1;
   }
 
+  if (context->mdata == NULL) {
+    log_error("mdata params is NULL");
+    return -1;
+  }
+
+  header_context = (struct header_middleware_context *)context->mdata;
+
+  // The schemas of the whole batch are pushed to the queue in one go
+  utarray_new(tp_array, &tp_list_icd);
+
+  for (size_t idx = 0; idx < count; idx++) {
+    unsigned int start = utarray_len(tp_array);
+
+    if (extract_slab_packets(ltype, &packets[idx].header, packets[idx].packet,
+                             ifname, &header_context->ids,
+                             header_context->schema_slab, PACKET_DECODE_ALL,
+                             tp_array) < 0) {
+      log_error("extract_slab_packets fail");
+    } else {
+      aggregate_header_packet(header_context->flows, tp_array, start);
+    }
+  }
+
+  add_packet_queue(tp_array, header_context->queue);
   utarray_free(tp_array);
 
   return 0;
 }
+
+ssize_t queue_length_header_middleware(struct middleware_context *context) {
+  struct header_middleware_context *header_context;
+
+  if (context == NULL || context->mdata == NULL) {
+    log_error("context params is NULL");
+    return -1;
+  }
+
+  header_context = (struct header_middleware_context *)context->mdata;
+  return get_packet_queue_length(header_context->queue);
+}
+
 struct capture_middleware header_middleware = {
     .init = init_header_middleware,
     .process = process_header_middleware,
     .free = free_header_middleware,
     .name = "header middleware",
+    .process_batch = process_batch_header_middleware,
+    .queue_length = queue_length_header_middleware,
+    .snaplen = MIDDLEWARE_SNAPLEN_HEADERS,
 };
@@ -213,7 +213,12 @@ bool decode_mdns_packet(struct capture_packet *cpac) {
   } else
     return false;
 
-  strcpy(cpac->mdnss.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->mdnsh, sizeof(struct mdns_header))) {
+    cpac->mdnsh = NULL;
+    return false;
+  }
+
+  cpac->mdnss.id = cpac->id;
 
   if (decode_mdns_header((uint8_t *)cpac->mdnsh, &mdnsh) < 0) {
     return false;
@@ -9,6 +9,7 @@
  */
 
 #define _GNU_SOURCE
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -58,7 +59,14 @@ bool decode_dhcp_packet(struct capture_packet *cpac) {
   } else
     return false;
 
-  strcpy(cpac->dhcps.id, cpac->id);
+  // The BOOTP legacy octets are not decoded
+  if (!has_capture_bytes(cpac, cpac->dhcph,
+                         offsetof(struct dhcp_header, legacy))) {
+    cpac->dhcph = NULL;
+    return false;
+  }
+
+  cpac->dhcps.id = cpac->id;
 
   cpac->dhcps.op = cpac->dhcph->op;
   cpac->dhcps.htype = cpac->dhcph->htype;
@@ -68,10 +76,11 @@ bool decode_dhcp_packet(struct capture_packet *cpac) {
   cpac->dhcps.secs = ntohs(cpac->dhcph->secs);
   cpac->dhcps.flags = ntohs(cpac->dhcph->flags);
 
-  bit32_2_ip(cpac->dhcph->ciaddr, cpac->dhcps.ciaddr);
-  bit32_2_ip(cpac->dhcph->yiaddr, cpac->dhcps.yiaddr);
-  bit32_2_ip(cpac->dhcph->siaddr, cpac->dhcps.siaddr);
-  bit32_2_ip(cpac->dhcph->giaddr, cpac->dhcps.giaddr);
+  cpac->dhcps.ciaddr.s_addr = cpac->dhcph->ciaddr;
+  cpac->dhcps.yiaddr.s_addr = cpac->dhcph->yiaddr;
+  cpac->dhcps.siaddr.s_addr = cpac->dhcph->siaddr;
+  cpac->dhcps.giaddr.s_addr = cpac->dhcph->giaddr;
+  os_memcpy(cpac->dhcps.chaddr, cpac->dhcph->chaddr, ETHER_ADDR_LEN);
 
   return false;
 }
@@ -84,7 +93,12 @@ bool decode_udp_packet(struct capture_packet *cpac) {
   else
     return false;
 
-  strcpy(cpac->udps.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->udph, sizeof(struct udphdr))) {
+    cpac->udph = NULL;
+    return false;
+  }
+
+  cpac->udps.id = cpac->id;
 
   cpac->udps.source = ntohs(cpac->udph->uh_sport);
   cpac->udps.dest = ntohs(cpac->udph->uh_dport);
@@ -104,7 +118,12 @@ bool decode_tcp_packet(struct capture_packet *cpac) {
   else
     return false;
 
-  strcpy(cpac->tcps.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->tcph, sizeof(struct tcphdr))) {
+    cpac->tcph = NULL;
+    return false;
+  }
+
+  cpac->tcps.id = cpac->id;
 
   cpac->tcps.source = ntohs(cpac->tcph->th_sport);
   cpac->tcps.dest = ntohs(cpac->tcph->th_dport);
@@ -130,7 +149,13 @@ bool decode_icmp4_packet(struct capture_packet *cpac) {
   // don't use icmphdr, it's non-standard and not supported on FreeBSD
   cpac->icmp4h = (struct icmp *)((char *)cpac->ip4h + sizeof(struct ip));
 
-  strcpy(cpac->icmp4s.id, cpac->id);
+  // Only the type, code, checksum and gateway fields are decoded
+  if (!has_capture_bytes(cpac, cpac->icmp4h, 8)) {
+    cpac->icmp4h = NULL;
+    return false;
+  }
+
+  cpac->icmp4s.id = cpac->id;
 
   cpac->icmp4s.type = cpac->icmp4h->icmp_type;
   cpac->icmp4s.code = cpac->icmp4h->icmp_code;
@@ -146,7 +171,12 @@ bool decode_icmp6_packet(struct capture_packet *cpac) {
   cpac->icmp6h =
       (struct icmp6_hdr *)((char *)cpac->ip6h + sizeof(struct ip6_hdr));
 
-  strcpy(cpac->icmp6s.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->icmp6h, sizeof(struct icmp6_hdr))) {
+    cpac->icmp6h = NULL;
+    return false;
+  }
+
+  cpac->icmp6s.id = cpac->id;
 
   cpac->icmp6s.icmp6_type = cpac->icmp6h->icmp6_type;
   cpac->icmp6s.icmp6_code = cpac->icmp6h->icmp6_code;
@@ -161,14 +191,15 @@ bool decode_icmp6_packet(struct capture_packet *cpac) {
 }
 
 bool decode_ip4_packet(struct capture_packet *cpac) {
+  cpac->ip4h = (struct ip *)((char *)cpac->ethh + sizeof(struct ether_header));
+
   // Return false if the header is not of the right length
-  if (cpac->length - sizeof(struct ether_header) < sizeof(struct ip)) {
+  if (!has_capture_bytes(cpac, cpac->ip4h, sizeof(struct ip))) {
+    cpac->ip4h = NULL;
     return false;
   }
 
-  cpac->ip4h = (struct ip *)((char *)cpac->ethh + sizeof(struct ether_header));
-
-  strcpy(cpac->ip4s.id, cpac->id);
+  cpac->ip4s.id = cpac->id;
 
   cpac->ip4s.ip_hl = cpac->ip4h->ip_hl;
   cpac->ip4s.ip_v = cpac->ip4h->ip_v;
@@ -179,43 +210,38 @@ bool decode_ip4_packet(struct capture_packet *cpac) {
   cpac->ip4s.ip_ttl = cpac->ip4h->ip_ttl;
   cpac->ip4s.ip_p = cpac->ip4h->ip_p;
   cpac->ip4s.ip_sum = ntohs(cpac->ip4h->ip_sum);
-  inaddr4_2_ip(&((cpac->ip4h)->ip_src), cpac->ip4s.ip_src);
-  inaddr4_2_ip(&((cpac->ip4h)->ip_dst), cpac->ip4s.ip_dst);
-
-  // log_trace("IP4 ip_src=%s ip_dst=%s ip_p=%d ip_v=%d", cpac->ip4s.ip_src,
-  // cpac->ip4s.ip_dst, cpac->ip4s.ip_p, cpac->ip4s.ip_v);
+  cpac->ip4s.ip_src = cpac->ip4h->ip_src;
+  cpac->ip4s.ip_dst = cpac->ip4h->ip_dst;
 
   // Process futher packets only if IP is version 4
   return (cpac->ip4s.ip_v == 4);
 }
 
 bool decode_ip6_packet(struct capture_packet *cpac) {
+  cpac->ip6h =
+      (struct ip6_hdr *)((char *)cpac->ethh + sizeof(struct ether_header));
+
   // Return false if the header is not of the right length
-  if (cpac->length - sizeof(struct ether_header) < sizeof(struct ip6_hdr)) {
+  if (!has_capture_bytes(cpac, cpac->ip6h, sizeof(struct ip6_hdr))) {
+    cpac->ip6h = NULL;
     return false;
   }
 
-  cpac->ip6h =
-      (struct ip6_hdr *)((char *)cpac->ethh + sizeof(struct ether_header));
-
   // Wrong IP6 version
   if (((cpac->ip6h)->ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION) {
     cpac->ip6h = NULL;
     return false;
   }
 
-  strcpy(cpac->ip6s.id, cpac->id);
+  cpac->ip6s.id = cpac->id;
 
   cpac->ip6s.ip6_un1_flow = ntohl(cpac->ip6h->ip6_flow);
   cpac->ip6s.ip6_un1_plen = ntohs(cpac->ip6h->ip6_plen);
   cpac->ip6s.ip6_un1_nxt = cpac->ip6h->ip6_nxt;
   cpac->ip6s.ip6_un1_hlim = cpac->ip6h->ip6_hlim;
   cpac->ip6s.ip6_un2_vfc = cpac->ip6h->ip6_vfc;
-  inaddr6_2_ip(&(cpac->ip6h->ip6_src), cpac->ip6s.ip6_src);
-  inaddr6_2_ip(&(cpac->ip6h->ip6_dst), cpac->ip6s.ip6_dst);
-
-  // log_trace("IP6 ip6_src=%s ip6_dst=%s", cpac->ip6s.ip6_src,
-  // cpac->ip6s.ip6_dst);
+  cpac->ip6s.ip6_src = cpac->ip6h->ip6_src;
+  cpac->ip6s.ip6_dst = cpac->ip6h->ip6_dst;
   return true;
 }
 
@@ -223,7 +249,12 @@ bool decode_arp_packet(struct capture_packet *cpac) {
   cpac->arph =
       (struct ether_arp *)((char *)cpac->ethh + sizeof(struct ether_header));
 
-  strcpy(cpac->arps.id, cpac->id);
+  if (!has_capture_bytes(cpac, cpac->arph, sizeof(struct ether_arp))) {
+    cpac->arph = NULL;
+    return false;
+  }
+
+  cpac->arps.id = cpac->id;
 
   cpac->arps.ar_hrd = ntohs(cpac->arph->arp_hrd);
   cpac->arps.ar_pro = ntohs(cpac->arph->arp_pro);
@@ -231,14 +262,11 @@ bool decode_arp_packet(struct capture_packet *cpac) {
   cpac->arps.ar_pln = cpac->arph->arp_pln;
   cpac->arps.ar_op = ntohs(cpac->arph->arp_op);
 
-  snprintf(cpac->arps.arp_sha, MACSTR_LEN, MACSTR,
-           MAC2STR(cpac->arph->arp_sha));
-  snprintf(cpac->arps.arp_spa, OS_INET_ADDRSTRLEN, IPSTR,
-           IP2STR(cpac->arph->arp_spa));
-  snprintf(cpac->arps.arp_tha, MACSTR_LEN, MACSTR,
-           MAC2STR(cpac->arph->arp_tha));
-  snprintf(cpac->arps.arp_tpa, OS_INET_ADDRSTRLEN, IPSTR,
-           IP2STR(cpac->arph->arp_tpa));
+  // The ARP addresses are not aligned in the packet
+  os_memcpy(cpac->arps.arp_sha, cpac->arph->arp_sha, ETHER_ADDR_LEN);
+  os_memcpy(&cpac->arps.arp_spa, cpac->arph->arp_spa, IP_ALEN);
+  os_memcpy(cpac->arps.arp_tha, cpac->arph->arp_tha, ETHER_ADDR_LEN);
+  os_memcpy(&cpac->arps.arp_tpa, cpac->arph->arp_tpa, IP_ALEN);
 
   // log_trace("ARP arp_sha=" MACSTR " arp_spa=" IPSTR " arp_tha=" MACSTR,
   // MAC2STR((cpac->arph)->arp_sha), IP2STR((cpac->arph)->arp_spa),
@@ -254,15 +282,15 @@ bool decode_eth_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
 
     // Init eth packet schema
     cpac->eths.timestamp = cpac->timestamp;
-    strcpy(cpac->eths.id, cpac->id);
+    cpac->eths.id = cpac->id;
     strcpy(cpac->eths.ifname, cpac->ifname);
     cpac->eths.caplen = cpac->caplen;
     cpac->eths.length = cpac->length;
 
-    snprintf(cpac->eths.ether_dhost, MACSTR_LEN, MACSTR,
-             MAC2STR(cpac->ethh->ether_dhost));
-    snprintf(cpac->eths.ether_shost, MACSTR_LEN, MACSTR,
-             MAC2STR(cpac->ethh->ether_shost));
+    os_memcpy(cpac->eths.ether_dhost, cpac->ethh->ether_dhost,
+              ETHER_ADDR_LEN);
+    os_memcpy(cpac->eths.ether_shost, cpac->ethh->ether_shost,
+              ETHER_ADDR_LEN);
     cpac->eths.ether_type = ntohs(cpac->ethh->ether_type);
 
     // log_trace("Ethernet type=0x%x ether_dhost=%s ether_shost=%s ethh=0x%x",
@@ -275,15 +303,41 @@ bool decode_eth_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
   return false;
 }
 
+/*
+ * The layers are decoded in order, so the decoder stops at the last layer
+ * in the decode mask. The headers of the lower layers are still decoded,
+ * since the upper layers are located from them.
+ */
+#define DECODE_ARP_MASK PACKET_DECODE_MASK(PACKET_ARP)
+#define DECODE_APP_MASK                                                        \
+  (PACKET_DECODE_MASK(PACKET_DNS) | PACKET_DECODE_MASK(PACKET_MDNS) |          \
+   PACKET_DECODE_MASK(PACKET_DHCP))
+#define DECODE_TRANSPORT_MASK                                                  \
+  (PACKET_DECODE_MASK(PACKET_TCP) | PACKET_DECODE_MASK(PACKET_UDP) |           \
+   PACKET_DECODE_MASK(PACKET_ICMP4) | PACKET_DECODE_MASK(PACKET_ICMP6) |       \
+   DECODE_APP_MASK)
+#define DECODE_NETWORK_MASK                                                    \
+  (PACKET_DECODE_MASK(PACKET_IP4) | PACKET_DECODE_MASK(PACKET_IP6) |           \
+   DECODE_TRANSPORT_MASK)
+
 int decode_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
-                  struct capture_packet *cpac) {
+                  struct capture_packet *cpac, uint32_t decode_mask) {
   int count = 0;
 
   if (decode_eth_packet(header, packet, cpac)) {
     count = 1;
-    if (cpac->eths.ether_type == ETHERTYPE_IP) {
+    if (!(decode_mask & (DECODE_NETWORK_MASK | DECODE_ARP_MASK))) {
+      return count;
+    }
+
+    if (cpac->eths.ether_type == ETHERTYPE_IP &&
+        (decode_mask & DECODE_NETWORK_MASK)) {
       if (decode_ip4_packet(cpac)) {
         count++;
+        if (!(decode_mask & DECODE_TRANSPORT_MASK)) {
+          return count;
+        }
+
         if ((cpac->ip4h)->ip_p == IPPROTO_TCP) {
           if (decode_tcp_packet(cpac))
             count++;
@@ -295,9 +349,14 @@ int decode_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
             count++;
         }
       }
-    } else if (cpac->eths.ether_type == ETHERTYPE_IPV6) {
+    } else if (cpac->eths.ether_type == ETHERTYPE_IPV6 &&
+               (decode_mask & DECODE_NETWORK_MASK)) {
       if (decode_ip6_packet(cpac)) {
         count++;
+        if (!(decode_mask & DECODE_TRANSPORT_MASK)) {
+          return count;
+        }
+
         if ((cpac->ip6h)->ip6_nxt == IPPROTO_TCP) {
           if (decode_tcp_packet(cpac))
             count++;
@@ -309,11 +368,16 @@ int decode_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
             count++;
         }
       }
-    } else if (cpac->eths.ether_type == ETHERTYPE_ARP) {
+    } else if (cpac->eths.ether_type == ETHERTYPE_ARP &&
+               (decode_mask & DECODE_ARP_MASK)) {
       if (decode_arp_packet(cpac))
         count++;
     }
 
+    if (!(decode_mask & DECODE_APP_MASK)) {
+      return count;
+    }
+
     if ((void *)cpac->tcph != NULL) {
       if (ntohs((cpac->tcph)->th_sport) == DNS_PORT ||
           ntohs((cpac->tcph)->th_dport) == DNS_PORT) {
@@ -346,17 +410,42 @@ int decode_packet(const struct pcap_pkthdr *header, const uint8_t *packet,
   return count;
 }
 
-int extract_packets(const char *ltype, const struct pcap_pkthdr *header,
-                    const uint8_t *packet, char *interface,
-                    UT_array *tp_array) {
+static int push_tuple_packet(UT_array *tp_array, struct os_slab *slab,
+                             uint32_t decode_mask, PACKET_TYPES type,
+                             const void *schema, size_t size) {
+  struct tuple_packet tp = {.type = type, .slab = slab};
+
+  // The lower layers of a requested layer are decoded, but not returned
+  if (!(decode_mask & PACKET_DECODE_MASK(type))) {
+    return 0;
+  }
+
+  if (slab != NULL) {
+    tp.packet = os_slab_alloc(slab);
+  } else {
+    tp.packet = os_malloc(size);
+  }
+
+  if (tp.packet == NULL) {
+    log_errno("packet alloc");
+    return -1;
+  }
+
+  os_memcpy(tp.packet, schema, size);
+  utarray_push_back(tp_array, &tp);
+  return 0;
+}
+
+int extract_slab_packets(const char *ltype, const struct pcap_pkthdr *header,
+                         const uint8_t *packet, char *interface,
+                         struct packet_id_gen *ids, struct os_slab *slab,
+                         uint32_t decode_mask, UT_array *tp_array) {
   (void)ltype;
 
   struct capture_packet cpac;
-  struct tuple_packet tp;
   int count;
 
   memset(&cpac, 0, sizeof(struct capture_packet));
-  os_memset(&tp, 0, sizeof(struct tuple_packet));
 
   os_to_timestamp(header->ts, &cpac.timestamp);
   cpac.caplen = header->caplen;
@@ -364,109 +453,86 @@ int extract_packets(const char *ltype, const struct pcap_pkthdr *header,
 
   os_strlcpy(cpac.ifname, interface, IF_NAMESIZE);
 
-  generate_radom_uuid(cpac.id);
+  cpac.id = next_packet_id(ids);
 
-  if ((count = decode_packet(header, packet, &cpac)) > 0) {
-    if (cpac.ethh != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct eth_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.eths, sizeof(struct eth_schema));
-      tp.type = PACKET_ETHERNET;
-      utarray_push_back(tp_array, &tp);
+  if ((count = decode_packet(header, packet, &cpac, decode_mask)) > 0) {
+    if (cpac.ethh != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_ETHERNET,
+                          &cpac.eths, sizeof(struct eth_schema)) < 0) {
+      return -1;
     }
-    if (cpac.arph != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct arp_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.arps, sizeof(struct arp_schema));
-      tp.type = PACKET_ARP;
-      utarray_push_back(tp_array, &tp);
+    if (cpac.arph != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_ARP, &cpac.arps,
+                          sizeof(struct arp_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.ip4h != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_IP4, &cpac.ip4s,
+                          sizeof(struct ip4_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.ip6h != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_IP6, &cpac.ip6s,
+                          sizeof(struct ip6_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.tcph != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_TCP, &cpac.tcps,
+                          sizeof(struct tcp_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.udph != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_UDP, &cpac.udps,
+                          sizeof(struct udp_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.icmp4h != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_ICMP4,
+                          &cpac.icmp4s, sizeof(struct icmp4_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.icmp6h != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_ICMP6,
+                          &cpac.icmp6s, sizeof(struct icmp6_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.dnsh != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_DNS, &cpac.dnss,
+                          sizeof(struct dns_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.mdnsh != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_MDNS, &cpac.mdnss,
+                          sizeof(struct mdns_schema)) < 0) {
+      return -1;
+    }
+    if (cpac.dhcph != NULL &&
+        push_tuple_packet(tp_array, slab, decode_mask, PACKET_DHCP, &cpac.dhcps,
+                          sizeof(struct dhcp_schema)) < 0) {
+      return -1;
     }
-    if (cpac.ip4h != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct ip4_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.ip4s, sizeof(struct ip4_schema));
-      tp.type = PACKET_IP4;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.ip6h != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct ip6_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.ip6s, sizeof(struct ip6_schema));
-      tp.type = PACKET_IP6;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.tcph != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct tcp_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.tcps, sizeof(struct tcp_schema));
-      tp.type = PACKET_TCP;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.udph != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct udp_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.udps, sizeof(struct udp_schema));
-      tp.type = PACKET_UDP;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.icmp4h != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct icmp4_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.icmp4s, sizeof(struct icmp4_schema));
-      tp.type = PACKET_ICMP4;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.icmp6h != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct icmp6_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.icmp6s, sizeof(struct icmp6_schema));
-      tp.type = PACKET_ICMP6;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.dnsh != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct dns_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.dnss, sizeof(struct dns_schema));
-      tp.type = PACKET_DNS;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.mdnsh != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct mdns_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.mdnss, sizeof(struct mdns_schema));
-      tp.type = PACKET_MDNS;
-      utarray_push_back(tp_array, &tp);
-    };
-    if (cpac.dhcph != NULL) {
-      if ((tp.packet = os_malloc(sizeof(struct dhcp_schema))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      os_memcpy(tp.packet, &cpac.dhcps, sizeof(struct dhcp_schema));
-      tp.type = PACKET_DHCP;
-      utarray_push_back(tp_array, &tp);
-    };
   }
 
   return utarray_len(tp_array);
 }
+
+static struct packet_id_gen default_ids;
+static pthread_once_t default_ids_once = PTHREAD_ONCE_INIT;
+
+static void init_default_ids(void) {
+  init_packet_id_gen(&default_ids, PACKET_ID_DEFAULT_SLOT, 0);
+}
+
+void seed_extract_packet_ids(uint64_t last_id) {
+  pthread_once(&default_ids_once, init_default_ids);
+  seed_packet_id_gen(&default_ids, last_id);
+}
+
+int extract_packets(const char *ltype, const struct pcap_pkthdr *header,
+                    const uint8_t *packet, char *interface,
+                    uint32_t decode_mask, UT_array *tp_array) {
+  pthread_once(&default_ids_once, init_default_ids);
+
+  return extract_slab_packets(ltype, header, packet, interface, &default_ids,
+                              NULL, decode_mask, tp_array);
+}
@@ -6,12 +6,21 @@
  * SPDX-FileCopyrightText: © 2021 NQMCyber Ltd and edgesec contributors
  * SPDX-License-Identifier: LGPL-3.0-or-later
  * @brief File containing the definition of the packet decoder utilities.
+ *
+ * The packet schemas store the MAC and IP addresses in binary form (network
+ * byte order), so no text formatting is done while decoding. The sinks that
+ * need the text form render the addresses with mac_2_str(), inaddr4_2_ip()
+ * and inaddr6_2_ip().
  */
 
 #ifndef PACKET_DECODER_H
 #define PACKET_DECODER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <net/ethernet.h>
 #include <net/if.h>
+#include <netinet/in.h>
 #include <pcap.h>
 
 #include <utarray.h>
@@ -20,6 +29,8 @@
 #include "../../../utils/net.h"
 #include "../../../utils/os.h"
 
+#include "packet_id.h"
+
 #define MAX_QUESTION_LEN 255
 
 typedef enum packet_types {
@@ -37,9 +48,21 @@ typedef enum packet_types {
   PACKET_DHCP
 } PACKET_TYPES;
 
+/**
+ * @brief The decode mask bit of a packet type
+ */
+#define PACKET_DECODE_MASK(type) (1U << (type))
+
+/**
+ * @brief Decode mask for all the packet types
+ */
+#define PACKET_DECODE_ALL 0xFFFFFFFFU
+
 struct tuple_packet {
-  uint8_t *packet;   /**< Packet data */
-  PACKET_TYPES type; /**< Packet type */
+  uint8_t *packet;       /**< Packet data */
+  PACKET_TYPES type;     /**< Packet type */
+  struct os_slab *slab;  /**< The slab of the packet data (NULL if the packet
+                            data was allocated with os_malloc) */
 };
 
 /**
@@ -48,13 +71,13 @@ struct tuple_packet {
  */
 struct eth_schema {
   uint64_t timestamp;           /**< Packet timestamp */
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint32_t caplen;              /**< Packet caplen */
   uint32_t length;              /**< Packet length */
   char ifname[IF_NAMESIZE];     /**< Packet interface name */
-  char ether_dhost[MACSTR_LEN]; /**< Packet destination eth addr */
-  char ether_shost[MACSTR_LEN]; /**< Packet source ether addr */
-  uint16_t ether_type;          /**< Packet packet type ID field */
+  uint8_t ether_dhost[ETHER_ADDR_LEN]; /**< Packet destination eth addr */
+  uint8_t ether_shost[ETHER_ADDR_LEN]; /**< Packet source ether addr */
+  uint16_t ether_type;                 /**< Packet packet type ID field */
 };
 
 /**
@@ -62,16 +85,16 @@ struct eth_schema {
  *
  */
 struct arp_schema {
-  char id[MAX_RANDOM_UUID_LEN];     /**< Packet id */
+  uint64_t id;                      /**< Packet id */
   uint16_t ar_hrd;                  /**< Packet Format of hardware address.  */
   uint16_t ar_pro;                  /**< Packet Format of protocol address.  */
   uint8_t ar_hln;                   /**< Packet Length of hardware address.  */
   uint8_t ar_pln;                   /**< Packet Length of protocol address.  */
   uint16_t ar_op;                   /**< Packet ARP opcode (command).  */
-  char arp_sha[MACSTR_LEN];         /**< Packet sender hardware address */
-  char arp_spa[OS_INET_ADDRSTRLEN]; /**< Packet sender protocol address */
-  char arp_tha[MACSTR_LEN];         /**< Packet target hardware address */
-  char arp_tpa[OS_INET_ADDRSTRLEN]; /**< Packet target protocol address */
+  uint8_t arp_sha[ETHER_ADDR_LEN]; /**< Packet sender hardware address */
+  struct in_addr arp_spa;          /**< Packet sender protocol address */
+  uint8_t arp_tha[ETHER_ADDR_LEN]; /**< Packet target hardware address */
+  struct in_addr arp_tpa;          /**< Packet target protocol address */
 };
 
 /**
@@ -79,9 +102,9 @@ struct arp_schema {
  *
  */
 struct ip4_schema {
-  char id[MAX_RANDOM_UUID_LEN];    /**< Packet id */
-  char ip_src[OS_INET_ADDRSTRLEN]; /**< Packet source address */
-  char ip_dst[OS_INET_ADDRSTRLEN]; /**< Packet dest address */
+  uint64_t id;                     /**< Packet id */
+  struct in_addr ip_src;        /**< Packet source address */
+  struct in_addr ip_dst;        /**< Packet dest address */
 
   uint8_t ip_hl;   /**< Packet header length */
   uint8_t ip_v;    /**< Packet version */
@@ -99,15 +122,15 @@ struct ip4_schema {
  *
  */
 struct ip6_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint32_t
       ip6_un1_flow; /**< Packet 4 bits version, 8 bits TC, 20 bits flow-ID */
   uint16_t ip6_un1_plen; /**< Packet payload length */
   uint8_t ip6_un1_nxt;   /**< Packet next header */
   uint8_t ip6_un1_hlim;  /**< Packet hop limit */
   uint8_t ip6_un2_vfc;   /**< Packet 4 bits version, top 4 bits tclass */
-  char ip6_src[OS_INET6_ADDRSTRLEN]; /**< Packet source address */
-  char ip6_dst[OS_INET6_ADDRSTRLEN]; /**< Packet destination address */
+  struct in6_addr ip6_src; /**< Packet source address */
+  struct in6_addr ip6_dst; /**< Packet destination address */
 };
 
 /**
@@ -115,7 +138,7 @@ struct ip6_schema {
  *
  */
 struct tcp_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint16_t source;              /**< Packet source port */
   uint16_t dest;                /**< Packet destination port */
   uint32_t seq;                 /**< Packet seq flag */
@@ -138,7 +161,7 @@ struct tcp_schema {
  *
  */
 struct udp_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint16_t source;              /**< Packet source port */
   uint16_t dest;                /**< Packet destination port */
   uint16_t len;                 /**< Packet udp length */
@@ -150,7 +173,7 @@ struct udp_schema {
  *
  */
 struct icmp4_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint8_t type;                 /**< Packet message type */
   uint8_t code;                 /**< Packet type sub-code */
   uint16_t checksum;            /**< Packet checksum */
@@ -162,7 +185,7 @@ struct icmp4_schema {
  *
  */
 struct icmp6_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint8_t icmp6_type;           /**< Packet type field */
   uint8_t icmp6_code;           /**< Packet code field */
   uint16_t icmp6_cksum;         /**< Packet checksum field */
@@ -174,7 +197,7 @@ struct icmp6_schema {
  *
  */
 struct dns_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint16_t tid;                 /**< Packet Transaction ID */
   uint16_t flags;               /**< Packet Flags */
   uint16_t nqueries;            /**< Packet Questions */
@@ -189,7 +212,7 @@ struct dns_schema {
  *
  */
 struct mdns_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint16_t tid;                 /**< Packet Transaction ID */
   uint16_t flags;               /**< Packet Flags */
   uint16_t nqueries;            /**< Packet Questions */
@@ -204,7 +227,7 @@ struct mdns_schema {
  *
  */
 struct dhcp_schema {
-  char id[MAX_RANDOM_UUID_LEN]; /**< Packet id */
+  uint64_t id;                  /**< Packet id */
   uint8_t op;                   /**< Packet packet type */
   uint8_t htype; /**< Packet type of hardware address for this machine
                     (Ethernet, etc) */
@@ -212,15 +235,15 @@ struct dhcp_schema {
   uint8_t hops;  /**< Packet hops */
   uint32_t
       xid; /**< Packet random transaction id number - chosen by this machine */
-  uint16_t secs;                   /**< Packet seconds used in timing */
-  uint16_t flags;                  /**< Packet flags */
-  char ciaddr[OS_INET_ADDRSTRLEN]; /**< Packet IP address of this machine (if we
-                                      already have one) */
-  char yiaddr[OS_INET_ADDRSTRLEN]; /**< Packet IP address of this machine
-                                      (offered by the DHCP server) */
-  char siaddr[OS_INET_ADDRSTRLEN]; /**< Packet IP address of DHCP server */
-  char giaddr[OS_INET_ADDRSTRLEN]; /**< Packet IP address of DHCP relay */
-  char chaddr[MACSTR_LEN];         /**< Packet client ether MAC addr */
+  uint16_t secs;          /**< Packet seconds used in timing */
+  uint16_t flags;         /**< Packet flags */
+  struct in_addr ciaddr;  /**< Packet IP address of this machine (if we
+                             already have one) */
+  struct in_addr yiaddr;  /**< Packet IP address of this machine
+                             (offered by the DHCP server) */
+  struct in_addr siaddr;  /**< Packet IP address of DHCP server */
+  struct in_addr giaddr;  /**< Packet IP address of DHCP relay */
+  uint8_t chaddr[ETHER_ADDR_LEN]; /**< Packet client ether MAC addr */
 };
 
 /**
@@ -330,20 +353,96 @@ struct capture_packet {
   uint32_t caplen;
   uint32_t length;
   char ifname[IF_NAMESIZE];
-  char id[MAX_RANDOM_UUID_LEN];
+  uint64_t id;
+};
+
+/**
+ * @brief Checks if a packet header was captured
+ *
+ * The packets are truncated to the capture snapshot length, so the decoders
+ * must only read the captured bytes.
+ *
+ * @param cpac The capture packet
+ * @param header The start of the header
+ * @param size The header size
+ * @return true if the header is in the captured bytes, false otherwise
+ */
+static inline bool has_capture_bytes(const struct capture_packet *cpac,
+                                     const void *header, size_t size) {
+  size_t offset =
+      (size_t)((const uint8_t *)header - (const uint8_t *)cpac->ethh);
+
+  return offset <= cpac->caplen && size <= cpac->caplen - offset;
+}
+
+/**
+ * @brief Union of all the packet schemas, used to size the schema slabs
+ *
+ */
+union packet_schema {
+  struct eth_schema eths;
+  struct arp_schema arps;
+  struct ip4_schema ip4s;
+  struct ip6_schema ip6s;
+  struct tcp_schema tcps;
+  struct udp_schema udps;
+  struct icmp4_schema icmp4s;
+  struct icmp6_schema icmp6s;
+  struct dns_schema dnss;
+  struct mdns_schema mdnss;
+  struct dhcp_schema dhcps;
 };
 
 /**
  * @brief Extract packets from pcap packet data
  *
+ * The packet ids are taken from a process wide generator. Only the packet
+ * types in decode_mask are returned, and the decoder stops at the last
+ * layer requested, e.g. PACKET_DECODE_MASK(PACKET_IP4) skips the transport
+ * and application layers.
+ *
  * @param ltype The link type
  * @param header The packet header as per pcap
  * @param packet The packet data
  * @param interface The packet interface
+ * @param decode_mask The PACKET_DECODE_MASK() of the packet types to return,
+ * PACKET_DECODE_ALL for all types
  * @param tp_array The array of returned packet tuples
  * @return int Total count of packet tuples
  */
 int extract_packets(const char *ltype, const struct pcap_pkthdr *header,
-                    const uint8_t *packet, char *interface, UT_array *tp_array);
+                    const uint8_t *packet, char *interface,
+                    uint32_t decode_mask, UT_array *tp_array);
+
+/**
+ * @brief Makes the next extract_packets() ids greater than an id
+ *
+ * @param last_id The last id already stored, e.g. in the output db
+ */
+void seed_extract_packet_ids(uint64_t last_id);
+
+/**
+ * @brief Extract packets from pcap packet data, allocating the packet tuples
+ * from a slab
+ *
+ * The slab objects must be at least sizeof(union packet_schema) bytes. The
+ * packet tuples are freed with free_packet_tuple(), from the thread that owns
+ * the slab.
+ *
+ * @param ltype The link type
+ * @param header The packet header as per pcap
+ * @param packet The packet data
+ * @param interface The packet interface
+ * @param ids The packet id generator
+ * @param slab The packet tuples slab, NULL to use os_malloc
+ * @param decode_mask The PACKET_DECODE_MASK() of the packet types to return,
+ * PACKET_DECODE_ALL for all types
+ * @param tp_array The array of returned packet tuples
+ * @return int Total count of packet tuples
+ */
+int extract_slab_packets(const char *ltype, const struct pcap_pkthdr *header,
+                         const uint8_t *packet, char *interface,
+                         struct packet_id_gen *ids, struct os_slab *slab,
+                         uint32_t decode_mask, UT_array *tp_array);
 
 #endif
@@ -0,0 +1,67 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the packet id generator.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "packet_id.h"
+
+#define PACKET_ID_SLOT_MASK ((uint64_t)MAX_PACKET_ID_SLOTS - 1)
+
+// Returns the first id of a slot greater than last_id
+static uint64_t get_packet_id_after(uint64_t last_id, uint64_t slot) {
+  return (((last_id >> PACKET_ID_SLOT_BITS) + 1) << PACKET_ID_SLOT_BITS) |
+         slot;
+}
+
+void init_packet_id_gen(struct packet_id_gen *gen, unsigned int slot,
+                        uint64_t last_id) {
+  time_t now = time(NULL);
+  uint64_t start = (now > PACKET_ID_EPOCH) ? (uint64_t)(now - PACKET_ID_EPOCH)
+                                           : 0;
+  uint64_t slot_bits = slot & PACKET_ID_SLOT_MASK;
+  uint64_t next =
+      (start << (PACKET_ID_COUNTER_BITS + PACKET_ID_SLOT_BITS)) | slot_bits;
+
+  if (last_id >= next) {
+    next = get_packet_id_after(last_id, slot_bits);
+  }
+
+  atomic_init(&gen->next, next);
+}
+
+void seed_packet_id_gen(struct packet_id_gen *gen, uint64_t last_id) {
+  uint64_t next = atomic_load_explicit(&gen->next, memory_order_relaxed);
+  uint64_t after;
+
+  do {
+    if (next > last_id) {
+      return;
+    }
+    after = get_packet_id_after(last_id, next & PACKET_ID_SLOT_MASK);
+  } while (!atomic_compare_exchange_weak_explicit(
+      &gen->next, &next, after, memory_order_relaxed, memory_order_relaxed));
+}
+
+const char *packet_id_2_uuid(uint64_t id,
+                             char str[static MAX_RANDOM_UUID_LEN]) {
+  // The 64 bits of the id fill the first four groups around the version and
+  // variant fields (RFC 9562)
+  snprintf(str, MAX_RANDOM_UUID_LEN,
+           "%08" PRIx32 "-%04" PRIx32 "-8%03" PRIx32 "-8%03" PRIx32
+           "-000000000000",
+           (uint32_t)(id >> 32), (uint32_t)((id >> 16) & 0xffff),
+           (uint32_t)((id >> 4) & 0xfff), (uint32_t)(id & 0xf));
+
+  return str;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the packet id generator.
+ *
+ * A packet id is a 64 bit number that joins the rows of the header tables
+ * for the same captured packet. The id is made of the capture start time
+ * (seconds since PACKET_ID_EPOCH), a packet counter and the slot of the
+ * capture interface:
+ *
+ * | start time (32 bits) | counter (24 bits) | slot (8 bits) |
+ *
+ * Every interface writing to a capture db gets its own slot from that db, so
+ * the interfaces never share an id. A generator starts after the last id
+ * stored in the db, so a capture that restarts within the same second
+ * doesn't reissue the ids of the previous run. When the counter overflows
+ * it carries into the start time.
+ */
+
+#ifndef PACKET_ID_H
+#define PACKET_ID_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "../../../utils/os.h"
+
+#define PACKET_ID_EPOCH 1577836800 // 2020-01-01T00:00:00Z
+#define PACKET_ID_SLOT_BITS 8
+#define PACKET_ID_COUNTER_BITS 24
+#define MAX_PACKET_ID_SLOTS (1U << PACKET_ID_SLOT_BITS)
+#define PACKET_ID_DEFAULT_SLOT 0 // The slot of the ids without an interface
+
+/**
+ * @brief Packet id generator structure definition
+ *
+ */
+struct packet_id_gen {
+  _Atomic uint64_t next; /**< The next packet id */
+};
+
+/**
+ * @brief Initialises a packet id generator with the current time
+ *
+ * The first id is greater than @p last_id.
+ *
+ * @param gen The packet id generator
+ * @param slot The capture interface slot, lower than MAX_PACKET_ID_SLOTS
+ * @param last_id The last id already stored (0 if none)
+ */
+void init_packet_id_gen(struct packet_id_gen *gen, unsigned int slot,
+                        uint64_t last_id);
+
+/**
+ * @brief Makes the next ids of a packet id generator greater than an id
+ *
+ * The generator can be shared by several threads.
+ *
+ * @param gen The packet id generator
+ * @param last_id The last id already stored
+ */
+void seed_packet_id_gen(struct packet_id_gen *gen, uint64_t last_id);
+
+/**
+ * @brief Returns a new packet id
+ *
+ * The generator can be shared by several threads.
+ *
+ * @param gen The packet id generator
+ * @return uint64_t The packet id
+ */
+static inline uint64_t next_packet_id(struct packet_id_gen *gen) {
+  return atomic_fetch_add_explicit(&gen->next,
+                                   (uint64_t)1 << PACKET_ID_SLOT_BITS,
+                                   memory_order_relaxed);
+}
+
+/**
+ * @brief Renders a packet id as an UUID string (version 8), used by the
+ * exporters that need a text id
+ *
+ * @param id The packet id
+ * @param[out] str The output string of MAX_RANDOM_UUID_LEN bytes
+ * @return const char* Pointer to the UUID string (same as @p str)
+ */
+const char *packet_id_2_uuid(uint64_t id, char str[static MAX_RANDOM_UUID_LEN]);
+
+#endif
@@ -27,6 +27,14 @@ struct packet_queue *init_packet_queue(void) {
     return NULL;
   }
 
+  queue->slab =
+      init_os_slab(sizeof(struct packet_queue), PACKET_QUEUE_SLAB_CHUNK);
+  if (queue->slab == NULL) {
+    log_error("init_os_slab fail");
+    os_free(queue);
+    return NULL;
+  }
+
   dl_list_init(&queue->list);
 
   return queue;
@@ -41,12 +49,13 @@ struct packet_queue *push_packet_queue(struct packet_queue *queue,
     return NULL;
   }
 
-  if ((el = init_packet_queue()) == NULL) {
-    log_debug("init_packet_queue fail");
+  if ((el = os_slab_alloc(queue->slab)) == NULL) {
+    log_errno("os_slab_alloc");
     return NULL;
   }
 
   el->tp = tp;
+  el->slab = queue->slab;
   dl_list_add_tail(&queue->list, &el->list);
 
   return el;
@@ -61,31 +70,55 @@ struct packet_queue *pop_packet_queue(struct packet_queue *queue) {
 
 void free_packet_tuple(struct tuple_packet *tp) {
   if (tp != NULL) {
-    if (tp->packet != NULL)
+    if (tp->slab != NULL) {
+      os_slab_free(tp->slab, tp->packet);
+    } else if (tp->packet != NULL) {
       os_free(tp->packet);
+    }
   }
 }
 
 void free_packet_queue_el(struct packet_queue *el) {
   if (el != NULL) {
     dl_list_del(&el->list);
-    os_free(el);
+    os_slab_free(el->slab, el);
   }
 }
 
 void free_packet_queue(struct packet_queue *queue) {
   struct packet_queue *el;
 
+  if (queue == NULL) {
+    return;
+  }
+
   while ((el = pop_packet_queue(queue)) != NULL)
     free_packet_queue_el(el);
 
-  free_packet_queue_el(queue);
+  free_os_slab(queue->slab);
+  os_free(queue);
 }
 
 ssize_t get_packet_queue_length(struct packet_queue *queue) {
   return (queue != NULL) ? dl_list_len(&queue->list) : 0;
 }
 
+int get_packet_queue_stats(struct packet_queue *queue,
+                           struct os_slab_stats *stats) {
+  if (queue == NULL) {
+    log_trace("queue param is NULL");
+    return -1;
+  }
+
+  if (stats == NULL) {
+    log_trace("stats param is NULL");
+    return -1;
+  }
+
+  get_os_slab_stats(queue->slab, stats);
+  return 0;
+}
+
 int is_packet_queue_empty(struct packet_queue *queue) {
   if (queue == NULL) {
     log_trace("queue param is NULL");
@@ -24,9 +24,15 @@
  */
 struct packet_queue {
   struct tuple_packet tp; /**< Packet address and metadata */
+  struct os_slab *slab;   /**< The slab of the queue elements */
   struct dl_list list;    /**< List definition */
 };
 
+/**
+ * @brief Number of queue elements allocated at once by the queue slab
+ */
+#define PACKET_QUEUE_SLAB_CHUNK 256
+
 /**
  * @brief Initialises and empty packet queue
  *
@@ -52,6 +58,16 @@ struct packet_queue *push_packet_queue(struct packet_queue *queue,
  */
 struct packet_queue *pop_packet_queue(struct packet_queue *queue);
 
+/**
+ * @brief Returns the statistics of the packet queue elements slab
+ *
+ * @param queue The pointer to the packet queue
+ * @param[out] stats The slab statistics
+ * @return int 0 on success, -1 on failure
+ */
+int get_packet_queue_stats(struct packet_queue *queue,
+                           struct os_slab_stats *stats);
+
 /**
  * @brief Frees an allocated packet tuple
  *
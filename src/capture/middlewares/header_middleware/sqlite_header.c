@@ -9,611 +9,834 @@
  * utilities.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sqlite3.h>
 #include <string.h>
+#include <strings.h>
 
 #include "../../../utils/allocs.h"
 #include "../../../utils/log.h"
+#include "../../../utils/net.h"
 #include "../../../utils/os.h"
 #include "../../../utils/sqliteu.h"
 
+#include "../../capture_stats.h"
+
 #include "packet_decoder.h"
 #include "sqlite_header.h"
 
-#define EXTRACT_META_PACKET(term, tp)                                          \
-  term.hash = tp->mp.hash;                                                     \
-  term.timestamp = tp->mp.timestamp;                                           \
-  term.caplen = tp->mp.caplen;                                                 \
-  term.length = tp->mp.length;
-
-int extract_eth_statement(sqlite3 *db, struct eth_schema *eths) {
-  sqlite3_stmt *res = NULL;
-  int column_idx, rc;
+static const char *const insert_statements[HEADER_STATEMENTS_COUNT] = {
+    [PACKET_NONE] = NULL,
+    [PACKET_ETHERNET] = ETH_INSERT_INTO,
+    [PACKET_ARP] = ARP_INSERT_INTO,
+    [PACKET_IP4] = IP4_INSERT_INTO,
+    [PACKET_IP6] = IP6_INSERT_INTO,
+    [PACKET_TCP] = TCP_INSERT_INTO,
+    [PACKET_UDP] = UDP_INSERT_INTO,
+    [PACKET_ICMP4] = ICMP4_INSERT_INTO,
+    [PACKET_ICMP6] = ICMP6_INSERT_INTO,
+    [PACKET_DNS] = DNS_INSERT_INTO,
+    [PACKET_MDNS] = MDNS_INSERT_INTO,
+    [PACKET_DHCP] = DHCP_INSERT_INTO,
+};
+
+/*
+ * The bind_*_statement functions bind the schema fields by position. The
+ * positions follow the order of the parameters in the *_INSERT_INTO
+ * statements. The binary addresses are rendered to text in local buffers,
+ * which sqlite copies (SQLITE_TRANSIENT).
+ */
+static int bind_eth_statement(sqlite3_stmt *res, struct eth_schema *eths) {
+  int rc = SQLITE_OK;
+  char ether_dhost[MACSTR_LEN], ether_shost[MACSTR_LEN];
+
+  mac_2_str(eths->ether_dhost, ether_dhost);
+  mac_2_str(eths->ether_shost, ether_shost);
+
+  rc |= sqlite3_bind_int64(res, 1, eths->timestamp);
+  rc |= sqlite3_bind_int64(res, 2, (sqlite3_int64)eths->id);
+  rc |= sqlite3_bind_int64(res, 3, eths->caplen);
+  rc |= sqlite3_bind_int64(res, 4, eths->length);
+  rc |= sqlite3_bind_text(res, 5, eths->ifname, -1, SQLITE_STATIC);
+  rc |= sqlite3_bind_text(res, 6, ether_dhost, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 7, ether_shost, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_int64(res, 8, eths->ether_type);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-  if (eths == NULL) {
-    log_error("ethh is NULL");
-    return -1;
-  }
+static int bind_arp_statement(sqlite3_stmt *res, struct arp_schema *arps) {
+  int rc = SQLITE_OK;
+  char arp_sha[MACSTR_LEN], arp_tha[MACSTR_LEN];
+  char arp_spa[OS_INET_ADDRSTRLEN], arp_tpa[OS_INET_ADDRSTRLEN];
+
+  mac_2_str(arps->arp_sha, arp_sha);
+  mac_2_str(arps->arp_tha, arp_tha);
+  inaddr4_2_ip(&arps->arp_spa, arp_spa);
+  inaddr4_2_ip(&arps->arp_tpa, arp_tpa);
+
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)arps->id);
+  rc |= sqlite3_bind_int64(res, 2, arps->ar_hrd);
+  rc |= sqlite3_bind_int64(res, 3, arps->ar_pro);
+  rc |= sqlite3_bind_int64(res, 4, arps->ar_hln);
+  rc |= sqlite3_bind_int64(res, 5, arps->ar_pln);
+  rc |= sqlite3_bind_int64(res, 6, arps->ar_op);
+  rc |= sqlite3_bind_text(res, 7, arp_sha, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 8, arp_spa, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 9, arp_tha, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 10, arp_tpa, -1, SQLITE_TRANSIENT);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-  rc = sqlite3_prepare_v2(db, ETH_INSERT_INTO, -1, &res, 0);
+static int bind_ip4_statement(sqlite3_stmt *res, struct ip4_schema *ip4s) {
+  int rc = SQLITE_OK;
+  char ip_src[OS_INET_ADDRSTRLEN], ip_dst[OS_INET_ADDRSTRLEN];
+
+  inaddr4_2_ip(&ip4s->ip_src, ip_src);
+  inaddr4_2_ip(&ip4s->ip_dst, ip_dst);
+
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)ip4s->id);
+  rc |= sqlite3_bind_int64(res, 2, ip4s->ip_hl);
+  rc |= sqlite3_bind_int64(res, 3, ip4s->ip_v);
+  rc |= sqlite3_bind_int64(res, 4, ip4s->ip_tos);
+  rc |= sqlite3_bind_int64(res, 5, ip4s->ip_len);
+  rc |= sqlite3_bind_int64(res, 6, ip4s->ip_id);
+  rc |= sqlite3_bind_int64(res, 7, ip4s->ip_off);
+  rc |= sqlite3_bind_int64(res, 8, ip4s->ip_ttl);
+  rc |= sqlite3_bind_int64(res, 9, ip4s->ip_p);
+  rc |= sqlite3_bind_int64(res, 10, ip4s->ip_sum);
+  rc |= sqlite3_bind_text(res, 11, ip_src, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 12, ip_dst, -1, SQLITE_TRANSIENT);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@timestamp");
-    if (sqlite3_bind_int64(res, column_idx, eths->timestamp) != SQLITE_OK)
-      return false;
+static int bind_ip6_statement(sqlite3_stmt *res, struct ip6_schema *ip6s) {
+  int rc = SQLITE_OK;
+  char ip6_src[OS_INET6_ADDRSTRLEN], ip6_dst[OS_INET6_ADDRSTRLEN];
 
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, eths->id, -1, NULL);
+  inaddr6_2_ip(&ip6s->ip6_src, ip6_src);
+  inaddr6_2_ip(&ip6s->ip6_dst, ip6_dst);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@caplen");
-    if (sqlite3_bind_int64(res, column_idx, eths->caplen) != SQLITE_OK)
-      return false;
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)ip6s->id);
+  rc |= sqlite3_bind_int64(res, 2, ip6s->ip6_un1_flow);
+  rc |= sqlite3_bind_int64(res, 3, ip6s->ip6_un1_plen);
+  rc |= sqlite3_bind_int64(res, 4, ip6s->ip6_un1_nxt);
+  rc |= sqlite3_bind_int64(res, 5, ip6s->ip6_un1_hlim);
+  rc |= sqlite3_bind_int64(res, 6, ip6s->ip6_un2_vfc);
+  rc |= sqlite3_bind_text(res, 7, ip6_src, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 8, ip6_dst, -1, SQLITE_TRANSIENT);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@length");
-    if (sqlite3_bind_int64(res, column_idx, eths->length) != SQLITE_OK)
-      return false;
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ifname");
-    sqlite3_bind_text(res, column_idx, eths->ifname, -1, NULL);
+static int bind_tcp_statement(sqlite3_stmt *res, struct tcp_schema *tcps) {
+  int rc = SQLITE_OK;
+
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)tcps->id);
+  rc |= sqlite3_bind_int64(res, 2, tcps->source);
+  rc |= sqlite3_bind_int64(res, 3, tcps->dest);
+  rc |= sqlite3_bind_int64(res, 4, tcps->seq);
+  rc |= sqlite3_bind_int64(res, 5, tcps->ack_seq);
+  rc |= sqlite3_bind_int64(res, 6, tcps->res1);
+  rc |= sqlite3_bind_int64(res, 7, tcps->doff);
+  rc |= sqlite3_bind_int64(res, 8, tcps->fin);
+  rc |= sqlite3_bind_int64(res, 9, tcps->syn);
+  rc |= sqlite3_bind_int64(res, 10, tcps->rst);
+  rc |= sqlite3_bind_int64(res, 11, tcps->psh);
+  rc |= sqlite3_bind_int64(res, 12, tcps->ack);
+  rc |= sqlite3_bind_int64(res, 13, tcps->urg);
+  rc |= sqlite3_bind_int64(res, 14, tcps->window);
+  rc |= sqlite3_bind_int64(res, 15, tcps->check_p);
+  rc |= sqlite3_bind_int64(res, 16, tcps->urg_ptr);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ether_dhost");
-    sqlite3_bind_text(res, column_idx, eths->ether_dhost, -1, NULL);
+static int bind_udp_statement(sqlite3_stmt *res, struct udp_schema *udps) {
+  int rc = SQLITE_OK;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ether_shost");
-    sqlite3_bind_text(res, column_idx, eths->ether_shost, -1, NULL);
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)udps->id);
+  rc |= sqlite3_bind_int64(res, 2, udps->source);
+  rc |= sqlite3_bind_int64(res, 3, udps->dest);
+  rc |= sqlite3_bind_int64(res, 4, udps->len);
+  rc |= sqlite3_bind_int64(res, 5, udps->check_p);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ether_type");
-    sqlite3_bind_int64(res, column_idx, eths->ether_type);
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    /*
-    log_trace("sqlite insert eth ether_type=0x%x ether_dhost=%s ether_shost=%s",
-              eths->ether_type, eths->ether_dhost, eths->ether_shost);
-    */
+static int bind_icmp4_statement(sqlite3_stmt *res, struct icmp4_schema *icmp4s) {
+  int rc = SQLITE_OK;
 
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-    return -1;
-  }
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)icmp4s->id);
+  rc |= sqlite3_bind_int64(res, 2, icmp4s->type);
+  rc |= sqlite3_bind_int64(res, 3, icmp4s->code);
+  rc |= sqlite3_bind_int64(res, 4, icmp4s->checksum);
+  rc |= sqlite3_bind_int64(res, 5, icmp4s->gateway);
 
-  return 0;
+  return (rc == SQLITE_OK) ? 0 : -1;
 }
 
-int extract_arp_statement(sqlite3 *db, struct arp_schema *arps) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
+static int bind_icmp6_statement(sqlite3_stmt *res, struct icmp6_schema *icmp6s) {
+  int rc = SQLITE_OK;
 
-  rc = sqlite3_prepare_v2(db, ARP_INSERT_INTO, -1, &res, 0);
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)icmp6s->id);
+  rc |= sqlite3_bind_int64(res, 2, icmp6s->icmp6_type);
+  rc |= sqlite3_bind_int64(res, 3, icmp6s->icmp6_code);
+  rc |= sqlite3_bind_int64(res, 4, icmp6s->icmp6_cksum);
+  rc |= sqlite3_bind_int64(res, 5, icmp6s->icmp6_un_data32);
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, arps->id, -1, NULL);
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ar_hrd");
-    sqlite3_bind_int64(res, column_idx, arps->ar_hrd);
+static int bind_dns_statement(sqlite3_stmt *res, struct dns_schema *dnss) {
+  int rc = SQLITE_OK;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ar_pro");
-    sqlite3_bind_int64(res, column_idx, arps->ar_pro);
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)dnss->id);
+  rc |= sqlite3_bind_int64(res, 2, dnss->tid);
+  rc |= sqlite3_bind_int64(res, 3, dnss->flags);
+  rc |= sqlite3_bind_int64(res, 4, dnss->nqueries);
+  rc |= sqlite3_bind_int64(res, 5, dnss->nanswers);
+  rc |= sqlite3_bind_int64(res, 6, dnss->nauth);
+  rc |= sqlite3_bind_int64(res, 7, dnss->nother);
+  rc |= sqlite3_bind_text(res, 8, dnss->qname, -1, SQLITE_STATIC);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ar_hln");
-    sqlite3_bind_int64(res, column_idx, arps->ar_hln);
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ar_pln");
-    sqlite3_bind_int64(res, column_idx, arps->ar_pln);
+static int bind_mdns_statement(sqlite3_stmt *res, struct mdns_schema *mdnss) {
+  int rc = SQLITE_OK;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ar_op");
-    sqlite3_bind_int64(res, column_idx, arps->ar_op);
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)mdnss->id);
+  rc |= sqlite3_bind_int64(res, 2, mdnss->tid);
+  rc |= sqlite3_bind_int64(res, 3, mdnss->flags);
+  rc |= sqlite3_bind_int64(res, 4, mdnss->nqueries);
+  rc |= sqlite3_bind_int64(res, 5, mdnss->nanswers);
+  rc |= sqlite3_bind_int64(res, 6, mdnss->nauth);
+  rc |= sqlite3_bind_int64(res, 7, mdnss->nother);
+  rc |= sqlite3_bind_text(res, 8, mdnss->qname, -1, SQLITE_STATIC);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@arp_sha");
-    sqlite3_bind_text(res, column_idx, arps->arp_sha, -1, NULL);
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@arp_spa");
-    sqlite3_bind_text(res, column_idx, arps->arp_spa, -1, NULL);
+static int bind_dhcp_statement(sqlite3_stmt *res, struct dhcp_schema *dhcps) {
+  int rc = SQLITE_OK;
+  char ciaddr[OS_INET_ADDRSTRLEN], yiaddr[OS_INET_ADDRSTRLEN];
+  char siaddr[OS_INET_ADDRSTRLEN], giaddr[OS_INET_ADDRSTRLEN];
+  char chaddr[MACSTR_LEN];
+
+  inaddr4_2_ip(&dhcps->ciaddr, ciaddr);
+  inaddr4_2_ip(&dhcps->yiaddr, yiaddr);
+  inaddr4_2_ip(&dhcps->siaddr, siaddr);
+  inaddr4_2_ip(&dhcps->giaddr, giaddr);
+  mac_2_str(dhcps->chaddr, chaddr);
+
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)dhcps->id);
+  rc |= sqlite3_bind_int64(res, 2, dhcps->op);
+  rc |= sqlite3_bind_int64(res, 3, dhcps->htype);
+  rc |= sqlite3_bind_int64(res, 4, dhcps->hlen);
+  rc |= sqlite3_bind_int64(res, 5, dhcps->hops);
+  rc |= sqlite3_bind_int64(res, 6, dhcps->xid);
+  rc |= sqlite3_bind_int64(res, 7, dhcps->secs);
+  rc |= sqlite3_bind_int64(res, 8, dhcps->flags);
+  rc |= sqlite3_bind_text(res, 9, ciaddr, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 10, yiaddr, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 11, siaddr, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 12, giaddr, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 13, chaddr, -1, SQLITE_TRANSIENT);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
+}
+
+static int bind_packet_statement(sqlite3_stmt *res,
+                                 struct tuple_packet *tp) {
+  switch (tp->type) {
+    case PACKET_NONE:
+      return -1;
+    case PACKET_ETHERNET:
+      return bind_eth_statement(res, (struct eth_schema *)tp->packet);
+    case PACKET_ARP:
+      return bind_arp_statement(res, (struct arp_schema *)tp->packet);
+    case PACKET_IP4:
+      return bind_ip4_statement(res, (struct ip4_schema *)tp->packet);
+    case PACKET_IP6:
+      return bind_ip6_statement(res, (struct ip6_schema *)tp->packet);
+    case PACKET_TCP:
+      return bind_tcp_statement(res, (struct tcp_schema *)tp->packet);
+    case PACKET_UDP:
+      return bind_udp_statement(res, (struct udp_schema *)tp->packet);
+    case PACKET_ICMP4:
+      return bind_icmp4_statement(res, (struct icmp4_schema *)tp->packet);
+    case PACKET_ICMP6:
+      return bind_icmp6_statement(res, (struct icmp6_schema *)tp->packet);
+    case PACKET_DNS:
+      return bind_dns_statement(res, (struct dns_schema *)tp->packet);
+    case PACKET_MDNS:
+      return bind_mdns_statement(res, (struct mdns_schema *)tp->packet);
+    case PACKET_DHCP:
+      return bind_dhcp_statement(res, (struct dhcp_schema *)tp->packet);
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@arp_tha");
-    sqlite3_bind_text(res, column_idx, arps->arp_tha, -1, NULL);
+  return -1;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@arp_tpa");
-    sqlite3_bind_text(res, column_idx, arps->arp_tpa, -1, NULL);
+static int check_tuple_packet(struct tuple_packet *tp) {
+  if (tp == NULL) {
+    log_error("tp param is NULL");
+    return -1;
+  }
 
-    // log_trace("sqlite insert arp ar_hrd=%d arp_sha=%s arp_spa=%s arp_tha=%s "
-    //           "arp_tpa=%s",
-    //           arps->ar_hrd, arps->arp_sha, arps->arp_spa, arps->arp_tha,
-    //           arps->arp_tpa);
+  if (tp->packet == NULL) {
+    log_error("tp->packet param is NULL");
+    return -1;
+  }
 
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  if (tp->type <= PACKET_NONE || tp->type >= HEADER_STATEMENTS_COUNT) {
+    log_error("Unknown packet type %d", tp->type);
     return -1;
   }
 
   return 0;
 }
 
-int extract_ip4_statement(sqlite3 *db, struct ip4_schema *ip4s) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
-
-  rc = sqlite3_prepare_v2(db, IP4_INSERT_INTO, -1, &res, 0);
+static int step_packet_statement(sqlite3_stmt *res, struct tuple_packet *tp) {
+  int rc;
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, ip4s->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_hl");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_hl);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_v");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_v);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_tos");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_tos);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_len");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_len);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_id");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_id);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_off");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_off);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_ttl");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_ttl);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_p");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_p);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_sum");
-    sqlite3_bind_int64(res, column_idx, ip4s->ip_sum);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_src");
-    sqlite3_bind_text(res, column_idx, ip4s->ip_src, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip_dst");
-    sqlite3_bind_text(res, column_idx, ip4s->ip_dst, -1, NULL);
+  if (bind_packet_statement(res, tp) < 0) {
+    log_error("bind_packet_statement fail");
+    return -1;
+  }
 
-    // log_trace("sqlite insert IP4 ip_p=%d ip_v=%d ip_src=%s ip_dst=%s",
-    //           ip4s->ip_p, ip4s->ip_v, ip4s->ip_src, ip4s->ip_dst);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  if ((rc = sqlite3_step(res)) != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errstr(rc));
     return -1;
   }
 
   return 0;
 }
 
-int extract_ip6_statement(sqlite3 *db, struct ip6_schema *ip6s) {
-  int column_idx, rc;
+int save_packet_statement(sqlite3 *db, struct tuple_packet *tp) {
   sqlite3_stmt *res = NULL;
+  int ret;
 
-  rc = sqlite3_prepare_v2(db, IP6_INSERT_INTO, -1, &res, 0);
-
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, ip6s->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_un1_flow");
-    sqlite3_bind_int64(res, column_idx, ip6s->ip6_un1_flow);
+  if (db == NULL) {
+    log_error("db param is NULL");
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_un1_plen");
-    sqlite3_bind_int64(res, column_idx, ip6s->ip6_un1_plen);
+  if (check_tuple_packet(tp) < 0) {
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_un1_nxt");
-    sqlite3_bind_int64(res, column_idx, ip6s->ip6_un1_nxt);
+  if (sqlite3_prepare_v2(db, insert_statements[tp->type], -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_un1_hlim");
-    sqlite3_bind_int64(res, column_idx, ip6s->ip6_un1_hlim);
+  ret = step_packet_statement(res, tp);
+  sqlite3_finalize(res);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_un2_vfc");
-    sqlite3_bind_int64(res, column_idx, ip6s->ip6_un2_vfc);
+  return ret;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_src");
-    sqlite3_bind_text(res, column_idx, ip6s->ip6_src, -1, NULL);
+/**
+ * Private implementation of free_sqlite_header_writer(), without its compiler
+ * attributes, so init_sqlite_header_writer() can call it on failure.
+ */
+static void __free_sqlite_header_writer(struct sqlite_header_writer *writer) {
+  if (writer != NULL) {
+    if (commit_sqlite_header_writer(writer) < 0) {
+      log_error("commit_sqlite_header_writer fail");
+    }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ip6_dst");
-    sqlite3_bind_text(res, column_idx, ip6s->ip6_dst, -1, NULL);
+    for (size_t i = 0; i < HEADER_STATEMENTS_COUNT; i++) {
+      sqlite3_finalize(writer->statements[i]);
+    }
+    sqlite3_finalize(writer->flow_statement);
 
-    // log_trace("sqlite insert IP6 ip6_src=%s ip6_dst=%s ip6_un1_nxt=%d",
-    //           ip6s->ip6_src, ip6s->ip6_dst, ip6s->ip6_un1_nxt);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-    return -1;
+    os_free(writer);
   }
+}
 
-  return 0;
+void free_sqlite_header_writer(struct sqlite_header_writer *writer) {
+  __free_sqlite_header_writer(writer);
 }
 
-int extract_tcp_statement(sqlite3 *db, struct tcp_schema *tcps) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
+struct sqlite_header_writer *
+init_sqlite_header_writer(sqlite3 *db, unsigned int max_batch_size) {
+  struct sqlite_header_writer *writer = NULL;
 
-  rc = sqlite3_prepare_v2(db, TCP_INSERT_INTO, -1, &res, 0);
+  if (db == NULL) {
+    log_error("db param is NULL");
+    return NULL;
+  }
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, tcps->id, -1, NULL);
+  if ((writer = os_zalloc(sizeof(struct sqlite_header_writer))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@source");
-    sqlite3_bind_int64(res, column_idx, tcps->source);
+  writer->db = db;
+  writer->max_batch_size = max_batch_size;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@dest");
-    sqlite3_bind_int64(res, column_idx, tcps->dest);
+  for (size_t i = 0; i < HEADER_STATEMENTS_COUNT; i++) {
+    if (insert_statements[i] == NULL) {
+      continue;
+    }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@seq");
-    sqlite3_bind_int64(res, column_idx, tcps->seq);
+    if (sqlite3_prepare_v2(db, insert_statements[i], -1,
+                           &writer->statements[i], NULL) != SQLITE_OK) {
+      log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+      __free_sqlite_header_writer(writer);
+      return NULL;
+    }
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ack_seq");
-    sqlite3_bind_int64(res, column_idx, tcps->ack_seq);
+  if (sqlite3_prepare_v2(db, FLOW_INSERT_INTO, -1, &writer->flow_statement,
+                         NULL) != SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    __free_sqlite_header_writer(writer);
+    return NULL;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@res1");
-    sqlite3_bind_int64(res, column_idx, tcps->res1);
+  return writer;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@doff");
-    sqlite3_bind_int64(res, column_idx, tcps->doff);
+static void begin_sqlite_header_writer(struct sqlite_header_writer *writer) {
+  if (writer->in_transaction &&
+      writer->batch_size >= writer->max_batch_size) {
+    if (commit_sqlite_header_writer(writer) < 0) {
+      log_error("commit_sqlite_header_writer fail");
+    }
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@fin");
-    sqlite3_bind_int64(res, column_idx, tcps->fin);
+  if (writer->max_batch_size && !writer->in_transaction) {
+    if (execute_sqlite_query(writer->db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+      // Fall back to autocommit mode for this row
+      log_warn("Failed to begin transaction, ignoring.");
+    } else {
+      writer->in_transaction = true;
+    }
+  }
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@syn");
-    sqlite3_bind_int64(res, column_idx, tcps->syn);
+int save_sqlite_header_packet(struct sqlite_header_writer *writer,
+                              struct tuple_packet *tp) {
+  sqlite3_stmt *res = NULL;
+  int ret;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@rst");
-    sqlite3_bind_int64(res, column_idx, tcps->rst);
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@psh");
-    sqlite3_bind_int64(res, column_idx, tcps->psh);
+  if (check_tuple_packet(tp) < 0) {
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ack");
-    sqlite3_bind_int64(res, column_idx, tcps->ack);
+  begin_sqlite_header_writer(writer);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@urg");
-    sqlite3_bind_int64(res, column_idx, tcps->urg);
+  res = writer->statements[tp->type];
+  ret = step_packet_statement(res, tp);
+  sqlite3_reset(res);
+  sqlite3_clear_bindings(res);
 
-    column_idx = sqlite3_bind_parameter_index(res, "@window");
-    sqlite3_bind_int64(res, column_idx, tcps->window);
+  if (writer->in_transaction) {
+    writer->batch_size++;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@check_p");
-    sqlite3_bind_int64(res, column_idx, tcps->check_p);
+  return ret;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@urg_ptr");
-    sqlite3_bind_int64(res, column_idx, tcps->urg_ptr);
+static int bind_flow_statement(sqlite3_stmt *res,
+                               const struct flow_record *record) {
+  int rc = SQLITE_OK;
+  char ip_src[OS_INET6_ADDRSTRLEN], ip_dst[OS_INET6_ADDRSTRLEN];
 
-    // log_trace("sqlite insert TCP source=%d dest=%d", tcps->source,
-    // tcps->dest);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
+  if (record->key.family == AF_INET6) {
+    inaddr6_2_ip((struct in6_addr *)record->key.src, ip_src);
+    inaddr6_2_ip((struct in6_addr *)record->key.dst, ip_dst);
   } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-    return -1;
+    inaddr4_2_ip((struct in_addr *)record->key.src, ip_src);
+    inaddr4_2_ip((struct in_addr *)record->key.dst, ip_dst);
   }
 
-  return 0;
+  rc |= sqlite3_bind_int64(res, 1, (sqlite3_int64)record->first_timestamp);
+  rc |= sqlite3_bind_int64(res, 2, (sqlite3_int64)record->last_timestamp);
+  rc |= sqlite3_bind_text(res, 3, record->key.ifname, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 4, ip_src, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_text(res, 5, ip_dst, -1, SQLITE_TRANSIENT);
+  rc |= sqlite3_bind_int64(res, 6, record->key.source);
+  rc |= sqlite3_bind_int64(res, 7, record->key.dest);
+  rc |= sqlite3_bind_int64(res, 8, record->key.protocol);
+  rc |= sqlite3_bind_int64(res, 9, (sqlite3_int64)record->packets);
+  rc |= sqlite3_bind_int64(res, 10, (sqlite3_int64)record->bytes);
+  rc |= sqlite3_bind_int64(res, 11, record->tcp_flags);
+
+  return (rc == SQLITE_OK) ? 0 : -1;
 }
 
-int extract_udp_statement(sqlite3 *db, struct udp_schema *udps) {
-  int column_idx, rc;
+int save_sqlite_header_flow(struct sqlite_header_writer *writer,
+                            const struct flow_record *record) {
   sqlite3_stmt *res = NULL;
+  int rc, ret = 0;
 
-  rc = sqlite3_prepare_v2(db, UDP_INSERT_INTO, -1, &res, 0);
-
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, udps->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@source");
-    sqlite3_bind_int64(res, column_idx, udps->source);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@dest");
-    sqlite3_bind_int64(res, column_idx, udps->dest);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@len");
-    sqlite3_bind_int64(res, column_idx, udps->len);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@check_p");
-    sqlite3_bind_int64(res, column_idx, udps->check_p);
-
-    // log_trace("sqlite insert UDP source=%d dest=%d", udps->source,
-    // udps->dest);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  if (writer == NULL) {
+    log_error("writer param is NULL");
     return -1;
   }
 
-  return 0;
-}
+  if (record == NULL) {
+    log_error("record param is NULL");
+    return -1;
+  }
 
-int extract_icmp4_statement(sqlite3 *db, struct icmp4_schema *icmp4s) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
+  begin_sqlite_header_writer(writer);
 
-  rc = sqlite3_prepare_v2(db, ICMP4_INSERT_INTO, -1, &res, 0);
+  res = writer->flow_statement;
+  if (bind_flow_statement(res, record) < 0) {
+    log_error("bind_flow_statement fail");
+    ret = -1;
+  } else if ((rc = sqlite3_step(res)) != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errstr(rc));
+    ret = -1;
+  }
+  sqlite3_reset(res);
+  sqlite3_clear_bindings(res);
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, icmp4s->id, -1, NULL);
+  if (writer->in_transaction) {
+    writer->batch_size++;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@type");
-    sqlite3_bind_int64(res, column_idx, icmp4s->type);
+  return ret;
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@code");
-    sqlite3_bind_int64(res, column_idx, icmp4s->code);
+int commit_sqlite_header_writer(struct sqlite_header_writer *writer) {
+  struct os_reltime start, end, latency;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@checksum");
-    sqlite3_bind_int64(res, column_idx, icmp4s->checksum);
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@gateway");
-    sqlite3_bind_int64(res, column_idx, icmp4s->gateway);
+  if (!writer->in_transaction) {
+    return 0;
+  }
 
-    // log_trace("sqlite insert ICMP4 type=%d code=%d", icmp4s->type,
-    //           icmp4s->code);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  os_get_reltime(&start);
+  if (execute_sqlite_query(writer->db, "COMMIT TRANSACTION") < 0) {
+    // The transaction stays open and the commit is retried on next call
+    log_error("Failed to commit header packets");
     return -1;
   }
+  os_get_reltime(&end);
+
+  os_reltime_sub(&end, &start, &latency);
+  record_capture_commit((uint64_t)latency.sec * 1000000 +
+                        (uint64_t)latency.usec);
 
+  writer->in_transaction = false;
+  writer->batch_size = 0;
   return 0;
 }
 
-int extract_icmp6_statement(sqlite3 *db, struct icmp6_schema *icmp6s) {
-  int column_idx, rc;
+/**
+ * @brief Checks whether the header tables predate the integer packet ids
+ *
+ * @param db The sqlite3 db
+ * @return int 1 if the tables must be migrated, 0 if not, -1 on failure
+ */
+static int check_old_header_tables(sqlite3 *db) {
   sqlite3_stmt *res = NULL;
+  const unsigned char *type;
+  int rc, old = 0;
 
-  rc = sqlite3_prepare_v2(db, ICMP6_INSERT_INTO, -1, &res, 0);
-
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, icmp6s->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@icmp6_type");
-    sqlite3_bind_int64(res, column_idx, icmp6s->icmp6_type);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@icmp6_code");
-    sqlite3_bind_int64(res, column_idx, icmp6s->icmp6_code);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@icmp6_cksum");
-    sqlite3_bind_int64(res, column_idx, icmp6s->icmp6_cksum);
+  if (sqlite3_prepare_v2(db, HEADER_SELECT_ID_TYPE, -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@icmp6_un_data32");
-    sqlite3_bind_int64(res, column_idx, icmp6s->icmp6_un_data32);
+  if ((rc = sqlite3_step(res)) == SQLITE_ROW) {
+    type = sqlite3_column_text(res, 0);
+    old = (type != NULL && strcasecmp((const char *)type, "TEXT") == 0);
+  }
 
-    // log_trace("sqlite insert ICMP6 type=%d code=%d", icmp6s->icmp6_type,
-    //           icmp6s->icmp6_code);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  sqlite3_finalize(res);
+  if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  return 0;
+  return old;
 }
 
-int extract_dns_statement(sqlite3 *db, struct dns_schema *dnss) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
+#define HEADER_MIGRATION(table, order, create)                                 \
+  { table, HEADER_MIGRATE_ID_MAP(table, order),                                \
+    HEADER_MIGRATE_TABLE(table, create) }
+
+struct header_migration {
+  const char *table;
+  const char *map;
+  const char *migrate;
+};
+
+static int run_header_migration(sqlite3 *db) {
+  // The eth rows are numbered first, so the ids follow the capture order
+  const struct header_migration migrations[] = {
+      HEADER_MIGRATION("eth", " ORDER BY timestamp", ETH_CREATE_TABLE),
+      HEADER_MIGRATION("arp", "", ARP_CREATE_TABLE),
+      HEADER_MIGRATION("ip4", "", IP4_CREATE_TABLE),
+      HEADER_MIGRATION("ip6", "", IP6_CREATE_TABLE),
+      HEADER_MIGRATION("tcp", "", TCP_CREATE_TABLE),
+      HEADER_MIGRATION("udp", "", UDP_CREATE_TABLE),
+      HEADER_MIGRATION("icmp4", "", ICMP4_CREATE_TABLE),
+      HEADER_MIGRATION("icmp6", "", ICMP6_CREATE_TABLE),
+      HEADER_MIGRATION("dns", "", DNS_CREATE_TABLE),
+      HEADER_MIGRATION("mdns", "", MDNS_CREATE_TABLE),
+      HEADER_MIGRATION("dhcp", "", DHCP_CREATE_TABLE),
+  };
+  bool exists[ARRAY_SIZE(migrations)];
+  int rc;
 
-  rc = sqlite3_prepare_v2(db, DNS_INSERT_INTO, -1, &res, 0);
+  if (execute_sqlite_query(db, HEADER_CREATE_ID_MAP) < 0) {
+    return -1;
+  }
 
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, dnss->id, -1, NULL);
+  for (size_t i = 0; i < ARRAY_SIZE(migrations); i++) {
+    if ((rc = check_table_exists(db, migrations[i].table)) < 0) {
+      return -1;
+    }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@tid");
-    sqlite3_bind_int64(res, column_idx, dnss->tid);
+    exists[i] = (rc > 0);
+    if (exists[i] && execute_sqlite_query(db, migrations[i].map) < 0) {
+      return -1;
+    }
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@flags");
-    sqlite3_bind_int64(res, column_idx, dnss->flags);
+  for (size_t i = 0; i < ARRAY_SIZE(migrations); i++) {
+    if (exists[i] && execute_sqlite_query(db, migrations[i].migrate) < 0) {
+      return -1;
+    }
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@nqueries");
-    sqlite3_bind_int64(res, column_idx, dnss->nqueries);
+  return execute_sqlite_query(db, HEADER_DROP_ID_MAP);
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@nanswers");
-    sqlite3_bind_int64(res, column_idx, dnss->nanswers);
+static int migrate_sqlite_header_db(sqlite3 *db) {
+  int rc;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@nauth");
-    sqlite3_bind_int64(res, column_idx, dnss->nauth);
+  if (execute_sqlite_query(db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on the header db");
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@nother");
-    sqlite3_bind_int64(res, column_idx, dnss->nother);
+  // Another connection may have migrated the tables in the meantime
+  if ((rc = check_old_header_tables(db)) > 0) {
+    log_info("Migrating the header tables to the integer packet ids");
+    rc = run_header_migration(db);
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@qname");
-    sqlite3_bind_text(res, column_idx, dnss->qname, -1, NULL);
+  if (rc < 0) {
+    log_error("Failed to migrate the header tables");
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
+    return -1;
+  }
 
-    // log_trace("sqlite insert DNS tid=%d, qname=%s", dnss->tid, dnss->qname);
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  if (execute_sqlite_query(db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit the header tables migration");
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
     return -1;
   }
 
   return 0;
 }
 
-int extract_mdsn_statement(sqlite3 *db, struct mdns_schema *mdnss) {
-  int column_idx, rc;
-  sqlite3_stmt *res = NULL;
-
-  rc = sqlite3_prepare_v2(db, MDNS_INSERT_INTO, -1, &res, 0);
-
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, mdnss->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@tid");
-    sqlite3_bind_int64(res, column_idx, mdnss->tid);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@flags");
-    sqlite3_bind_int64(res, column_idx, mdnss->flags);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@nqueries");
-    sqlite3_bind_int64(res, column_idx, mdnss->nqueries);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@nanswers");
-    sqlite3_bind_int64(res, column_idx, mdnss->nanswers);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@nauth");
-    sqlite3_bind_int64(res, column_idx, mdnss->nauth);
+int init_sqlite_header_db(sqlite3 *db) {
+  const char *tables[] = {
+      ETH_CREATE_TABLE,   ARP_CREATE_TABLE,   IP4_CREATE_TABLE,
+      IP6_CREATE_TABLE,   TCP_CREATE_TABLE,   UDP_CREATE_TABLE,
+      ICMP4_CREATE_TABLE, ICMP6_CREATE_TABLE, DNS_CREATE_TABLE,
+      MDNS_CREATE_TABLE,  DHCP_CREATE_TABLE,  FLOW_CREATE_TABLE,
+      PACKET_ID_SLOT_CREATE_TABLE, ETH_CREATE_ID_INDEX,
+  };
+  int rc;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@nother");
-    sqlite3_bind_int64(res, column_idx, mdnss->nother);
+  if (db == NULL) {
+    log_error("db param is NULL");
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@qname");
-    sqlite3_bind_text(res, column_idx, mdnss->qname, -1, NULL);
+  log_debug("sqlite autocommit mode=%d", sqlite3_get_autocommit(db));
 
-    // log_trace("sqlite insert mDNS tid=%d, qname=%s", mdnss->tid,
-    // mdnss->qname);
+  if ((rc = check_old_header_tables(db)) < 0) {
+    log_error("check_old_header_tables fail");
+    return -1;
+  }
 
-    sqlite3_step(res);
-    sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+  if (rc > 0 && migrate_sqlite_header_db(db) < 0) {
+    log_error("migrate_sqlite_header_db fail");
     return -1;
   }
 
+  for (size_t i = 0; i < ARRAY_SIZE(tables); i++) {
+    if (execute_sqlite_query(db, tables[i]) < 0) {
+      log_error("execute_sqlite_query fail: %s", tables[i]);
+      return -1;
+    }
+  }
+
   return 0;
 }
 
-int extract_dhcp_statement(sqlite3 *db, struct dhcp_schema *dhcps) {
-  int column_idx, rc;
+static int find_packet_id_slot(sqlite3 *db, const char *ifname, int *slot) {
   sqlite3_stmt *res = NULL;
+  int rc;
 
-  rc = sqlite3_prepare_v2(db, DHCP_INSERT_INTO, -1, &res, 0);
-
-  if (rc == SQLITE_OK) {
-    column_idx = sqlite3_bind_parameter_index(res, "@id");
-    sqlite3_bind_text(res, column_idx, dhcps->id, -1, NULL);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@op");
-    sqlite3_bind_int64(res, column_idx, dhcps->op);
-
-    column_idx = sqlite3_bind_parameter_index(res, "@htype");
-    sqlite3_bind_int64(res, column_idx, dhcps->htype);
+  if (sqlite3_prepare_v2(db, PACKET_ID_SLOT_SELECT, -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@hlen");
-    sqlite3_bind_int64(res, column_idx, dhcps->hlen);
+  if (sqlite3_bind_text(res, 1, ifname, -1, SQLITE_STATIC) != SQLITE_OK) {
+    log_error("sqlite3_bind_text fail");
+    sqlite3_finalize(res);
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@hops");
-    sqlite3_bind_int64(res, column_idx, dhcps->hops);
+  if ((rc = sqlite3_step(res)) == SQLITE_ROW) {
+    *slot = sqlite3_column_int(res, 0);
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@xid");
-    sqlite3_bind_int64(res, column_idx, dhcps->xid);
+  sqlite3_finalize(res);
+  if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@secs");
-    sqlite3_bind_int64(res, column_idx, dhcps->secs);
+  return (rc == SQLITE_ROW);
+}
 
-    column_idx = sqlite3_bind_parameter_index(res, "@flags");
-    sqlite3_bind_int64(res, column_idx, dhcps->flags);
+static int add_packet_id_slot(sqlite3 *db, const char *ifname) {
+  sqlite3_stmt *res = NULL;
+  int rc, slot = PACKET_ID_DEFAULT_SLOT + 1;
 
-    column_idx = sqlite3_bind_parameter_index(res, "@ciaddr");
-    sqlite3_bind_text(res, column_idx, dhcps->ciaddr, -1, NULL);
+  // The slots are sorted, so the first gap is the lowest free slot
+  if (sqlite3_prepare_v2(db, PACKET_ID_SLOT_SELECT_ALL, -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@yiaddr");
-    sqlite3_bind_text(res, column_idx, dhcps->yiaddr, -1, NULL);
+  while ((rc = sqlite3_step(res)) == SQLITE_ROW) {
+    if (sqlite3_column_int(res, 0) == slot) {
+      slot++;
+    } else if (sqlite3_column_int(res, 0) > slot) {
+      break;
+    }
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@siaddr");
-    sqlite3_bind_text(res, column_idx, dhcps->siaddr, -1, NULL);
+  sqlite3_finalize(res);
+  if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@giaddr");
-    sqlite3_bind_text(res, column_idx, dhcps->giaddr, -1, NULL);
+  if (slot >= (int)MAX_PACKET_ID_SLOTS) {
+    log_error("No free packet id slot for ifname=%s", ifname);
+    return -1;
+  }
 
-    column_idx = sqlite3_bind_parameter_index(res, "@chaddr");
-    sqlite3_bind_text(res, column_idx, dhcps->chaddr, -1, NULL);
+  if (sqlite3_prepare_v2(db, PACKET_ID_SLOT_INSERT_INTO, -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-    // log_trace(
-    //     "sqlite insert DHCP ciaddr=%s yiaddr=%s siaddr=%s giaddr=%s
-    //     chaddr=%s", dhcps->ciaddr, dhcps->yiaddr, dhcps->siaddr,
-    //     dhcps->giaddr, dhcps->chaddr);
-    sqlite3_step(res);
+  if (sqlite3_bind_text(res, 1, ifname, -1, SQLITE_STATIC) != SQLITE_OK ||
+      sqlite3_bind_int(res, 2, slot) != SQLITE_OK) {
+    log_error("sqlite3 bind fail");
     sqlite3_finalize(res);
-  } else {
-    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  return 0;
+  rc = sqlite3_step(res);
+  sqlite3_finalize(res);
+  if (rc != SQLITE_DONE) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
+  return slot;
 }
 
-int save_packet_statement(sqlite3 *db, struct tuple_packet *tp) {
+int get_sqlite_packet_id_slot(sqlite3 *db, const char *ifname) {
+  int slot = -1, rc;
+
   if (db == NULL) {
     log_error("db param is NULL");
     return -1;
   }
 
-  if (tp == NULL) {
-    log_error("tp param is NULL");
+  if (ifname == NULL) {
+    log_error("ifname param is NULL");
     return -1;
   }
 
-  if (tp->packet == NULL) {
-    log_error("tp->packet param is NULL");
+  // Several capture threads can add their interfaces to the same db
+  if (execute_sqlite_query(db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on the header db");
     return -1;
   }
 
-  switch (tp->type) {
-    case PACKET_NONE:
-      return -1;
-    case PACKET_ETHERNET:
-      return extract_eth_statement(db, (struct eth_schema *)tp->packet);
-    case PACKET_ARP:
-      return extract_arp_statement(db, (struct arp_schema *)tp->packet);
-    case PACKET_IP4:
-      return extract_ip4_statement(db, (struct ip4_schema *)tp->packet);
-    case PACKET_IP6:
-      return extract_ip6_statement(db, (struct ip6_schema *)tp->packet);
-    case PACKET_TCP:
-      return extract_tcp_statement(db, (struct tcp_schema *)tp->packet);
-    case PACKET_UDP:
-      return extract_udp_statement(db, (struct udp_schema *)tp->packet);
-    case PACKET_ICMP4:
-      return extract_icmp4_statement(db, (struct icmp4_schema *)tp->packet);
-    case PACKET_ICMP6:
-      return extract_icmp6_statement(db, (struct icmp6_schema *)tp->packet);
-    case PACKET_DNS:
-      return extract_dns_statement(db, (struct dns_schema *)tp->packet);
-    case PACKET_MDNS:
-      return extract_mdsn_statement(db, (struct mdns_schema *)tp->packet);
-    case PACKET_DHCP:
-      return extract_dhcp_statement(db, (struct dhcp_schema *)tp->packet);
+  if ((rc = find_packet_id_slot(db, ifname, &slot)) == 0) {
+    slot = add_packet_id_slot(db, ifname);
   }
 
-  return -1;
+  if (slot < 0) {
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
+    return -1;
+  }
+
+  if (execute_sqlite_query(db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit the packet id slot");
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
+    return -1;
+  }
+
+  return slot;
 }
 
-int init_sqlite_header_db(sqlite3 *db) {
-  const char *tables[] = {
-      ETH_CREATE_TABLE,   ARP_CREATE_TABLE,   IP4_CREATE_TABLE,
-      IP6_CREATE_TABLE,   TCP_CREATE_TABLE,   UDP_CREATE_TABLE,
-      ICMP4_CREATE_TABLE, ICMP6_CREATE_TABLE, DNS_CREATE_TABLE,
-      MDNS_CREATE_TABLE,  DHCP_CREATE_TABLE,
-  };
+int get_sqlite_header_last_id(sqlite3 *db, uint64_t *id) {
+  sqlite3_stmt *res = NULL;
+  int rc;
 
   if (db == NULL) {
     log_error("db param is NULL");
     return -1;
   }
 
-  log_debug("sqlite autocommit mode=%d", sqlite3_get_autocommit(db));
+  if (sqlite3_prepare_v2(db, HEADER_SELECT_LAST_ID, -1, &res, NULL) !=
+      SQLITE_OK) {
+    log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
 
-  for (size_t i = 0; i < ARRAY_SIZE(tables); i++) {
-    if (execute_sqlite_query(db, tables[i]) < 0) {
-      log_error("execute_sqlite_query fail: %s", tables[i]);
-      return -1;
-    }
+  *id = 0;
+  if ((rc = sqlite3_step(res)) == SQLITE_ROW) {
+    *id = (uint64_t)sqlite3_column_int64(res, 0);
+  }
+
+  sqlite3_finalize(res);
+  if (rc != SQLITE_ROW) {
+    log_error("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
   }
 
   return 0;
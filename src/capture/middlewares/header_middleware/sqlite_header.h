@@ -11,33 +11,36 @@
 #ifndef SQLITE_HEADER_H
 #define SQLITE_HEADER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <pcap.h>
 #include <sqlite3.h>
 
 #include "../../../utils/allocs.h"
+#include "../../../utils/attributes.h"
 #include "../../../utils/os.h"
 
 #include "../../capture_config.h"
 
+#include "flow_table.h"
 #include "packet_decoder.h"
 
 #define MAX_DB_NAME 100
 
 #define ETH_CREATE_TABLE                                                       \
   "CREATE TABLE IF NOT EXISTS eth (timestamp INTEGER NOT NULL, "               \
-  "id TEXT NOT NULL, caplen INTEGER, length INTEGER, ifname TEXT, "            \
+  "id INTEGER NOT NULL, caplen INTEGER, length INTEGER, ifname TEXT, "         \
   "ether_dhost TEXT, ether_shost TEXT, ether_type INTEGER, PRIMARY KEY "       \
   "(timestamp, id));"
 
 #define ARP_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS arp (id TEXT, "                                  \
+  "CREATE TABLE IF NOT EXISTS arp (id INTEGER, "                               \
   "ar_hrd INTEGER, ar_pro INTEGER, ar_hln INTEGER, "                           \
   "ar_pln INTEGER, ar_op INTEGER, arp_sha TEXT, arp_spa TEXT, "                \
   "arp_tha TEXT, arp_tpa TEXT, PRIMARY KEY (id));"
 
 #define IP4_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS ip4 (id TEXT NOT NULL, "                         \
+  "CREATE TABLE IF NOT EXISTS ip4 (id INTEGER NOT NULL, "                      \
   "ip_hl INTEGER, ip_v INTEGER, ip_tos INTEGER, ip_len INTEGER, ip_id "        \
   "INTEGER, "                                                                  \
   "ip_off INTEGER, ip_ttl INTEGER, ip_p INTEGER, ip_sum INTEGER, ip_src "      \
@@ -45,13 +48,13 @@
   "ip_dst TEXT, PRIMARY KEY (id));"
 
 #define IP6_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS ip6 (id TEXT NOT NULL, "                         \
+  "CREATE TABLE IF NOT EXISTS ip6 (id INTEGER NOT NULL, "                      \
   "ip6_un1_flow INTEGER, ip6_un1_plen INTEGER, ip6_un1_nxt INTEGER, "          \
   "ip6_un1_hlim INTEGER, "                                                     \
   "ip6_un2_vfc INTEGER, ip6_src TEXT, ip6_dst TEXT, PRIMARY KEY (id));"
 
 #define TCP_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS tcp (id TEXT NOT NULL, "                         \
+  "CREATE TABLE IF NOT EXISTS tcp (id INTEGER NOT NULL, "                      \
   "source INTEGER, dest INTEGER, seq INTEGER, ack_seq INTEGER, res1 INTEGER, " \
   "doff INTEGER, fin INTEGER, "                                                \
   "syn INTEGER, rst INTEGER, psh INTEGER, ack INTEGER, urg INTEGER, window "   \
@@ -59,39 +62,89 @@
   "urg_ptr INTEGER, PRIMARY KEY (id));"
 
 #define UDP_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS udp (id TEXT NOT NULL, "                         \
+  "CREATE TABLE IF NOT EXISTS udp (id INTEGER NOT NULL, "                      \
   "source INTEGER, dest INTEGER, len INTEGER, check_p INTEGER, PRIMARY KEY "   \
   "(id));"
 
 #define ICMP4_CREATE_TABLE                                                     \
-  "CREATE TABLE IF NOT EXISTS icmp4 (id TEXT NOT NULL, "                       \
+  "CREATE TABLE IF NOT EXISTS icmp4 (id INTEGER NOT NULL, "                    \
   "type INTEGER, code INTEGER, checksum INTEGER, gateway INTEGER, PRIMARY "    \
   "KEY (id));"
 
 #define ICMP6_CREATE_TABLE                                                     \
-  "CREATE TABLE IF NOT EXISTS icmp6 (id TEXT NOT NULL, "                       \
+  "CREATE TABLE IF NOT EXISTS icmp6 (id INTEGER NOT NULL, "                    \
   "icmp6_type INTEGER, icmp6_code INTEGER, icmp6_cksum INTEGER, "              \
   "icmp6_un_data32 INTEGER, PRIMARY KEY (id));"
 
 #define DNS_CREATE_TABLE                                                       \
-  "CREATE TABLE IF NOT EXISTS dns (id TEXT NOT NULL, "                         \
+  "CREATE TABLE IF NOT EXISTS dns (id INTEGER NOT NULL, "                      \
   "tid INTEGER, flags INTEGER, nqueries INTEGER, nanswers INTEGER, nauth "     \
   "INTEGER, "                                                                  \
   "nother INTEGER, qname TEXT, PRIMARY KEY (id));"
 
 #define MDNS_CREATE_TABLE                                                      \
-  "CREATE TABLE IF NOT EXISTS mdns (id TEXT NOT NULL, "                        \
+  "CREATE TABLE IF NOT EXISTS mdns (id INTEGER NOT NULL, "                     \
   "tid INTEGER, flags INTEGER, nqueries INTEGER, nanswers INTEGER, nauth "     \
   "INTEGER, "                                                                  \
   "nother INTEGER, qname TEXT, PRIMARY KEY (id));"
 
 #define DHCP_CREATE_TABLE                                                      \
-  "CREATE TABLE IF NOT EXISTS dhcp (id TEXT NOT NULL, "                        \
+  "CREATE TABLE IF NOT EXISTS dhcp (id INTEGER NOT NULL, "                     \
   "op INTEGER, htype INTEGER, hlen INTEGER, hops INTEGER, xid INTEGER, secs "  \
   "INTEGER, flags INTEGER, "                                                   \
   "ciaddr TEXT, yiaddr TEXT, siaddr TEXT, giaddr TEXT, chaddr TEXT, "          \
   "PRIMARY KEY (id));"
 
+#define FLOW_CREATE_TABLE                                                      \
+  "CREATE TABLE IF NOT EXISTS flow (first_timestamp INTEGER NOT NULL, "        \
+  "last_timestamp INTEGER NOT NULL, ifname TEXT, ip_src TEXT, ip_dst TEXT, "   \
+  "source INTEGER, dest INTEGER, protocol INTEGER, packets INTEGER, "          \
+  "bytes INTEGER, tcp_flags INTEGER);"
+
+// The last id lookup at startup would otherwise scan the whole eth table
+#define ETH_CREATE_ID_INDEX "CREATE INDEX IF NOT EXISTS eth_id ON eth (id);"
+
+/* Before the 64-bit packet ids, the header tables had TEXT UUID ids. The
+ * migration numbers the UUIDs in the order of their eth timestamps and
+ * rewrites them as ids of the default slot with a zero start time, so they
+ * are lower than all the new ids and keep joining the rows of a packet. */
+#define HEADER_SELECT_ID_TYPE                                                  \
+  "SELECT type FROM pragma_table_info('eth') WHERE name = 'id';"
+#define HEADER_ID_MAP_TABLE_NAME "header_id_map"
+#define HEADER_CREATE_ID_MAP                                                   \
+  "CREATE TEMP TABLE " HEADER_ID_MAP_TABLE_NAME                                \
+  " (counter INTEGER PRIMARY KEY, uuid TEXT NOT NULL UNIQUE);"
+#define HEADER_DROP_ID_MAP "DROP TABLE temp." HEADER_ID_MAP_TABLE_NAME ";"
+#define HEADER_MIGRATE_ID_MAP(table, order)                                    \
+  "INSERT OR IGNORE INTO " HEADER_ID_MAP_TABLE_NAME " (uuid) SELECT id FROM "  \
+  table order ";"
+/* The ids are rewritten in the old table, as the integer PRIMARY KEY of the
+ * new tables can't hold the UUIDs, and the copy converts them to integers */
+#define HEADER_MIGRATE_TABLE(table, create)                                    \
+  "UPDATE " table " SET id = (SELECT counter FROM " HEADER_ID_MAP_TABLE_NAME   \
+  " WHERE uuid = " table ".id) * 256;" /* counter << PACKET_ID_SLOT_BITS */    \
+  "ALTER TABLE " table " RENAME TO " table "_old;" create                      \
+  "INSERT INTO " table " SELECT * FROM " table "_old;"                         \
+  "DROP TABLE " table "_old;"
+
+#define PACKET_ID_SLOT_TABLE_NAME "packet_id_slot"
+#define PACKET_ID_SLOT_CREATE_TABLE                                            \
+  "CREATE TABLE IF NOT EXISTS " PACKET_ID_SLOT_TABLE_NAME                      \
+  " (ifname TEXT PRIMARY KEY, slot INTEGER NOT NULL UNIQUE);"
+#define PACKET_ID_SLOT_SELECT                                                  \
+  "SELECT slot FROM " PACKET_ID_SLOT_TABLE_NAME " WHERE ifname = @ifname;"
+#define PACKET_ID_SLOT_SELECT_ALL                                              \
+  "SELECT slot FROM " PACKET_ID_SLOT_TABLE_NAME " ORDER BY slot ASC;"
+#define PACKET_ID_SLOT_INSERT_INTO                                             \
+  "INSERT INTO " PACKET_ID_SLOT_TABLE_NAME " VALUES(@ifname, @slot);"
+#define HEADER_SELECT_LAST_ID                                                  \
+  "SELECT MAX(id) FROM (SELECT MAX(id) AS id FROM eth UNION ALL "              \
+  "SELECT MAX(id) FROM arp UNION ALL SELECT MAX(id) FROM ip4 UNION ALL "       \
+  "SELECT MAX(id) FROM ip6 UNION ALL SELECT MAX(id) FROM tcp UNION ALL "       \
+  "SELECT MAX(id) FROM udp UNION ALL SELECT MAX(id) FROM icmp4 UNION ALL "     \
+  "SELECT MAX(id) FROM icmp6 UNION ALL SELECT MAX(id) FROM dns UNION ALL "     \
+  "SELECT MAX(id) FROM mdns UNION ALL SELECT MAX(id) FROM dhcp);"
+
 #define ETH_INSERT_INTO                                                        \
   "INSERT INTO eth VALUES(@timestamp, @id, @caplen, @length, @ifname, "        \
   "@ether_dhost, @ether_shost, @ether_type);"
@@ -129,20 +182,148 @@
   "@op, @htype, @hlen, @hops, @xid, @secs, @flags, "                           \
   "@ciaddr, @yiaddr, @siaddr, @giaddr, @chaddr);"
 
+#define FLOW_INSERT_INTO                                                       \
+  "INSERT INTO flow VALUES(@first_timestamp, @last_timestamp, @ifname, "       \
+  "@ip_src, @ip_dst, @source, @dest, @protocol, @packets, @bytes, "            \
+  "@tcp_flags);"
+
+/**
+ * @brief Number of insert statements, one for each PACKET_TYPES value
+ */
+#define HEADER_STATEMENTS_COUNT (PACKET_DHCP + 1)
+
+/**
+ * @brief The sqlite header writer structure definition
+ *
+ * Holds one prepared insert statement for each packet type, so a packet is
+ * saved without recompiling the SQL, and groups the inserts in transactions
+ * of at most max_batch_size packets.
+ */
+struct sqlite_header_writer {
+  sqlite3 *db; /**< The sqlite3 db */
+  sqlite3_stmt *statements[HEADER_STATEMENTS_COUNT]; /**< The insert
+                                                        statements indexed by
+                                                        packet type */
+  sqlite3_stmt *flow_statement; /**< The flow insert statement */
+  unsigned int max_batch_size; /**< Maximum packets per transaction (0 to
+                                  disable transactions) */
+  unsigned int batch_size;     /**< Packets in the open transaction */
+  bool in_transaction;         /**< True if a transaction is open */
+};
+
 /**
  * @brief Save packets to sqlite db
  *
+ * The insert statement is prepared for every call, use
+ * save_sqlite_header_packet() when saving many packets.
+ *
  * @param db The sqlite3 db
  * @param tp The packet tuple structure
  * @return int 0 on success, -1 o failure
  */
 int save_packet_statement(sqlite3 *db, struct tuple_packet *tp);
 
+/**
+ * @brief Frees the sqlite header writer, commits any open transaction
+ *
+ * @param writer The sqlite header writer
+ */
+void free_sqlite_header_writer(struct sqlite_header_writer *writer);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be
+ * free_sqlite_header_writer()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_sqlite_header_writer                                       \
+  __attribute__((malloc(free_sqlite_header_writer, 1))) __must_check
+#else
+#define __must_free_sqlite_header_writer __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises the sqlite header writer and prepares the insert
+ * statements
+ *
+ * The header tables must already exist, see init_sqlite_header_db().
+ *
+ * @param db The sqlite3 db
+ * @param max_batch_size Maximum number of packets in a transaction. If 0 the
+ * writer doesn't open transactions and the caller can manage them.
+ * @return struct sqlite_header_writer* The writer, NULL on failure.
+ * You must free this using free_sqlite_header_writer().
+ */
+__must_free_sqlite_header_writer struct sqlite_header_writer *
+init_sqlite_header_writer(sqlite3 *db, unsigned int max_batch_size);
+
+/**
+ * @brief Saves a packet using the prepared insert statements
+ *
+ * Opens a transaction if none is open, and commits it first if it already
+ * holds max_batch_size packets.
+ *
+ * @param writer The sqlite header writer
+ * @param tp The packet tuple structure
+ * @return int 0 on success, -1 on failure
+ */
+int save_sqlite_header_packet(struct sqlite_header_writer *writer,
+                              struct tuple_packet *tp);
+
+/**
+ * @brief Saves a flow record using the prepared insert statement
+ *
+ * The flow is saved in the same transaction as the packets.
+ *
+ * @param writer The sqlite header writer
+ * @param record The flow record
+ * @return int 0 on success, -1 on failure
+ */
+int save_sqlite_header_flow(struct sqlite_header_writer *writer,
+                            const struct flow_record *record);
+
+/**
+ * @brief Commits the open transaction of the sqlite header writer
+ *
+ * On failure the transaction is kept open and the commit is retried on the
+ * next call.
+ *
+ * @param writer The sqlite header writer
+ * @return int 0 on success, -1 on failure
+ */
+int commit_sqlite_header_writer(struct sqlite_header_writer *writer);
+
 /**
  * @brief Initialises the sqlite3 header db tables
  *
+ * The tables of an old db with UUID packet ids are migrated to the integer
+ * packet ids.
+ *
  * @param db The sqlite3 db
  * @return 0 on success, -1 on failure
  */
 int init_sqlite_header_db(sqlite3 *db);
+
+/**
+ * @brief Returns the packet id slot of an interface
+ *
+ * A new interface gets the lowest free slot of the db, starting from 1, since
+ * PACKET_ID_DEFAULT_SLOT is kept for the ids without an interface.
+ *
+ * @param db The sqlite3 db
+ * @param ifname The interface name
+ * @return int The slot, -1 on failure or if the db has no free slot
+ */
+int get_sqlite_packet_id_slot(sqlite3 *db, const char *ifname);
+
+/**
+ * @brief Returns the largest packet id stored in the header tables
+ *
+ * @param db The sqlite3 db
+ * @param[out] id The largest packet id, 0 if the tables are empty
+ * @return 0 on success, -1 on failure
+ */
+int get_sqlite_header_last_id(sqlite3 *db, uint64_t *id);
 #endif
@@ -9,6 +9,7 @@
  * utilities.
  */
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,7 @@
 
 #include "pcap_middleware.h"
 #include "pcap_queue.h"
+#include "pcap_segment.h"
 #include "sqlite_pcap.h"
 
 #include <eloop.h>
@@ -26,20 +28,24 @@
 #include "../../../utils/os.h"
 #include "../../../utils/squeue.h"
 
+#include "../../capture_stats.h"
 #include "../../pcap_service.h"
 
 #define PCAP_SUBFOLDER_NAME                                                    \
   "./capture" /* Subfodler name to store raw pcap data                         \
                */
-#define PCAP_EXTENSION ".pcap"
 #define PCAP_PROCESS_INTERVAL 10 * 1000 // In microseconds
 
-#define MAX_PCAP_FILE_NAME_LENGTH                                              \
-  MAX_RANDOM_UUID_LEN + ARRAY_SIZE(PCAP_EXTENSION)
+#define PCAP_SEGMENT_MAX_SIZE                                                  \
+  256 * 1024 /* Maximum size in bytes of a pcap segment file */
+#define PCAP_SEGMENT_MAX_AGE                                                   \
+  60 * 1000000 /* Maximum age in microseconds of a pcap segment file */
 
 struct pcap_middleware_context {
   char pcap_path[MAX_OS_PATH_LEN];
   struct pcap_queue *queue;
+  struct pcap_segment *segment;
+  uint64_t segments; /**< Number of segments saved to the db */
 };
 
 int get_pcap_folder_path(char *capture_db_path, char *pcap_path) {
@@ -77,37 +83,36 @@ int get_pcap_folder_path(char *capture_db_path, char *pcap_path) {
   return 0;
 }
 
-void construct_pcap_file_name(char *file_name) {
-  generate_radom_uuid(file_name);
-  strcat(file_name, PCAP_EXTENSION);
-}
-
 int save_pcap_file_data(struct middleware_context *context,
                         struct pcap_pkthdr *header, uint8_t *packet) {
-  char *path = NULL;
-  char file_name[MAX_PCAP_FILE_NAME_LENGTH];
-  uint64_t timestamp = 0;
+  uint64_t timestamp = 0, offset = 0;
 
   struct pcap_middleware_context *pcap_context =
       (struct pcap_middleware_context *)context->mdata;
 
   os_to_timestamp(header->ts, &timestamp);
-  construct_pcap_file_name(file_name);
 
-  if ((path = construct_path(pcap_context->pcap_path, file_name)) == NULL) {
-    log_error("construct_path fail");
+  if (write_pcap_segment(pcap_context->segment, header, packet, &offset) < 0) {
+    log_error("write_pcap_segment fail");
     return -1;
   }
 
-  if (dump_file_pcap(context->pc, path, header, packet) < 0) {
-    log_error("dump_file_pcap fail");
-    os_free(path);
-    return -1;
-  }
+  record_capture_bytes(PCAP_RECORD_HEADER_SIZE + header->caplen);
 
-  os_free(path);
+  // The segment row is saved with the first record of a new segment, or
+  // with the next record if that failed, as the offset counts the file
+  // bytes before the record
+  if (pcap_context->segments != pcap_context->segment->opened) {
+    if (save_sqlite_pcap_segment(context->db, pcap_context->segment->name,
+                                 context->pc->ifname, timestamp, offset) < 0) {
+      log_error("save_sqlite_pcap_segment fail");
+      return -1;
+    }
+    pcap_context->segments = pcap_context->segment->opened;
+  }
 
-  if (save_sqlite_pcap_entry(context->db, file_name, timestamp, header->caplen,
+  if (save_sqlite_pcap_entry(context->db, pcap_context->segment->name,
+                             timestamp, offset, header->caplen,
                              header->len) < 0) {
     log_error("save_sqlite_pcap_entry fail");
     return -1;
@@ -133,6 +138,10 @@ void eloop_tout_pcap_handler(void *eloop_ctx, void *user_ctx) {
     }
   }
 
+  if (flush_pcap_segment(pcap_context->segment) < 0) {
+    log_error("flush_pcap_segment fail");
+  }
+
   if (edge_eloop_register_timeout(context->eloop, 0, PCAP_PROCESS_INTERVAL,
                                   eloop_tout_pcap_handler, NULL,
                                   (void *)user_ctx) == -1) {
@@ -142,11 +151,17 @@ void eloop_tout_pcap_handler(void *eloop_ctx, void *user_ctx) {
 
 void free_pcap_middleware(struct middleware_context *context) {
   struct pcap_middleware_context *pcap_context;
+  struct os_slab_stats stats;
 
   if (context != NULL) {
     if (context->mdata != NULL) {
       pcap_context = (struct pcap_middleware_context *)context->mdata;
+      if (get_pcap_queue_stats(pcap_context->queue, &stats) == 0) {
+        log_debug("pcap queue high-water=%zu capacity=%zu allocs=%" PRIu64,
+                  stats.high_water, stats.capacity, stats.allocs);
+      }
       free_pcap_queue(pcap_context->queue);
+      free_pcap_segment(pcap_context->segment);
       os_free(pcap_context);
       context->mdata = NULL;
     }
@@ -154,10 +169,12 @@ void free_pcap_middleware(struct middleware_context *context) {
   }
 }
 
-struct middleware_context *init_pcap_middleware(sqlite3 *db, char *db_path,
-                                                struct eloop_data *eloop,
-                                                struct pcap_context *pc,
-                                                char *params) {
+struct middleware_context *
+init_pcap_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                     struct pcap_context *pc, char *params,
+                     const struct capture_conf *config) {
+  (void)config;
+
   struct middleware_context *context = NULL;
   struct pcap_middleware_context *pcap_context = NULL;
 
@@ -178,6 +195,11 @@ struct middleware_context *init_pcap_middleware(sqlite3 *db, char *db_path,
     return NULL;
   }
 
+  if (pc == NULL) {
+    log_error("pc param is NULL");
+    return NULL;
+  }
+
   if ((context = os_zalloc(sizeof(struct middleware_context))) == NULL) {
     log_errno("zalloc");
     return NULL;
@@ -214,6 +236,15 @@ struct middleware_context *init_pcap_middleware(sqlite3 *db, char *db_path,
     return NULL;
   }
 
+  if ((pcap_context->segment =
+           init_pcap_segment(pc->pd, pcap_context->pcap_path,
+                             PCAP_SEGMENT_MAX_SIZE, PCAP_SEGMENT_MAX_AGE)) ==
+      NULL) {
+    log_error("init_pcap_segment fail");
+    free_pcap_middleware(context);
+    return NULL;
+  }
+
   if (init_sqlite_pcap_db(db) < 0) {
     log_error("init_sqlite_pcap_db fail");
     free_pcap_middleware(context);
@@ -261,9 +292,22 @@ int process_pcap_middleware(struct middleware_context *context,
   return 0;
 }
 
+ssize_t queue_length_pcap_middleware(struct middleware_context *context) {
+  struct pcap_middleware_context *pcap_context;
+
+  if (context == NULL || context->mdata == NULL) {
+    log_error("context params is NULL");
+    return -1;
+  }
+
+  pcap_context = (struct pcap_middleware_context *)context->mdata;
+  return get_pcap_queue_length(pcap_context->queue);
+}
+
 struct capture_middleware pcap_middleware = {
     .init = init_pcap_middleware,
     .process = process_pcap_middleware,
     .free = free_pcap_middleware,
     .name = "pcap middleware",
+    .queue_length = queue_length_pcap_middleware,
 };
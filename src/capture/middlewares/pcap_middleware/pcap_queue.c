@@ -27,11 +27,25 @@ struct pcap_queue *init_pcap_queue(void) {
     return NULL;
   }
 
+  // The elements hold the packet data after the element structure
+  queue->slab =
+      init_os_slab(sizeof(struct pcap_queue) + PCAP_QUEUE_INLINE_SIZE,
+                   PCAP_QUEUE_SLAB_CHUNK);
+  if (queue->slab == NULL) {
+    log_error("init_os_slab fail");
+    os_free(queue);
+    return NULL;
+  }
+
   dl_list_init(&queue->list);
 
   return queue;
 }
 
+static inline uint8_t *get_inline_packet(struct pcap_queue *el) {
+  return (uint8_t *)(el + 1);
+}
+
 struct pcap_queue *push_pcap_queue(struct pcap_queue *queue,
                                    struct pcap_pkthdr *header,
                                    uint8_t *packet) {
@@ -52,15 +66,19 @@ struct pcap_queue *push_pcap_queue(struct pcap_queue *queue,
     return NULL;
   }
 
-  if ((el = init_pcap_queue()) == NULL) {
-    log_debug("init_packet_queue fail");
+  if ((el = os_slab_alloc(queue->slab)) == NULL) {
+    log_errno("os_slab_alloc");
     return NULL;
   }
 
   os_memcpy(&el->header, header, sizeof(struct pcap_pkthdr));
-  el->packet = os_malloc(header->caplen);
-  if (el->packet == NULL) {
+  el->slab = queue->slab;
+
+  if (header->caplen <= PCAP_QUEUE_INLINE_SIZE) {
+    el->packet = get_inline_packet(el);
+  } else if ((el->packet = os_malloc(header->caplen)) == NULL) {
     log_errno("os_malloc");
+    os_slab_free(el->slab, el);
     return NULL;
   }
 
@@ -81,24 +99,47 @@ struct pcap_queue *pop_pcap_queue(struct pcap_queue *queue) {
 void free_pcap_queue_el(struct pcap_queue *el) {
   if (el != NULL) {
     dl_list_del(&el->list);
-    os_free(el->packet);
-    os_free(el);
+    if (el->packet != get_inline_packet(el)) {
+      os_free(el->packet);
+    }
+    os_slab_free(el->slab, el);
   }
 }
 
 void free_pcap_queue(struct pcap_queue *queue) {
   struct pcap_queue *el;
 
+  if (queue == NULL) {
+    return;
+  }
+
   while ((el = pop_pcap_queue(queue)) != NULL)
     free_pcap_queue_el(el);
 
-  free_pcap_queue_el(queue);
+  free_os_slab(queue->slab);
+  os_free(queue);
 }
 
 ssize_t get_pcap_queue_length(struct pcap_queue *queue) {
   return (queue != NULL) ? dl_list_len(&queue->list) : 0;
 }
 
+int get_pcap_queue_stats(struct pcap_queue *queue,
+                         struct os_slab_stats *stats) {
+  if (queue == NULL) {
+    log_trace("queue param is NULL");
+    return -1;
+  }
+
+  if (stats == NULL) {
+    log_trace("stats param is NULL");
+    return -1;
+  }
+
+  get_os_slab_stats(queue->slab, stats);
+  return 0;
+}
+
 int is_pcap_queue_empty(struct pcap_queue *queue) {
   if (queue == NULL) {
     log_trace("queue param is NULL");
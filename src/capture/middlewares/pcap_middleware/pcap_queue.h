@@ -19,8 +19,20 @@
 
 #include <list.h>
 
+#include "../../../utils/allocs.h"
 #include "../../../utils/attributes.h"
 
+/**
+ * @brief Maximum packet size stored in the queue element itself, larger
+ * packets are allocated separately
+ */
+#define PCAP_QUEUE_INLINE_SIZE 1600
+
+/**
+ * @brief Number of queue elements allocated at once by the queue slab
+ */
+#define PCAP_QUEUE_SLAB_CHUNK 256
+
 /**
  * @brief pcap queueu structure definition
  *
@@ -28,6 +40,7 @@
 struct pcap_queue {
   struct pcap_pkthdr header; /**< pcap header */
   uint8_t *packet;           /**< pointer to the packet data */
+  struct os_slab *slab;      /**< The slab of the queue elements */
   struct dl_list list;       /**< List definition */
 };
 
@@ -72,6 +85,16 @@ ssize_t get_pcap_queue_length(struct pcap_queue *queue);
  */
 void free_pcap_queue(struct pcap_queue *queue);
 
+/**
+ * @brief Returns the statistics of the pcap queue elements slab
+ *
+ * @param queue The pointer to the pcap queue
+ * @param[out] stats The slab statistics
+ * @return int 0 on success, -1 on failure
+ */
+int get_pcap_queue_stats(struct pcap_queue *queue,
+                         struct os_slab_stats *stats);
+
 /**
  * @brief Checks if pcap queue is empty
  *
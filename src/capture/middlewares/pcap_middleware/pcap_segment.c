@@ -0,0 +1,204 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the rolling pcap segment
+ * writer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pcap.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../../../utils/allocs.h"
+#include "../../../utils/log.h"
+#include "../../../utils/os.h"
+#include "pcap_segment.h"
+
+static void construct_pcap_file_name(char *file_name) {
+  generate_radom_uuid(file_name);
+  strcat(file_name, PCAP_EXTENSION);
+}
+
+void close_pcap_segment(struct pcap_segment *segment) {
+  if (segment != NULL) {
+    if (segment->dumper != NULL) {
+      log_trace("Closing pcap segment %s with size=%" PRIu64, segment->name,
+                segment->offset);
+      pcap_dump_close(segment->dumper);
+      segment->dumper = NULL;
+    }
+    segment->name[0] = '\0';
+    segment->offset = 0;
+    segment->start_timestamp = 0;
+  }
+}
+
+void free_pcap_segment(struct pcap_segment *segment) {
+  if (segment != NULL) {
+    close_pcap_segment(segment);
+    os_free(segment);
+  }
+}
+
+struct pcap_segment *init_pcap_segment(pcap_t *pd, const char *pcap_path,
+                                       uint64_t max_size, uint64_t max_age) {
+  struct pcap_segment *segment = NULL;
+
+  if (pd == NULL) {
+    log_error("pd param is NULL");
+    return NULL;
+  }
+
+  if (pcap_path == NULL) {
+    log_error("pcap_path param is NULL");
+    return NULL;
+  }
+
+  if ((segment = os_zalloc(sizeof(struct pcap_segment))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  segment->pd = pd;
+  segment->max_size = max_size;
+  segment->max_age = max_age;
+  os_strlcpy(segment->pcap_path, pcap_path, MAX_OS_PATH_LEN);
+
+  return segment;
+}
+
+static int open_pcap_segment(struct pcap_segment *segment,
+                             uint64_t timestamp) {
+  char *path = NULL;
+  long offset;
+
+  construct_pcap_file_name(segment->name);
+
+  if ((path = construct_path(segment->pcap_path, segment->name)) == NULL) {
+    log_error("construct_path fail");
+    segment->name[0] = '\0';
+    return -1;
+  }
+
+  if ((segment->dumper = pcap_dump_open(segment->pd, path)) == NULL) {
+    log_error("pcap_dump_open fail: %s", pcap_geterr(segment->pd));
+    segment->name[0] = '\0';
+    os_free(path);
+    return -1;
+  }
+
+  log_trace("Opened pcap segment %s", path);
+  os_free(path);
+
+  // Position after the pcap file header
+  if ((offset = pcap_dump_ftell(segment->dumper)) < 0) {
+    log_error("pcap_dump_ftell fail");
+    close_pcap_segment(segment);
+    return -1;
+  }
+
+  segment->offset = (uint64_t)offset;
+  segment->start_timestamp = timestamp;
+  segment->opened++;
+
+  return 0;
+}
+
+static bool is_pcap_segment_full(struct pcap_segment *segment,
+                                 uint64_t timestamp) {
+  if (segment->max_size && segment->offset >= segment->max_size) {
+    return true;
+  }
+
+  if (segment->max_age && timestamp > segment->start_timestamp &&
+      timestamp - segment->start_timestamp >= segment->max_age) {
+    return true;
+  }
+
+  return false;
+}
+
+int write_pcap_segment(struct pcap_segment *segment,
+                       struct pcap_pkthdr *header, uint8_t *packet,
+                       uint64_t *offset) {
+  uint64_t timestamp = 0;
+
+  if (segment == NULL) {
+    log_error("segment param is NULL");
+    return -1;
+  }
+
+  if (header == NULL) {
+    log_error("header param is NULL");
+    return -1;
+  }
+
+  if (packet == NULL) {
+    log_error("packet param is NULL");
+    return -1;
+  }
+
+  if (offset == NULL) {
+    log_error("offset param is NULL");
+    return -1;
+  }
+
+  os_to_timestamp(header->ts, &timestamp);
+
+  if (segment->dumper != NULL && is_pcap_segment_full(segment, timestamp)) {
+    close_pcap_segment(segment);
+  }
+
+  if (segment->dumper == NULL) {
+    if (open_pcap_segment(segment, timestamp) < 0) {
+      log_error("open_pcap_segment fail");
+      return -1;
+    }
+  }
+
+  pcap_dump((u_char *)segment->dumper, header, packet);
+
+  *offset = segment->offset;
+  segment->offset += PCAP_RECORD_HEADER_SIZE + header->caplen;
+
+  return 0;
+}
+
+int flush_pcap_segment(struct pcap_segment *segment) {
+  struct stat sb;
+
+  if (segment == NULL) {
+    log_error("segment param is NULL");
+    return -1;
+  }
+
+  if (segment->dumper == NULL) {
+    return 0;
+  }
+
+  if (pcap_dump_flush(segment->dumper) < 0) {
+    log_error("pcap_dump_flush fail for %s", segment->name);
+    close_pcap_segment(segment);
+    return -1;
+  }
+
+  if (fstat(fileno(pcap_dump_file(segment->dumper)), &sb) < 0) {
+    log_errno("fstat");
+    return -1;
+  }
+
+  if (sb.st_nlink == 0) {
+    log_trace("pcap segment %s was removed", segment->name);
+    close_pcap_segment(segment);
+  }
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the rolling pcap segment writer.
+ *
+ * A segment is a single pcap file that stays open and receives packets until
+ * it reaches a maximum size or a maximum age, after which a new segment
+ * file is created. Every written packet is identified by the segment name
+ * and its byte offset inside the segment.
+ */
+
+#ifndef PCAP_SEGMENT_H
+#define PCAP_SEGMENT_H
+
+#include <stdint.h>
+#include <pcap.h>
+
+#include "../../../utils/attributes.h"
+#include "../../../utils/os.h"
+
+#define PCAP_EXTENSION ".pcap"
+
+#define MAX_PCAP_FILE_NAME_LENGTH                                              \
+  MAX_RANDOM_UUID_LEN + ARRAY_SIZE(PCAP_EXTENSION)
+
+/**
+ * @brief Size in bytes of the per-packet record header written by
+ * pcap_dump() (two 32 bit timestamp fields, caplen and len)
+ */
+#define PCAP_RECORD_HEADER_SIZE 16
+
+/**
+ * @brief pcap segment writer structure definition
+ *
+ */
+struct pcap_segment {
+  pcap_t *pd;                /**< The pcap structure used to open dumpers */
+  pcap_dumper_t *dumper;     /**< The dumper for the open segment (or NULL) */
+  char pcap_path[MAX_OS_PATH_LEN];          /**< The segments folder path */
+  char name[MAX_PCAP_FILE_NAME_LENGTH];     /**< The open segment file name */
+  uint64_t max_size;        /**< Maximum segment size in bytes */
+  uint64_t max_age;         /**< Maximum segment age in microseconds */
+  uint64_t start_timestamp; /**< Timestamp of the first segment packet */
+  uint64_t offset;          /**< Byte offset of the next packet record */
+  uint64_t opened;          /**< Number of segments opened so far */
+};
+
+/**
+ * @brief Frees the pcap segment writer and closes the open segment
+ *
+ * @param segment The pcap segment writer
+ */
+void free_pcap_segment(struct pcap_segment *segment);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_pcap_segment()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_pcap_segment                                               \
+  __attribute__((malloc(free_pcap_segment, 1))) __must_check
+#else
+#define __must_free_pcap_segment __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a pcap segment writer
+ *
+ * No segment file is created until the first packet is written.
+ *
+ * @param pd The pcap structure (defines the link type and snaplen)
+ * @param pcap_path The folder path to store the segments
+ * @param max_size The maximum segment size in bytes
+ * @param max_age The maximum segment age in microseconds
+ * @return struct pcap_segment* The segment writer, NULL on failure.
+ * You must free this using free_pcap_segment().
+ */
+__must_free_pcap_segment struct pcap_segment *
+init_pcap_segment(pcap_t *pd, const char *pcap_path, uint64_t max_size,
+                  uint64_t max_age);
+
+/**
+ * @brief Appends a packet to the open segment
+ *
+ * A new segment is created if there is no open segment, or if the open
+ * segment exceeded its maximum size or age.
+ *
+ * @param segment The pcap segment writer
+ * @param header The pcap header
+ * @param packet The pcap packet
+ * @param[out] offset The byte offset of the packet record in the segment
+ * @return 0 on success, -1 on failure
+ */
+int write_pcap_segment(struct pcap_segment *segment,
+                       struct pcap_pkthdr *header, uint8_t *packet,
+                       uint64_t *offset);
+
+/**
+ * @brief Flushes the open segment to disk
+ *
+ * If the open segment file was removed from disk (for example by the cleaner
+ * middleware) the segment is closed, so the next packet starts a new one.
+ *
+ * @param segment The pcap segment writer
+ * @return 0 on success, -1 on failure
+ */
+int flush_pcap_segment(struct pcap_segment *segment);
+
+/**
+ * @brief Closes the open segment
+ *
+ * @param segment The pcap segment writer
+ */
+void close_pcap_segment(struct pcap_segment *segment);
+
+#endif
@@ -21,22 +21,136 @@
 #include "../../../utils/os.h"
 #include "../../../utils/sqliteu.h"
 
+/**
+ * @brief Checks whether the pcap table predates the file_offset column
+ *
+ * @param db The sqlite3 db
+ * @return int 1 if the table must be migrated, 0 if not, -1 on failure
+ */
+static int check_old_pcap_table(sqlite3 *db) {
+  int rc;
+
+  if ((rc = check_table_exists(db, PCAP_TABLE_NAME)) <= 0) {
+    return rc;
+  }
+
+  if ((rc = check_column_exists(db, PCAP_TABLE_NAME, "file_offset")) < 0) {
+    return -1;
+  }
+
+  return !rc;
+}
+
+static int migrate_sqlite_pcap_db(sqlite3 *db) {
+  int rc;
+
+  if (execute_sqlite_query(db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on the pcap db");
+    return -1;
+  }
+
+  // Another connection may have migrated the table in the meantime
+  if ((rc = check_old_pcap_table(db)) > 0) {
+    log_info("Migrating the old " PCAP_TABLE_NAME " table");
+    rc = execute_sqlite_query(db, PCAP_MIGRATE_TABLE);
+  }
+
+  if (rc < 0) {
+    log_error("Failed to migrate the " PCAP_TABLE_NAME " table");
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
+    return -1;
+  }
+
+  if (execute_sqlite_query(db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit the " PCAP_TABLE_NAME " migration");
+    execute_sqlite_query(db, "ROLLBACK TRANSACTION");
+    return -1;
+  }
+
+  return 0;
+}
+
 int init_sqlite_pcap_db(sqlite3 *db) {
+  int rc;
+
   if (db == NULL) {
     log_error("db param is NULL");
     return -1;
   }
 
+  if ((rc = check_old_pcap_table(db)) < 0) {
+    log_error("check_old_pcap_table fail");
+    return -1;
+  }
+
+  if (rc > 0 && migrate_sqlite_pcap_db(db) < 0) {
+    log_error("migrate_sqlite_pcap_db fail");
+    return -1;
+  }
+
   if (execute_sqlite_query(db, PCAP_CREATE_TABLE) < 0) {
     log_error("execute_sqlite_query fail");
     return -1;
   }
 
+  if (execute_sqlite_query(db, PCAP_CREATE_SEGMENT_TABLE) < 0) {
+    log_error("execute_sqlite_query fail");
+    return -1;
+  }
+
+  if (execute_sqlite_query(db, PCAP_CREATE_USAGE_TABLE) < 0) {
+    log_error("execute_sqlite_query fail");
+    return -1;
+  }
+
+  if (execute_sqlite_query(db, PCAP_CREATE_TRIGGERS) < 0) {
+    log_error("execute_sqlite_query fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int bind_pcap_text(sqlite3_stmt *res, const char *name,
+                          const char *value) {
+  int column_idx = sqlite3_bind_parameter_index(res, name);
+
+  if (sqlite3_bind_text(res, column_idx, value, -1, NULL) != SQLITE_OK) {
+    log_trace("sqlite3_bind_text fail for %s", name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int bind_pcap_int64(sqlite3_stmt *res, const char *name,
+                           uint64_t value) {
+  int column_idx = sqlite3_bind_parameter_index(res, name);
+
+  if (sqlite3_bind_int64(res, column_idx, (sqlite3_int64)value) !=
+      SQLITE_OK) {
+    log_trace("sqlite3_bind_int64 fail for %s", name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int step_pcap_statement(sqlite3 *db, sqlite3_stmt *res) {
+  int rc = sqlite3_step(res);
+
+  sqlite3_finalize(res);
+
+  if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+    log_trace("sqlite3_step fail: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
   return 0;
 }
 
 int save_sqlite_pcap_entry(sqlite3 *db, char *name, uint64_t timestamp,
-                           uint32_t caplen, uint32_t length) {
+                           uint64_t offset, uint32_t caplen, uint32_t length) {
   sqlite3_stmt *res = NULL;
   int column_idx;
 
@@ -52,6 +166,13 @@ int save_sqlite_pcap_entry(sqlite3 *db, char *name, uint64_t timestamp,
     return -1;
   }
 
+  column_idx = sqlite3_bind_parameter_index(res, "@file_offset");
+  if (sqlite3_bind_int64(res, column_idx, offset) != SQLITE_OK) {
+    log_trace("sqlite3_bind_int64 fail");
+    sqlite3_finalize(res);
+    return -1;
+  }
+
   column_idx = sqlite3_bind_parameter_index(res, "@caplen");
   if (sqlite3_bind_int64(res, column_idx, caplen) != SQLITE_OK) {
     log_trace("sqlite3_bind_int64 fail");
@@ -79,114 +200,114 @@ int save_sqlite_pcap_entry(sqlite3 *db, char *name, uint64_t timestamp,
   return 0;
 }
 
-int get_first_pcap_entry(sqlite3 *db, uint64_t *timestamp, uint64_t *caplen) {
-  int rc;
+int save_sqlite_pcap_segment(sqlite3 *db, const char *name, const char *ifname,
+                             uint64_t timestamp, uint64_t size) {
   sqlite3_stmt *res = NULL;
 
-  if (sqlite3_prepare_v2(db, PCAP_SELECT_FIRST_ENTRY, -1, &res, 0) !=
+  if (sqlite3_prepare_v2(db, PCAP_SEGMENT_INSERT_INTO, -1, &res, 0) !=
       SQLITE_OK) {
     log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  *timestamp = 0;
-  *caplen = 0;
+  if (bind_pcap_text(res, "@name", name) < 0 ||
+      bind_pcap_text(res, "@ifname", ifname) < 0 ||
+      bind_pcap_int64(res, "@timestamp", timestamp) < 0 ||
+      bind_pcap_int64(res, "@size", size) < 0) {
+    sqlite3_finalize(res);
+    return -1;
+  }
 
-  rc = sqlite3_step(res);
+  return step_pcap_statement(db, res);
+}
 
-  if (rc == SQLITE_ROW) {
-    *timestamp = sqlite3_column_int64(res, 0);
-    *caplen = sqlite3_column_int64(res, 1);
-  } else if (rc == SQLITE_OK || rc == SQLITE_DONE) {
-    log_trace("No rows");
-    sqlite3_finalize(res);
-    return 1;
-  } else {
-    log_trace("sqlite3_step fail");
+int backfill_sqlite_pcap_segments(sqlite3 *db, const char *ifname) {
+  sqlite3_stmt *res = NULL;
+
+  if (sqlite3_prepare_v2(db, PCAP_SEGMENT_BACKFILL, -1, &res, 0) !=
+      SQLITE_OK) {
+    log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
+  if (bind_pcap_text(res, "@ifname", ifname) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  sqlite3_finalize(res);
+  if (step_pcap_statement(db, res) < 0) {
+    return -1;
+  }
+
+  if (sqlite3_changes(db)) {
+    log_info("Added %d pcap segments for ifname=%s", sqlite3_changes(db),
+             ifname);
+  }
+
   return 0;
 }
 
-int sum_pcap_group(sqlite3 *db, uint64_t lt, uint32_t lim, uint64_t *ht,
-                   uint64_t *sum) {
-  int rc;
+int save_sqlite_pcap_quota(sqlite3 *db, const char *ifname, uint64_t max_size,
+                           uint64_t max_age) {
   sqlite3_stmt *res = NULL;
-  int column_idx;
-
-  *sum = 0;
 
-  if (sqlite3_prepare_v2(db, PCAP_SUM_GROUP, -1, &res, 0) != SQLITE_OK) {
+  if (sqlite3_prepare_v2(db, PCAP_USAGE_INSERT, -1, &res, 0) != SQLITE_OK) {
     log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@lt");
-  if (sqlite3_bind_int64(res, column_idx, lt) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
+  if (bind_pcap_text(res, "@ifname", ifname) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@lim");
-  if (sqlite3_bind_int64(res, column_idx, lim) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
-    sqlite3_finalize(res);
+  if (step_pcap_statement(db, res) < 0) {
     return -1;
   }
 
-  while ((rc = sqlite3_step(res)) == SQLITE_ROW) {
-    *ht = sqlite3_column_int64(res, 0);
-    *sum = *sum + sqlite3_column_int64(res, 1);
+  if (sqlite3_prepare_v2(db, PCAP_USAGE_UPDATE_QUOTA, -1, &res, 0) !=
+      SQLITE_OK) {
+    log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
   }
 
-  if (rc != SQLITE_OK && rc != SQLITE_DONE) {
-    log_trace("sqlite3_step fail");
+  if (bind_pcap_text(res, "@ifname", ifname) < 0 ||
+      bind_pcap_int64(res, "@max_size", max_size) < 0 ||
+      bind_pcap_int64(res, "@max_age", max_age) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  sqlite3_finalize(res);
-  return 0;
+  return step_pcap_statement(db, res);
 }
 
-int get_pcap_meta_array(sqlite3 *db, uint64_t lt, uint32_t lim,
-                        UT_array *pcap_meta_arr) {
+int get_sqlite_pcap_usage(sqlite3 *db, const char *ifname,
+                          struct pcap_usage *usage) {
   int rc;
-  struct pcap_file_meta p;
   sqlite3_stmt *res = NULL;
-  int column_idx;
 
-  if (sqlite3_prepare_v2(db, PCAP_SELECT_GROUP, -1, &res, 0) != SQLITE_OK) {
+  if (sqlite3_prepare_v2(db, PCAP_USAGE_SELECT, -1, &res, 0) != SQLITE_OK) {
     log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@lt");
-  if (sqlite3_bind_int64(res, column_idx, lt) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
+  if (bind_pcap_text(res, "@ifname", ifname) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@lim");
-  if (sqlite3_bind_int64(res, column_idx, lim) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
-    sqlite3_finalize(res);
-    return -1;
-  }
+  os_memset(usage, 0, sizeof(struct pcap_usage));
 
-  while ((rc = sqlite3_step(res)) == SQLITE_ROW) {
-    os_memset(&p, 0, sizeof(struct pcap_file_meta));
-    p.timestamp = sqlite3_column_int64(res, 0);
-    p.name = os_strdup((char *)sqlite3_column_text(res, 1));
-    utarray_push_back(pcap_meta_arr, &p);
-  }
+  rc = sqlite3_step(res);
 
-  if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+  if (rc == SQLITE_ROW) {
+    usage->size = sqlite3_column_int64(res, 0);
+    usage->max_size = sqlite3_column_int64(res, 1);
+    usage->max_age = sqlite3_column_int64(res, 2);
+  } else if (rc == SQLITE_OK || rc == SQLITE_DONE) {
+    sqlite3_finalize(res);
+    return 1;
+  } else {
     log_trace("sqlite3_step fail");
     sqlite3_finalize(res);
     return -1;
@@ -196,37 +317,66 @@ int get_pcap_meta_array(sqlite3 *db, uint64_t lt, uint32_t lim,
   return 0;
 }
 
-int delete_pcap_entries(sqlite3 *db, uint64_t lt, uint64_t ht) {
-  int rc;
+int get_oldest_pcap_segment(sqlite3 *db, const char *ifname,
+                            struct pcap_file_meta *meta) {
+  int rc, rows = 0;
   sqlite3_stmt *res = NULL;
-  int column_idx;
 
-  if (sqlite3_prepare_v2(db, PCAP_DELETE_GROUP, -1, &res, 0) != SQLITE_OK) {
+  if (sqlite3_prepare_v2(db, PCAP_SEGMENT_SELECT_OLDEST, -1, &res, 0) !=
+      SQLITE_OK) {
     log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@lt");
-  if (sqlite3_bind_int64(res, column_idx, lt) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
+  if (bind_pcap_text(res, "@ifname", ifname) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  column_idx = sqlite3_bind_parameter_index(res, "@ht");
-  if (sqlite3_bind_int64(res, column_idx, ht) != SQLITE_OK) {
-    log_trace("sqlite3_bind_int64 fail");
-    sqlite3_finalize(res);
+  os_memset(meta, 0, sizeof(struct pcap_file_meta));
+
+  // The second row only tells that the oldest segment is not the open one
+  while ((rc = sqlite3_step(res)) == SQLITE_ROW && !rows++) {
+    meta->timestamp = sqlite3_column_int64(res, 1);
+    meta->size = sqlite3_column_int64(res, 2);
+    if ((meta->name = os_strdup((char *)sqlite3_column_text(res, 0))) ==
+        NULL) {
+      log_errno("os_strdup");
+      sqlite3_finalize(res);
+      return -1;
+    }
+  }
+
+  sqlite3_finalize(res);
+
+  if (rc != SQLITE_ROW && rc != SQLITE_OK && rc != SQLITE_DONE) {
+    log_trace("sqlite3_step fail");
+    os_free(meta->name);
+    meta->name = NULL;
     return -1;
   }
 
-  rc = sqlite3_step(res);
+  if (rows < 2) {
+    os_free(meta->name);
+    meta->name = NULL;
+    return 1;
+  }
 
-  if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+  return 0;
+}
+
+int delete_pcap_segment(sqlite3 *db, const char *name) {
+  sqlite3_stmt *res = NULL;
+
+  if (sqlite3_prepare_v2(db, PCAP_SEGMENT_DELETE, -1, &res, 0) != SQLITE_OK) {
+    log_trace("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    return -1;
+  }
+
+  if (bind_pcap_text(res, "@name", name) < 0) {
     sqlite3_finalize(res);
     return -1;
   }
 
-  sqlite3_finalize(res);
-  return 0;
+  return step_pcap_statement(db, res);
 }
@@ -22,27 +22,96 @@
 #define PCAP_CREATE_TABLE                                                      \
   "CREATE TABLE IF NOT EXISTS " PCAP_TABLE_NAME                                \
   " (timestamp INTEGER NOT NULL, name TEXT NOT NULL, "                         \
-  "caplen INTEGER, length INTEGER, "                                           \
-  "PRIMARY KEY (name));"
+  "file_offset INTEGER NOT NULL, caplen INTEGER, length INTEGER, "             \
+  "PRIMARY KEY (name, file_offset));"
+/* Before the segment files, a pcap table row had its own single packet file,
+ * so the packet record follows the 24 bytes pcap file header. */
+#define PCAP_OLD_TABLE_NAME PCAP_TABLE_NAME "_old"
+#define PCAP_MIGRATE_TABLE                                                     \
+  "ALTER TABLE " PCAP_TABLE_NAME " RENAME TO " PCAP_OLD_TABLE_NAME ";"         \
+  PCAP_CREATE_TABLE                                                            \
+  "INSERT OR IGNORE INTO " PCAP_TABLE_NAME " SELECT timestamp, name, 24, "     \
+  "caplen, length FROM " PCAP_OLD_TABLE_NAME ";"                               \
+  "DROP TABLE " PCAP_OLD_TABLE_NAME ";"
 #define PCAP_INSERT_INTO                                                       \
-  "INSERT INTO " PCAP_TABLE_NAME " VALUES(@timestamp, @name, @caplen, "        \
-  "@length);"
-#define PCAP_SELECT_FIRST_ENTRY                                                \
-  "SELECT timestamp,caplen FROM " PCAP_TABLE_NAME                              \
-  " ORDER BY timestamp ASC LIMIT 1;"
-#define PCAP_SUM_GROUP                                                         \
-  "SELECT timestamp,caplen FROM " PCAP_TABLE_NAME                              \
-  " WHERE timestamp > @lt ORDER BY timestamp ASC LIMIT @lim;"
-#define PCAP_SELECT_GROUP                                                      \
-  "SELECT timestamp,name FROM " PCAP_TABLE_NAME                                \
-  " WHERE timestamp >= @lt ORDER BY timestamp ASC LIMIT @lim;"
-#define PCAP_DELETE_GROUP                                                      \
-  "DELETE FROM " PCAP_TABLE_NAME " WHERE timestamp >= @lt AND timestamp <= "   \
-  "@ht;"
+  "INSERT INTO " PCAP_TABLE_NAME " VALUES(@timestamp, @name, @file_offset, "   \
+  "@caplen, @length);"
+#define PCAP_SEGMENT_TABLE_NAME "pcap_segment"
+#define PCAP_CREATE_SEGMENT_TABLE                                              \
+  "CREATE TABLE IF NOT EXISTS " PCAP_SEGMENT_TABLE_NAME                        \
+  " (name TEXT PRIMARY KEY, ifname TEXT NOT NULL, timestamp INTEGER NOT "      \
+  "NULL, size INTEGER NOT NULL);"                                              \
+  "CREATE INDEX IF NOT EXISTS " PCAP_SEGMENT_TABLE_NAME "_age ON "             \
+  PCAP_SEGMENT_TABLE_NAME " (ifname, timestamp);"
+#define PCAP_USAGE_TABLE_NAME "pcap_usage"
+#define PCAP_CREATE_USAGE_TABLE                                                \
+  "CREATE TABLE IF NOT EXISTS " PCAP_USAGE_TABLE_NAME                          \
+  " (ifname TEXT PRIMARY KEY, size INTEGER NOT NULL DEFAULT 0, "               \
+  "max_size INTEGER NOT NULL DEFAULT 0, max_age INTEGER NOT NULL DEFAULT 0);"
+/* The running byte counters are kept by triggers, so the inserts of every
+ * connection are counted. A pcap record is its 16 bytes header and caplen. */
+#define PCAP_CREATE_TRIGGERS                                                   \
+  "CREATE TRIGGER IF NOT EXISTS " PCAP_TABLE_NAME "_insert AFTER INSERT ON "   \
+  PCAP_TABLE_NAME " BEGIN "                                                    \
+  "UPDATE " PCAP_SEGMENT_TABLE_NAME " SET size = size + NEW.caplen + 16 "      \
+  "WHERE name = NEW.name; "                                                    \
+  "UPDATE " PCAP_USAGE_TABLE_NAME " SET size = size + NEW.caplen + 16 "        \
+  "WHERE ifname = (SELECT ifname FROM " PCAP_SEGMENT_TABLE_NAME                \
+  " WHERE name = NEW.name); END;"                                              \
+  "CREATE TRIGGER IF NOT EXISTS " PCAP_SEGMENT_TABLE_NAME "_insert AFTER "     \
+  "INSERT ON " PCAP_SEGMENT_TABLE_NAME " BEGIN "                               \
+  "INSERT OR IGNORE INTO " PCAP_USAGE_TABLE_NAME " (ifname) VALUES "           \
+  "(NEW.ifname); "                                                             \
+  "UPDATE " PCAP_USAGE_TABLE_NAME " SET size = size + NEW.size "               \
+  "WHERE ifname = NEW.ifname; END;"                                            \
+  "CREATE TRIGGER IF NOT EXISTS " PCAP_SEGMENT_TABLE_NAME "_delete AFTER "     \
+  "DELETE ON " PCAP_SEGMENT_TABLE_NAME " BEGIN "                               \
+  "UPDATE " PCAP_USAGE_TABLE_NAME " SET size = size - OLD.size "               \
+  "WHERE ifname = OLD.ifname; "                                                \
+  "DELETE FROM " PCAP_TABLE_NAME " WHERE name = OLD.name; END;"
+#define PCAP_SEGMENT_INSERT_INTO                                               \
+  "INSERT INTO " PCAP_SEGMENT_TABLE_NAME " VALUES(@name, @ifname, "            \
+  "@timestamp, @size);"
+/* The pcap rows saved before the segment table have no segment, every file
+ * is its 24 bytes pcap file header followed by the records. */
+#define PCAP_SEGMENT_BACKFILL                                                  \
+  "INSERT OR IGNORE INTO " PCAP_SEGMENT_TABLE_NAME " SELECT name, @ifname, "  \
+  "MIN(timestamp), 24 + SUM(caplen + 16) FROM " PCAP_TABLE_NAME               \
+  " WHERE name NOT IN (SELECT name FROM " PCAP_SEGMENT_TABLE_NAME ") "         \
+  "GROUP BY name;"
+#define PCAP_SEGMENT_SELECT_OLDEST                                             \
+  "SELECT name,timestamp,size FROM " PCAP_SEGMENT_TABLE_NAME                   \
+  " WHERE ifname = @ifname ORDER BY timestamp ASC LIMIT 2;"
+#define PCAP_SEGMENT_DELETE                                                    \
+  "DELETE FROM " PCAP_SEGMENT_TABLE_NAME " WHERE name = @name;"
+#define PCAP_USAGE_INSERT                                                      \
+  "INSERT OR IGNORE INTO " PCAP_USAGE_TABLE_NAME " (ifname) VALUES(@ifname);"
+#define PCAP_USAGE_UPDATE_QUOTA                                                \
+  "UPDATE " PCAP_USAGE_TABLE_NAME " SET max_size = @max_size, "                \
+  "max_age = @max_age WHERE ifname = @ifname;"
+#define PCAP_USAGE_SELECT                                                      \
+  "SELECT size,max_size,max_age FROM " PCAP_USAGE_TABLE_NAME                   \
+  " WHERE ifname = @ifname;"
 
+/**
+ * @brief The pcap segment file metadata
+ *
+ */
 struct pcap_file_meta {
-  uint64_t timestamp;
-  char *name;
+  uint64_t timestamp; /**< Timestamp of the first segment packet */
+  char *name;         /**< The segment file name */
+  uint64_t size;      /**< The segment file size in bytes */
+};
+
+/**
+ * @brief The pcap store usage and quotas of an interface
+ *
+ */
+struct pcap_usage {
+  uint64_t size;     /**< The size in bytes of the interface segments */
+  uint64_t max_size; /**< The maximum size in bytes, 0 for no limit */
+  uint64_t max_age;  /**< The maximum segment age in microseconds, 0 for no
+                        limit */
 };
 
 /**
@@ -56,59 +125,90 @@ int init_sqlite_pcap_db(sqlite3 *db);
 /**
  * @brief Save a pcap entry into the sqlite db
  *
+ * The entry caplen is added to the size of its segment and interface.
+ *
  * @param db The sqlite db structure pointer
- * @param name The pcap file name
+ * @param name The pcap segment file name
  * @param timestamp The timestamp value
+ * @param offset The byte offset of the packet record in the segment file
  * @param caplen The capture len
  * @param length The offwire packet len
  * @return int 0 on success, -1 on failure
  */
 int save_sqlite_pcap_entry(sqlite3 *db, char *name, uint64_t timestamp,
-                           uint32_t caplen, uint32_t length);
+                           uint64_t offset, uint32_t caplen, uint32_t length);
 
 /**
- * @brief Returns the first pcap entry timestamp
+ * @brief Save a new pcap segment into the sqlite db
  *
  * @param db The sqlite db structure pointer
- * @param timestamp The returned timestamp value
- * @param caplen The returned caplen value
- * @return int 0 on success, 1 for no data and -1 on failure
+ * @param name The pcap segment file name
+ * @param ifname The capture interface of the segment
+ * @param timestamp The timestamp of the first segment packet
+ * @param size The initial segment size (the pcap file header)
+ * @return int 0 on success, -1 on failure
  */
-int get_first_pcap_entry(sqlite3 *db, uint64_t *timestamp, uint64_t *caplen);
+int save_sqlite_pcap_segment(sqlite3 *db, const char *name, const char *ifname,
+                             uint64_t timestamp, uint64_t size);
 
 /**
- * @brief Returns the pcap meta array
+ * @brief Adds a pcap segment for every pcap file without one
+ *
+ * The pcap rows saved before the segment table don't have a segment, so
+ * their files aren't counted by the store quotas and are never cleaned. The
+ * rows don't record their interface, so the segments are given to ifname.
  *
  * @param db The sqlite db structure pointer
- * @param lt The lower timestamp
- * @param lim The limit number of rows
- * @param pcap_meta_arr The pcap meta array
- * @return int 0 on success, 1 for no data and -1 on failure
+ * @param ifname The capture interface of the segments
+ * @return int 0 on success, -1 on failure
  */
-int get_pcap_meta_array(sqlite3 *db, uint64_t lt, uint32_t lim,
-                        UT_array *pcap_meta_arr);
+int backfill_sqlite_pcap_segments(sqlite3 *db, const char *ifname);
 
 /**
- * @brief Removes a set of entries
+ * @brief Sets the pcap store quotas of an interface
  *
  * @param db The sqlite db structure pointer
- * @param lt The lower timestamp
- * @param ht The higher timestamp
+ * @param ifname The capture interface
+ * @param max_size The maximum size in bytes, 0 for no limit
+ * @param max_age The maximum segment age in microseconds, 0 for no limit
+ * @return int 0 on success, -1 on failure
+ */
+int save_sqlite_pcap_quota(sqlite3 *db, const char *ifname, uint64_t max_size,
+                           uint64_t max_age);
+
+/**
+ * @brief Returns the pcap store usage and quotas of an interface
+ *
+ * @param db The sqlite db structure pointer
+ * @param ifname The capture interface
+ * @param[out] usage The returned usage
  * @return int 0 on success, 1 for no data and -1 on failure
  */
-int delete_pcap_entries(sqlite3 *db, uint64_t lt, uint64_t ht);
+int get_sqlite_pcap_usage(sqlite3 *db, const char *ifname,
+                          struct pcap_usage *usage);
 
 /**
- * @brief Calculates the sum of the group of a pcap
+ * @brief Returns the oldest closed pcap segment of an interface
+ *
+ * The newest segment of the interface is never returned, since it can still
+ * be open for writing.
  *
  * @param db The sqlite db structure pointer
- * @param lt The lower bound timestamp
- * @param lim The limit number of rows
- * @param ht The returned upper timestamp
- * @param sum The returned sum
+ * @param ifname The capture interface
+ * @param[out] meta The returned segment, meta->name must be freed with
+ * os_free()
  * @return int 0 on success, 1 for no data and -1 on failure
  */
-int sum_pcap_group(sqlite3 *db, uint64_t lt, uint32_t lim, uint64_t *ht,
-                   uint64_t *sum);
+int get_oldest_pcap_segment(sqlite3 *db, const char *ifname,
+                            struct pcap_file_meta *meta);
+
+/**
+ * @brief Removes a pcap segment and all its entries
+ *
+ * @param db The sqlite db structure pointer
+ * @param name The pcap segment file name
+ * @return int 0 on success, -1 on failure
+ */
+int delete_pcap_segment(sqlite3 *db, const char *name);
 
 #endif
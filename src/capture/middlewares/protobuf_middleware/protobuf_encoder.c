@@ -15,6 +15,7 @@
 
 #include "../../../utils/allocs.h"
 #include "../../../utils/log.h"
+#include "../../../utils/net.h"
 #include "../../../utils/os.h"
 
 #include "../header_middleware/packet_decoder.h"
@@ -32,60 +33,102 @@
 #include "tcp.pb-c.h"
 #include "udp.pb-c.h"
 
+#include "protobuf_encoder.h"
 #include "protobuf_utils.h"
 
-ssize_t encode_eth_packet(const struct eth_schema *eths, uint8_t **buffer) {
+void free_protobuf_scratch(struct protobuf_scratch *scratch) {
+  if (scratch != NULL) {
+    os_free(scratch->data);
+    scratch->data = NULL;
+    scratch->size = 0;
+  }
+}
+
+uint8_t *reserve_protobuf_scratch(struct protobuf_scratch *scratch,
+                                  size_t size) {
+  size_t new_size = (scratch->size) ? scratch->size : PROTOBUF_SCRATCH_SIZE;
+  uint8_t *data = NULL;
+
+  if (size <= scratch->size) {
+    return scratch->data;
+  }
+
+  while (new_size < size) {
+    new_size <<= 1;
+  }
+
+  // The content is kept, a payload is packed before its wrapper
+  if ((data = os_realloc(scratch->data, new_size)) == NULL) {
+    log_errno("os_realloc");
+    return NULL;
+  }
+
+  scratch->data = data;
+  scratch->size = new_size;
+  return data;
+}
+
+static ssize_t pack_protobuf_scratch(const ProtobufCMessage *message,
+                                     struct protobuf_scratch *scratch) {
+  size_t packed_size = protobuf_c_message_get_packed_size(message);
+  uint8_t *data = reserve_protobuf_scratch(scratch, packed_size);
+
+  if (data == NULL) {
+    log_error("reserve_protobuf_scratch fail");
+    return -1;
+  }
+
+  return (ssize_t)protobuf_c_message_pack(message, data);
+}
+
+ssize_t encode_eth_packet(const struct eth_schema *eths,
+                          struct protobuf_scratch *scratch) {
   Eth__EthSchema eth = ETH__ETH_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
+  char ether_dhost[MACSTR_LEN], ether_shost[MACSTR_LEN];
 
   eth.timestamp = eths->timestamp;
-  eth.id = (char *)eths->id;
+  eth.id = (char *)packet_id_2_uuid(eths->id, id);
   eth.caplen = eths->caplen;
   eth.length = eths->length;
   eth.ifname = (char *)eths->ifname;
-  eth.ether_dhost = (char *)eths->ether_dhost;
-  eth.ether_shost = (char *)eths->ether_shost;
+  eth.ether_dhost = (char *)mac_2_str(eths->ether_dhost, ether_dhost);
+  eth.ether_shost = (char *)mac_2_str(eths->ether_shost, ether_shost);
   eth.ether_type = eths->ether_type;
 
-  size_t packed_size = eth__eth_schema__get_packed_size(&eth);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)eth__eth_schema__pack(&eth, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&eth, scratch);
 }
 
-ssize_t encode_arp_packet(const struct arp_schema *arps, uint8_t **buffer) {
+ssize_t encode_arp_packet(const struct arp_schema *arps,
+                          struct protobuf_scratch *scratch) {
   Arp__ArpSchema arp = ARP__ARP_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
+  char arp_sha[MACSTR_LEN], arp_tha[MACSTR_LEN];
+  char arp_spa[OS_INET_ADDRSTRLEN], arp_tpa[OS_INET_ADDRSTRLEN];
 
-  arp.id = (char *)arps->id;
+  arp.id = (char *)packet_id_2_uuid(arps->id, id);
   arp.ar_hrd = arps->ar_hrd;
   arp.ar_pro = arps->ar_pro;
   arp.ar_hln = arps->ar_hln;
   arp.ar_pln = arps->ar_pln;
   arp.ar_op = arps->ar_op;
-  arp.arp_sha = (char *)arps->arp_sha;
-  arp.arp_spa = (char *)arps->arp_spa;
-  arp.arp_tha = (char *)arps->arp_tha;
-  arp.arp_tpa = (char *)arps->arp_tpa;
-
-  size_t packed_size = arp__arp_schema__get_packed_size(&arp);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
+  arp.arp_sha = (char *)mac_2_str(arps->arp_sha, arp_sha);
+  arp.arp_spa = (char *)inaddr4_2_ip(&arps->arp_spa, arp_spa);
+  arp.arp_tha = (char *)mac_2_str(arps->arp_tha, arp_tha);
+  arp.arp_tpa = (char *)inaddr4_2_ip(&arps->arp_tpa, arp_tpa);
 
-  return (ssize_t)arp__arp_schema__pack(&arp, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&arp, scratch);
 }
 
-ssize_t encode_ip4_pcaket(const struct ip4_schema *ip4s, uint8_t **buffer) {
+ssize_t encode_ip4_pcaket(const struct ip4_schema *ip4s,
+                          struct protobuf_scratch *scratch) {
   Ip4__Ip4Schema ip4 = IP4__IP4_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
+  char ip_src[OS_INET_ADDRSTRLEN], ip_dst[OS_INET_ADDRSTRLEN];
 
-  ip4.id = (char *)ip4s->id;
-  ip4.ip_src = (char *)ip4s->ip_src;
-  ip4.ip_dst = (char *)ip4s->ip_dst;
+  ip4.id = (char *)packet_id_2_uuid(ip4s->id, id);
+  ip4.ip_src = (char *)inaddr4_2_ip(&ip4s->ip_src, ip_src);
+  ip4.ip_dst = (char *)inaddr4_2_ip(&ip4s->ip_dst, ip_dst);
   ip4.ip_hl = ip4s->ip_hl;
   ip4.ip_v = ip4s->ip_v;
   ip4.ip_tos = ip4s->ip_tos;
@@ -96,42 +139,33 @@ ssize_t encode_ip4_pcaket(const struct ip4_schema *ip4s, uint8_t **buffer) {
   ip4.ip_p = ip4s->ip_p;
   ip4.ip_sum = ip4s->ip_sum;
 
-  size_t packed_size = ip4__ip4_schema__get_packed_size(&ip4);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)ip4__ip4_schema__pack(&ip4, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&ip4, scratch);
 }
 
-ssize_t encode_ip6_packet(const struct ip6_schema *ip6s, uint8_t **buffer) {
+ssize_t encode_ip6_packet(const struct ip6_schema *ip6s,
+                          struct protobuf_scratch *scratch) {
   Ip6__Ip6Schema ip6 = IP6__IP6_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
+  char ip6_src[OS_INET6_ADDRSTRLEN], ip6_dst[OS_INET6_ADDRSTRLEN];
 
-  ip6.id = (char *)ip6s->id;
+  ip6.id = (char *)packet_id_2_uuid(ip6s->id, id);
   ip6.ip6_un1_flow = ip6s->ip6_un1_flow;
   ip6.ip6_un1_plen = ip6s->ip6_un1_plen;
   ip6.ip6_un1_nxt = ip6s->ip6_un1_nxt;
   ip6.ip6_un1_hlim = ip6s->ip6_un1_hlim;
   ip6.ip6_un2_vfc = ip6s->ip6_un2_vfc;
-  ip6.ip6_src = (char *)ip6s->ip6_src;
-  ip6.ip6_dst = (char *)ip6s->ip6_dst;
+  ip6.ip6_src = (char *)inaddr6_2_ip(&ip6s->ip6_src, ip6_src);
+  ip6.ip6_dst = (char *)inaddr6_2_ip(&ip6s->ip6_dst, ip6_dst);
 
-  size_t packed_size = ip6__ip6_schema__get_packed_size(&ip6);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)ip6__ip6_schema__pack(&ip6, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&ip6, scratch);
 }
 
-ssize_t encode_tcp_packet(const struct tcp_schema *tcps, uint8_t **buffer) {
+ssize_t encode_tcp_packet(const struct tcp_schema *tcps,
+                          struct protobuf_scratch *scratch) {
   Tcp__TcpSchema tcp = TCP__TCP_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  tcp.id = (char *)tcps->id;
+  tcp.id = (char *)packet_id_2_uuid(tcps->id, id);
   tcp.source = tcps->source;
   tcp.dest = tcps->dest;
   tcp.seq = tcps->seq;
@@ -148,79 +182,57 @@ ssize_t encode_tcp_packet(const struct tcp_schema *tcps, uint8_t **buffer) {
   tcp.check_p = tcps->check_p;
   tcp.urg_ptr = tcps->urg_ptr;
 
-  size_t packed_size = tcp__tcp_schema__get_packed_size(&tcp);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)tcp__tcp_schema__pack(&tcp, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&tcp, scratch);
 }
 
-ssize_t encode_udp_packet(const struct udp_schema *udps, uint8_t **buffer) {
+ssize_t encode_udp_packet(const struct udp_schema *udps,
+                          struct protobuf_scratch *scratch) {
   Udp__UdpSchema udp = UDP__UDP_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  udp.id = (char *)udps->id;
+  udp.id = (char *)packet_id_2_uuid(udps->id, id);
   udp.source = udps->source;
   udp.dest = udps->dest;
   udp.len = udps->len;
   udp.check_p = udps->check_p;
 
-  size_t packed_size = udp__udp_schema__get_packed_size(&udp);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)udp__udp_schema__pack(&udp, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&udp, scratch);
 }
 
 ssize_t encode_icmp4_packet(const struct icmp4_schema *icmp4s,
-                            uint8_t **buffer) {
+                            struct protobuf_scratch *scratch) {
   Icmp4__Icmp4Schema icmp4 = ICMP4__ICMP4_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  icmp4.id = (char *)icmp4s->id;
+  icmp4.id = (char *)packet_id_2_uuid(icmp4s->id, id);
   icmp4.type = icmp4s->type;
   icmp4.code = icmp4s->code;
   icmp4.checksum = icmp4s->checksum;
   icmp4.gateway = icmp4s->gateway;
 
-  size_t packed_size = icmp4__icmp4_schema__get_packed_size(&icmp4);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)icmp4__icmp4_schema__pack(&icmp4, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&icmp4, scratch);
 }
 
 ssize_t encode_icmp6_packet(const struct icmp6_schema *icmp6s,
-                            uint8_t **buffer) {
+                            struct protobuf_scratch *scratch) {
   Icmp6__Icmp6Schema icmp6 = ICMP6__ICMP6_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  icmp6.id = (char *)icmp6s->id;
+  icmp6.id = (char *)packet_id_2_uuid(icmp6s->id, id);
   icmp6.icmp6_type = icmp6s->icmp6_type;
   icmp6.icmp6_code = icmp6s->icmp6_code;
   icmp6.icmp6_cksum = icmp6s->icmp6_cksum;
   icmp6.icmp6_un_data32 = icmp6s->icmp6_un_data32;
 
-  size_t packed_size = icmp6__icmp6_schema__get_packed_size(&icmp6);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)icmp6__icmp6_schema__pack(&icmp6, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&icmp6, scratch);
 }
 
-ssize_t encode_dns_packet(const struct dns_schema *dnss, uint8_t **buffer) {
+ssize_t encode_dns_packet(const struct dns_schema *dnss,
+                          struct protobuf_scratch *scratch) {
   Dns__DnsSchema dns = DNS__DNS_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  dns.id = (char *)dnss->id;
+  dns.id = (char *)packet_id_2_uuid(dnss->id, id);
   dns.tid = dnss->tid;
   dns.flags = dnss->flags;
   dns.nqueries = dnss->nqueries;
@@ -229,20 +241,15 @@ ssize_t encode_dns_packet(const struct dns_schema *dnss, uint8_t **buffer) {
   dns.nother = dnss->nother;
   dns.qname = (char *)dnss->qname;
 
-  size_t packed_size = dns__dns_schema__get_packed_size(&dns);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)dns__dns_schema__pack(&dns, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&dns, scratch);
 }
 
-ssize_t encode_mdsn_packet(const struct mdns_schema *mdnss, uint8_t **buffer) {
+ssize_t encode_mdsn_packet(const struct mdns_schema *mdnss,
+                           struct protobuf_scratch *scratch) {
   Mdns__MdnsSchema mdns = MDNS__MDNS_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
 
-  mdns.id = (char *)mdnss->id;
+  mdns.id = (char *)packet_id_2_uuid(mdnss->id, id);
   mdns.tid = mdnss->tid;
   mdns.flags = mdnss->flags;
   mdns.nqueries = mdnss->nqueries;
@@ -251,20 +258,18 @@ ssize_t encode_mdsn_packet(const struct mdns_schema *mdnss, uint8_t **buffer) {
   mdns.nother = mdnss->nother;
   mdns.qname = (char *)mdnss->qname;
 
-  size_t packed_size = mdns__mdns_schema__get_packed_size(&mdns);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)mdns__mdns_schema__pack(&mdns, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&mdns, scratch);
 }
 
-ssize_t encode_dhcp_packet(struct dhcp_schema *dhcps, uint8_t **buffer) {
+ssize_t encode_dhcp_packet(struct dhcp_schema *dhcps,
+                           struct protobuf_scratch *scratch) {
   Dhcp__DhcpSchema dhcp = DHCP__DHCP_SCHEMA__INIT;
+  char id[MAX_RANDOM_UUID_LEN];
+  char ciaddr[OS_INET_ADDRSTRLEN], yiaddr[OS_INET_ADDRSTRLEN];
+  char siaddr[OS_INET_ADDRSTRLEN], giaddr[OS_INET_ADDRSTRLEN];
+  char chaddr[MACSTR_LEN];
 
-  dhcp.id = dhcps->id;
+  dhcp.id = (char *)packet_id_2_uuid(dhcps->id, id);
   dhcp.op = dhcps->op;
   dhcp.htype = dhcps->htype;
   dhcp.hlen = dhcps->hlen;
@@ -272,24 +277,17 @@ ssize_t encode_dhcp_packet(struct dhcp_schema *dhcps, uint8_t **buffer) {
   dhcp.xid = dhcps->xid;
   dhcp.secs = dhcps->secs;
   dhcp.flags = dhcps->flags;
-  dhcp.ciaddr = dhcps->ciaddr;
-  dhcp.yiaddr = dhcps->yiaddr;
-  dhcp.siaddr = dhcps->siaddr;
-  dhcp.giaddr = dhcps->giaddr;
-  dhcp.chaddr = dhcps->chaddr;
+  dhcp.ciaddr = (char *)inaddr4_2_ip(&dhcps->ciaddr, ciaddr);
+  dhcp.yiaddr = (char *)inaddr4_2_ip(&dhcps->yiaddr, yiaddr);
+  dhcp.siaddr = (char *)inaddr4_2_ip(&dhcps->siaddr, siaddr);
+  dhcp.giaddr = (char *)inaddr4_2_ip(&dhcps->giaddr, giaddr);
+  dhcp.chaddr = (char *)mac_2_str(dhcps->chaddr, chaddr);
 
-  size_t packed_size = dhcp__dhcp_schema__get_packed_size(&dhcp);
-
-  if ((*buffer = os_malloc(packed_size)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)dhcp__dhcp_schema__pack(&dhcp, *buffer);
+  return pack_protobuf_scratch((const ProtobufCMessage *)&dhcp, scratch);
 }
 
-ssize_t encode_protobuf_packet(const struct tuple_packet *tp,
-                               uint8_t **buffer) {
+static ssize_t encode_protobuf_packet(const struct tuple_packet *tp,
+                                      struct protobuf_scratch *scratch) {
   if (tp == NULL) {
     log_error("tp param is NULL");
     return -1;
@@ -300,85 +298,77 @@ ssize_t encode_protobuf_packet(const struct tuple_packet *tp,
     return -1;
   }
 
-  if (buffer == NULL) {
-    log_error("buffer param is NULL");
-    return -1;
-  }
-
-  *buffer = NULL;
-
   switch (tp->type) {
     case PACKET_NONE:
       return -1;
     case PACKET_ETHERNET:
-      return encode_eth_packet((struct eth_schema *)tp->packet, buffer);
+      return encode_eth_packet((struct eth_schema *)tp->packet, scratch);
     case PACKET_ARP:
-      return encode_arp_packet((struct arp_schema *)tp->packet, buffer);
+      return encode_arp_packet((struct arp_schema *)tp->packet, scratch);
     case PACKET_IP4:
-      return encode_ip4_pcaket((struct ip4_schema *)tp->packet, buffer);
+      return encode_ip4_pcaket((struct ip4_schema *)tp->packet, scratch);
     case PACKET_IP6:
-      return encode_ip6_packet((struct ip6_schema *)tp->packet, buffer);
+      return encode_ip6_packet((struct ip6_schema *)tp->packet, scratch);
     case PACKET_TCP:
-      return encode_tcp_packet((struct tcp_schema *)tp->packet, buffer);
+      return encode_tcp_packet((struct tcp_schema *)tp->packet, scratch);
     case PACKET_UDP:
-      return encode_udp_packet((struct udp_schema *)tp->packet, buffer);
+      return encode_udp_packet((struct udp_schema *)tp->packet, scratch);
     case PACKET_ICMP4:
-      return encode_icmp4_packet((struct icmp4_schema *)tp->packet, buffer);
+      return encode_icmp4_packet((struct icmp4_schema *)tp->packet, scratch);
     case PACKET_ICMP6:
-      return encode_icmp6_packet((struct icmp6_schema *)tp->packet, buffer);
+      return encode_icmp6_packet((struct icmp6_schema *)tp->packet, scratch);
     case PACKET_DNS:
-      return encode_dns_packet((struct dns_schema *)tp->packet, buffer);
+      return encode_dns_packet((struct dns_schema *)tp->packet, scratch);
     case PACKET_MDNS:
-      return encode_mdsn_packet((struct mdns_schema *)tp->packet, buffer);
+      return encode_mdsn_packet((struct mdns_schema *)tp->packet, scratch);
     case PACKET_DHCP:
-      return encode_dhcp_packet((struct dhcp_schema *)tp->packet, buffer);
+      return encode_dhcp_packet((struct dhcp_schema *)tp->packet, scratch);
   }
 
   return -1;
 }
 
-ssize_t encode_protobuf_sync_delimited(const PACKET_TYPES type,
-                                       uint8_t *packet_buffer, size_t length,
-                                       uint8_t **buffer) {
-  char header_id[20] = {0};
-
-  *buffer = NULL;
+static ssize_t encode_protobuf_sync_delimited(const PACKET_TYPES type,
+                                              struct protobuf_scratch *scratch,
+                                              size_t length, uint8_t **buffer) {
+  const char *header_id = NULL;
+  uint8_t *data = NULL;
 
   switch (type) {
     case PACKET_NONE:
       return -1;
     case PACKET_ETHERNET:
-      os_strlcpy(header_id, "eth", 20);
+      header_id = "eth";
       break;
     case PACKET_ARP:
-      os_strlcpy(header_id, "arp", 20);
+      header_id = "arp";
       break;
     case PACKET_IP4:
-      os_strlcpy(header_id, "ip4", 20);
+      header_id = "ip4";
       break;
     case PACKET_IP6:
-      os_strlcpy(header_id, "ip6", 20);
+      header_id = "ip6";
       break;
     case PACKET_TCP:
-      os_strlcpy(header_id, "tcp", 20);
+      header_id = "tcp";
       break;
     case PACKET_UDP:
-      os_strlcpy(header_id, "udp", 20);
+      header_id = "udp";
       break;
     case PACKET_ICMP4:
-      os_strlcpy(header_id, "icmp4", 20);
+      header_id = "icmp4";
       break;
     case PACKET_ICMP6:
-      os_strlcpy(header_id, "icmp6", 20);
+      header_id = "icmp6";
       break;
     case PACKET_DNS:
-      os_strlcpy(header_id, "dns", 20);
+      header_id = "dns";
       break;
     case PACKET_MDNS:
-      os_strlcpy(header_id, "mdns", 20);
+      header_id = "mdns";
       break;
     case PACKET_DHCP:
-      os_strlcpy(header_id, "dhcp", 20);
+      header_id = "dhcp";
       break;
     default:
       return -1;
@@ -389,39 +379,53 @@ ssize_t encode_protobuf_sync_delimited(const PACKET_TYPES type,
 
   sync.header_lookup_case =
       TDX__VOLT_API__SYNC__V1__PROTOBUF_SYNC_WRAPPER__HEADER_LOOKUP_HEADER_ID;
-  sync.header_id = header_id;
+  sync.header_id = (char *)header_id;
   sync.payload.len = length;
-  sync.payload.data = packet_buffer;
 
   size_t sync_length =
       protobuf_c_message_del_get_packed_size((const ProtobufCMessage *)&sync);
 
-  if ((*buffer = os_malloc(sync_length)) == NULL) {
-    log_errno("os_malloc");
+  // The wrapper is packed in the scratch right after its payload
+  if ((data = reserve_protobuf_scratch(scratch, length + sync_length)) ==
+      NULL) {
+    log_error("reserve_protobuf_scratch fail");
     return -1;
   }
 
-  return protobuf_c_message_del_pack((const ProtobufCMessage *)&sync, *buffer);
+  sync.payload.data = data;
+  *buffer = &data[length];
+
+  return (ssize_t)protobuf_c_message_del_pack((const ProtobufCMessage *)&sync,
+                                              *buffer);
 }
 
-ssize_t encode_protobuf_sync_wrapper(struct tuple_packet *tp,
-                                     uint8_t **buffer) {
-  uint8_t *packet_buffer = NULL;
-  ssize_t packet_length = encode_protobuf_packet(tp, &packet_buffer);
+ssize_t pack_protobuf_sync_wrapper(const struct tuple_packet *tp,
+                                   struct protobuf_scratch *scratch,
+                                   uint8_t **buffer) {
+  if (scratch == NULL) {
+    log_error("scratch param is NULL");
+    return -1;
+  }
+
+  if (buffer == NULL) {
+    log_error("buffer param is NULL");
+    return -1;
+  }
+
+  *buffer = NULL;
+
+  ssize_t packet_length = encode_protobuf_packet(tp, scratch);
   if (packet_length < 0) {
     log_error("encode_protobuf_packet fail");
     return -1;
   }
 
-  ssize_t sync_length = encode_protobuf_sync_delimited(tp->type, packet_buffer,
-                                                       packet_length, buffer);
+  ssize_t sync_length = encode_protobuf_sync_delimited(
+      tp->type, scratch, (size_t)packet_length, buffer);
   if (sync_length < 0) {
-    log_error("encode_protobuf_sync fail");
-    os_free(packet_buffer);
+    log_error("encode_protobuf_sync_delimited fail");
     return -1;
   }
 
-  os_free(packet_buffer);
-
   return sync_length;
 }
@@ -13,21 +13,48 @@
 
 #include "../header_middleware/packet_decoder.h"
 
+#define PROTOBUF_SCRATCH_SIZE                                                  \
+  1024 /* Initial size in bytes of the protobuf packing scratch buffer */
+
 /**
- * @brief Encodes the packet into a protobuf message
+ * @brief Scratch buffer reused for packing the protobuf messages
  *
- * @param[in] tp The packet
- * @param[out] buffer The encoded protobuf packet
- * @return the output buffer size, -1 on failure
  */
-ssize_t encode_protobuf_packet(struct tuple_packet *tp, uint8_t **buffer);
+struct protobuf_scratch {
+  uint8_t *data; /**< The scratch data */
+  size_t size;   /**< The scratch size in bytes */
+};
+
+/**
+ * @brief Frees the scratch buffer data
+ *
+ * @param scratch The scratch buffer
+ */
+void free_protobuf_scratch(struct protobuf_scratch *scratch);
 
 /**
- * @brief Encodes the packet into a wrapper protobuf message
+ * @brief Grows the scratch buffer to at least size bytes, keeping its content
+ *
+ * @param scratch The scratch buffer
+ * @param size The required size in bytes
+ * @return uint8_t* The scratch data, NULL on failure
+ */
+uint8_t *reserve_protobuf_scratch(struct protobuf_scratch *scratch,
+                                  size_t size);
+
+/**
+ * @brief Packs the packet into a length delimited wrapper protobuf message
+ *
+ * The message is packed into the scratch buffer, so no memory is allocated
+ * once the scratch buffer is large enough.
  *
  * @param[in] tp The packet
- * @param[out] buffer The encoded wrapper protobuf packet
- * @return the output buffer size, -1 on failure
+ * @param[in] scratch The scratch buffer
+ * @param[out] buffer The packed message, valid until the next use of the
+ * scratch buffer
+ * @return the packed message size, -1 on failure
  */
-ssize_t encode_protobuf_sync_wrapper(struct tuple_packet *tp, uint8_t **buffer);
+ssize_t pack_protobuf_sync_wrapper(const struct tuple_packet *tp,
+                                   struct protobuf_scratch *scratch,
+                                   uint8_t **buffer);
 #endif
@@ -17,8 +17,8 @@
 #include <sqlite3.h>
 #include <string.h>
 
-#include "protobuf_encoder.h"
 #include "protobuf_middleware.h"
+#include "protobuf_writer.h"
 
 #include "../../../utils/allocs.h"
 #include "../../../utils/log.h"
@@ -29,32 +29,25 @@
 #include "../header_middleware/packet_decoder.h"
 #include "../header_middleware/packet_queue.h"
 
+#define PROTOBUF_FLUSH_INTERVAL 10 * 1000 // In microseconds
+
 static const UT_icd tp_list_icd = {sizeof(struct tuple_packet), NULL, NULL,
                                    free_packet};
 
-int pipe_protobuf_tuple_packet(const char *path, int *fd,
+int pipe_protobuf_tuple_packet(struct protobuf_writer *writer,
                                struct tuple_packet *p) {
-  uint8_t *buffer = NULL;
-  ssize_t length = encode_protobuf_sync_wrapper(p, &buffer);
-  if (length < 0) {
-    log_error("encode_protobuf_packet fail");
-    return -1;
-  }
-
-  if (open_write_nonblock(path, fd, buffer, length) < 0) {
-    log_error("open_write_nonblock fail");
-    os_free(buffer);
+  if (write_protobuf_writer(writer, p) < 0) {
+    log_error("write_protobuf_writer fail");
     return -1;
   }
 
-  os_free(buffer);
   return 0;
 }
 
-int pipe_protobuf_packets(const char *path, int *fd, UT_array *packets) {
+int pipe_protobuf_packets(struct protobuf_writer *writer, UT_array *packets) {
   struct tuple_packet *p = NULL;
   while ((p = (struct tuple_packet *)utarray_next(packets, p)) != NULL) {
-    if (pipe_protobuf_tuple_packet(path, fd, p) < 0) {
+    if (pipe_protobuf_tuple_packet(writer, p) < 0) {
       log_error("pipe_protobuf_tuple_packet fail");
       return -1;
     }
@@ -63,25 +56,44 @@ int pipe_protobuf_packets(const char *path, int *fd, UT_array *packets) {
   return 0;
 }
 
+void eloop_tout_protobuf_handler(void *eloop_ctx, void *user_ctx) {
+  (void)eloop_ctx;
+
+  struct middleware_context *context = (struct middleware_context *)user_ctx;
+
+  if (flush_protobuf_writer((struct protobuf_writer *)context->mdata) < 0) {
+    log_error("flush_protobuf_writer fail");
+  }
+
+  if (edge_eloop_register_timeout(context->eloop, 0, PROTOBUF_FLUSH_INTERVAL,
+                                  eloop_tout_protobuf_handler, NULL,
+                                  (void *)user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
 void free_protobuf_middleware(struct middleware_context *context) {
   if (context != NULL) {
-    if (context->mdata != NULL) {
-      int *fd = (int *)context->mdata;
-      close(*fd);
-      os_free(context->mdata);
-    }
+    free_protobuf_writer((struct protobuf_writer *)context->mdata);
+    context->mdata = NULL;
     os_free(context);
   }
 }
 
-struct middleware_context *init_protobuf_middleware(sqlite3 *db, char *db_path,
-                                                    struct eloop_data *eloop,
-                                                    struct pcap_context *pc,
-                                                    char *params) {
+struct middleware_context *
+init_protobuf_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                         struct pcap_context *pc, char *params,
+                         const struct capture_conf *config) {
   (void)db_path;
+  (void)config;
 
   log_info("Init protobuf middleware...");
 
+  if (params == NULL) {
+    log_error("params param is NULL");
+    return NULL;
+  }
+
   struct middleware_context *context =
       os_zalloc(sizeof(struct middleware_context));
   if (context == NULL) {
@@ -94,18 +106,28 @@ struct middleware_context *init_protobuf_middleware(sqlite3 *db, char *db_path,
   context->pc = pc;
   context->params = params;
 
-  int *pipe_fd = os_zalloc(sizeof(int));
-  if (pipe_fd == NULL) {
-    log_errno("os_zalloc");
+  // The params are the pipe path
+  struct protobuf_writer *writer =
+      init_protobuf_writer(params, PROTOBUF_WRITER_BUFFER_SIZE);
+  if (writer == NULL) {
+    log_error("init_protobuf_writer fail");
     free_protobuf_middleware(context);
     return NULL;
   }
 
-  context->mdata = (void *)pipe_fd;
+  context->mdata = (void *)writer;
+
+  if (eloop != NULL &&
+      edge_eloop_register_timeout(eloop, 0, PROTOBUF_FLUSH_INTERVAL,
+                                  eloop_tout_protobuf_handler, NULL,
+                                  (void *)context) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+    free_protobuf_middleware(context);
+    return NULL;
+  }
 
   return context;
 }
-
 int process_protobuf_middleware(struct middleware_context *context,
                                 const char *ltype, struct pcap_pkthdr *header,
                                 uint8_t *packet, char *ifname) {
@@ -119,23 +141,18 @@ int process_protobuf_middleware(struct middleware_context *context,
     return -1;
   }
 
-  if (context->params == NULL) {
-    log_error("params param is NULL");
-    return -1;
-  }
-
-  char *pipe_path = context->params;
-  int *pipe_fd = (int *)context->mdata;
+  struct protobuf_writer *writer = (struct protobuf_writer *)context->mdata;
 
   UT_array *packets = NULL;
   utarray_new(packets, &tp_list_icd);
 
-  int npackets = extract_packets(ltype, header, packet, ifname, packets);
+  int npackets = extract_packets(ltype, header, packet, ifname,
+                                 PACKET_DECODE_ALL, packets);
 
   if (npackets < 0) {
     log_error("extract_packets fail");
   } else if (npackets > 0) {
-    if (pipe_protobuf_packets(pipe_path, pipe_fd, packets) < 0) {
+    if (pipe_protobuf_packets(writer, packets) < 0) {
       log_error("pipe_protobuf_packets fail");
     }
   }
@@ -145,9 +162,47 @@ int process_protobuf_middleware(struct middleware_context *context,
   return 0;
 }
 
+int process_batch_protobuf_middleware(struct middleware_context *context,
+                                      const char *ltype,
+                                      struct middleware_packet *packets,
+                                      size_t count, char *ifname) {
+  if (context == NULL) {
+    log_error("context param is NULL");
+    return -1;
+  }
+
+  if (context->mdata == NULL) {
+    log_error("mdata param is NULL");
+    return -1;
+  }
+
+  struct protobuf_writer *writer = (struct protobuf_writer *)context->mdata;
+
+  UT_array *tp_array = NULL;
+  utarray_new(tp_array, &tp_list_icd);
+
+  for (size_t idx = 0; idx < count; idx++) {
+    if (extract_packets(ltype, &packets[idx].header, packets[idx].packet,
+                        ifname, PACKET_DECODE_ALL, tp_array) < 0) {
+      log_error("extract_packets fail");
+    }
+  }
+
+  if (utarray_len(tp_array) &&
+      pipe_protobuf_packets(writer, tp_array) < 0) {
+    log_error("pipe_protobuf_packets fail");
+  }
+
+  utarray_free(tp_array);
+
+  return 0;
+}
+
 struct capture_middleware protobuf_middleware = {
     .init = init_protobuf_middleware,
     .process = process_protobuf_middleware,
     .free = free_protobuf_middleware,
     .name = "protobuf middleware",
+    .process_batch = process_batch_protobuf_middleware,
+    .snaplen = MIDDLEWARE_SNAPLEN_HEADERS,
 };
@@ -12,28 +12,26 @@
 #define PROTOBUF_MIDDLEWARE_H
 
 #include "../../middleware.h"
+#include "protobuf_writer.h"
 
 /**
  * @brief pipe the serialised protobuf tuple packets
  *
- * @param path[in] The pipe file path
- * @param fd[in,out] The pipe file descriptor.
- * If `0`, this will be set to a new fd pointing to @p path.
+ * @param writer[in] The protobuf pipe writer
  * @param p[in] The tuple packet
  * @return 0 on success, -1 otherwise
  */
-int pipe_protobuf_tuple_packet(const char *path, int *fd,
+int pipe_protobuf_tuple_packet(struct protobuf_writer *writer,
                                struct tuple_packet *p);
 
 /**
  * @brief pipe the serialised protobuf packets
  *
- * @param path[in] The pipe file path
- * @param fd[in] The pipe file descriptor
+ * @param writer[in] The protobuf pipe writer
  * @param packets[in] The array of packets
  * @return 0 on success, -1 otherwise
  */
-int pipe_protobuf_packets(const char *path, int *fd, UT_array *packets);
+int pipe_protobuf_packets(struct protobuf_writer *writer, UT_array *packets);
 
 /**
  * @brief protobuf Capture Middleware.
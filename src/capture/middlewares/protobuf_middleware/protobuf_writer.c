@@ -0,0 +1,309 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the buffered protobuf stream
+ * writer.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../../utils/allocs.h"
+#include "../../../utils/log.h"
+#include "../../../utils/os.h"
+
+#include "../../capture_stats.h"
+#include "protobuf_writer.h"
+
+static void close_protobuf_writer_fd(struct protobuf_writer *writer) {
+  if (writer->fd >= 0) {
+    close(writer->fd);
+    writer->fd = -1;
+  }
+}
+
+static int open_protobuf_writer_fd(struct protobuf_writer *writer) {
+  struct os_reltime now;
+
+  os_get_reltime(&now);
+  if (os_reltime_before(&now, &writer->next_open)) {
+    return -1;
+  }
+
+  writer->next_open = now;
+  writer->next_open.sec += PROTOBUF_WRITER_REOPEN_INTERVAL;
+
+  // Fails with ENXIO while the pipe has no reader
+  if ((writer->fd = open(writer->path, O_WRONLY | O_NONBLOCK)) < 0) {
+    if (errno != ENXIO) {
+      log_errno("open %s", writer->path);
+    }
+    return -1;
+  }
+
+  writer->reopens++;
+  log_debug("Opened protobuf pipe %s", writer->path);
+  return 0;
+}
+
+/* Writes to the pipe without raising SIGPIPE when the reader is gone */
+static ssize_t write_protobuf_writer_fd(struct protobuf_writer *writer) {
+  sigset_t pipe_set, old_set;
+  struct timespec zero = {0, 0};
+  ssize_t ret;
+  int err;
+
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+  ret = write(writer->fd, &writer->data[writer->start],
+              writer->end - writer->start);
+  err = errno;
+
+  if (ret < 0 && err == EPIPE) {
+    while (sigtimedwait(&pipe_set, NULL, &zero) > 0) {
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  errno = err;
+  return ret;
+}
+
+static size_t get_frame_length(const uint8_t *data, size_t length) {
+  uint32_t value = 0;
+  size_t idx;
+
+  // A frame is a varint length followed by the message
+  for (idx = 0; idx < 5 && idx < length; idx++) {
+    value |= (uint32_t)(data[idx] & 0x7F) << (7 * idx);
+    if (!(data[idx] & 0x80)) {
+      return idx + 1 + value;
+    }
+  }
+
+  return length;
+}
+
+static void advance_protobuf_writer(struct protobuf_writer *writer,
+                                    size_t length) {
+  writer->start += length;
+
+  while (writer->boundary < writer->start) {
+    writer->boundary += get_frame_length(&writer->data[writer->boundary],
+                                         writer->end - writer->boundary);
+  }
+
+  if (writer->start == writer->end) {
+    writer->start = writer->end = writer->boundary = 0;
+  }
+}
+
+/**
+ * Private implementation of free_protobuf_writer(), without its compiler
+ * attributes, so init_protobuf_writer() can call it on failure.
+ */
+static void __free_protobuf_writer(struct protobuf_writer *writer) {
+  if (writer != NULL) {
+    if (flush_protobuf_writer(writer) < 0) {
+      log_error("flush_protobuf_writer fail");
+    }
+
+    log_debug("protobuf writer: messages=%" PRIu64 " bytes=%" PRIu64
+              " dropped=%" PRIu64 " reopens=%" PRIu64 " unwritten=%zu",
+              writer->messages, writer->bytes, writer->dropped,
+              writer->reopens, writer->end - writer->start);
+
+    close_protobuf_writer_fd(writer);
+    free_protobuf_scratch(&writer->scratch);
+    os_free(writer->data);
+    os_free(writer);
+  }
+}
+
+void free_protobuf_writer(struct protobuf_writer *writer) {
+  __free_protobuf_writer(writer);
+}
+
+struct protobuf_writer *init_protobuf_writer(const char *path, size_t size) {
+  struct protobuf_writer *writer = NULL;
+
+  if (path == NULL) {
+    log_error("path param is NULL");
+    return NULL;
+  }
+
+  if (!size) {
+    log_error("size param is zero");
+    return NULL;
+  }
+
+  if ((writer = os_zalloc(sizeof(struct protobuf_writer))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  writer->fd = -1;
+  writer->size = size;
+  os_strlcpy(writer->path, path, MAX_OS_PATH_LEN);
+
+  if ((writer->data = os_malloc(size)) == NULL) {
+    log_errno("os_malloc");
+    __free_protobuf_writer(writer);
+    return NULL;
+  }
+
+  return writer;
+}
+
+int flush_protobuf_writer(struct protobuf_writer *writer) {
+  ssize_t ret;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  while (writer->start < writer->end) {
+    if (writer->fd < 0 && open_protobuf_writer_fd(writer) < 0) {
+      return 0;
+    }
+
+    if ((ret = write_protobuf_writer_fd(writer)) >= 0) {
+      writer->bytes += (uint64_t)ret;
+      record_capture_bytes((uint64_t)ret);
+      advance_protobuf_writer(writer, (size_t)ret);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    } else if (errno == EPIPE) {
+      // The reader restarted, so it must not get the rest of a message
+      log_debug("protobuf pipe %s reader closed", writer->path);
+      close_protobuf_writer_fd(writer);
+      if (writer->start != writer->boundary) {
+        advance_protobuf_writer(writer, writer->boundary - writer->start);
+        writer->dropped++;
+      }
+    } else if (errno != EINTR) {
+      log_errno("write %s", writer->path);
+      close_protobuf_writer_fd(writer);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int drain_protobuf_writer(struct protobuf_writer *writer, int timeout) {
+  struct os_reltime start, now, diff;
+  struct pollfd pfd;
+  long elapsed;
+  int wait;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  os_get_reltime(&start);
+
+  while (true) {
+    if (flush_protobuf_writer(writer) < 0) {
+      log_error("flush_protobuf_writer fail");
+      return -1;
+    }
+
+    if (writer->start == writer->end) {
+      return 0;
+    }
+
+    // Without a reader, wait for the next open attempt
+    wait = (writer->fd < 0) ? PROTOBUF_WRITER_REOPEN_INTERVAL * 1000 : -1;
+
+    if (timeout >= 0) {
+      os_get_reltime(&now);
+      os_reltime_sub(&now, &start, &diff);
+      elapsed = (long)(diff.sec * 1000 + diff.usec / 1000);
+      if (elapsed >= timeout) {
+        return 1;
+      }
+      if (wait < 0 || wait > timeout - elapsed) {
+        wait = (int)(timeout - elapsed);
+      }
+    }
+
+    pfd.fd = writer->fd;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, (writer->fd < 0) ? 0 : 1, wait) < 0 && errno != EINTR) {
+      log_errno("poll");
+      return -1;
+    }
+  }
+}
+
+static void compact_protobuf_writer(struct protobuf_writer *writer) {
+  if (writer->start) {
+    os_memmove(writer->data, &writer->data[writer->start],
+               writer->end - writer->start);
+    writer->end -= writer->start;
+    writer->boundary -= writer->start;
+    writer->start = 0;
+  }
+}
+
+int write_protobuf_writer(struct protobuf_writer *writer,
+                          const struct tuple_packet *tp) {
+  uint8_t *buffer = NULL;
+  ssize_t length;
+
+  if (writer == NULL) {
+    log_error("writer param is NULL");
+    return -1;
+  }
+
+  if ((length = pack_protobuf_sync_wrapper(tp, &writer->scratch, &buffer)) <
+      0) {
+    log_error("pack_protobuf_sync_wrapper fail");
+    return -1;
+  }
+
+  if (writer->size - writer->end < (size_t)length) {
+    if (writer->wait_timeout) {
+      if (drain_protobuf_writer(writer, writer->wait_timeout) < 0) {
+        log_error("drain_protobuf_writer fail");
+      }
+    } else if (flush_protobuf_writer(writer) < 0) {
+      log_error("flush_protobuf_writer fail");
+    }
+    compact_protobuf_writer(writer);
+  }
+
+  if (writer->size - writer->end < (size_t)length) {
+    writer->dropped++;
+    return 0;
+  }
+
+  os_memcpy(&writer->data[writer->end], buffer, length);
+  writer->end += length;
+  writer->messages++;
+
+  if (writer->end - writer->start >= PROTOBUF_WRITER_FLUSH_SIZE &&
+      flush_protobuf_writer(writer) < 0) {
+    log_error("flush_protobuf_writer fail");
+  }
+
+  return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the buffered protobuf stream
+ * writer.
+ *
+ * The writer packs the length delimited ProtobufSyncWrapper messages into a
+ * single output buffer, which is written to the pipe with one syscall per
+ * flush. Data that can't be written (pipe full or no reader) stays in the
+ * buffer, and new messages are dropped and counted only when the buffer is
+ * full, unless the writer is set to wait for the pipe. When the reader closes
+ * the pipe, the writer reopens it and resumes at the next message boundary.
+ */
+
+#ifndef PROTOBUF_WRITER_H
+#define PROTOBUF_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../../utils/attributes.h"
+#include "../../../utils/os.h"
+#include "../header_middleware/packet_decoder.h"
+
+#include "protobuf_encoder.h"
+
+#define PROTOBUF_WRITER_BUFFER_SIZE                                            \
+  (256 * 1024) /* Size in bytes of the protobuf writer output buffer */
+#define PROTOBUF_WRITER_FLUSH_SIZE                                             \
+  (64 * 1024) /* Buffered bytes that trigger a flush */
+#define PROTOBUF_WRITER_REOPEN_INTERVAL                                        \
+  1 /* Minimum interval in sec between two pipe open attempts */
+
+/**
+ * @brief Buffered protobuf stream writer structure definition
+ *
+ */
+struct protobuf_writer {
+  char path[MAX_OS_PATH_LEN]; /**< The pipe path */
+  int fd;                     /**< The pipe fd, -1 if not open */
+  struct os_reltime next_open; /**< The time of the next open attempt */
+  uint8_t *data;              /**< The output buffer */
+  size_t size;                /**< The output buffer size */
+  size_t start;               /**< Offset of the first unwritten byte */
+  size_t end;                 /**< Offset of the end of the buffered data */
+  size_t boundary; /**< Offset of the first message boundary after start */
+  struct protobuf_scratch scratch; /**< The packing scratch buffer */
+  uint64_t messages; /**< Number of buffered messages */
+  uint64_t bytes;    /**< Number of bytes written to the pipe */
+  uint64_t dropped;  /**< Number of messages dropped */
+  uint64_t reopens;  /**< Number of times the pipe was opened */
+  int wait_timeout; /**< Time in ms to wait for the pipe when the buffer is
+                       full, -1 for no limit and 0 to drop the messages */
+};
+
+/**
+ * @brief Flushes and frees the protobuf writer
+ *
+ * @param writer The protobuf writer
+ */
+void free_protobuf_writer(struct protobuf_writer *writer);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_protobuf_writer()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_protobuf_writer                                            \
+  __attribute__((malloc(free_protobuf_writer, 1))) __must_check
+#else
+#define __must_free_protobuf_writer __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a protobuf writer
+ *
+ * The pipe is opened on the first flush.
+ *
+ * @param path The pipe path
+ * @param size The output buffer size in bytes
+ * @return struct protobuf_writer* The protobuf writer, NULL on failure.
+ * You must free this using free_protobuf_writer().
+ */
+__must_free_protobuf_writer struct protobuf_writer *
+init_protobuf_writer(const char *path, size_t size);
+
+/**
+ * @brief Packs a tuple packet and appends it to the output buffer
+ *
+ * The buffer is flushed when it holds more than PROTOBUF_WRITER_FLUSH_SIZE
+ * bytes. If the message doesn't fit in the buffer, the writer waits at most
+ * wait_timeout ms for the pipe to drain, and drops the message if it still
+ * doesn't fit.
+ *
+ * @param writer The protobuf writer
+ * @param tp The tuple packet
+ * @return int 0 on success, -1 on failure
+ */
+int write_protobuf_writer(struct protobuf_writer *writer,
+                          const struct tuple_packet *tp);
+
+/**
+ * @brief Writes the buffered messages to the pipe
+ *
+ * The messages that can't be written stay in the buffer.
+ *
+ * @param writer The protobuf writer
+ * @return int 0 on success, -1 on failure
+ */
+int flush_protobuf_writer(struct protobuf_writer *writer);
+
+/**
+ * @brief Waits until all the buffered messages are written to the pipe
+ *
+ * The writer polls the pipe until it is writable and retries the open while
+ * the pipe has no reader.
+ *
+ * @param writer The protobuf writer
+ * @param timeout The maximum time to wait in ms, -1 for no limit
+ * @return int 0 on success, 1 if the timeout expired and -1 on failure
+ */
+int drain_protobuf_writer(struct protobuf_writer *writer, int timeout);
+
+#endif
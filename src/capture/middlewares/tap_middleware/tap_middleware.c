@@ -40,12 +40,13 @@ void free_tap_middleware(struct middleware_context *context) {
   }
 }
 
-struct middleware_context *init_tap_middleware(sqlite3 *db, char *db_path,
-                                               struct eloop_data *eloop,
-                                               struct pcap_context *pc,
-                                               char *params) {
+struct middleware_context *
+init_tap_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                    struct pcap_context *pc, char *params,
+                    const struct capture_conf *config) {
   (void)db_path;
   (void)eloop;
+  (void)config;
   struct middleware_context *context = NULL;
 
   log_info("Init tap middleware...");
@@ -77,7 +78,8 @@ struct middleware_context *init_tap_middleware(sqlite3 *db, char *db_path,
 
   struct pcap_context *pctx = NULL;
 
-  if (run_pcap(params, false, false, 10, NULL, true, NULL, NULL, &pctx) < 0) {
+  if (run_pcap(params, false, false, 10, 0, NULL, true, NULL, NULL, &pctx) <
+      0) {
     log_error("run_pcap fail");
     free_tap_middleware(context);
     return NULL;
@@ -13,10 +13,17 @@
 #ifndef MIDDLEWARES_LIST_H
 #define MIDDLEWARES_LIST_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include <eloop.h>
 #include <pcap.h>
 #include <sqlite3.h>
 #include <utarray.h>
+
+#include "../utils/log.h"
+
 #include "middleware.h"
 
 /**
@@ -55,22 +62,24 @@ UT_array *assign_middlewares(void);
  * @param[in] handlers The list of middlewares created from
  * assign_middlewares().
  * @param[in] db The SQLite database.
- * @param[in] db_path The path to the SQLite database.
  * @param[in] eloop Global event loop data.
  * @param[in] pc The pcap context created by run_pcap()
- * @param[in] params The middleware params
+ * @param[in] config The capture config with the middleware params
  * @retval 0 on success.
  * @retval -1 on error.
  */
 static inline int init_middlewares(UT_array *handlers, sqlite3 *db,
-                                   char *db_path, struct eloop_data *eloop,
-                                   struct pcap_context *pc, char *params) {
+                                   struct eloop_data *eloop,
+                                   struct pcap_context *pc,
+                                   struct capture_conf *config) {
   struct middleware_handlers *handler = NULL;
 
   while ((handler =
               (struct middleware_handlers *)utarray_next(handlers, handler))) {
     log_trace("Initialising capture middleware: %s", handler->f.name);
-    handler->context = handler->f.init(db, db_path, eloop, pc, params);
+    handler->context =
+        handler->f.init(db, config->capture_db_path, eloop, pc,
+                        config->middleware_params, config);
     if (handler->context == NULL) {
       log_error("handle init error");
       return -1;
@@ -127,4 +136,132 @@ static inline void process_middlewares(UT_array *handlers, char *ltype,
   }
 }
 
+/**
+ * @brief Checks if any of the middlewares implements
+ * #capture_middleware::process_batch()
+ *
+ * @param[in] handlers The list of middlewares.
+ * @return true if a middleware processes batches, false otherwise.
+ */
+static inline bool has_batch_middlewares(UT_array *handlers) {
+  struct middleware_handlers *handler = NULL;
+
+  while ((handler =
+              (struct middleware_handlers *)utarray_next(handlers, handler))) {
+    if (handler->f.process_batch != NULL) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Returns the number of packets waiting in all the middleware queues.
+ *
+ * Middlewares without #capture_middleware::queue_length() are skipped.
+ *
+ * @param[in] handlers The list of middlewares.
+ * @return The total queue length.
+ */
+static inline uint64_t get_middlewares_queue_length(UT_array *handlers) {
+  struct middleware_handlers *handler = NULL;
+  uint64_t length = 0;
+  ssize_t ret;
+
+  while ((handler =
+              (struct middleware_handlers *)utarray_next(handlers, handler))) {
+    if (handler->f.queue_length != NULL && handler->context != NULL &&
+        (ret = handler->f.queue_length(handler->context)) > 0) {
+      length += (uint64_t)ret;
+    }
+  }
+
+  return length;
+}
+
+/**
+ * @brief Returns the number of bytes of every packet used by the middlewares.
+ *
+ * @param[in] handlers The list of middlewares.
+ * @return The largest #capture_middleware::snaplen, 0 if a middleware uses the
+ * full packets or if there are no middlewares.
+ */
+static inline uint32_t get_middlewares_snaplen(UT_array *handlers) {
+  struct middleware_handlers *handler = NULL;
+  uint32_t snaplen = 0;
+
+  while ((handler =
+              (struct middleware_handlers *)utarray_next(handlers, handler))) {
+    if (handler->f.snaplen == MIDDLEWARE_SNAPLEN_FULL) {
+      return MIDDLEWARE_SNAPLEN_FULL;
+    }
+
+    if (handler->f.snaplen > snaplen) {
+      snaplen = handler->f.snaplen;
+    }
+  }
+
+  return snaplen;
+}
+
+/**
+ * @brief Runs a middleware for a batch of packets.
+ *
+ * Middlewares without #capture_middleware::process_batch() are run for every
+ * packet of the batch with #capture_middleware::process().
+ *
+ * @param[in] handler The middleware to run.
+ * @param[in] ltype The packet type.
+ * @param[in] packets The array of packets.
+ * @param[in] count The number of packets in the array.
+ * @param[in] ifname The name of the capture interface.
+ * @retval 0 on success.
+ * @retval -1 on error.
+ */
+static inline int process_middleware_batch(struct middleware_handlers *handler,
+                                           char *ltype,
+                                           struct middleware_packet *packets,
+                                           size_t count, char *ifname) {
+  int ret = 0;
+
+  if (handler->f.process_batch != NULL) {
+    return handler->f.process_batch(handler->context, ltype, packets, count,
+                                    ifname);
+  }
+
+  for (size_t idx = 0; idx < count; idx++) {
+    if (handler->f.process(handler->context, ltype, &packets[idx].header,
+                           packets[idx].packet, ifname) < 0) {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+/**
+ * @brief Runs all the middlewares for a batch of packets.
+ *
+ * An error is logged if any of the handlers fail.
+ *
+ * @param[in] handlers The list of middlewares to run.
+ * @param[in] ltype The packet type.
+ * @param[in] packets The array of packets.
+ * @param[in] count The number of packets in the array.
+ * @param[in] ifname The name of the capture interface.
+ */
+static inline void process_middlewares_batch(UT_array *handlers, char *ltype,
+                                             struct middleware_packet *packets,
+                                             size_t count, char *ifname) {
+  struct middleware_handlers *handler = NULL;
+
+  while ((handler =
+              (struct middleware_handlers *)utarray_next(handlers, handler))) {
+    if (process_middleware_batch(handler, ltype, packets, count, ifname) < 0) {
+      log_error("handler process_batch fail");
+    }
+  }
+}
+
 #endif /* !MIDDLEWARES_LIST_H */
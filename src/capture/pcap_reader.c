@@ -0,0 +1,265 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the streaming pcap file
+ * reader.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+
+#include "pcap_reader.h"
+
+/**
+ * Private implementation of close_pcap_reader(), without its compiler
+ * attributes, so open_pcap_reader_fd() can call it on failure.
+ */
+static void __close_pcap_reader(struct pcap_reader *reader) {
+  if (reader != NULL) {
+    if (reader->map != NULL) {
+      munmap(reader->map, reader->map_size);
+    }
+    if (reader->close_fd && reader->fd >= 0) {
+      close(reader->fd);
+    }
+    os_free(reader->buf);
+    os_free(reader);
+  }
+}
+
+void close_pcap_reader(struct pcap_reader *reader) {
+  __close_pcap_reader(reader);
+}
+
+/**
+ * @brief Makes at least len bytes of unread data available. The unread tail
+ * is moved to the front of the stream buffer only when it doesn't fit.
+ *
+ * @return int 1 if the data is available, 0 if the stream ended, -1 on error
+ */
+static int fill_pcap_reader(struct pcap_reader *reader, size_t len) {
+  ssize_t read_size;
+
+  if (reader->end - reader->start >= len) {
+    return 1;
+  }
+
+  if (reader->map != NULL || reader->eof) {
+    return 0;
+  }
+
+  if (len > reader->buf_size) {
+    log_error("Read of %zu bytes larger than the buffer", len);
+    return -1;
+  }
+
+  if (reader->buf_size - reader->start < len) {
+    os_memmove(reader->buf, reader->buf + reader->start,
+               reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+
+  while (reader->end - reader->start < len) {
+    read_size = read(reader->fd, reader->buf + reader->end,
+                     reader->buf_size - reader->end);
+    if (read_size < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_errno("read");
+      return -1;
+    } else if (read_size == 0) {
+      reader->eof = true;
+      return 0;
+    }
+    reader->end += (size_t)read_size;
+  }
+
+  return 1;
+}
+
+static const uint8_t *consume_pcap_reader(struct pcap_reader *reader,
+                                          size_t len) {
+  const uint8_t *data = reader->data + reader->start;
+
+  reader->start += len;
+  reader->offset += len;
+
+  return data;
+}
+
+/**
+ * @brief Maps a regular pcap file into memory
+ *
+ * @return int 0 on success, -1 if the file has to be read as a stream
+ */
+static int map_pcap_reader(struct pcap_reader *reader, const struct stat *sb) {
+  // The file doesn't fit in the address space of a 32 bit system
+  if ((uintmax_t)sb->st_size > SIZE_MAX) {
+    log_debug("File of %jd bytes too large to map", (intmax_t)sb->st_size);
+    return -1;
+  }
+
+  reader->map_size = (size_t)sb->st_size;
+  reader->map = mmap(NULL, reader->map_size, PROT_READ, MAP_PRIVATE,
+                     reader->fd, 0);
+  if (reader->map == MAP_FAILED) {
+    log_errno("mmap");
+    reader->map = NULL;
+    reader->map_size = 0;
+    return -1;
+  }
+
+  if (madvise(reader->map, reader->map_size, MADV_SEQUENTIAL) < 0) {
+    log_errno("madvise");
+  }
+
+  reader->data = reader->map;
+  reader->end = reader->map_size;
+
+  return 0;
+}
+
+struct pcap_reader *open_pcap_reader_fd(int fd, bool close_fd) {
+  struct pcap_reader *reader = NULL;
+  struct stat sb;
+  int ret;
+
+  if (fd < 0) {
+    log_error("Invalid fd %d", fd);
+    return NULL;
+  }
+
+  if ((reader = os_zalloc(sizeof(struct pcap_reader))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  reader->fd = fd;
+  reader->close_fd = close_fd;
+
+  if (fstat(fd, &sb) < 0) {
+    log_errno("fstat");
+    goto fail;
+  }
+
+  if (!S_ISREG(sb.st_mode) || sb.st_size <= 0 ||
+      map_pcap_reader(reader, &sb) < 0) {
+    reader->buf_size = PCAP_READER_BUFFER_SIZE;
+    if ((reader->buf = os_malloc(reader->buf_size)) == NULL) {
+      log_errno("os_malloc");
+      goto fail;
+    }
+    reader->data = reader->buf;
+  }
+
+  if ((ret = fill_pcap_reader(reader, sizeof(struct pcap_file_header))) < 0) {
+    log_error("fill_pcap_reader fail");
+    goto fail;
+  } else if (ret == 0) {
+    log_error("Missing pcap file header");
+    goto fail;
+  }
+
+  os_memcpy(&reader->header,
+            consume_pcap_reader(reader, sizeof(struct pcap_file_header)),
+            sizeof(struct pcap_file_header));
+
+  log_trace("pcap_file_header magic = %x", reader->header.magic);
+  log_trace("pcap_file_header snaplen = %" PRIu32, reader->header.snaplen);
+  log_trace("pcap_file_header linktype = %" PRIu32, reader->header.linktype);
+
+  if (reader->header.magic != PCAP_READER_MAGIC) {
+    log_error("Not a pcap file (magic number error), perhaps a pcapng file!!!");
+    goto fail;
+  }
+
+  return reader;
+
+fail:
+  // The fd is owned by the caller on failure
+  reader->close_fd = false;
+  __close_pcap_reader(reader);
+  return NULL;
+}
+
+struct pcap_reader *open_pcap_reader(const char *path) {
+  struct pcap_reader *reader = NULL;
+  int fd;
+
+  if (path == NULL) {
+    return open_pcap_reader_fd(STDIN_FILENO, false);
+  }
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    log_errno("open %s", path);
+    return NULL;
+  }
+
+  if ((reader = open_pcap_reader_fd(fd, true)) == NULL) {
+    close(fd);
+  }
+
+  return reader;
+}
+
+int next_pcap_reader(struct pcap_reader *reader, struct pcap_pkthdr *header,
+                     const uint8_t **packet) {
+  struct pcap_reader_pkthdr pkt_header;
+  int ret;
+
+  if ((ret = fill_pcap_reader(reader, sizeof(pkt_header))) <= 0) {
+    if (reader->end != reader->start) {
+      log_warn("Truncated packet header at offset %" PRIu64, reader->offset);
+    }
+    return ret;
+  }
+
+  os_memcpy(&pkt_header, reader->data + reader->start, sizeof(pkt_header));
+
+  if (pkt_header.caplen > pkt_header.len) {
+    log_error("caplen > len");
+    return -1;
+  }
+
+  if (pkt_header.caplen > PCAP_READER_MAX_CAPLEN) {
+    log_error("caplen %" PRIu32 " too large", pkt_header.caplen);
+    return -1;
+  }
+
+  // Read the header and the packet in one go, so the header isn't
+  // consumed if the packet is truncated
+  if ((ret = fill_pcap_reader(reader, sizeof(pkt_header) +
+                                          pkt_header.caplen)) <= 0) {
+    if (ret == 0) {
+      log_warn("Truncated packet at offset %" PRIu64, reader->offset);
+    }
+    return ret;
+  }
+
+  consume_pcap_reader(reader, sizeof(pkt_header));
+  *packet = consume_pcap_reader(reader, pkt_header.caplen);
+
+  header->ts.tv_sec = pkt_header.ts_sec;
+  header->ts.tv_usec = pkt_header.ts_usec;
+  header->caplen = pkt_header.caplen;
+  header->len = pkt_header.len;
+
+  return 1;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the streaming pcap file reader.
+ *
+ * Regular files are memory mapped and the packets are returned as pointers
+ * into the mapping. Pipes, stdin and the regular files that can't be mapped
+ * are read into a fixed buffer that is reused for the whole stream, so the
+ * memory use doesn't grow with the stream size.
+ */
+
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#include "../utils/attributes.h"
+
+#define PCAP_READER_MAGIC 0xa1b2c3d4 // The pcap file magic number
+#define PCAP_READER_BUFFER_SIZE                                                \
+  (1024 * 1024) // The stream buffer size in bytes
+#define PCAP_READER_MAX_CAPLEN                                                 \
+  262144 // The maximum packet size, same as the libpcap MAXIMUM_SNAPLEN
+
+/**
+ * @brief The pcap file packet header
+ *
+ */
+struct pcap_reader_pkthdr {
+  uint32_t ts_sec;  /**< timestamp seconds */
+  uint32_t ts_usec; /**< timestamp microseconds */
+  uint32_t caplen;  /**< length of portion present */
+  uint32_t len;     /**< length this packet (off wire) */
+} STRUCT_PACKED;
+
+/**
+ * @brief Streaming pcap file reader structure definition
+ *
+ */
+struct pcap_reader {
+  int fd;                         /**< The pcap file descriptor */
+  bool close_fd;                  /**< Close the fd when the reader is freed */
+  uint8_t *map;                   /**< The file mapping, NULL in stream mode */
+  size_t map_size;                /**< The file mapping size */
+  uint8_t *buf;                   /**< The stream buffer */
+  size_t buf_size;                /**< The stream buffer size */
+  const uint8_t *data;            /**< The start of the unread data */
+  size_t start;                   /**< The offset of the unread data */
+  size_t end;                     /**< The offset of the end of the data */
+  bool eof;                       /**< Set when the stream ended */
+  uint64_t offset;                /**< Number of bytes consumed */
+  struct pcap_file_header header; /**< The pcap file header */
+};
+
+/**
+ * @brief Closes the pcap reader
+ *
+ * @param reader The pcap reader
+ */
+void close_pcap_reader(struct pcap_reader *reader);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be close_pcap_reader()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_close_pcap_reader                                               \
+  __attribute__((malloc(close_pcap_reader, 1))) __must_check
+#else
+#define __must_close_pcap_reader __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Opens a pcap reader on a file descriptor and reads the pcap file
+ * header
+ *
+ * Regular files are memory mapped, any other file is streamed. A regular file
+ * is also streamed if it is larger than the address space or mmap() fails.
+ *
+ * @param fd The pcap file descriptor
+ * @param close_fd If true, the fd is closed with the reader
+ * @return struct pcap_reader* The pcap reader, NULL on failure.
+ * You must free this using close_pcap_reader().
+ */
+__must_close_pcap_reader struct pcap_reader *
+open_pcap_reader_fd(int fd, bool close_fd);
+
+/**
+ * @brief Opens a pcap reader on a file and reads the pcap file header
+ *
+ * @param path The pcap file path, NULL for stdin
+ * @return struct pcap_reader* The pcap reader, NULL on failure.
+ * You must free this using close_pcap_reader().
+ */
+__must_close_pcap_reader struct pcap_reader *
+open_pcap_reader(const char *path);
+
+/**
+ * @brief Reads the next packet from the pcap reader
+ *
+ * The packet points into the reader mapping or buffer and is only valid
+ * until the next call.
+ *
+ * @param reader The pcap reader
+ * @param[out] header The packet header
+ * @param[out] packet The packet data
+ * @return int 1 if a packet was read, 0 at the end of the file, -1 on failure
+ */
+int next_pcap_reader(struct pcap_reader *reader, struct pcap_pkthdr *header,
+                     const uint8_t **packet);
+
+#endif
@@ -0,0 +1,350 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the TPACKET_V3 capture ring.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pcap.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+
+#include "pcap_ring.h"
+
+#ifdef __linux__
+
+#define RING_FRAME_SIZE 2048 // Only used to size the ring, frames are variable
+#define RING_VLAN_TAG_LEN 4  // The 802.1Q tag size
+
+/**
+ * Private implementation of close_pcap_ring(), without its compiler attributes,
+ * so open_pcap_ring() can call it on failure.
+ */
+static void __close_pcap_ring(struct pcap_ring *ring) {
+  if (ring != NULL) {
+    if (ring->map != NULL) {
+      munmap(ring->map, ring->map_size);
+    }
+    if (ring->fd >= 0) {
+      close(ring->fd);
+    }
+    os_free(ring);
+  }
+}
+
+void close_pcap_ring(struct pcap_ring *ring) { __close_pcap_ring(ring); }
+
+static int set_ring_option(int fd, int level, int name, const void *value,
+                           socklen_t len, const char *label) {
+  if (setsockopt(fd, level, name, value, len) < 0) {
+    log_errno("setsockopt %s", label);
+    return -1;
+  }
+
+  return 0;
+}
+
+struct pcap_ring *open_pcap_ring(const char *ifname,
+                                 const struct pcap_ring_conf *conf,
+                                 const struct bpf_program *fp) {
+  struct pcap_ring *ring = NULL;
+  struct tpacket_req3 req = {0};
+  struct sockaddr_ll sll = {0};
+  int version = TPACKET_V3;
+  // Headroom in front of every packet, used to reinsert the VLAN tag
+  unsigned int reserve = RING_VLAN_TAG_LEN;
+  unsigned int ifindex;
+
+  if (ifname == NULL) {
+    log_error("ifname param is NULL");
+    return NULL;
+  }
+
+  if (conf == NULL) {
+    log_error("conf param is NULL");
+    return NULL;
+  }
+
+  if (!conf->block_size || conf->block_size % getpagesize() ||
+      conf->block_size < RING_FRAME_SIZE) {
+    log_error("Invalid ring block size %" PRIu32, conf->block_size);
+    return NULL;
+  }
+
+  if (!conf->block_count) {
+    log_error("Invalid ring block count %" PRIu32, conf->block_count);
+    return NULL;
+  }
+
+  if ((ifindex = if_nametoindex(ifname)) == 0) {
+    log_errno("if_nametoindex %s", ifname);
+    return NULL;
+  }
+
+  if ((ring = os_zalloc(sizeof(struct pcap_ring))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  ring->block_size = conf->block_size;
+  ring->block_count = conf->block_count;
+  ring->snaplen = conf->snaplen;
+
+  // Don't receive any packets before the socket is bound to the interface
+  if ((ring->fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+    log_errno("socket");
+    goto fail;
+  }
+
+  if (fp != NULL) {
+    struct sock_fprog prog = {
+        .len = (unsigned short)fp->bf_len,
+        .filter = (struct sock_filter *)fp->bf_insns,
+    };
+    if (set_ring_option(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                        sizeof(prog), "SO_ATTACH_FILTER") < 0) {
+      goto fail;
+    }
+  }
+
+  if (set_ring_option(ring->fd, SOL_PACKET, PACKET_VERSION, &version,
+                      sizeof(version), "PACKET_VERSION") < 0) {
+    goto fail;
+  }
+
+  if (set_ring_option(ring->fd, SOL_PACKET, PACKET_RESERVE, &reserve,
+                      sizeof(reserve), "PACKET_RESERVE") < 0) {
+    goto fail;
+  }
+
+  req.tp_block_size = conf->block_size;
+  req.tp_block_nr = conf->block_count;
+  req.tp_frame_size = RING_FRAME_SIZE;
+  req.tp_frame_nr = (conf->block_size / RING_FRAME_SIZE) * conf->block_count;
+  req.tp_retire_blk_tov = conf->timeout;
+  if (set_ring_option(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req),
+                      "PACKET_RX_RING") < 0) {
+    goto fail;
+  }
+
+  ring->map_size = (size_t)conf->block_size * conf->block_count;
+  ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   ring->fd, 0);
+  if (ring->map == MAP_FAILED) {
+    log_errno("mmap");
+    ring->map = NULL;
+    goto fail;
+  }
+
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_ifindex = (int)ifindex;
+  if (bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    log_errno("bind");
+    goto fail;
+  }
+
+  if (conf->promiscuous) {
+    struct packet_mreq mr = {
+        .mr_ifindex = (int)ifindex,
+        .mr_type = PACKET_MR_PROMISC,
+    };
+    if (set_ring_option(ring->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr,
+                        sizeof(mr), "PACKET_ADD_MEMBERSHIP") < 0) {
+      goto fail;
+    }
+  }
+
+  // The sockets of a fanout group share the flows of the interface by hash
+  if (conf->fanout_group) {
+    int fanout = conf->fanout_group |
+                 ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    if (set_ring_option(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                        sizeof(fanout), "PACKET_FANOUT") < 0) {
+      goto fail;
+    }
+  }
+
+  log_debug("TPACKET_V3 ring on %s with %" PRIu32 " blocks of %" PRIu32
+            " bytes",
+            ifname, conf->block_count, conf->block_size);
+
+  return ring;
+
+fail:
+  __close_pcap_ring(ring);
+  return NULL;
+}
+
+static void process_ring_frame(struct pcap_ring *ring,
+                               struct tpacket3_hdr *hdr, pcap_ring_fn fn,
+                               void *ctx) {
+  uint8_t *packet = (uint8_t *)hdr + hdr->tp_mac;
+  struct pcap_pkthdr header = {
+      .ts.tv_sec = hdr->tp_sec,
+      .ts.tv_usec = hdr->tp_nsec / 1000,
+      .caplen = hdr->tp_snaplen,
+      .len = hdr->tp_len,
+  };
+
+  // The kernel strips the VLAN tag, so put it back in the reserved headroom
+  if ((hdr->tp_status & TP_STATUS_VLAN_VALID) &&
+      header.caplen >= 2 * ETH_ALEN) {
+    uint16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID)
+                        ? hdr->hv1.tp_vlan_tpid
+                        : ETH_P_8021Q;
+    uint16_t tag[2] = {htons(tpid), htons((uint16_t)hdr->hv1.tp_vlan_tci)};
+
+    packet -= RING_VLAN_TAG_LEN;
+    os_memmove(packet, packet + RING_VLAN_TAG_LEN, 2 * ETH_ALEN);
+    os_memcpy(packet + 2 * ETH_ALEN, tag, RING_VLAN_TAG_LEN);
+    header.caplen += RING_VLAN_TAG_LEN;
+    header.len += RING_VLAN_TAG_LEN;
+  }
+
+  if (ring->snaplen && header.caplen > ring->snaplen) {
+    header.caplen = ring->snaplen;
+  }
+
+  fn(ctx, &header, packet);
+}
+
+int dispatch_pcap_ring(struct pcap_ring *ring, pcap_ring_fn fn,
+                       pcap_ring_block_fn block_fn, void *ctx) {
+  int count = 0;
+
+  if (ring == NULL) {
+    log_error("ring param is NULL");
+    return -1;
+  }
+
+  // Reads at most one lap of the ring, so the eloop isn't starved
+  for (uint32_t blocks = 0; blocks < ring->block_count; blocks++) {
+    struct tpacket_block_desc *desc =
+        (struct tpacket_block_desc *)(ring->map + (size_t)ring->block_idx *
+                                                      ring->block_size);
+
+    if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER)) {
+      break;
+    }
+
+    struct tpacket3_hdr *hdr =
+        (struct tpacket3_hdr *)((uint8_t *)desc +
+                                desc->hdr.bh1.offset_to_first_pkt);
+    for (uint32_t idx = 0; idx < desc->hdr.bh1.num_pkts; idx++) {
+      if (fn != NULL) {
+        process_ring_frame(ring, hdr, fn, ctx);
+      }
+      hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+    }
+
+    count += (int)desc->hdr.bh1.num_pkts;
+
+    // Lets the caller consume the packets it kept a pointer to
+    if (block_fn != NULL) {
+      block_fn(ctx);
+    }
+
+    // Retire the block, the packet pointers are invalid from now on
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    ring->block_idx = (ring->block_idx + 1) % ring->block_count;
+  }
+
+  return count;
+}
+
+int inject_pcap_ring(struct pcap_ring *ring, const uint8_t *packet,
+                     size_t size) {
+  ssize_t sent;
+
+  if ((sent = send(ring->fd, packet, size, 0)) < 0) {
+    log_errno("send");
+    return -1;
+  }
+
+  return (int)sent;
+}
+
+int get_pcap_ring_stats(struct pcap_ring *ring, struct pcap_stat *ps) {
+  struct tpacket_stats_v3 stats = {0};
+  socklen_t len = sizeof(stats);
+
+  // The kernel resets the counters on every read
+  if (getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) {
+    log_errno("getsockopt PACKET_STATISTICS");
+    return -1;
+  }
+
+  ring->received += stats.tp_packets;
+  ring->drops += stats.tp_drops;
+
+  ps->ps_recv = (u_int)ring->received;
+  ps->ps_drop = (u_int)ring->drops;
+  ps->ps_ifdrop = 0;
+
+  return 0;
+}
+
+#else
+
+void close_pcap_ring(struct pcap_ring *ring) { os_free(ring); }
+
+struct pcap_ring *open_pcap_ring(const char *ifname,
+                                 const struct pcap_ring_conf *conf,
+                                 const struct bpf_program *fp) {
+  (void)ifname;
+  (void)conf;
+  (void)fp;
+
+  log_error("TPACKET_V3 rings are only supported on Linux");
+  return NULL;
+}
+
+int dispatch_pcap_ring(struct pcap_ring *ring, pcap_ring_fn fn,
+                       pcap_ring_block_fn block_fn, void *ctx) {
+  (void)ring;
+  (void)fn;
+  (void)block_fn;
+  (void)ctx;
+
+  return -1;
+}
+
+int inject_pcap_ring(struct pcap_ring *ring, const uint8_t *packet,
+                     size_t size) {
+  (void)ring;
+  (void)packet;
+  (void)size;
+
+  return -1;
+}
+
+int get_pcap_ring_stats(struct pcap_ring *ring, struct pcap_stat *ps) {
+  (void)ring;
+  (void)ps;
+
+  return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the TPACKET_V3 capture ring.
+ *
+ * The kernel writes the captured packets into a memory mapped ring of blocks
+ * shared with the AF_PACKET socket. A block is handed back to the kernel only
+ * after all its packets were passed to the callback, so the packets are read
+ * in place without any copies. Only available on Linux.
+ */
+
+#ifndef PCAP_RING_H
+#define PCAP_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#include "../utils/attributes.h"
+
+/**
+ * @brief TPACKET_V3 ring configuration structure
+ *
+ */
+struct pcap_ring_conf {
+  uint32_t block_size;   /**< The block size, a multiple of the page size */
+  uint32_t block_count;  /**< The number of blocks in the ring */
+  uint32_t snaplen;      /**< The maximum number of bytes per packet */
+  uint32_t timeout;      /**< The block retire timeout in milliseconds */
+  uint16_t fanout_group; /**< The PACKET_FANOUT group id, 0 to disable */
+  bool promiscuous;      /**< Puts the interface into promiscuous mode */
+};
+
+/**
+ * @brief TPACKET_V3 ring callback, the packet is valid only until the function
+ * returns
+ *
+ */
+typedef void (*pcap_ring_fn)(void *ctx, struct pcap_pkthdr *header,
+                             uint8_t *packet);
+
+/**
+ * @brief TPACKET_V3 ring block callback, called after the packets of a block
+ * were passed to the packet callback and before the block is handed back to
+ * the kernel
+ *
+ */
+typedef void (*pcap_ring_block_fn)(void *ctx);
+
+/**
+ * @brief TPACKET_V3 ring structure definition
+ *
+ */
+struct pcap_ring {
+  int fd;                /**< The AF_PACKET socket */
+  uint8_t *map;          /**< The memory mapped ring */
+  size_t map_size;       /**< The size of the memory mapped ring */
+  uint32_t block_size;   /**< The block size */
+  uint32_t block_count;  /**< The number of blocks in the ring */
+  uint32_t block_idx;    /**< The index of the next block to read */
+  uint32_t snaplen;      /**< The maximum number of bytes per packet */
+  uint64_t received;     /**< The number of packets received by the kernel */
+  uint64_t drops;        /**< The number of packets dropped by the kernel */
+};
+
+/**
+ * @brief Closes the TPACKET_V3 ring
+ *
+ * @param ring The TPACKET_V3 ring
+ */
+void close_pcap_ring(struct pcap_ring *ring);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be close_pcap_ring()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_close_pcap_ring                                                 \
+  __attribute__((malloc(close_pcap_ring, 1))) __must_check
+#else
+#define __must_close_pcap_ring __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Opens a TPACKET_V3 ring on an interface
+ *
+ * @param ifname The capture interface
+ * @param conf The ring configuration
+ * @param fp The compiled capture filter, NULL for no filter
+ * @return struct pcap_ring* The TPACKET_V3 ring, NULL on failure.
+ * You must free this using close_pcap_ring().
+ */
+__must_close_pcap_ring struct pcap_ring *
+open_pcap_ring(const char *ifname, const struct pcap_ring_conf *conf,
+               const struct bpf_program *fp);
+
+/**
+ * @brief Passes all the packets of the retired blocks to a callback and hands
+ * the blocks back to the kernel
+ *
+ * The packet pointers stay valid until the block callback of their block
+ * returns, so the packets of a block can be batched without being copied.
+ *
+ * @param ring The TPACKET_V3 ring
+ * @param fn The packet callback
+ * @param block_fn The block callback, NULL for none
+ * @param ctx The context for the callback functions
+ * @return int the number of packets read, -1 on failure
+ */
+int dispatch_pcap_ring(struct pcap_ring *ring, pcap_ring_fn fn,
+                       pcap_ring_block_fn block_fn, void *ctx);
+
+/**
+ * @brief Sends a packet on the TPACKET_V3 ring interface
+ *
+ * @param ring The TPACKET_V3 ring
+ * @param packet The packet data
+ * @param size The packet size
+ * @return int number of bytes sent on success, -1 on failure
+ */
+int inject_pcap_ring(struct pcap_ring *ring, const uint8_t *packet,
+                     size_t size);
+
+/**
+ * @brief Returns the TPACKET_V3 ring capture statistics
+ *
+ * @param ring[in] The TPACKET_V3 ring
+ * @param ps[out] The pcap_stat structure
+ * @return 0 on success, -1 on failure
+ */
+int get_pcap_ring_stats(struct pcap_ring *ring, struct pcap_stat *ps);
+
+#endif
@@ -16,7 +16,6 @@
 #include "../utils/net.h"
 #include "../utils/os.h"
 
-#define PCAP_SNAPSHOT_LENGTH 65535
 #define PCAP_BUFFER_SIZE 64 * 1024
 
 static const UT_icd pcap_list_icd = {sizeof(struct pcap_context *), NULL, NULL,
@@ -65,12 +64,31 @@ void receive_pcap_packet(u_char *args, const struct pcap_pkthdr *header,
   }
 }
 
+static void receive_ring_packet(void *ctx, struct pcap_pkthdr *header,
+                                uint8_t *packet) {
+  receive_pcap_packet((u_char *)ctx, header, packet);
+}
+
+static void receive_ring_block(void *ctx) {
+  struct pcap_context *pc = (struct pcap_context *)ctx;
+
+  if (pc->block_fn != NULL) {
+    pc->block_fn(pc->fn_ctx);
+  }
+}
+
 int capture_pcap_packet(struct pcap_context *ctx) {
+  if (ctx->ring != NULL) {
+    return dispatch_pcap_ring(ctx->ring, receive_ring_packet,
+                              receive_ring_block, (void *)ctx);
+  }
+
   return pcap_dispatch(ctx->pd, -1, receive_pcap_packet, (u_char *)ctx);
 }
 
 void close_pcap(struct pcap_context *ctx) {
   if (ctx != NULL) {
+    close_pcap_ring(ctx->ring);
     if (ctx->pd != NULL) {
       pcap_close(ctx->pd);
     }
@@ -79,7 +97,10 @@ void close_pcap(struct pcap_context *ctx) {
 }
 
 int capture_pcap_start(struct pcap_context *ctx) {
-  if (ctx != NULL) {
+  if (ctx != NULL && ctx->ring != NULL) {
+    log_error("The TPACKET_V3 ring is only read from an eloop");
+    return -1;
+  } else if (ctx != NULL) {
     return pcap_loop(ctx->pd, -1, receive_pcap_packet, (u_char *)ctx);
   } else {
     log_error("ctx is NULL");
@@ -103,8 +124,9 @@ int get_pcap_datalink(struct pcap_context *ctx) {
 }
 
 int run_pcap(char *interface, bool immediate, bool promiscuous, int timeout,
-             char *filter, bool nonblock, capture_callback_fn pcap_fn,
-             void *fn_ctx, struct pcap_context **pctx) {
+             uint32_t snaplen, char *filter, bool nonblock,
+             capture_callback_fn pcap_fn, void *fn_ctx,
+             struct pcap_context **pctx) {
   int ret;
   char err[PCAP_ERRBUF_SIZE];
   bpf_u_int32 mask, net;
@@ -139,7 +161,8 @@ int run_pcap(char *interface, bool immediate, bool promiscuous, int timeout,
     return -1;
   }
 
-  if ((ret = pcap_set_snaplen(ctx->pd, PCAP_SNAPSHOT_LENGTH)) < 0) {
+  if ((ret = pcap_set_snaplen(
+           ctx->pd, (snaplen) ? (int)snaplen : PCAP_SNAPSHOT_LENGTH)) < 0) {
     log_error("pcap_set_snaplen fail %d", ret);
     goto fail;
   }
@@ -214,6 +237,70 @@ fail:
   return -1;
 }
 
+int run_pcap_ring(char *interface, const struct pcap_ring_conf *conf,
+                  char *filter, capture_callback_fn pcap_fn,
+                  capture_block_fn block_fn, void *fn_ctx,
+                  struct pcap_context **pctx) {
+  struct bpf_program fp;
+  bool has_filter = (filter != NULL && strlen(filter));
+  struct pcap_context *ctx = NULL;
+  int snaplen;
+
+  if (conf == NULL) {
+    log_error("conf param is NULL");
+    return -1;
+  }
+
+  snaplen = (conf->snaplen) ? (int)conf->snaplen : PCAP_SNAPSHOT_LENGTH;
+
+  if ((ctx = os_zalloc(sizeof(struct pcap_context))) == NULL) {
+    log_errno("os_zalloc");
+    return -1;
+  }
+
+  os_strlcpy(ctx->ifname, interface, IF_NAMESIZE);
+  ctx->pcap_fn = pcap_fn;
+  ctx->block_fn = block_fn;
+  ctx->fn_ctx = fn_ctx;
+
+  if ((ctx->pd = pcap_open_dead(DLT_EN10MB, snaplen)) == NULL) {
+    log_error("pcap_open_dead fail");
+    goto fail;
+  }
+
+  if (has_filter) {
+    if (pcap_compile(ctx->pd, &fp, filter, 1, PCAP_NETMASK_UNKNOWN) == -1) {
+      log_error("Couldn't parse filter %s: %s", filter, pcap_geterr(ctx->pd));
+      goto fail;
+    }
+    log_trace("Setting filter to=%s", filter);
+  }
+
+  ctx->ring = open_pcap_ring(interface, conf, (has_filter) ? &fp : NULL);
+
+  if (has_filter) {
+    pcap_freecode(&fp);
+  }
+
+  if (ctx->ring == NULL) {
+    log_error("open_pcap_ring fail");
+    goto fail;
+  }
+
+  ctx->pcap_fd = ctx->ring->fd;
+
+  log_debug("Ring capture started on %s with link_type=%s", interface,
+            pcap_datalink_val_to_name(pcap_datalink(ctx->pd)));
+
+  *pctx = ctx;
+  return 0;
+
+fail:
+  close_pcap(ctx);
+  *pctx = NULL;
+  return -1;
+}
+
 int dump_file_pcap(struct pcap_context *ctx, char *file_path,
                    struct pcap_pkthdr *header, uint8_t *packet) {
   pcap_dumper_t *dumper;
@@ -227,6 +314,10 @@ int dump_file_pcap(struct pcap_context *ctx, char *file_path,
 }
 
 int get_pcap_stats(const struct pcap_context *ctx, struct pcap_stat *ps) {
+  if (ctx->ring != NULL) {
+    return get_pcap_ring_stats(ctx->ring, ps);
+  }
+
   if (pcap_stats(ctx->pd, ps) != 0) {
     log_error("pcap_stats fail: %s", pcap_geterr(ctx->pd));
     return -1;
@@ -236,6 +327,10 @@ int get_pcap_stats(const struct pcap_context *ctx, struct pcap_stat *ps) {
 }
 
 int inject_pcap(struct pcap_context *ctx, uint8_t *packet, size_t size) {
+  if (ctx->ring != NULL) {
+    return inject_pcap_ring(ctx->ring, packet, size);
+  }
+
   int sent = pcap_inject(ctx->pd, packet, size);
 
   if (sent < 0) {
@@ -18,10 +18,16 @@
 #include <sys/types.h>
 #include <utarray.h>
 
+#include "pcap_ring.h"
+
+#define PCAP_SNAPSHOT_LENGTH 65535 // The default maximum bytes per packet
+
 typedef void (*capture_callback_fn)(const void *ctx, const void *pcap_ctx,
                                     char *ltype, struct pcap_pkthdr *header,
                                     uint8_t *packet);
 
+typedef void (*capture_block_fn)(const void *ctx);
+
 /**
  * @brief Pcap context structure definition
  *
@@ -32,6 +38,8 @@ struct pcap_context {
   char ifname[IF_NAMESIZE];    /**< The pcap interface */
   capture_callback_fn pcap_fn; /**< The pcap capture callback */
   void *fn_ctx;                /**< The context for callback function */
+  capture_block_fn block_fn;   /**< The ring block callback, NULL for none */
+  struct pcap_ring *ring; /**< The TPACKET_V3 ring, NULL for libpcap capture */
 };
 
 /**
@@ -64,6 +72,8 @@ int get_pcap_datalink(struct pcap_context *ctx);
  * @param immediate The immediate mode flag
  * @param promiscuous The promiscuous mode flag
  * @param timeout The timeout (in milliseconds)
+ * @param snaplen The maximum number of bytes per packet, 0 for
+ * PCAP_SNAPSHOT_LENGTH
  * @param filter The capture filter string
  * @param nonblock  Sets the capture to nonblocking mode
  * @param pcap_fn The pcap capture callback
@@ -72,8 +82,32 @@ int get_pcap_datalink(struct pcap_context *ctx);
  * @return 0 on success, -1 on failure
  */
 int run_pcap(char *interface, bool immediate, bool promiscuous, int timeout,
-             char *filter, bool nonblock, capture_callback_fn pcap_fn,
-             void *fn_ctx, struct pcap_context **pctx);
+             uint32_t snaplen, char *filter, bool nonblock,
+             capture_callback_fn pcap_fn, void *fn_ctx,
+             struct pcap_context **pctx);
+
+/**
+ * @brief Executes the capture service with a TPACKET_V3 ring
+ *
+ * The packets are passed to the callback straight from the memory mapped
+ * ring, without being copied. A packet stays valid until the block callback
+ * returns, which happens once per ring block, before the block is handed back
+ * to the kernel. The pcap structure of the context is a dead Ethernet handle,
+ * only used to compile the filter and to dump packets.
+ *
+ * @param interface The capture interface
+ * @param conf The TPACKET_V3 ring configuration
+ * @param filter The capture filter string
+ * @param pcap_fn The pcap capture callback
+ * @param block_fn The ring block callback, NULL for none
+ * @param fn_ctx The context for callback functions
+ * @param pctx The returned pcap context
+ * @return 0 on success, -1 on failure
+ */
+int run_pcap_ring(char *interface, const struct pcap_ring_conf *conf,
+                  char *filter, capture_callback_fn pcap_fn,
+                  capture_block_fn block_fn, void *fn_ctx,
+                  struct pcap_context **pctx);
 
 /**
  * @brief Captures a pcap packet
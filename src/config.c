@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <minIni.h>
+#include <sqlite3.h>
 #include <unistd.h>
 
 #include "./dhcp/dhcp_config_utils.h"
@@ -484,6 +485,30 @@ bool load_dhcp_conf(const char *filename, struct app_config *config) {
   return true;
 }
 
+/**
+ * @brief Returns the maximum number of capture db shards
+ *
+ * The shards are read back by attaching all of them to a single sqlite3
+ * connection, so their number is bounded by the attached db limit.
+ *
+ * @return long The maximum number of shards, -1 on failure
+ */
+static long get_max_db_shards(void) {
+  sqlite3 *db = NULL;
+  long limit;
+
+  if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+    log_error("Cannot open database: %s", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return -1;
+  }
+
+  limit = (long)sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1);
+  sqlite3_close(db);
+
+  return limit;
+}
+
 bool load_capture_config(const char *filename, struct capture_conf *config) {
   char *value = os_zalloc(INI_BUFFERSIZE);
 
@@ -499,6 +524,21 @@ bool load_capture_config(const char *filename, struct capture_conf *config) {
   os_strlcpy(config->filter, value, MAX_FILTER_SIZE);
   os_free(value);
 
+  // Load payloadFilter param
+  value = os_zalloc(INI_BUFFERSIZE);
+  ini_gets("capture", "payloadFilter", "", value, INI_BUFFERSIZE, filename);
+
+  os_strlcpy(config->payload_filter, value, MAX_FILTER_SIZE);
+  os_free(value);
+
+  // Load snapLength param
+  long snaplen = ini_getl("capture", "snapLength", 0, filename);
+  if (snaplen < 0 || snaplen > MAX_CAPTURE_SNAPLEN) {
+    log_error("Invalid snapLength %ld", snaplen);
+    return false;
+  }
+  config->snaplen = (uint32_t)snaplen;
+
   // Load middleware params
   char ini_buffer[INI_BUFFERSIZE] = "";
   ini_gets("capture", "middlewareParams", "", ini_buffer, INI_BUFFERSIZE,
@@ -516,6 +556,163 @@ bool load_capture_config(const char *filename, struct capture_conf *config) {
   config->buffer_timeout =
       (uint16_t)ini_getl("capture", "bufferTimeout", 10, filename);
 
+  // Load writerThreads param
+  config->writer_threads = ini_getbool("capture", "writerThreads", 0, filename);
+
+  // Load writerRingSize param
+  long ring_size = ini_getl("capture", "writerRingSize",
+                            DEFAULT_WRITER_RING_SIZE, filename);
+  if (ring_size <= 0) {
+    log_error("Invalid writerRingSize %ld", ring_size);
+    return false;
+  }
+  config->writer_ring_size = (uint32_t)ring_size;
+
+  // Load writerBackpressure param
+  ini_gets("capture", "writerBackpressure", "drop-newest", ini_buffer,
+           INI_BUFFERSIZE, filename);
+  if (strcmp(ini_buffer, "drop-newest") == 0) {
+    config->writer_backpressure = WRITER_DROP_NEWEST;
+  } else if (strcmp(ini_buffer, "drop-oldest") == 0) {
+    config->writer_backpressure = WRITER_DROP_OLDEST;
+  } else if (strcmp(ini_buffer, "block") == 0) {
+    config->writer_backpressure = WRITER_BLOCK;
+  } else {
+    log_error("Invalid writerBackpressure %s", ini_buffer);
+    return false;
+  }
+
+  // Load captureRing param
+  config->capture_ring = ini_getbool("capture", "captureRing", 0, filename);
+
+  // Load ringBlockSize param
+  long block_size = ini_getl("capture", "ringBlockSize",
+                             DEFAULT_CAPTURE_RING_BLOCK_SIZE, filename);
+  if (block_size <= 0 || block_size > UINT32_MAX) {
+    log_error("Invalid ringBlockSize %ld", block_size);
+    return false;
+  }
+  config->ring_block_size = (uint32_t)block_size;
+
+  // Load ringBlockCount param
+  long block_count = ini_getl("capture", "ringBlockCount",
+                              DEFAULT_CAPTURE_RING_BLOCK_COUNT, filename);
+  if (block_count <= 0 || block_count > UINT32_MAX) {
+    log_error("Invalid ringBlockCount %ld", block_count);
+    return false;
+  }
+  config->ring_block_count = (uint32_t)block_count;
+
+  // Load ringFanoutGroup param
+  long fanout_group = ini_getl("capture", "ringFanoutGroup", 0, filename);
+  if (fanout_group < 0 || fanout_group > UINT16_MAX) {
+    log_error("Invalid ringFanoutGroup %ld", fanout_group);
+    return false;
+  }
+  config->ring_fanout_group = (uint16_t)fanout_group;
+
+  // Load captureDbShards param
+  long db_shards = ini_getl("capture", "captureDbShards", 0, filename);
+  if (db_shards < 0) {
+    log_error("Invalid captureDbShards %ld", db_shards);
+    return false;
+  }
+
+  if (db_shards) {
+    long max_db_shards = get_max_db_shards();
+    if (db_shards > max_db_shards) {
+      log_error("Invalid captureDbShards %ld, the maximum is %ld", db_shards,
+                max_db_shards);
+      return false;
+    }
+  }
+  config->db_shards = (uint32_t)db_shards;
+
+  // Load pinCaptureThreads param
+  config->pin_threads =
+      ini_getbool("capture", "pinCaptureThreads", 0, filename);
+
+  // Load cleanerStoreSize param
+  long store_size = ini_getl("capture", "cleanerStoreSize",
+                             DEFAULT_CLEANER_STORE_SIZE, filename);
+  if (store_size < 0 || store_size > UINT32_MAX) {
+    log_error("Invalid cleanerStoreSize %ld", store_size);
+    return false;
+  }
+  config->cleaner_store_size = (uint32_t)store_size;
+
+  // Load cleanerStoreAge param
+  long store_age = ini_getl("capture", "cleanerStoreAge", 0, filename);
+  if (store_age < 0 || store_age > UINT32_MAX) {
+    log_error("Invalid cleanerStoreAge %ld", store_age);
+    return false;
+  }
+  config->cleaner_store_age = (uint32_t)store_age;
+
+  // Load cleanerQuotas param
+  ini_gets("capture", "cleanerQuotas", "", ini_buffer, INI_BUFFERSIZE,
+           filename);
+  os_strlcpy(config->cleaner_quotas, ini_buffer, MAX_CLEANER_QUOTAS_SIZE);
+
+  // Load sampleRate param
+  long sample_rate = ini_getl("capture", "sampleRate", 0, filename);
+  if (sample_rate < 0 || sample_rate > UINT32_MAX) {
+    log_error("Invalid sampleRate %ld", sample_rate);
+    return false;
+  }
+  config->sample_rate = (uint32_t)sample_rate;
+
+  // Load sampleFlowBytes param
+  long flow_bytes = ini_getl("capture", "sampleFlowBytes", 0, filename);
+  if (flow_bytes < 0 || flow_bytes > UINT32_MAX) {
+    log_error("Invalid sampleFlowBytes %ld", flow_bytes);
+    return false;
+  }
+  config->sample_flow_bytes = (uint32_t)flow_bytes;
+
+  // Load samplePacketRate param
+  long packet_rate = ini_getl("capture", "samplePacketRate", 0, filename);
+  if (packet_rate < 0 || packet_rate > UINT32_MAX) {
+    log_error("Invalid samplePacketRate %ld", packet_rate);
+    return false;
+  }
+  config->sample_packet_rate = (uint32_t)packet_rate;
+
+  // Load sampleBurst param
+  long burst = ini_getl("capture", "sampleBurst", 0, filename);
+  if (burst < 0 || burst > UINT32_MAX) {
+    log_error("Invalid sampleBurst %ld", burst);
+    return false;
+  }
+  config->sample_burst = (uint32_t)burst;
+
+  // Load headerBatchSize param
+  long header_batch_size = ini_getl("capture", "headerBatchSize",
+                                    DEFAULT_HEADER_BATCH_SIZE, filename);
+  if (header_batch_size < 0 || header_batch_size > UINT32_MAX) {
+    log_error("Invalid headerBatchSize %ld", header_batch_size);
+    return false;
+  }
+  config->header_batch_size = (uint32_t)header_batch_size;
+
+  // Load columnStoreSize param
+  long column_size = ini_getl("capture", "columnStoreSize",
+                              DEFAULT_COLUMN_STORE_SIZE, filename);
+  if (column_size < 0 || column_size > UINT32_MAX) {
+    log_error("Invalid columnStoreSize %ld", column_size);
+    return false;
+  }
+  config->column_store_size = (uint32_t)column_size;
+
+  // Load columnStoreAge param
+  long column_age = ini_getl("capture", "columnStoreAge",
+                             DEFAULT_COLUMN_STORE_AGE, filename);
+  if (column_age < 0 || column_age > UINT32_MAX) {
+    log_error("Invalid columnStoreAge %ld", column_age);
+    return false;
+  }
+  config->column_store_age = (uint32_t)column_age;
+
   return true;
 }
 
@@ -531,7 +531,8 @@ int create_domain_command(char *src_ip, char *dst_ip, char **out) {
 int send_bridge_command(struct mdns_context *context, struct tuple_packet *tp) {
   struct ip4_schema *sch = NULL;
   char *domain = NULL;
-  uint8_t sip[IP_ALEN], dip[IP_ALEN];
+  char src_ip[OS_INET_ADDRSTRLEN], dst_ip[OS_INET_ADDRSTRLEN];
+  uint8_t *sip, *dip;
   int ret, retd;
 
   if (tp->type == PACKET_IP4) {
@@ -540,15 +541,9 @@ int send_bridge_command(struct mdns_context *context, struct tuple_packet *tp) {
     return 0;
   }
 
-  if (ip4_2_buf(sch->ip_src, sip) < 0) {
-    log_error("Wrong source IP4");
-    return -1;
-  }
-
-  if (ip4_2_buf(sch->ip_dst, dip) < 0) {
-    log_error("Wrong source IP4");
-    return -1;
-  }
+  // The schema stores the addresses in network byte order
+  sip = (uint8_t *)&sch->ip_src.s_addr;
+  dip = (uint8_t *)&sch->ip_dst.s_addr;
 
   if ((ret = check_mdns_mapper_req(&context->imap, sip, MDNS_REQUEST_ANSWER)) <
       0) {
@@ -564,13 +559,17 @@ int send_bridge_command(struct mdns_context *context, struct tuple_packet *tp) {
 
   if (!ret && !retd) {
     /*
-    log_trace("mDNS request not found for src=%s, dst=%s", sch->ip_src,
-              sch->ip_dst);
+    log_trace("mDNS request not found for src=" IPSTR ", dst=" IPSTR,
+              IP2STR(sip), IP2STR(dip));
     */
     return 0;
   }
 
-  if (create_domain_command(sch->ip_src, sch->ip_dst, &domain) < 0) {
+  // Render the addresses only for the matched packets
+  inaddr4_2_ip(&sch->ip_src, src_ip);
+  inaddr4_2_ip(&sch->ip_dst, dst_ip);
+
+  if (create_domain_command(src_ip, dst_ip, &domain) < 0) {
     log_error("create_domain_command fail");
     return -1;
   }
@@ -616,7 +615,9 @@ void mdns_pcap_callback(const void *ctx, const void *pcap_ctx, char *ltype,
 
   utarray_new(tp_array, &tp_list_icd);
 
-  if (extract_packets(ltype, header, packet, pc->ifname, tp_array) > 0) {
+  // Only the IP4 addresses are used to open the bridges
+  if (extract_packets(ltype, header, packet, pc->ifname,
+                      PACKET_DECODE_MASK(PACKET_IP4), tp_array) > 0) {
     while ((p = (struct tuple_packet *)utarray_next(tp_array, p)) != NULL) {
       if (send_bridge_command(context, p) < 0) {
         log_error("send_pcap_meta fail");
@@ -650,7 +651,7 @@ int run_mdns_capture(struct eloop_data *eloop, struct mdns_context *context) {
   HASH_ITER(hh, context->vlan_mapper, current, tmp) {
     log_info("Registering pcap for ifname=%s", current->value.ifname);
     if (run_pcap(current->value.ifname, false, false, MDNS_PCAP_BUFFER_TIMEOUT,
-                 context->config.filter, true, mdns_pcap_callback,
+                 0, context->config.filter, true, mdns_pcap_callback,
                  (void *)context, &pctx) < 0) {
       log_error("run_pcap fail");
       return -1;
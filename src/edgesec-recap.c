@@ -15,11 +15,15 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <glob.h>
 #include <inttypes.h>
 #include <libgen.h>
 #include <pcap.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sqlite3.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -30,59 +34,61 @@
 #include "capture/middlewares/header_middleware/packet_queue.h"
 #include "capture/middlewares/header_middleware/sqlite_header.h"
 #include "capture/middlewares/protobuf_middleware/protobuf_middleware.h"
+#include "capture/pcap_reader.h"
 #include "utils/attributes.h"
 #include "utils/os.h"
 #include "utils/sqliteu.h"
 #include "version.h"
 
-#define PCAP_MAGIC_VALUE 0xa1b2c3d4
 #define QUEUE_PROCESS_INTERVAL 100 * 1000 // In microseconds
-#define PCAP_READ_INTERVAL 10             // in ms
-#define PCAP_READ_SIZE 1024               // bytes
 #define IFNAME_DEFAULT "ifname"
+#define RECAP_DIR_PATTERN "*.pcap" // The pcap files of a directory
+#define RECAP_BATCH_SIZE 4096      // Decoded packets in a worker batch
+#define RECAP_QUEUE_SIZE 64        // Worker batches waiting for the writer
+#define RECAP_DRAIN_TIMEOUT 5000   // Time in ms to drain the pipe of a capture
 
-#define OPT_STRING ":p:f:i:tnkdhv"
+#define OPT_STRING ":p:f:i:w:tnkdhv"
 
 #define USAGE_STRING                                                           \
-  "\t%s [-p filename] [-f filename] [-i interface] [-t] [-n] [-k] [-d] [-h] "  \
-  "[-v]\n"
+  "\t%s [-p filename] [-f filename] [-i interface] [-w workers] [-t] [-n] "    \
+  "[-k] [-d] [-h] [-v]\n"
 
 #define DESCRIPTION_STRING                                                     \
   "\nRun capture on an input pcap file, stdin or libpcap and output to a "     \
   "capture db or pipe.\n"
 
-enum PCAP_FILE_STATE {
-  PCAP_FILE_STATE_INIT = 0,
-  PCAP_FILE_STATE_READ_PCAP_HEADER,
-  PCAP_FILE_STATE_READ_PKT_HEADER,
-  PCAP_FILE_STATE_READ_PACKET,
-  PCAP_FILE_STATE_FIN
-};
-
-struct pcap_pkthdr32 {
-  uint32_t ts_sec;  /* timestamp seconds.*/
-  uint32_t ts_usec; /* timestamp microseconds.*/
-  uint32_t caplen;  /* length of portion present */
-  uint32_t len;     /* length this packet (off wire) */
-} STRUCT_PACKED;
-
 struct recap_context {
   sqlite3 *db;
-  int pipe_fd;
-  FILE *pcap_fd;
+  struct sqlite_header_writer *writer;
+  struct protobuf_writer *pipe_writer;
+  struct pcap_reader *reader;
   struct packet_queue *pq;
-  char *pcap_data;
   char *ifname;
   char *out_path;
-  ssize_t data_size;
   uint64_t total_size;
   uint64_t npackets;
-  enum PCAP_FILE_STATE state;
-  struct pcap_file_header pcap_header;
-  struct pcap_pkthdr32 pkt_header;
   bool pipe;
 };
 
+/**
+ * @brief The multi-file ingestion worker pool. The workers decode the pcap
+ * files and the main thread writes the decoded batches.
+ */
+struct recap_pool {
+  glob_t files;              /**< The pcap files */
+  atomic_size_t next_file;   /**< The index of the next file to decode */
+  _Atomic uint64_t bytes;    /**< Number of bytes read by the workers */
+  atomic_uint errors;        /**< Number of files that failed */
+  char *ifname;              /**< The interface name saved in the db */
+  pthread_mutex_t lock;      /**< The batch queue lock */
+  pthread_cond_t not_empty;  /**< Signalled when a batch is queued */
+  pthread_cond_t not_full;   /**< Signalled when a batch is dequeued */
+  UT_array *queue[RECAP_QUEUE_SIZE]; /**< The batch queue */
+  size_t head;               /**< The index of the first queued batch */
+  size_t count;              /**< Number of queued batches */
+  size_t running;            /**< Number of running workers */
+};
+
 void show_app_version(void) {
   fprintf(stdout, "edgesec-recap app version %s\n", EDGESEC_VERSION);
 }
@@ -93,11 +99,13 @@ void show_app_help(char *app_name) {
   fprintf(stdout, USAGE_STRING, basename(app_name));
   fprintf(stdout, DESCRIPTION_STRING);
   fprintf(stdout, "\nOptions:\n");
-  fprintf(stdout, "\t-p filename\t Path to the pcap file name.\n");
+  fprintf(stdout, "\t-p filename\t Path to the pcap file, directory or glob.\n");
   fprintf(stdout, "\t-f filename\t Path to the capture db or pipe.\n");
   fprintf(
       stdout,
       "\t-i interface\t Interface name to save to db or to capture from.\n");
+  fprintf(stdout, "\t-w workers\t Number of decoding workers when the pcap "
+                  "path is a directory or a glob (default: CPU count).\n");
   fprintf(stdout, "\t-t\t\t Use a single SQLITE transaction.\n");
   fprintf(stdout, "\t-n\t\t Capture from network stream.\n");
   fprintf(stdout, "\t-k\t\t Pipe to file.\n");
@@ -128,8 +136,10 @@ PRINTF_FORMAT(1, 2) void log_cmdline_error(const char *format, ...) {
 
 void process_app_options(int argc, char *argv[], uint8_t *verbosity,
                          char **pcap_path, char **out_path, char **ifname,
-                         bool *pipe, bool *capture, bool *transaction) {
+                         bool *pipe, bool *capture, bool *transaction,
+                         unsigned int *workers) {
   int opt;
+  long value;
 
   while ((opt = getopt(argc, argv, OPT_STRING)) != -1) {
     switch (opt) {
@@ -149,6 +159,12 @@ void process_app_options(int argc, char *argv[], uint8_t *verbosity,
       case 'i':
         *ifname = os_strdup(optarg);
         break;
+      case 'w':
+        if ((value = strtol(optarg, NULL, 10)) <= 0) {
+          log_cmdline_error("Invalid number of workers %s\n", optarg);
+        }
+        *workers = (unsigned int)value;
+        break;
       case 'n':
         *capture = true;
         break;
@@ -173,146 +189,21 @@ void process_app_options(int argc, char *argv[], uint8_t *verbosity,
   }
 }
 
-ssize_t read_pcap_stream_fd(struct recap_context *pctx, size_t len,
-                            char **data) {
-  if ((*data = os_malloc(len)) == NULL) {
-    log_errno("os_malloc");
-    return -1;
-  }
-
-  return (ssize_t)fread(*data, sizeof(char), len, pctx->pcap_fd);
-}
-
-ssize_t read_pcap(struct recap_context *pctx, size_t len) {
-  char *data = NULL;
-  ssize_t read_size = read_pcap_stream_fd(pctx, len, &data);
-  if (read_size < 0) {
-    log_error("read_pcap_stream_fd fail");
-    return -1;
-  }
-
-  pctx->total_size += read_size;
-
-  ssize_t current_size = read_size + pctx->data_size;
-
-  if (read_size > 0) {
-    char *reallocated_pcap_data = os_realloc(pctx->pcap_data, current_size);
-    if (reallocated_pcap_data == NULL) {
-      log_errno("os_realloc");
-      os_free(data);
-      // don't free `pctx->pcap_data`, since it might be realloc-ed by the next
-      // read_pcap() call
-      return -1;
-    }
-    pctx->pcap_data = reallocated_pcap_data;
-    os_memcpy(&pctx->pcap_data[pctx->data_size], data, read_size);
-    pctx->data_size = current_size;
-  }
-  os_free(data);
-
-  return read_size;
-}
-
-int process_file_header_state(struct recap_context *pctx) {
-  ssize_t pcap_header_size = (ssize_t)sizeof(struct pcap_file_header);
-
-  size_t len = (pcap_header_size > pctx->data_size)
-                   ? pcap_header_size - pctx->data_size
-                   : 0;
-
-  ssize_t read_size = read_pcap(pctx, len);
-  if (read_size < 0) {
-    log_error("read_pcap fail");
-    return -1;
-  }
-
-  if (pctx->data_size >= pcap_header_size) {
-    log_trace("Received pcap header:");
-    os_memcpy(&pctx->pcap_header, pctx->pcap_data, pcap_header_size);
-
-    log_trace("\tpcap_file_header magic = %x", pctx->pcap_header.magic);
-    log_trace("\tpcap_file_header version_major = %d",
-              pctx->pcap_header.version_major);
-    log_trace("\tpcap_file_header version_minor = %d",
-              pctx->pcap_header.version_minor);
-    log_trace("\tpcap_file_header thiszone = %" PRId32,
-              pctx->pcap_header.thiszone);
-    log_trace("\tpcap_file_header snaplen = %" PRIu32,
-              pctx->pcap_header.snaplen);
-    log_trace("\tpcap_file_header linktype = %" PRIu32,
-              pctx->pcap_header.linktype);
-    pctx->data_size = 0;
-
-    if (pctx->pcap_header.magic != PCAP_MAGIC_VALUE) {
-      log_error(
-          "Not a pcap file (magic number error), perhaps a pcapng file!!!");
-      return -1;
-    }
-    pctx->state = PCAP_FILE_STATE_READ_PKT_HEADER;
-  } else if (read_size == 0) {
-    log_trace("No data received");
-    pctx->state = PCAP_FILE_STATE_FIN;
-  }
-
-  return 0;
-}
-
-int process_pkt_header_state(struct recap_context *pctx) {
-  ssize_t read_size = 0;
-  ssize_t pkt_header_size = (ssize_t)sizeof(struct pcap_pkthdr32);
-
-  size_t len = (pkt_header_size > pctx->data_size)
-                   ? pkt_header_size - pctx->data_size
-                   : 0;
-
-  if ((read_size = read_pcap(pctx, len)) < 0) {
-    log_error("read_pcap fail");
-    return -1;
-  }
-
-  if (pctx->data_size >= pkt_header_size) {
-    log_trace("Received pkt header:");
-    os_memcpy(&pctx->pkt_header, pctx->pcap_data, pkt_header_size);
-    log_trace("\tpcap_pkthdr ts_sec = %" PRIu32, pctx->pkt_header.ts_sec);
-    log_trace("\tpcap_pkthdr ts_usec = %" PRIu32, pctx->pkt_header.ts_usec);
-    log_trace("\tpcap_pkthdr caplen = %" PRIu32, pctx->pkt_header.caplen);
-    log_trace("\tpcap_pkthdr len = %" PRIu32, pctx->pkt_header.len);
-
-    if (pctx->pkt_header.caplen > pctx->pkt_header.len) {
-      log_error("caplen > len");
-      return -1;
-    }
-
-    pctx->data_size = 0;
-    pctx->state = PCAP_FILE_STATE_READ_PACKET;
-  } else if (read_size == 0) {
-    log_trace("No data received");
-    pctx->state = PCAP_FILE_STATE_FIN;
-  }
-
-  return 0;
-}
-
-void get_packet_header(struct recap_context *pctx, struct pcap_pkthdr *header) {
-  header->ts.tv_sec = pctx->pkt_header.ts_sec;
-  header->ts.tv_usec = pctx->pkt_header.ts_usec;
-  header->caplen = pctx->pkt_header.caplen;
-  header->len = pctx->pkt_header.len;
-}
-
-int save_sqlite_tuple_packet(sqlite3 *db, struct tuple_packet *p) {
-  if (save_packet_statement(db, p) < 0) {
-    log_error("save_packet_statement fail");
+int save_sqlite_tuple_packet(struct sqlite_header_writer *writer,
+                             struct tuple_packet *p) {
+  if (save_sqlite_header_packet(writer, p) < 0) {
+    log_error("save_sqlite_header_packet fail");
     return -1;
   }
 
   return 0;
 }
 
-int save_sqlite_packet(sqlite3 *db, UT_array *packets) {
+int save_sqlite_packet(struct sqlite_header_writer *writer,
+                       UT_array *packets) {
   struct tuple_packet *p = NULL;
   while ((p = (struct tuple_packet *)utarray_next(packets, p)) != NULL) {
-    if (save_sqlite_tuple_packet(db, p) < 0) {
+    if (save_sqlite_tuple_packet(writer, p) < 0) {
       log_error("save_sqlite_tuple_packet fail");
       return -1;
     }
@@ -326,12 +217,12 @@ static const UT_icd tp_list_icd = {sizeof(struct tuple_packet), NULL, NULL,
 
 int save_packet_array(struct recap_context *pctx, UT_array *packets) {
   if (pctx->pipe) {
-    if (pipe_protobuf_packets(pctx->out_path, &pctx->pipe_fd, packets) < 0) {
+    if (pipe_protobuf_packets(pctx->pipe_writer, packets) < 0) {
       log_error("pipe_protobuf_packets fail");
       return -1;
     }
   } else {
-    if (save_sqlite_packet(pctx->db, packets) < 0) {
+    if (save_sqlite_packet(pctx->writer, packets) < 0) {
       log_error("save_sqlite_packet fail");
       return -1;
     }
@@ -342,12 +233,12 @@ int save_packet_array(struct recap_context *pctx, UT_array *packets) {
 
 int save_tuple_packet(struct recap_context *pctx, struct tuple_packet *p) {
   if (pctx->pipe) {
-    if (pipe_protobuf_tuple_packet(pctx->out_path, &pctx->pipe_fd, p) < 0) {
+    if (pipe_protobuf_tuple_packet(pctx->pipe_writer, p) < 0) {
       log_error("pipe_protobuf_tuple_packet fail");
       return -1;
     }
   } else {
-    if (save_sqlite_tuple_packet(pctx->db, p) < 0) {
+    if (save_sqlite_tuple_packet(pctx->writer, p) < 0) {
       log_error("save_sqlite_tuple_packet fail");
       return -1;
     }
@@ -362,7 +253,8 @@ int save_decoded_packet(const char *ltype, const struct pcap_pkthdr *header,
   UT_array *packets = NULL;
   utarray_new(packets, &tp_list_icd);
 
-  int npackets = extract_packets(ltype, header, packet, ifname, packets);
+  int npackets = extract_packets(ltype, header, packet, ifname,
+                                 PACKET_DECODE_ALL, packets);
   if (npackets < 0) {
     log_error("extract_packets fail");
     utarray_free(packets);
@@ -380,15 +272,12 @@ int save_decoded_packet(const char *ltype, const struct pcap_pkthdr *header,
   return npackets;
 }
 
-int save_raw_packet(struct recap_context *pctx) {
-  const char *ltype = pcap_datalink_val_to_name(pctx->pcap_header.linktype);
-  uint8_t *packet = (uint8_t *)pctx->pcap_data;
+int save_raw_packet(struct recap_context *pctx,
+                    const struct pcap_pkthdr *header, const uint8_t *packet) {
+  const char *ltype =
+      pcap_datalink_val_to_name((int)pctx->reader->header.linktype);
 
-  struct pcap_pkthdr header;
-  get_packet_header(pctx, &header);
-
-  int npackets =
-      save_decoded_packet(ltype, &header, packet, pctx->ifname, pctx);
+  int npackets = save_decoded_packet(ltype, header, packet, pctx->ifname, pctx);
   if (npackets < 0) {
     log_error("save_decoded_packet fail");
     return -1;
@@ -399,97 +288,285 @@ int save_raw_packet(struct recap_context *pctx) {
   return 0;
 }
 
-int process_pkt_read_state(struct recap_context *pctx) {
-  size_t len = ((ssize_t)pctx->pkt_header.caplen > pctx->data_size)
-                   ? pctx->pkt_header.caplen - pctx->data_size
-                   : 0;
+int process_file_stream(const char *pcap_path, struct recap_context *pctx) {
+  struct pcap_pkthdr header;
+  const uint8_t *packet = NULL;
+  int ret;
 
-  ssize_t read_size = read_pcap(pctx, len);
-  if (read_size < 0) {
-    log_error("read_pcap fail");
+  // Regular files are memory mapped, stdin is read into a fixed buffer
+  if ((pctx->reader = open_pcap_reader(pcap_path)) == NULL) {
+    log_error("open_pcap_reader fail");
     return -1;
   }
 
-  if (pctx->data_size >= (ssize_t)pctx->pkt_header.caplen) {
-    log_trace("Received pkt data");
-
-    if (save_raw_packet(pctx) < 0) {
-      log_error("process_packet fail");
+  while ((ret = next_pcap_reader(pctx->reader, &header, &packet)) > 0) {
+    if (save_raw_packet(pctx, &header, packet) < 0) {
+      log_error("save_raw_packet fail");
       return -1;
     }
+    pctx->total_size = pctx->reader->offset;
+  }
+
+  pctx->total_size = pctx->reader->offset;
 
-    pctx->data_size = 0;
-    pctx->state = PCAP_FILE_STATE_READ_PKT_HEADER;
-  } else if (read_size == 0) {
-    log_trace("No data received");
-    pctx->state = PCAP_FILE_STATE_FIN;
+  if (ret < 0) {
+    log_error("next_pcap_reader fail");
+    return -1;
   }
 
   return 0;
 }
 
-int process_file_stream_state(struct recap_context *pctx) {
-  log_trace("Processing file stream %" PRIu64 " bytes", pctx->total_size);
+bool is_multi_file_path(const char *pcap_path) {
+  struct stat sb;
 
-  switch (pctx->state) {
-    case PCAP_FILE_STATE_INIT:
-      if ((pctx->pcap_data = os_malloc(sizeof(char))) == NULL) {
-        log_errno("os_malloc");
-        return -1;
-      }
-      pctx->npackets = 0;
-      pctx->total_size = 0;
-      pctx->data_size = 0;
-      pctx->state = PCAP_FILE_STATE_READ_PCAP_HEADER;
-      return 1;
-    case PCAP_FILE_STATE_READ_PCAP_HEADER:
-      if (process_file_header_state(pctx) < 0) {
-        log_error("process_file_header_state fail");
-        return -1;
-      }
-      return 1;
-    case PCAP_FILE_STATE_READ_PKT_HEADER:
-      if (process_pkt_header_state(pctx) < 0) {
-        log_error("process_pkt_header_state fail");
-        return -1;
-      }
-      return 1;
-    case PCAP_FILE_STATE_READ_PACKET:
-      if (process_pkt_read_state(pctx) < 0) {
-        log_error("process_pkt_read_state fail");
-        return -1;
-      }
-      return 1;
-    case PCAP_FILE_STATE_FIN:
-      return 0;
-    default:
-      log_trace("Unknown state");
-      return -1;
+  if (pcap_path == NULL) {
+    return false;
+  }
+
+  if (strpbrk(pcap_path, "*?[") != NULL) {
+    return true;
   }
+
+  return (stat(pcap_path, &sb) == 0 && S_ISDIR(sb.st_mode));
 }
 
-int process_file_stream(const char *pcap_path, struct recap_context *pctx) {
-  if (pcap_path != NULL) {
-    if ((pctx->pcap_fd = fopen(pcap_path, "rb")) == NULL) {
-      log_errno("fopen failed for pcap file %s", pcap_path);
+int glob_pcap_files(const char *pcap_path, glob_t *files) {
+  struct stat sb;
+  char *pattern = NULL;
+  int ret;
+
+  if (stat(pcap_path, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+    if ((pattern = concat_paths(pcap_path, RECAP_DIR_PATTERN)) == NULL) {
+      log_error("concat_paths fail");
       return -1;
     }
-  } else {
-    pctx->pcap_fd = stdin;
+  } else if ((pattern = os_strdup(pcap_path)) == NULL) {
+    log_errno("os_strdup");
+    return -1;
+  }
+
+  ret = glob(pattern, 0, NULL, files);
+  if (ret == GLOB_NOMATCH) {
+    log_error("No pcap files match %s", pattern);
+  } else if (ret != 0) {
+    log_error("glob fail for %s", pattern);
+  }
+
+  os_free(pattern);
+  return (ret == 0) ? 0 : -1;
+}
+
+static void push_recap_pool(struct recap_pool *pool, UT_array *packets) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->count == RECAP_QUEUE_SIZE) {
+    pthread_cond_wait(&pool->not_full, &pool->lock);
   }
 
+  pool->queue[(pool->head + pool->count) % RECAP_QUEUE_SIZE] = packets;
+  pool->count++;
+  pthread_cond_signal(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/* Returns NULL when the queue is empty and all the workers have ended */
+static UT_array *pop_recap_pool(struct recap_pool *pool) {
+  UT_array *packets = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->count && pool->running) {
+    pthread_cond_wait(&pool->not_empty, &pool->lock);
+  }
+
+  if (pool->count) {
+    packets = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % RECAP_QUEUE_SIZE;
+    pool->count--;
+    pthread_cond_signal(&pool->not_full);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return packets;
+}
+
+static int decode_recap_file(struct recap_pool *pool, const char *path) {
+  struct pcap_reader *reader = NULL;
+  struct pcap_pkthdr header;
+  const uint8_t *packet = NULL;
+  const char *ltype = NULL;
+  UT_array *packets = NULL;
   int ret;
-  while ((ret = process_file_stream_state(pctx) > 0)) {
+
+  if ((reader = open_pcap_reader(path)) == NULL) {
+    log_error("open_pcap_reader fail for %s", path);
+    return -1;
+  }
+
+  ltype = pcap_datalink_val_to_name((int)reader->header.linktype);
+  utarray_new(packets, &tp_list_icd);
+
+  while ((ret = next_pcap_reader(reader, &header, &packet)) > 0) {
+    if (extract_packets(ltype, &header, packet, pool->ifname,
+                        PACKET_DECODE_ALL, packets) < 0) {
+      log_error("extract_packets fail for %s", path);
+      continue;
+    }
+
+    // The writer takes the ownership of the full batches
+    if (utarray_len(packets) >= RECAP_BATCH_SIZE) {
+      push_recap_pool(pool, packets);
+      utarray_new(packets, &tp_list_icd);
+    }
   }
 
+  if (utarray_len(packets)) {
+    push_recap_pool(pool, packets);
+  } else {
+    utarray_free(packets);
+  }
+
+  atomic_fetch_add(&pool->bytes, reader->offset);
+  close_pcap_reader(reader);
+
   if (ret < 0) {
-    log_error("process_file_stream_state fail");
+    log_error("next_pcap_reader fail for %s", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void *recap_worker_thread(void *arg) {
+  struct recap_pool *pool = (struct recap_pool *)arg;
+  size_t idx;
+
+  while ((idx = atomic_fetch_add(&pool->next_file, 1)) <
+         pool->files.gl_pathc) {
+    log_debug("Decoding %s", pool->files.gl_pathv[idx]);
+    if (decode_recap_file(pool, pool->files.gl_pathv[idx]) < 0) {
+      atomic_fetch_add(&pool->errors, 1);
+    }
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->running--;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static int save_recap_batch(struct recap_context *pctx, UT_array *packets) {
+  // Outside the single transaction mode every batch is a transaction
+  bool batch_transaction =
+      (pctx->db != NULL && sqlite3_get_autocommit(pctx->db));
+
+  if (batch_transaction &&
+      execute_sqlite_query(pctx->db, "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on db %s", pctx->out_path);
+    return -1;
+  }
+
+  if (save_packet_array(pctx, packets) < 0) {
+    log_error("save_packet_array fail");
+    // A partially saved batch is never committed
+    if (batch_transaction) {
+      execute_sqlite_query(pctx->db, "ROLLBACK TRANSACTION");
+    }
+    return -1;
+  }
+
+  if (batch_transaction &&
+      execute_sqlite_query(pctx->db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit packets to database %s", pctx->out_path);
+    execute_sqlite_query(pctx->db, "ROLLBACK TRANSACTION");
     return -1;
   }
 
   return 0;
 }
 
+int process_file_pool(const char *pcap_path, unsigned int workers,
+                      struct recap_context *pctx) {
+  struct recap_pool pool = {.ifname = pctx->ifname};
+  pthread_t *ids = NULL;
+  UT_array *packets = NULL;
+  unsigned int started = 0;
+  int ret = 0;
+
+  if (glob_pcap_files(pcap_path, &pool.files) < 0) {
+    log_error("glob_pcap_files fail");
+    return -1;
+  }
+
+  if (workers > pool.files.gl_pathc) {
+    workers = (unsigned int)pool.files.gl_pathc;
+  }
+
+  fprintf(stdout, "Decoding %zu pcap files with %u workers\n",
+          pool.files.gl_pathc, workers);
+
+  if ((ids = os_calloc(workers, sizeof(pthread_t))) == NULL) {
+    log_errno("os_calloc");
+    globfree(&pool.files);
+    return -1;
+  }
+
+  atomic_init(&pool.next_file, 0);
+  atomic_init(&pool.bytes, 0);
+  atomic_init(&pool.errors, 0);
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.not_empty, NULL);
+  pthread_cond_init(&pool.not_full, NULL);
+
+  pthread_mutex_lock(&pool.lock);
+  for (; started < workers; started++) {
+    if (pthread_create(&ids[started], NULL, recap_worker_thread, &pool) != 0) {
+      log_errno("pthread_create");
+      break;
+    }
+    pool.running++;
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  if (!started) {
+    ret = -1;
+  }
+
+  // A single writer saves the batches of all the workers
+  while ((packets = pop_recap_pool(&pool)) != NULL) {
+    if (!ret && save_recap_batch(pctx, packets) < 0) {
+      log_error("save_recap_batch fail");
+      ret = -1;
+    }
+
+    if (!ret) {
+      pctx->npackets += utarray_len(packets);
+    }
+    utarray_free(packets);
+  }
+
+  for (unsigned int idx = 0; idx < started; idx++) {
+    if (pthread_join(ids[idx], NULL) != 0) {
+      log_errno("pthread_join");
+    }
+  }
+
+  pctx->total_size = atomic_load(&pool.bytes);
+  if (atomic_load(&pool.errors)) {
+    log_error("Failed to decode %u pcap files", atomic_load(&pool.errors));
+    ret = -1;
+  }
+
+  pthread_cond_destroy(&pool.not_full);
+  pthread_cond_destroy(&pool.not_empty);
+  pthread_mutex_destroy(&pool.lock);
+  globfree(&pool.files);
+  os_free(ids);
+
+  return ret;
+}
+
 void add_packet_queue(UT_array *packets, struct packet_queue *queue) {
   struct tuple_packet *p = NULL;
 
@@ -519,7 +596,8 @@ void pcap_callback(const void *ctx, const void *pcap_ctx, char *ltype,
   UT_array *packets = NULL;
   utarray_new(packets, &tp_list_icd);
 
-  int npackets = extract_packets(ltype, header, packet, pctx->ifname, packets);
+  int npackets = extract_packets(ltype, header, packet, pctx->ifname,
+                                 PACKET_DECODE_ALL, packets);
 
   if (npackets > 0) {
     add_packet_queue(packets, pctx->pq);
@@ -570,6 +648,8 @@ void eloop_tout_header_handler(void *eloop_ctx, void *user_ctx) {
       if (execute_sqlite_query(pctx->db, "COMMIT TRANSACTION") < 0) {
         log_error("Failed to commit packets to database %s", pctx->out_path);
       }
+    } else if (flush_protobuf_writer(pctx->pipe_writer) < 0) {
+      log_error("flush_protobuf_writer fail");
     }
   }
 
@@ -590,7 +670,7 @@ int process_pcap_capture(struct recap_context *pctx) {
     log_error("edge_eloop_init fail");
     goto process_pcap_capture_fail;
   }
-  if (run_pcap(pctx->ifname, false, false, 10, NULL, true, pcap_callback,
+  if (run_pcap(pctx->ifname, false, false, 10, 0, NULL, true, pcap_callback,
                (void *)pctx, &pc) < 0) {
     log_error("run_pcap fail");
     goto process_pcap_capture_fail;
@@ -637,19 +717,24 @@ int main(int argc, char *argv[]) {
   char *pcap_path = NULL;
   bool capture = false;
   bool transaction = false;
+  bool multi_file = false;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned int workers = (cpus > 0) ? (unsigned int)cpus : 1;
+  struct os_reltime start, end, diff;
   struct recap_context pctx = {.db = NULL,
-                               .pipe_fd = -1,
-                               .pcap_fd = NULL,
+                               .writer = NULL,
+                               .pipe_writer = NULL,
+                               .reader = NULL,
                                .pq = NULL,
                                .ifname = NULL,
                                .out_path = NULL,
-                               .state = PCAP_FILE_STATE_INIT,
                                .total_size = 0,
                                .npackets = 0,
                                .pipe = false};
 
   process_app_options(argc, argv, &verbosity, &pcap_path, &pctx.out_path,
-                      &pctx.ifname, &pctx.pipe, &capture, &transaction);
+                      &pctx.ifname, &pctx.pipe, &capture, &transaction,
+                      &workers);
   if (verbosity > MAX_LOG_LEVELS) {
     level = 0;
   } else if (!verbosity) {
@@ -684,6 +769,21 @@ int main(int argc, char *argv[]) {
       goto cleanup;
     }
 
+    // Continue after the packet ids already in the db
+    uint64_t last_id;
+    if (get_sqlite_header_last_id(pctx.db, &last_id) < 0) {
+      fprintf(stderr, "get_sqlite_header_last_id fail\n");
+      goto cleanup;
+    }
+    seed_extract_packet_ids(last_id);
+
+    // Transactions are managed by recap, the writer only caches the
+    // prepared insert statements
+    if ((pctx.writer = init_sqlite_header_writer(pctx.db, 0)) == NULL) {
+      fprintf(stderr, "init_sqlite_header_writer fail\n");
+      goto cleanup;
+    }
+
     // Begin transaction is used by default in capture
     if (transaction && !capture) {
       fprintf(stdout, "Using transaction mode\n");
@@ -702,9 +802,29 @@ int main(int argc, char *argv[]) {
     }
 
     fprintf(stdout, "Created pipe file at %s\n", pctx.out_path);
+
+    if ((pctx.pipe_writer = init_protobuf_writer(
+             pctx.out_path, PROTOBUF_WRITER_BUFFER_SIZE)) == NULL) {
+      fprintf(stderr, "init_protobuf_writer fail");
+      goto cleanup;
+    }
+
+    // A file is piped without losing messages, a capture doesn't block
+    pctx.pipe_writer->wait_timeout = (capture) ? 0 : -1;
   }
 
+  os_get_reltime(&start);
+
   if (!capture) {
+    multi_file = is_multi_file_path(pcap_path);
+  }
+
+  if (multi_file) {
+    if (process_file_pool(pcap_path, workers, &pctx) < 0) {
+      fprintf(stderr, "process_file_pool fail");
+      goto cleanup;
+    }
+  } else if (!capture) {
     if (process_file_stream(pcap_path, &pctx) < 0) {
       fprintf(stderr, "process_file_stream fail");
       goto cleanup;
@@ -723,6 +843,30 @@ int main(int argc, char *argv[]) {
   }
   fprintf(stdout, "Processed packets = %" PRIu64 "\n", pctx.npackets);
 
+  if (pctx.pipe_writer != NULL) {
+    int ret = drain_protobuf_writer(pctx.pipe_writer,
+                                    (capture) ? RECAP_DRAIN_TIMEOUT : -1);
+    if (ret < 0) {
+      fprintf(stderr, "drain_protobuf_writer fail");
+    } else if (ret > 0) {
+      fprintf(stderr, "Timeout draining the pipe %s\n", pctx.out_path);
+    }
+    fprintf(stdout,
+            "Piped protobuf messages = %" PRIu64 ", bytes = %" PRIu64
+            ", dropped = %" PRIu64 ", unwritten bytes = %zu\n",
+            pctx.pipe_writer->messages, pctx.pipe_writer->bytes,
+            pctx.pipe_writer->dropped,
+            pctx.pipe_writer->end - pctx.pipe_writer->start);
+  }
+
+  os_get_reltime(&end);
+  os_reltime_sub(&end, &start, &diff);
+  if (!capture && (diff.sec || diff.usec)) {
+    double elapsed = (double)diff.sec + (double)diff.usec / 1000000.0;
+    fprintf(stdout, "Throughput = %.0f packets/s, %.0f bytes/s\n",
+            (double)pctx.npackets / elapsed, (double)pctx.total_size / elapsed);
+  }
+
   if (pctx.db != NULL && !capture) {
     // If AUTOCOMMIT is disabled, we need to manually make a COMMIT
     if (sqlite3_get_autocommit(pctx.db) == 0) {
@@ -739,14 +883,13 @@ int main(int argc, char *argv[]) {
   exit_code = EXIT_SUCCESS;
 
 cleanup:
-  if (pcap_path != NULL) {
-    os_free(pcap_path);
-    fclose(pctx.pcap_fd);
-  }
-
-  os_free(pctx.pcap_data);
+  os_free(pcap_path);
+  close_pcap_reader(pctx.reader);
 
+  free_protobuf_writer(pctx.pipe_writer);
   os_free(pctx.out_path);
+  // the prepared statements must be finalized before closing the db
+  free_sqlite_header_writer(pctx.writer);
   // sqlite3 close on a NULL ptr is fine
   // any uncommited transactions will be automatically rolled-back on close
   sqlite3_close(pctx.db);
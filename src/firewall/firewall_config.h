@@ -40,6 +40,8 @@ struct fwctx {
   char *nat_interface;
   bool exec_firewall;
   char *firewall_bin_path; /**< The firewall binary path string */
+  bool batch;              /**< Defers the firewall commits to fw_end_batch */
+  bool batch_changed;      /**< The firewall changed during the batch */
 #ifdef WITH_UCI_SERVICE
   struct uctx *ctx;
 #else
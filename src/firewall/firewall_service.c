@@ -179,6 +179,48 @@ struct fwctx *fw_init_context(hmap_if_conn *if_mapper,
   return fw_ctx;
 }
 
+static int commit_firewall(struct fwctx *context) {
+  // The batched changes are committed by fw_end_batch
+  if (context->batch) {
+    context->batch_changed = true;
+    return 0;
+  }
+
+#ifdef WITH_UCI_SERVICE
+  if (uwrt_commit_section(context->ctx, "firewall") < 0) {
+    log_error("uwrt_commit_section fail");
+    return -1;
+  }
+#endif
+
+  if (run_firewall(context) < 0) {
+    log_error("run_firewall fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+void fw_begin_batch(struct fwctx *context) {
+  if (context != NULL) {
+    context->batch = true;
+  }
+}
+
+int fw_end_batch(struct fwctx *context) {
+  if (context == NULL || !context->batch) {
+    return 0;
+  }
+
+  context->batch = false;
+  if (!context->batch_changed) {
+    return 0;
+  }
+
+  context->batch_changed = false;
+  return commit_firewall(context);
+}
+
 int fw_add_nat(struct fwctx *context, char *ip_addr) {
 #ifdef WITH_UCI_SERVICE
   char brname[IF_NAMESIZE];
@@ -195,10 +237,6 @@ int fw_add_nat(struct fwctx *context, char *ip_addr) {
     return -1;
   }
 
-  if (uwrt_commit_section(context->ctx, "firewall") < 0) {
-    log_error("uwrt_commit_section fail");
-    return -1;
-  }
 #else
   char ifname[IF_NAMESIZE];
 
@@ -215,8 +253,8 @@ int fw_add_nat(struct fwctx *context, char *ip_addr) {
   }
 #endif
 
-  if (run_firewall(context) < 0) {
-    log_error("run_firewall fail");
+  if (commit_firewall(context) < 0) {
+    log_error("commit_firewall fail");
     return -1;
   }
 
@@ -231,10 +269,6 @@ int fw_remove_nat(struct fwctx *context, char *ip_addr) {
     return -1;
   }
 
-  if (uwrt_commit_section(context->ctx, "firewall") < 0) {
-    log_error("uwrt_commit_section fail");
-    return -1;
-  }
 #else
   char ifname[IF_NAMESIZE];
 
@@ -251,8 +285,8 @@ int fw_remove_nat(struct fwctx *context, char *ip_addr) {
   }
 #endif
 
-  if (run_firewall(context) < 0) {
-    log_error("run_firewall fail");
+  if (commit_firewall(context) < 0) {
+    log_error("commit_firewall fail");
     return -1;
   }
 
@@ -284,10 +318,6 @@ int fw_add_bridge(struct fwctx *context, char *ip_addr_left,
     return -1;
   }
 
-  if (uwrt_commit_section(context->ctx, "firewall") < 0) {
-    log_error("uwrt_commit_section fail");
-    return -1;
-  }
 #else
   char ifname_left[IF_NAMESIZE], ifname_right[IF_NAMESIZE];
 
@@ -312,8 +342,8 @@ int fw_add_bridge(struct fwctx *context, char *ip_addr_left,
   }
 #endif
 
-  if (run_firewall(context) < 0) {
-    log_error("run_firewall fail");
+  if (commit_firewall(context) < 0) {
+    log_error("commit_firewall fail");
     return -1;
   }
 
@@ -330,10 +360,6 @@ int fw_remove_bridge(struct fwctx *context, char *ip_addr_left,
     return -1;
   }
 
-  if (uwrt_commit_section(context->ctx, "firewall") < 0) {
-    log_error("uwrt_commit_section fail");
-    return -1;
-  }
 #else
   char ifname_left[IF_NAMESIZE], ifname_right[IF_NAMESIZE];
 
@@ -358,8 +384,8 @@ int fw_remove_bridge(struct fwctx *context, char *ip_addr_left,
   }
 #endif
 
-  if (run_firewall(context) < 0) {
-    log_error("run_firewall fail");
+  if (commit_firewall(context) < 0) {
+    log_error("commit_firewall fail");
     return -1;
   }
 
@@ -49,6 +49,24 @@ struct fwctx *fw_init_context(hmap_if_conn *if_mapper,
  */
 void fw_free_context(struct fwctx *context);
 
+/**
+ * @brief Starts a batch of firewall changes
+ *
+ * The firewall changes are committed and the firewall is reloaded once by
+ * fw_end_batch(), instead of after every change.
+ *
+ * @param context The firewall context
+ */
+void fw_begin_batch(struct fwctx *context);
+
+/**
+ * @brief Ends a batch of firewall changes and commits them
+ *
+ * @param context The firewall context
+ * @return 0 on success, -1 on failure
+ */
+int fw_end_batch(struct fwctx *context);
+
 /**
  * @brief Adds NAT rule to an IP
  *
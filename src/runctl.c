@@ -141,7 +141,7 @@ int create_mac_mapper(struct supervisor_context *ctx) {
       }
 #endif
 
-      if (!put_mac_mapper(&ctx->mac_mapper, *p)) {
+      if (!put_mac_mapper(&ctx->mac_mapper, &ctx->ip_mapper, *p)) {
         log_error("put_mac_mapper fail");
         utarray_free(mac_conn_arr);
         return -1;
@@ -578,6 +578,7 @@ run_engine_fail:
   hmap_str_keychar_free(&context->hmap_bin_paths);
   fw_free_context(context->fw_ctx);
   free_mac_mapper(&context->mac_mapper);
+  free_ip_mapper(&context->ip_mapper);
   free_if_mapper(&context->if_mapper);
   free_vlan_mapper(&context->vlan_mapper);
   free_bridge_list(context->bridge_list);
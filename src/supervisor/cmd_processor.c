@@ -14,10 +14,13 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <unistd.h>
 
 #include "cmd_processor.h"
+#include "cmd_reply.h"
 #include "mac_mapper.h"
 #include "network_commands.h"
 #ifdef WITH_CRYPTO_SERVICE
@@ -60,6 +63,77 @@ bool process_domain_buffer(char *domain_buffer, size_t domain_buffer_len,
   return true;
 }
 
+// The arguments point into the command buffer, so they are not copied
+static const UT_icd cmd_arg_icd = {sizeof(char *), NULL, NULL, NULL};
+
+int reserve_cmd_buffer(struct cmd_buffer *cmd_buf, size_t len) {
+  size_t size = (cmd_buf->size) ? cmd_buf->size : MIN_CMD_BUFFER_SIZE;
+  char *buf;
+
+  if (cmd_buf->args == NULL) {
+    utarray_new(cmd_buf->args, &cmd_arg_icd);
+  }
+
+  // Leaves room for the NUL terminator
+  if (len < cmd_buf->size) {
+    return 0;
+  }
+
+  while (size <= len) {
+    size *= 2;
+  }
+
+  // The previous command is not needed, so the buffer isn't copied
+  if ((buf = os_malloc(size)) == NULL) {
+    log_errno("os_malloc");
+    return -1;
+  }
+
+  os_free(cmd_buf->buf);
+  cmd_buf->buf = buf;
+  cmd_buf->size = size;
+  return 0;
+}
+
+static ssize_t split_cmd_line(char *line, char sep, UT_array *args) {
+  char *start, *end;
+
+  utarray_clear(args);
+
+  // remove the end new line character
+  start = rtrim(line, NULL);
+  while ((end = strchr(start, sep)) != NULL) {
+    *end = '\0';
+    utarray_push_back(args, &start);
+    start = end + 1;
+  }
+  utarray_push_back(args, &start);
+
+  return (ssize_t)utarray_len(args);
+}
+
+ssize_t split_cmd_buffer(struct cmd_buffer *cmd_buf, size_t len, char sep) {
+  if (cmd_buf == NULL || cmd_buf->args == NULL || !len ||
+      len >= cmd_buf->size) {
+    return -1;
+  }
+
+  cmd_buf->buf[len] = '\0';
+  return split_cmd_line(cmd_buf->buf, sep, cmd_buf->args);
+}
+
+void free_cmd_buffer(struct cmd_buffer *cmd_buf) {
+  if (cmd_buf != NULL) {
+    os_free(cmd_buf->buf);
+    if (cmd_buf->args != NULL) {
+      utarray_free(cmd_buf->args);
+    }
+    cmd_buf->buf = NULL;
+    cmd_buf->size = 0;
+    cmd_buf->args = NULL;
+  }
+}
+
 int write_newline_socket_data(int sock, char *data,
                               const struct client_address *client_addr) {
   char *msg;
@@ -101,6 +175,35 @@ ssize_t process_subscribe_events_cmd(int sock,
   return write_socket_data(sock, OK_REPLY, strlen(OK_REPLY), client_addr);
 }
 
+ssize_t process_get_capture_stats_cmd(int sock,
+                                      const struct client_address *client_addr,
+                                      struct supervisor_context *context,
+                                      UT_array *cmd_arr) {
+  char **ptr = (char **)utarray_next(cmd_arr, NULL);
+  char *ifname = NULL;
+  char *reply = NULL;
+  ssize_t ret;
+
+  // Optional interface name
+  ptr = (char **)utarray_next(cmd_arr, ptr);
+  if (ptr != NULL && *ptr != NULL) {
+    ifname = *ptr;
+  }
+
+  if (get_capture_stats_cmd(context, ifname, &reply) < 0) {
+    log_error("get_capture_stats_cmd fail");
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
+
+  if (reply == NULL) {
+    return write_socket_data(sock, OK_REPLY, strlen(OK_REPLY), client_addr);
+  }
+
+  ret = write_socket_data(sock, reply, strlen(reply), client_addr);
+  os_free(reply);
+  return ret;
+}
+
 ssize_t process_accept_mac_cmd(int sock,
                                const struct client_address *client_addr,
                                struct supervisor_context *context,
@@ -275,63 +378,76 @@ ssize_t process_get_map_cmd(int sock, const struct client_address *client_addr,
   return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
 }
 
+struct mac_conn_reply {
+  struct cmd_reply reply;
+  int ret;
+};
+
+static bool append_mac_conn_reply(const uint8_t mac_addr[ETHER_ADDR_LEN],
+                                  const struct mac_conn_info *info,
+                                  void *args) {
+  struct mac_conn_reply *conn_reply = (struct mac_conn_reply *)args;
+
+  conn_reply->ret = append_cmd_reply(
+      &conn_reply->reply,
+      "%s,%02x:%02x:%02x:%02x:%02x:%02x,%s,%s,%d,%d,%s,%s,%d,%" PRIu64
+      ",%d\n",
+      (info->allow_connection) ? "a" : "d", MAC2STR(mac_addr), info->ip_addr,
+      info->ip_sec_addr, info->vlanid, (info->nat) ? 1 : 0, info->label,
+      info->id, (info->pass_len) ? 1 : 0, info->join_timestamp,
+      (int)info->status);
+
+  return conn_reply->ret > 0;
+}
+
+static ssize_t write_cmd_reply(int sock,
+                               const struct client_address *client_addr,
+                               struct cmd_reply *reply) {
+  ssize_t bytes_sent;
+
+  if (reply->buf == NULL) {
+    return write_socket_data(sock, OK_REPLY, strlen(OK_REPLY), client_addr);
+  }
+
+  bytes_sent = write_socket_data(sock, reply->buf, reply->len, client_addr);
+  free_cmd_reply(reply);
+  return bytes_sent;
+}
+
 ssize_t process_get_all_cmd(int sock, const struct client_address *client_addr,
                             struct supervisor_context *context,
                             UT_array *cmd_arr) {
-  (void)cmd_arr; /* unused */
-
-  char temp[255];
-  struct mac_conn *mac_list = NULL;
-  int mac_list_len = get_mac_list(&context->mac_mapper, &mac_list);
-  int total = 0;
-  ssize_t bytes_sent;
+  char **ptr = (char **)utarray_next(cmd_arr, NULL);
+  struct mac_conn_reply conn_reply = {.ret = 1};
+  size_t offset;
+  ssize_t next;
 
   log_trace("GET_ALL");
 
-  if (mac_list != NULL) {
-    char *reply_buf = os_malloc(1);
-    if (reply_buf == NULL) {
-      log_errno("malloc");
-      os_free(mac_list);
-      return -1;
-    }
-    reply_buf[0] = '\0';
-
-    for (int count = 0; count < mac_list_len; count++) {
-      struct mac_conn el = mac_list[count];
-      int line_size = snprintf(
-          temp, 255,
-          "%s,%02x:%02x:%02x:%02x:%02x:%02x,%s,%s,%d,%d,%s,%s,%d,%" PRIu64
-          ",%d\n",
-          (el.info.allow_connection) ? "a" : "d", MAC2STR(el.mac_addr),
-          el.info.ip_addr, el.info.ip_sec_addr, el.info.vlanid,
-          (el.info.nat) ? 1 : 0, el.info.label, el.info.id,
-          (el.info.pass_len) ? 1 : 0, el.info.join_timestamp,
-          (int)el.info.status);
-      total += line_size + 1;
-      char *expanded_reply_buf = os_realloc(reply_buf, total);
-      if (expanded_reply_buf == NULL) {
-        log_errno("realloc: failed to re-allocate %d bytes", total);
-        os_free(mac_list);
-        os_free(reply_buf);
-        return -1;
-      } else {
-        reply_buf = expanded_reply_buf;
-      }
-      strcat(reply_buf, temp);
-    }
+  // Optional continuation token
+  ptr = (char **)utarray_next(cmd_arr, ptr);
+  if (get_cmd_reply_token((ptr != NULL) ? *ptr : NULL, &offset) < 0) {
+    log_error("get_cmd_reply_token fail");
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
 
-    bytes_sent =
-        write_socket_data(sock, reply_buf, strlen(reply_buf), client_addr);
+  init_cmd_reply(&conn_reply.reply, CMD_REPLY_PAGE_SIZE);
+  if ((next = iter_mac_mapper(&context->mac_mapper, offset,
+                              append_mac_conn_reply, &conn_reply)) < 0 ||
+      conn_reply.ret < 0) {
+    log_error("iter_mac_mapper fail");
+    free_cmd_reply(&conn_reply.reply);
+    return -1;
+  }
 
-    os_free(mac_list);
-    os_free(reply_buf);
-  } else {
-    bytes_sent =
-        write_socket_data(sock, OK_REPLY, strlen(OK_REPLY), client_addr);
+  // The iteration stops at the first connection that doesn't fit the page
+  if (!conn_reply.ret && end_cmd_reply(&conn_reply.reply, (size_t)next) < 0) {
+    log_error("end_cmd_reply fail");
+    free_cmd_reply(&conn_reply.reply);
+    return -1;
   }
 
-  return bytes_sent;
+  return write_cmd_reply(sock, client_addr, &conn_reply.reply);
 }
 
 ssize_t process_set_ip_cmd(int sock, const struct client_address *client_addr,
@@ -501,49 +617,51 @@ ssize_t process_get_bridges_cmd(int sock,
                                 const struct client_address *client_addr,
                                 struct supervisor_context *context,
                                 UT_array *cmd_arr) {
-  (void)cmd_arr; /* unused */
-
+  char **ptr = (char **)utarray_next(cmd_arr, NULL);
+  struct bridge_mac_tuple *p;
   UT_array *tuple_list_arr;
+  struct cmd_reply reply;
+  size_t offset, count;
+  int ret;
+
+  log_trace("GET_BRIDGES");
+
+  // Optional continuation token
+  ptr = (char **)utarray_next(cmd_arr, ptr);
+  if (get_cmd_reply_token((ptr != NULL) ? *ptr : NULL, &offset) < 0) {
+    log_error("get_cmd_reply_token fail");
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
+
   if (get_all_bridge_edges(context->bridge_list, &tuple_list_arr) <= 0) {
     // list is empty or invalid
     return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
   }
 
-  int total = 0;
-  char *reply_buf = NULL;
-  log_trace("GET_BRIDGES");
-
-  for (struct bridge_mac_tuple *p = utarray_front(tuple_list_arr); p != NULL;
-       p = utarray_next(tuple_list_arr, p)) {
-    char temp[255];
-    int line_size = snprintf(temp, 255, MACSTR "," MACSTR "\n",
-                             MAC2STR(p->src_addr), MAC2STR(p->dst_addr));
-    total += line_size + 1;
-    {
-      char *reallocated_reply_buf = os_realloc(reply_buf, total);
-      if (reallocated_reply_buf == NULL) {
-        log_errno("realloc: failed to allocate %d bytes", total);
-        free(reply_buf);
-        utarray_free(tuple_list_arr);
-        return -1;
-      }
-      if (reply_buf == NULL) {
-        // initialise the buffer as an empty string
-        reallocated_reply_buf[0] = '\0';
-      }
-      reply_buf = reallocated_reply_buf;
+  init_cmd_reply(&reply, CMD_REPLY_PAGE_SIZE);
+  count = utarray_len(tuple_list_arr);
+  for (; offset < count; offset++) {
+    p = (struct bridge_mac_tuple *)utarray_eltptr(tuple_list_arr, offset);
+    if ((ret = append_cmd_reply(&reply, MACSTR "," MACSTR "\n",
+                                MAC2STR(p->src_addr), MAC2STR(p->dst_addr))) <
+        0) {
+      log_error("append_cmd_reply fail");
+      free_cmd_reply(&reply);
+      utarray_free(tuple_list_arr);
+      return -1;
+    } else if (!ret) {
+      break;
     }
-    strcat(reply_buf, temp);
   }
   utarray_free(tuple_list_arr);
 
-  if (reply_buf) {
-    ssize_t bytes_sent =
-        write_socket_data(sock, reply_buf, strlen(reply_buf), client_addr);
-    os_free(reply_buf);
-    return bytes_sent;
-  } else
-    return write_socket_data(sock, OK_REPLY, strlen(OK_REPLY), client_addr);
+  if (offset < count && end_cmd_reply(&reply, offset) < 0) {
+    log_error("end_cmd_reply fail");
+    free_cmd_reply(&reply);
+    return -1;
+  }
+
+  return write_cmd_reply(sock, client_addr, &reply);
 }
 
 ssize_t process_register_ticket_cmd(int sock,
@@ -984,64 +1102,190 @@ ssize_t process_sign_blob_cmd(int sock,
 }
 #endif
 
-process_cmd_fn get_command_function(const char *cmd) {
-  if (!strcmp(cmd, CMD_PING)) {
-    return process_ping_cmd;
-  } else if (!strcmp(cmd, CMD_SUBSCRIBE_EVENTS)) {
-    return process_subscribe_events_cmd;
-  } else if (!strcmp(cmd, CMD_ACCEPT_MAC)) {
-    return process_accept_mac_cmd;
-  } else if (!strcmp(cmd, CMD_DENY_MAC)) {
-    return process_deny_mac_cmd;
-  } else if (!strcmp(cmd, CMD_ADD_NAT)) {
-    return process_add_nat_cmd;
-  } else if (!strcmp(cmd, CMD_REMOVE_NAT)) {
-    return process_remove_nat_cmd;
-  } else if (!strcmp(cmd, CMD_ASSIGN_PSK)) {
-    return process_assign_psk_cmd;
-  } else if (!strcmp(cmd, CMD_GET_MAP)) {
-    return process_get_map_cmd;
-  } else if (!strcmp(cmd, CMD_GET_ALL)) {
-    return process_get_all_cmd;
-  } else if (!strcmp(cmd, CMD_SET_IP)) {
-    return process_set_ip_cmd;
-  } else if (!strcmp(cmd, CMD_ADD_BRIDGE)) {
-    return process_add_bridge_cmd;
-  } else if (!strcmp(cmd, CMD_REMOVE_BRIDGE)) {
-    return process_remove_bridge_cmd;
-  } else if (!strcmp(cmd, CMD_CLEAR_BRIDGES)) {
-    return process_clear_bridges_cmd;
-  } else if (!strcmp(cmd, CMD_GET_BRIDGES)) {
-    return process_get_bridges_cmd;
-  } else if (!strcmp(cmd, CMD_REGISTER_TICKET)) {
-    return process_register_ticket_cmd;
-  } else if (!strcmp(cmd, CMD_CLEAR_PSK)) {
-    return process_clear_psk_cmd;
+bool is_batch_cmd(const char *buf, size_t len) {
+  size_t cmd_len = strlen(CMD_BATCH);
+
+  return buf != NULL && len > cmd_len &&
+         strncmp(buf, CMD_BATCH, cmd_len) == 0 && buf[cmd_len] == '\n';
+}
+
+static bool run_batch_line(int fds[2], const struct client_address *addr,
+                           struct supervisor_context *context, UT_array *args,
+                           char *line) {
+  char reply[sizeof(FAIL_REPLY)], drain;
+  ssize_t received;
+  process_cmd_fn cfn;
+  bool status = true;
+  char **arg;
+
+  split_cmd_line(line, CMD_DELIMITER, args);
+  arg = (char **)utarray_front(args);
+
+  // The subscriber address would be the socket pair
+  if (!strcmp(*arg, CMD_SUBSCRIBE_EVENTS) ||
+      (cfn = get_command_function(*arg)) == NULL) {
+    log_error("%s can't be run in a batch", *arg);
+    return false;
   }
-#ifdef WITH_CRYPTO_SERVICE
-  else if (!strcmp(cmd, CMD_PUT_CRYPT)) {
-    return process_put_crypt_cmd;
-  } else if (!strcmp(cmd, CMD_GET_CRYPT)) {
-    return process_get_crypt_cmd;
-  } else if (!strcmp(cmd, CMD_GEN_RANDKEY)) {
-    return process_gen_randkey_cmd;
-  } else if (!strcmp(cmd, CMD_GEN_PRIVKEY)) {
-    return process_gen_privkey_cmd;
-  } else if (!strcmp(cmd, CMD_GEN_PUBKEY)) {
-    return process_gen_pubkey_cmd;
-  } else if (!strcmp(cmd, CMD_GEN_CERT)) {
-    return process_gen_cert_cmd;
-  } else if (!strcmp(cmd, CMD_ENCRYPT_BLOB)) {
-    return process_encrypt_blob_cmd;
-  } else if (!strcmp(cmd, CMD_DECRYPT_BLOB)) {
-    return process_decrypt_blob_cmd;
-  } else if (!strcmp(cmd, CMD_SIGN_BLOB)) {
-    return process_sign_blob_cmd;
+
+  if (cfn(fds[0], addr, context, args) == -1) {
+    log_error("%s fail", *arg);
+    status = false;
+  }
+
+  // Only the start of the reply is needed to get the command status
+  if ((received = recv(fds[1], reply, sizeof(reply), MSG_DONTWAIT)) < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      log_errno("recv");
+    }
+    return false;
+  }
+
+  // Discards the replies of commands writing more than one datagram
+  while (recv(fds[1], &drain, sizeof(drain), MSG_DONTWAIT) >= 0) {
+  }
+
+  return status && !((size_t)received == strlen(FAIL_REPLY) &&
+                     strncmp(reply, FAIL_REPLY, strlen(FAIL_REPLY)) == 0);
+}
+
+ssize_t process_batch_cmd(int sock, const struct client_address *client_addr,
+                          struct supervisor_context *context,
+                          struct cmd_buffer *cmd_buf, size_t len) {
+  // The commands reply to the connected socket pair
+  struct client_address batch_addr = {.type = SOCKET_TYPE_DOMAIN, .len = 0};
+  struct cmd_reply reply;
+  char *line, *next;
+  int fds[2];
+  int ret = 0;
+  bool batch_status = true;
+
+  if (cmd_buf == NULL || cmd_buf->args == NULL ||
+      !is_batch_cmd(cmd_buf->buf, len) || len >= cmd_buf->size) {
+    log_error("Invalid batch command");
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
+
+  log_trace("BATCH");
+
+  cmd_buf->buf[len] = '\0';
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == -1) {
+    log_errno("socketpair");
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
   }
+
+  if (begin_batch_cmd(context) < 0) {
+    log_error("begin_batch_cmd fail");
+    close(fds[0]);
+    close(fds[1]);
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
+
+  init_cmd_reply(&reply, 0);
+  for (line = &cmd_buf->buf[strlen(CMD_BATCH) + 1]; line != NULL && ret >= 0;
+       line = next) {
+    if ((next = strchr(line, '\n')) != NULL) {
+      *next++ = '\0';
+    }
+
+    if (!strlen(rtrim(line, NULL))) {
+      continue;
+    }
+
+    ret = append_cmd_reply(&reply, "%s",
+                           run_batch_line(fds, &batch_addr, context,
+                                          cmd_buf->args, line)
+                               ? OK_REPLY
+                               : FAIL_REPLY);
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+
+  // The line commands already changed the in-memory state, so the client
+  // still gets their replies when the db or firewall commit fails
+  if (end_batch_cmd(context) < 0) {
+    log_error("end_batch_cmd fail");
+    batch_status = false;
+  }
+
+  if (ret < 0 || append_cmd_reply(&reply, "%s %s", CMD_BATCH,
+                                  batch_status ? OK_REPLY : FAIL_REPLY) < 0) {
+    log_error("append_cmd_reply fail");
+    free_cmd_reply(&reply);
+    return write_socket_data(sock, FAIL_REPLY, strlen(FAIL_REPLY), client_addr);
+  }
+
+  return write_cmd_reply(sock, client_addr, &reply);
+}
+
+/**
+ * @brief Command table entry structure definition
+ *
+ */
+struct cmd_entry {
+  const char *cmd;   /**< The command name */
+  process_cmd_fn fn; /**< The command function */
+};
+
+// Sorted by the command name for the binary search, keep it sorted when
+// adding new commands
+static const struct cmd_entry cmd_table[] = {
+    {CMD_ACCEPT_MAC, process_accept_mac_cmd},
+    {CMD_ADD_BRIDGE, process_add_bridge_cmd},
+    {CMD_ADD_NAT, process_add_nat_cmd},
+    {CMD_ASSIGN_PSK, process_assign_psk_cmd},
+    {CMD_CLEAR_BRIDGES, process_clear_bridges_cmd},
+    {CMD_CLEAR_PSK, process_clear_psk_cmd},
+#ifdef WITH_CRYPTO_SERVICE
+    {CMD_DECRYPT_BLOB, process_decrypt_blob_cmd},
+#endif
+    {CMD_DENY_MAC, process_deny_mac_cmd},
+#ifdef WITH_CRYPTO_SERVICE
+    {CMD_ENCRYPT_BLOB, process_encrypt_blob_cmd},
+    {CMD_GEN_CERT, process_gen_cert_cmd},
+    {CMD_GEN_PRIVKEY, process_gen_privkey_cmd},
+    {CMD_GEN_PUBKEY, process_gen_pubkey_cmd},
+    {CMD_GEN_RANDKEY, process_gen_randkey_cmd},
+#endif
+    {CMD_GET_ALL, process_get_all_cmd},
+    {CMD_GET_BRIDGES, process_get_bridges_cmd},
+    {CMD_GET_CAPTURE_STATS, process_get_capture_stats_cmd},
+#ifdef WITH_CRYPTO_SERVICE
+    {CMD_GET_CRYPT, process_get_crypt_cmd},
+#endif
+    {CMD_GET_MAP, process_get_map_cmd},
+    {CMD_PING, process_ping_cmd},
+#ifdef WITH_CRYPTO_SERVICE
+    {CMD_PUT_CRYPT, process_put_crypt_cmd},
 #endif
-  else {
+    {CMD_REGISTER_TICKET, process_register_ticket_cmd},
+    {CMD_REMOVE_BRIDGE, process_remove_bridge_cmd},
+    {CMD_REMOVE_NAT, process_remove_nat_cmd},
+    {CMD_SET_IP, process_set_ip_cmd},
+#ifdef WITH_CRYPTO_SERVICE
+    {CMD_SIGN_BLOB, process_sign_blob_cmd},
+#endif
+    {CMD_SUBSCRIBE_EVENTS, process_subscribe_events_cmd},
+};
+
+static int cmp_cmd_entry(const void *key, const void *entry) {
+  return strcmp((const char *)key, ((const struct cmd_entry *)entry)->cmd);
+}
+
+process_cmd_fn get_command_function(const char *cmd) {
+  const struct cmd_entry *entry;
+
+  if (cmd == NULL) {
+    log_trace("cmd param is NULL");
+    return NULL;
+  }
+
+  if ((entry = bsearch(cmd, cmd_table, ARRAY_SIZE(cmd_table),
+                       sizeof(struct cmd_entry), cmp_cmd_entry)) == NULL) {
     log_trace("unknown command");
+    return NULL;
   }
 
-  return NULL;
+  return entry->fn;
 }
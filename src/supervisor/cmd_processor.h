@@ -24,6 +24,8 @@
 #define CMD_PING "PING_SUPERVISOR"
 #define CMD_SET_IP "SET_IP"
 #define CMD_SUBSCRIBE_EVENTS "SUBSCRIBE_EVENTS"
+#define CMD_GET_CAPTURE_STATS "GET_CAPTURE_STATS"
+#define CMD_BATCH "BATCH"
 
 // NETCON commands
 #define CMD_ACCEPT_MAC "ACCEPT_MAC"
@@ -60,6 +62,8 @@
 
 #define MAX_QUERY_OP_LEN 3
 
+#define MIN_CMD_BUFFER_SIZE 256 // Initial size of the command buffer
+
 typedef ssize_t (*process_cmd_fn)(int sock,
                                   const struct client_address *client_addr,
                                   struct supervisor_context *context,
@@ -77,6 +81,38 @@ typedef ssize_t (*process_cmd_fn)(int sock,
 bool process_domain_buffer(char *domain_buffer, size_t domain_buffer_len,
                            UT_array *cmd_arr, char sep);
 
+/**
+ * @brief Makes room in the command buffer for a received command
+ *
+ * The buffer only grows, so it is reallocated only for a command longer
+ * than all the previous ones. Its content is not preserved.
+ *
+ * @param cmd_buf The command buffer
+ * @param len The received command length
+ * @return int 0 on success, -1 on failure
+ */
+int reserve_cmd_buffer(struct cmd_buffer *cmd_buf, size_t len);
+
+/**
+ * @brief Splits the received command in place into the command arguments
+ *
+ * The arguments point into the command buffer and are valid until the next
+ * received command.
+ *
+ * @param cmd_buf The command buffer
+ * @param len The received command length
+ * @param sep The string separator
+ * @return ssize_t The number of arguments, -1 on failure
+ */
+ssize_t split_cmd_buffer(struct cmd_buffer *cmd_buf, size_t len, char sep);
+
+/**
+ * @brief Frees the command buffer
+ *
+ * @param cmd_buf The command buffer
+ */
+void free_cmd_buffer(struct cmd_buffer *cmd_buf);
+
 /**
  * @brief Processes the PING command
  *
@@ -103,6 +139,20 @@ ssize_t process_subscribe_events_cmd(int sock,
                                      struct supervisor_context *context,
                                      UT_array *cmd_arr);
 
+/**
+ * @brief Processes the GET_CAPTURE_STATS command
+ *
+ * @param sock The domain server socket
+ * @param client_addr The client address for replies
+ * @param context The supervisor structure instance
+ * @param cmd_arr The array of received commands
+ * @return ssize_t Size of reply written data
+ */
+ssize_t process_get_capture_stats_cmd(int sock,
+                                      const struct client_address *client_addr,
+                                      struct supervisor_context *context,
+                                      UT_array *cmd_arr);
+
 /**
  * @brief Processes the ACCEPT_MAC command
  *
@@ -187,6 +237,9 @@ ssize_t process_get_map_cmd(int sock, const struct client_address *client_addr,
 /**
  * @brief Processes the GET_ALL command
  *
+ * Large replies are paged, see cmd_reply.h. The optional argument is the
+ * continuation token of the page.
+ *
  * @param sock The domain server socket
  * @param client_addr The client address for replies
  * @param context The supervisor structure instance
@@ -255,6 +308,9 @@ ssize_t process_clear_bridges_cmd(int sock,
 /**
  * @brief Processes the GET_BRIDGES command
  *
+ * Large replies are paged, see cmd_reply.h. The optional argument is the
+ * continuation token of the page.
+ *
  * @param sock The domain server socket
  * @param client_addr The client address for replies
  * @param context The supervisor structure instance
@@ -451,11 +507,48 @@ ssize_t process_sign_blob_cmd(int sock,
                               UT_array *cmd_arr);
 #endif
 
+/**
+ * @brief Checks if a received command is a BATCH command
+ *
+ * @param buf The received command
+ * @param len The received command length
+ * @return true if the command starts with the line "BATCH", false otherwise
+ */
+bool is_batch_cmd(const char *buf, size_t len);
+
+/**
+ * @brief Processes the BATCH command
+ *
+ * The first line of the command is "BATCH" and every following line is a
+ * command. The commands are executed in order, with the macconn db writes in
+ * a single transaction and the firewall changes committed once at the end.
+ * The reply has a OK or FAIL line for every non empty command line, followed
+ * by a "BATCH OK" or "BATCH FAIL" line with the status of the final commit.
+ * Event subscriptions are not allowed in a batch.
+ *
+ * The batch is not atomic for the in-memory state: the mapper and firewall
+ * changes of the successful lines stay applied even if a later line or the
+ * final commit fails.
+ *
+ * @param sock The domain server socket
+ * @param client_addr The client address for replies
+ * @param context The supervisor structure instance
+ * @param cmd_buf The command buffer holding the received command
+ * @param len The received command length
+ * @return ssize_t Size of reply written data, or `-1` on failure
+ */
+ssize_t process_batch_cmd(int sock, const struct client_address *client_addr,
+                          struct supervisor_context *context,
+                          struct cmd_buffer *cmd_buf, size_t len);
+
 /**
  * @brief Get the command function pointer
  *
+ * Looks up the command in the table of commands sorted by name.
+ *
  * @param cmd The command string
- * @return process_cmd_fn The returned function pointer
+ * @return process_cmd_fn The returned function pointer, NULL if the command
+ * is unknown
  */
 process_cmd_fn get_command_function(const char *cmd);
 #endif
@@ -0,0 +1,154 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the command reply builder.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../utils/allocs.h"
+#include "../utils/log.h"
+#include "../utils/os.h"
+
+#include "cmd_reply.h"
+
+void init_cmd_reply(struct cmd_reply *reply, size_t limit) {
+  reply->buf = NULL;
+  reply->len = 0;
+  reply->size = 0;
+  reply->limit = limit;
+}
+
+void free_cmd_reply(struct cmd_reply *reply) {
+  if (reply != NULL) {
+    os_free(reply->buf);
+    init_cmd_reply(reply, reply->limit);
+  }
+}
+
+static int reserve_cmd_reply(struct cmd_reply *reply, size_t len) {
+  size_t size = (reply->size) ? reply->size : CMD_REPLY_INIT_SIZE;
+  char *buf;
+
+  // Leaves room for the NUL terminator
+  if (reply->len + len < reply->size) {
+    return 0;
+  }
+
+  while (size <= reply->len + len) {
+    size *= 2;
+  }
+
+  if ((buf = os_realloc(reply->buf, size)) == NULL) {
+    log_errno("os_realloc: failed to allocate %zu bytes", size);
+    return -1;
+  }
+
+  reply->buf = buf;
+  reply->size = size;
+  return 0;
+}
+
+static int vappend_cmd_reply(struct cmd_reply *reply, bool check_limit,
+                             const char *fmt, va_list args) {
+  va_list args_copy;
+  int len;
+
+  va_copy(args_copy, args);
+  len = vsnprintf(NULL, 0, fmt, args_copy);
+  va_end(args_copy);
+
+  if (len < 0) {
+    log_errno("vsnprintf");
+    return -1;
+  }
+
+  if (check_limit && reply->limit && reply->len &&
+      reply->len + (size_t)len + MAX_CMD_REPLY_NEXT_LEN > reply->limit) {
+    return 0;
+  }
+
+  if (reserve_cmd_reply(reply, (size_t)len) < 0) {
+    log_error("reserve_cmd_reply fail");
+    return -1;
+  }
+
+  vsnprintf(&reply->buf[reply->len], reply->size - reply->len, fmt, args);
+  reply->len += (size_t)len;
+  return 1;
+}
+
+int append_cmd_reply(struct cmd_reply *reply, const char *fmt, ...) {
+  va_list args;
+  int ret;
+
+  if (reply == NULL) {
+    log_error("reply param is NULL");
+    return -1;
+  }
+
+  va_start(args, fmt);
+  ret = vappend_cmd_reply(reply, true, fmt, args);
+  va_end(args);
+
+  return ret;
+}
+
+static int append_cmd_reply_next(struct cmd_reply *reply, const char *fmt,
+                                 ...) {
+  va_list args;
+  int ret;
+
+  va_start(args, fmt);
+  ret = vappend_cmd_reply(reply, false, fmt, args);
+  va_end(args);
+
+  return ret;
+}
+
+int end_cmd_reply(struct cmd_reply *reply, size_t token) {
+  if (reply == NULL) {
+    log_error("reply param is NULL");
+    return -1;
+  }
+
+  if (append_cmd_reply_next(reply, CMD_REPLY_NEXT " %zu\n", token) < 0) {
+    log_error("append_cmd_reply_next fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+int get_cmd_reply_token(const char *token, size_t *offset) {
+  unsigned long long value;
+
+  *offset = 0;
+
+  if (token == NULL) {
+    return 0;
+  }
+
+  if (!is_number(token) || token[0] == '-' || token[0] == '+') {
+    log_error("Invalid reply token %s", token);
+    return -1;
+  }
+
+  errno = 0;
+  value = strtoull(token, NULL, 10);
+  if (errno == ERANGE) {
+    log_error("Invalid reply token %s", token);
+    return -1;
+  }
+
+  *offset = (size_t)value;
+  return 0;
+}
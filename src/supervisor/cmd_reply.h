@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the command reply builder.
+ *
+ * The replies are sent as a single datagram, so the list commands split
+ * large replies into pages. A page that is not the last one ends with the
+ * line "NEXT token", and the client requests the following page by
+ * appending the token to the command.
+ */
+
+#ifndef CMD_REPLY_H
+#define CMD_REPLY_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#define CMD_REPLY_PAGE_SIZE 16384 // Maximum length in bytes of a reply page
+#define CMD_REPLY_INIT_SIZE 256   // Initial size of the reply buffer
+
+#define CMD_REPLY_NEXT "NEXT"
+#define MAX_CMD_REPLY_NEXT_LEN 32 // Maximum length of the continuation line
+
+/**
+ * @brief Command reply structure definition
+ *
+ */
+struct cmd_reply {
+  char *buf;    /**< The NUL terminated reply, NULL if empty */
+  size_t len;   /**< The reply length */
+  size_t size;  /**< The reply buffer size */
+  size_t limit; /**< The maximum length of the reply lines */
+};
+
+/**
+ * @brief Initialises an empty command reply
+ *
+ * @param reply The command reply
+ * @param limit The maximum reply length, 0 for no limit
+ */
+void init_cmd_reply(struct cmd_reply *reply, size_t limit);
+
+/**
+ * @brief Frees the command reply buffer
+ *
+ * @param reply The command reply
+ */
+void free_cmd_reply(struct cmd_reply *reply);
+
+/**
+ * @brief Appends a formatted line to the command reply
+ *
+ * The line is appended only if the reply stays within the limit, leaving
+ * room for the continuation line. The first line of a reply is always
+ * appended, so every page makes progress.
+ *
+ * @param reply The command reply
+ * @param fmt The line format
+ * @return int 1 if appended, 0 if the reply is full, -1 on failure
+ */
+int append_cmd_reply(struct cmd_reply *reply, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Ends a reply page with the continuation line "NEXT token"
+ *
+ * @param reply The command reply
+ * @param token The continuation token
+ * @return int 0 on success, -1 on failure
+ */
+int end_cmd_reply(struct cmd_reply *reply, size_t token);
+
+/**
+ * @brief Parses the continuation token of a list command
+ *
+ * @param token The token string, NULL for the first page
+ * @param[out] offset The page offset
+ * @return int 0 on success, -1 on failure
+ */
+int get_cmd_reply_token(const char *token, size_t *offset);
+
+#endif
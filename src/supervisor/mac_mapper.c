@@ -7,7 +7,9 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  * @brief File containing the implementation of the mac mapper.
  */
+#include <arpa/inet.h>
 #include <stdbool.h>
+#include <sys/socket.h>
 
 #include "utils/allocs.h"
 #include "utils/log.h"
@@ -46,24 +48,150 @@ int get_mac_mapper(hmap_mac_conn **hmap, uint8_t mac_addr[ETHER_ADDR_LEN],
   return 0;
 }
 
-bool put_mac_mapper(hmap_mac_conn **hmap, struct mac_conn conn) {
+static bool get_ip_mapper_key(const char *ip, uint8_t key[IP_MAPPER_KEY_LEN]) {
+  os_memset(key, 0, IP_MAPPER_KEY_LEN);
+
+  if (inet_pton(AF_INET, ip, &key[1]) == 1) {
+    key[0] = AF_INET;
+    return true;
+  }
+
+  if (inet_pton(AF_INET6, ip, &key[1]) == 1) {
+    key[0] = AF_INET6;
+    return true;
+  }
+
+  return false;
+}
+
+static bool is_ip_mapper_key(const char *ip,
+                             const uint8_t key[IP_MAPPER_KEY_LEN]) {
+  uint8_t ip_key[IP_MAPPER_KEY_LEN];
+
+  return get_ip_mapper_key(ip, ip_key) &&
+         os_memcmp(ip_key, key, IP_MAPPER_KEY_LEN) == 0;
+}
+
+static void del_ip_mapper(hmap_ip_conn **ip_hmap, const char *ip,
+                          const struct mac_conn *conn) {
+  uint8_t key[IP_MAPPER_KEY_LEN];
+  hmap_ip_conn *s;
+
+  if (!get_ip_mapper_key(ip, key)) {
+    return;
+  }
+
+  // The address is kept if the MAC still has it
+  if (is_ip_mapper_key(conn->info.ip_addr, key) ||
+      is_ip_mapper_key(conn->info.ip_sec_addr, key)) {
+    return;
+  }
+
+  HASH_FIND(hh, *ip_hmap, key, IP_MAPPER_KEY_LEN, s);
+
+  // The IP could have been reassigned to another MAC in the meantime
+  if (s != NULL &&
+      os_memcmp(s->mac_addr, conn->mac_addr, ETHER_ADDR_LEN) == 0) {
+    HASH_DEL(*ip_hmap, s);
+    os_free(s);
+  }
+}
+
+static bool alloc_ip_mapper(hmap_ip_conn **ip_hmap, const char *ip,
+                            hmap_ip_conn **entry) {
+  uint8_t key[IP_MAPPER_KEY_LEN];
+  hmap_ip_conn *s;
+
+  *entry = NULL;
+
+  // Empty or invalid addresses are not indexed
+  if (!get_ip_mapper_key(ip, key)) {
+    return true;
+  }
+
+  HASH_FIND(hh, *ip_hmap, key, IP_MAPPER_KEY_LEN, s);
+
+  if (s == NULL) {
+    if ((*entry = (hmap_ip_conn *)os_malloc(sizeof(hmap_ip_conn))) == NULL) {
+      log_errno("os_malloc");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void add_ip_mapper(hmap_ip_conn **ip_hmap, const char *ip,
+                          const uint8_t mac_addr[ETHER_ADDR_LEN],
+                          hmap_ip_conn **entry) {
+  uint8_t key[IP_MAPPER_KEY_LEN];
+  hmap_ip_conn *s;
+
+  if (!get_ip_mapper_key(ip, key)) {
+    return;
+  }
+
+  HASH_FIND(hh, *ip_hmap, key, IP_MAPPER_KEY_LEN, s);
+
+  // A missing key was allocated by alloc_ip_mapper
+  if (s == NULL) {
+    s = *entry;
+    *entry = NULL;
+    os_memcpy(s->key, key, IP_MAPPER_KEY_LEN);
+    HASH_ADD(hh, *ip_hmap, key[0], IP_MAPPER_KEY_LEN, s);
+  }
+
+  os_memcpy(s->mac_addr, mac_addr, ETHER_ADDR_LEN);
+}
+
+bool put_mac_mapper(hmap_mac_conn **hmap, hmap_ip_conn **ip_hmap,
+                    struct mac_conn conn) {
   hmap_mac_conn *s;
+  hmap_ip_conn *entries[2] = {NULL, NULL};
+  struct mac_conn_info old_info;
+  bool is_new;
 
   if (hmap == NULL) {
     log_trace("hmap param is NULL");
     return false;
   }
 
+  if (ip_hmap == NULL) {
+    log_trace("ip_hmap param is NULL");
+    return false;
+  }
+
   HASH_FIND(hh, *hmap, conn.mac_addr, ETHER_ADDR_LEN,
             s); /* id already in the hash? */
 
-  if (s == NULL) {
+  // Everything is allocated first, so a failure leaves both maps unchanged
+  if ((is_new = (s == NULL))) {
     s = (hmap_mac_conn *)os_malloc(sizeof(hmap_mac_conn));
     if (s == NULL) {
       log_errno("os_malloc");
       return false;
     }
+  }
+
+  if (!alloc_ip_mapper(ip_hmap, conn.info.ip_addr, &entries[0]) ||
+      !alloc_ip_mapper(ip_hmap, conn.info.ip_sec_addr, &entries[1])) {
+    log_error("alloc_ip_mapper fail");
+    os_free(entries[0]);
+    if (is_new) {
+      os_free(s);
+    }
+    return false;
+  }
 
+  // The new addresses are mapped before the old ones are removed
+  add_ip_mapper(ip_hmap, conn.info.ip_addr, conn.mac_addr, &entries[0]);
+  add_ip_mapper(ip_hmap, conn.info.ip_sec_addr, conn.mac_addr, &entries[1]);
+
+  // Both addresses can share a key, leaving an entry unused
+  os_free(entries[0]);
+  os_free(entries[1]);
+
+  if (is_new) {
     // Copy the key and value
     os_memcpy(s->key, conn.mac_addr, ETHER_ADDR_LEN);
     s->value = conn.info;
@@ -71,8 +199,13 @@ bool put_mac_mapper(hmap_mac_conn **hmap, struct mac_conn conn) {
     // HASH_ADD_STR(hmap, key, s);
     HASH_ADD(hh, *hmap, key[0], ETHER_ADDR_LEN, s);
   } else {
+    old_info = s->value;
+
     // Copy the value
     s->value = conn.info;
+
+    del_ip_mapper(ip_hmap, old_info.ip_addr, &conn);
+    del_ip_mapper(ip_hmap, old_info.ip_sec_addr, &conn);
   }
 
   return true;
@@ -87,6 +220,15 @@ void free_mac_mapper(hmap_mac_conn **hmap) {
   }
 }
 
+void free_ip_mapper(hmap_ip_conn **ip_hmap) {
+  hmap_ip_conn *current, *tmp;
+
+  HASH_ITER(hh, *ip_hmap, current, tmp) {
+    HASH_DEL(*ip_hmap, current);
+    os_free(current);
+  }
+}
+
 int get_mac_list(hmap_mac_conn **hmap, struct mac_conn **list) {
   hmap_mac_conn *current, *tmp;
 
@@ -109,6 +251,33 @@ int get_mac_list(hmap_mac_conn **hmap, struct mac_conn **list) {
   return total_entries;
 }
 
+ssize_t iter_mac_mapper(hmap_mac_conn **hmap, size_t offset, mac_mapper_fn fn,
+                        void *args) {
+  hmap_mac_conn *current, *tmp;
+  size_t count = 0;
+
+  if (hmap == NULL) {
+    log_trace("hmap param is NULL");
+    return -1;
+  }
+
+  if (fn == NULL) {
+    log_trace("fn param is NULL");
+    return -1;
+  }
+
+  // New MAC connections are appended, so the offsets are stable
+  HASH_ITER(hh, *hmap, current, tmp) {
+    if (count >= offset &&
+        !fn((const uint8_t *)current->key, &current->value, args)) {
+      break;
+    }
+    count++;
+  }
+
+  return (ssize_t)count;
+}
+
 void init_default_mac_info(struct mac_conn_info *info, int default_open_vlanid,
                            bool allow_all_nat) {
   info->join_timestamp = 0;
@@ -125,11 +294,12 @@ void init_default_mac_info(struct mac_conn_info *info, int default_open_vlanid,
   os_memset(info->id, 0, MAX_RANDOM_UUID_LEN);
 }
 
-int get_ip_mapper(hmap_mac_conn **hmap, char *ip, uint8_t *mac_addr) {
-  hmap_mac_conn *current, *tmp;
+int get_ip_mapper(hmap_ip_conn **ip_hmap, const char *ip, uint8_t *mac_addr) {
+  uint8_t key[IP_MAPPER_KEY_LEN];
+  hmap_ip_conn *s;
 
-  if (hmap == NULL) {
-    log_trace("hmap param is NULL");
+  if (ip_hmap == NULL) {
+    log_trace("ip_hmap param is NULL");
     return -1;
   }
 
@@ -139,21 +309,19 @@ int get_ip_mapper(hmap_mac_conn **hmap, char *ip, uint8_t *mac_addr) {
   }
 
   if (mac_addr == NULL) {
-    log_trace("info param is NULL");
+    log_trace("mac_addr param is NULL");
     return -1;
   }
 
-  HASH_ITER(hh, *hmap, current, tmp) {
-    if (validate_ipv4_string(current->value.ip_addr) &&
-        strcmp(ip, current->value.ip_addr) == 0) {
-      os_memcpy(mac_addr, current->key, ETHER_ADDR_LEN);
-      return 1;
-    }
-    if (validate_ipv4_string(current->value.ip_sec_addr) &&
-        strcmp(ip, current->value.ip_sec_addr) == 0) {
-      os_memcpy(mac_addr, current->key, ETHER_ADDR_LEN);
-      return 1;
-    }
+  if (!get_ip_mapper_key(ip, key)) {
+    return 0;
+  }
+
+  HASH_FIND(hh, *ip_hmap, key, IP_MAPPER_KEY_LEN, s);
+
+  if (s != NULL) {
+    os_memcpy(mac_addr, s->mac_addr, ETHER_ADDR_LEN);
+    return 1;
   }
 
   return 0;
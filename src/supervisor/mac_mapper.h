@@ -26,6 +26,8 @@
 
 #define MAX_DEVICE_LABEL_SIZE 255
 
+#define IP_MAPPER_KEY_LEN 17 // The address family followed by the address
+
 /**
  * @brief MAC connection info structure
  *
@@ -69,6 +71,28 @@ typedef struct hashmap_mac_conn { /**< hashmap key */
   UT_hash_handle hh;          /**< hashmap handle */
 } hmap_mac_conn;
 
+/**
+ * @brief IP mapper connection structure
+ *
+ * Indexes the MAC mapper by the binary primary and secondary IP addresses.
+ */
+typedef struct hashmap_ip_conn {
+  uint8_t key[IP_MAPPER_KEY_LEN];   /**< hashmap key */
+  uint8_t mac_addr[ETHER_ADDR_LEN]; /**< MAC address in byte format */
+  UT_hash_handle hh;                /**< hashmap handle */
+} hmap_ip_conn;
+
+/**
+ * @brief MAC mapper iterator callback
+ *
+ * @param mac_addr MAC address in byte format
+ * @param info MAC connection info structure
+ * @param args The callback arguments
+ * @return true to continue the iteration, false to stop it
+ */
+typedef bool (*mac_mapper_fn)(const uint8_t mac_addr[ETHER_ADDR_LEN],
+                              const struct mac_conn_info *info, void *args);
+
 /**
  * @brief Get the MAC connection info structure for a given MAC address
  *
@@ -84,11 +108,17 @@ int get_mac_mapper(hmap_mac_conn **hmap, uint8_t mac_addr[ETHER_ADDR_LEN],
 /**
  * @brief Insert a MAC into the MAC mapper connection object
  *
+ * Updates the IP mapper with the primary and secondary IP addresses of the
+ * MAC connection and removes the addresses the MAC no longer has. On
+ * failure neither mapper is changed.
+ *
  * @param hmap MAC mapper object
+ * @param ip_hmap IP mapper object
  * @param conn MAC connection structure
  * @return true on success, false otherwise
  */
-bool put_mac_mapper(hmap_mac_conn **hmap, struct mac_conn conn);
+bool put_mac_mapper(hmap_mac_conn **hmap, hmap_ip_conn **ip_hmap,
+                    struct mac_conn conn);
 
 /**
  * @brief Frees the MAC mapper connection object
@@ -97,6 +127,13 @@ bool put_mac_mapper(hmap_mac_conn **hmap, struct mac_conn conn);
  */
 void free_mac_mapper(hmap_mac_conn **hmap);
 
+/**
+ * @brief Frees the IP mapper connection object
+ *
+ * @param ip_hmap IP mapper connection object
+ */
+void free_ip_mapper(hmap_ip_conn **ip_hmap);
+
 /**
  * @brief Get the MAC list from the MAC mapper connection object
  *
@@ -106,6 +143,19 @@ void free_mac_mapper(hmap_mac_conn **hmap);
  */
 int get_mac_list(hmap_mac_conn **hmap, struct mac_conn **list);
 
+/**
+ * @brief Iterates over the MAC mapper connection object in insertion order
+ *
+ * @param hmap MAC mapper connection object
+ * @param offset The number of MAC connections to skip
+ * @param fn The callback function
+ * @param args The callback arguments
+ * @return ssize_t The offset of the MAC connection the callback stopped at,
+ * or the number of MAC connections if it did not stop, @c -1 on error
+ */
+ssize_t iter_mac_mapper(hmap_mac_conn **hmap, size_t offset, mac_mapper_fn fn,
+                        void *args);
+
 /**
  * @brief Generate a default mac info configuration
  *
@@ -119,11 +169,11 @@ void init_default_mac_info(struct mac_conn_info *info, int default_open_vlanid,
 /**
  * @brief Get the MAC address for a given IP address
  *
- * @param hmap MAC mapper object
- * @param ip The AP address
+ * @param ip_hmap IP mapper object
+ * @param ip The IPv4 or IPv6 address
  * @param mac_addr Output MAC address
  * @return int @c 1 if MAC address found, @c -1 error and @c 0 if MAC address
  * not found
  */
-int get_ip_mapper(hmap_mac_conn **hmap, char *ip, uint8_t *mac_addr);
+int get_ip_mapper(hmap_ip_conn **ip_hmap, const char *ip, uint8_t *mac_addr);
 #endif
@@ -311,7 +311,7 @@ int add_bridge_ip_cmd(struct supervisor_context *context, char *left_ip_addr,
   int ret;
   uint8_t left_mac_addr[ETHER_ADDR_LEN], right_mac_addr[ETHER_ADDR_LEN];
 
-  ret = get_ip_mapper(&context->mac_mapper, left_ip_addr, left_mac_addr);
+  ret = get_ip_mapper(&context->ip_mapper, left_ip_addr, left_mac_addr);
   if (ret < 0) {
     log_error("get_ip_mapper fail");
     return -1;
@@ -321,7 +321,7 @@ int add_bridge_ip_cmd(struct supervisor_context *context, char *left_ip_addr,
     return -1;
   }
 
-  ret = get_ip_mapper(&context->mac_mapper, right_ip_addr, right_mac_addr);
+  ret = get_ip_mapper(&context->ip_mapper, right_ip_addr, right_mac_addr);
 
   if (ret < 0) {
     log_error("get_ip_mapper fail");
@@ -113,6 +113,10 @@ int send_events_subscriber(struct supervisor_context *context,
       log_trace("Sending event AP...");
       return send_events(context, EVENT_AP_TEXT, format, args);
       break;
+    case SUBSCRIBER_EVENT_CAPTURE_STATS:
+      log_trace("Sending event CAPTURE_STATS...");
+      return send_events(context, EVENT_CAPTURE_STATS_TEXT, format, args);
+      break;
     default:
       log_trace("No event specified");
       return -1;
@@ -23,10 +23,12 @@ enum SUBSCRIBER_EVENT {
   SUBSCRIBER_EVENT_NONE = 0,
   SUBSCRIBER_EVENT_IP,
   SUBSCRIBER_EVENT_AP,
+  SUBSCRIBER_EVENT_CAPTURE_STATS,
 };
 
 #define EVENT_IP_TEXT "IP"
 #define EVENT_AP_TEXT "AP"
+#define EVENT_CAPTURE_STATS_TEXT "CAPTURE_STATS"
 
 /**
  * @brief Add a subscriber to the subscriber events array
@@ -26,6 +26,7 @@
 #include "../utils/sockctl.h"
 
 #include "../capture/capture_service.h"
+#include "../capture/capture_stats.h"
 
 #include "cmd_processor.h"
 #include "network_commands.h"
@@ -46,8 +47,9 @@ void configure_mac_info(struct mac_conn_info *info, bool allow_connection,
   }
 }
 
-int run_analyser(char *ifname, struct capture_conf *config, pthread_t *pid) {
-  if (run_capture_thread(ifname, config, pid) < 0) {
+int run_analyser(char *ifname, struct capture_conf *config,
+                 struct capture_stats_registry *registry, pthread_t *pid) {
+  if (run_capture_thread(ifname, config, registry, pid) < 0) {
     log_error("run_capture_thread fail");
     return -1;
   }
@@ -69,7 +71,8 @@ int schedule_analyser(struct supervisor_context *context, int vlanid) {
     os_memcpy(&config, &context->capture_config, sizeof(config));
 
     log_trace("Starting analyser on ifname=%s", vlan_conn.ifname);
-    if (run_analyser(vlan_conn.ifname, &config, &pid) != 0) {
+    if (run_analyser(vlan_conn.ifname, &config, context->capture_stats,
+                     &pid) != 0) {
       log_error("run_analyser fail");
       return -1;
     }
@@ -106,8 +109,9 @@ int save_device_vlan(struct supervisor_context *context, uint8_t mac_addr[],
             info->vlanid);
   os_memcpy(conn.mac_addr, mac_addr, ETHER_ADDR_LEN);
   os_memcpy(&conn.info, info, sizeof(struct mac_conn_info));
-  if (save_mac_mapper(context, conn) < 0) {
-    log_trace("save_mac_mapper fail");
+  // Saved to the db by the journal timeout, so the RADIUS reply is not delayed
+  if (queue_mac_mapper(context, conn) < 0) {
+    log_trace("queue_mac_mapper fail");
     log_trace("REJECTING mac=" MACSTR, MAC2STR(mac_addr));
     return -1;
   }
@@ -230,51 +234,50 @@ void ap_service_callback(struct supervisor_context *context, uint8_t mac_addr[],
 
 int process_received_data(int sock, struct client_address *claddr,
                           struct supervisor_context *context) {
+  struct cmd_buffer *cmd_buf = (claddr->type == SOCKET_TYPE_UDP)
+                                   ? &context->udp_cmd
+                                   : &context->domain_cmd;
   uint32_t bytes_available;
+  ssize_t received;
+
   if (ioctl(sock, FIONREAD, &bytes_available) == -1) {
     log_errno("ioctl");
     return -1;
   }
 
-  char *buf;
-  if ((buf = os_malloc(bytes_available)) == NULL) {
-    log_errno("os_malloc");
+  if (reserve_cmd_buffer(cmd_buf, bytes_available) < 0) {
+    log_error("reserve_cmd_buffer fail");
     return -1;
   }
 
-  ssize_t received;
-  if ((received = read_socket_data(sock, buf, bytes_available, claddr, 0)) ==
-      -1) {
+  if ((received = read_socket_data(sock, cmd_buf->buf, bytes_available, claddr,
+                                   0)) == -1) {
     log_error("read_socket_data fail");
-    os_free(buf);
     return -1;
   }
 
-  UT_array *args = NULL;
-  utarray_new(args, &ut_str_icd);
-
   log_trace("Supervisor received %ld bytes", (long)received);
-  if (process_domain_buffer(buf, received, args, CMD_DELIMITER) == false) {
-    log_error("process_domain_buffer fail");
-    os_free(buf);
-    utarray_free(args);
-    return -1;
+  if (is_batch_cmd(cmd_buf->buf, received)) {
+    return (process_batch_cmd(sock, claddr, context, cmd_buf, received) < 0)
+               ? -1
+               : 0;
   }
 
-  os_free(buf);
+  if (split_cmd_buffer(cmd_buf, received, CMD_DELIMITER) < 0) {
+    log_error("split_cmd_buffer fail");
+    return -1;
+  }
 
-  char **arg = (char **)utarray_front(args);
+  char **arg = (char **)utarray_front(cmd_buf->args);
 
   process_cmd_fn cfn;
   if ((cfn = get_command_function(*arg)) != NULL) {
-    if (cfn(sock, claddr, context, args) == -1) {
+    if (cfn(sock, claddr, context, cmd_buf->args) == -1) {
       log_error("%s fail", *arg);
-      utarray_free(args);
       return -1;
     }
   }
 
-  utarray_free(args);
   return 0;
 }
 
@@ -306,6 +309,57 @@ void eloop_read_udp_handler(int sock, void *eloop_ctx, void *sock_ctx) {
   }
 }
 
+void eloop_tout_capture_stats_handler(void *eloop_ctx, void *user_ctx) {
+  (void)eloop_ctx;
+
+  struct supervisor_context *context = (struct supervisor_context *)user_ctx;
+  struct capture_stats *p = NULL;
+  char line[MAX_CAPTURE_STATS_LINE_LEN];
+  UT_array *stats_arr = NULL;
+
+  if (utarray_len(context->subscribers_array)) {
+    utarray_new(stats_arr, &capture_stats_icd);
+
+    if (get_capture_stats(context->capture_stats, stats_arr) < 0) {
+      log_error("get_capture_stats fail");
+    }
+
+    while ((p = (struct capture_stats *)utarray_next(stats_arr, p)) != NULL) {
+      if (format_capture_stats(p, line, MAX_CAPTURE_STATS_LINE_LEN) < 0) {
+        log_error("format_capture_stats fail");
+      } else if (send_events_subscriber(context,
+                                        SUBSCRIBER_EVENT_CAPTURE_STATS, "%s",
+                                        line) < 0) {
+        log_error("send_events_subscriber fail");
+      }
+    }
+
+    utarray_free(stats_arr);
+  }
+
+  if (edge_eloop_register_timeout(context->eloop, CAPTURE_STATS_INTERVAL, 0,
+                                  eloop_tout_capture_stats_handler, NULL,
+                                  user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
+void eloop_tout_mac_journal_handler(void *eloop_ctx, void *user_ctx) {
+  (void)eloop_ctx;
+
+  struct supervisor_context *context = (struct supervisor_context *)user_ctx;
+
+  if (flush_mac_journal(context) < 0) {
+    log_error("flush_mac_journal fail");
+  }
+
+  if (edge_eloop_register_timeout(context->eloop, MAC_JOURNAL_INTERVAL, 0,
+                                  eloop_tout_mac_journal_handler, NULL,
+                                  user_ctx) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+  }
+}
+
 void close_supervisor(struct supervisor_context *context) {
   if (context == NULL) {
     log_error("context param is NULL");
@@ -326,10 +380,22 @@ void close_supervisor(struct supervisor_context *context) {
     context->udp_sock = -1;
   }
 
+  free_cmd_buffer(&context->domain_cmd);
+  free_cmd_buffer(&context->udp_cmd);
+
+  if (flush_mac_journal(context) < 0) {
+    log_error("flush_mac_journal fail");
+  }
+  free_mac_journal(context);
+
   if (context->subscribers_array != NULL) {
     utarray_free(context->subscribers_array);
   }
   context->subscribers_array = NULL;
+
+  // The capture threads must be stopped before freeing the registry
+  free_capture_stats_registry(context->capture_stats);
+  context->capture_stats = NULL;
 }
 
 int run_supervisor(char *server_path, unsigned int port,
@@ -351,6 +417,12 @@ int run_supervisor(char *server_path, unsigned int port,
 
   utarray_new(context->subscribers_array, &client_address_icd);
 
+  if ((context->capture_stats = init_capture_stats_registry()) == NULL) {
+    log_error("init_capture_stats_registry fail");
+    close_supervisor(context);
+    return -1;
+  }
+
   if ((context->domain_sock = create_domain_server(server_path)) == -1) {
     log_error("create_domain_server fail");
     close_supervisor(context);
@@ -379,5 +451,23 @@ int run_supervisor(char *server_path, unsigned int port,
     return -1;
   }
 
+  // Pushes the capture threads statistics to the events subscribers
+  if (edge_eloop_register_timeout(context->eloop, CAPTURE_STATS_INTERVAL, 0,
+                                  eloop_tout_capture_stats_handler, NULL,
+                                  (void *)context) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+    close_supervisor(context);
+    return -1;
+  }
+
+  // Saves the MAC mapper changes queued by the RADIUS authentication
+  if (edge_eloop_register_timeout(context->eloop, MAC_JOURNAL_INTERVAL, 0,
+                                  eloop_tout_mac_journal_handler, NULL,
+                                  (void *)context) == -1) {
+    log_error("edge_eloop_register_timeout fail");
+    close_supervisor(context);
+    return -1;
+  }
+
   return 0;
 }
@@ -17,6 +17,7 @@
 #include <eloop.h>
 #include "../ap/ap_config.h"
 #include "../capture/capture_config.h"
+#include "../capture/capture_stats.h"
 #include "../crypt/crypt_config.h"
 #include "../dhcp/dhcp_config.h"
 #include "../dns/dns_config.h"
@@ -38,6 +39,16 @@ struct auth_ticket {
   int vlanid; /**< the ticket associated VLAN ID */
 };
 
+/**
+ * @brief Received command buffer, reused for every command of a socket
+ *
+ */
+struct cmd_buffer {
+  char *buf;      /**< The command line, split in place */
+  size_t size;    /**< The command line buffer size */
+  UT_array *args; /**< The command arguments, pointing into buf */
+};
+
 /**
  * @brief Supervisor structure definition
  *
@@ -45,6 +56,10 @@ struct auth_ticket {
 struct supervisor_context {
   struct fwctx *fw_ctx;             /**< The firewall context. */
   hmap_mac_conn *mac_mapper;        /**< MAC mapper connection structure */
+  hmap_ip_conn *ip_mapper;          /**< IP to MAC address mapper */
+  struct mac_journal_entry *mac_journal; /**< MAC addresses with changes not
+                                            yet saved, in the order they were
+                                            queued */
   hmap_if_conn *if_mapper;          /**< WiFi subnet to interface mapper */
   hmap_vlan_conn *vlan_mapper;      /**< WiFi VLAN to interface mapper */
   hmap_str_keychar *hmap_bin_paths; /**< Mapper for paths to systems binaries */
@@ -69,6 +84,8 @@ struct supervisor_context {
   struct bridge_mac_list *bridge_list;  /**< List of assigned bridges */
   int domain_sock;                      /**< The control server domain socket */
   int udp_sock;                         /**< The control server udp socket */
+  struct cmd_buffer domain_cmd; /**< The domain socket command buffer */
+  struct cmd_buffer udp_cmd;    /**< The udp socket command buffer */
   struct firewall_conf firewall_config; /**< Firewall service configuration. */
   struct capture_conf capture_config;   /**< Capture service configuration. */
   struct apconf hconfig;                /**< AP service configuration. */
@@ -83,6 +100,8 @@ struct supervisor_context {
   struct auth_ticket *ticket;            /**< The authentication ticket. */
   int ap_sock;                           /**< The AP notifier socket. */
   struct eloop_data *eloop;              /**< The main eloop context. */
+  struct capture_stats_registry *capture_stats; /**< The capture threads
+                                                   statistics. */
 };
 
 #endif
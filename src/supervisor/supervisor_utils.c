@@ -16,6 +16,7 @@
 
 #include "../utils/hash.h"
 #include "../utils/os.h"
+#include "../utils/sqliteu.h"
 
 #include "sqlite_macconn_writer.h"
 #include "supervisor_config.h"
@@ -80,7 +81,7 @@ int save_mac_mapper(struct supervisor_context *context, struct mac_conn conn) {
     generate_radom_uuid(conn.info.id);
   }
 
-  if (!put_mac_mapper(&context->mac_mapper, conn)) {
+  if (!put_mac_mapper(&context->mac_mapper, &context->ip_mapper, conn)) {
     log_error("put_mac_mapper fail");
     return -1;
   }
@@ -104,3 +105,135 @@ int save_mac_mapper(struct supervisor_context *context, struct mac_conn conn) {
 
   return 0;
 }
+
+int queue_mac_mapper(struct supervisor_context *context, struct mac_conn conn) {
+  struct mac_journal_entry *entry = NULL;
+
+  if (!strlen(conn.info.id)) {
+    generate_radom_uuid(conn.info.id);
+  }
+
+  if (!put_mac_mapper(&context->mac_mapper, &context->ip_mapper, conn)) {
+    log_error("put_mac_mapper fail");
+    return -1;
+  }
+
+  // The flush saves the latest mapper state, so a MAC is queued only once
+  HASH_FIND(hh, context->mac_journal, conn.mac_addr, ETHER_ADDR_LEN, entry);
+  if (entry == NULL) {
+    if ((entry = os_zalloc(sizeof(struct mac_journal_entry))) == NULL) {
+      log_errno("os_zalloc");
+      return -1;
+    }
+
+    os_memcpy(entry->mac_addr, conn.mac_addr, ETHER_ADDR_LEN);
+    HASH_ADD(hh, context->mac_journal, mac_addr, ETHER_ADDR_LEN, entry);
+  }
+
+  // The mapper already has the entry, so a failed save must not fail the
+  // caller. The entries stay queued for the next flush.
+  if (HASH_COUNT(context->mac_journal) >= MAX_MAC_JOURNAL_SIZE &&
+      flush_mac_journal(context) < 0) {
+    log_error("flush_mac_journal fail");
+  }
+
+  return 0;
+}
+
+static int save_mac_journal_entry(struct supervisor_context *context,
+                                  const uint8_t mac_addr[]) {
+  struct mac_conn conn;
+
+  os_memcpy(conn.mac_addr, mac_addr, ETHER_ADDR_LEN);
+  if (get_mac_mapper(&context->mac_mapper, conn.mac_addr, &conn.info) <= 0) {
+    log_error("get_mac_mapper fail for mac=" MACSTR, MAC2STR(mac_addr));
+    return -1;
+  }
+
+#ifdef WITH_CRYPTO_SERVICE
+  if (save_to_crypt(context->crypt_ctx, &(conn.info)) < 0) {
+    log_error("save_to_crypt failure");
+    return -1;
+  }
+
+  conn.info.pass_len = 0;
+  os_memset(conn.info.pass, 0, AP_SECRET_LEN);
+#endif
+
+  if (save_sqlite_macconn_entry(context->macconn_db, &conn) < 0) {
+    log_error("save_sqlite_macconn_entry fail");
+    return -1;
+  }
+
+  return 0;
+}
+
+int flush_mac_journal(struct supervisor_context *context) {
+  struct mac_journal_entry *entry = NULL, *tmp = NULL;
+  bool transaction;
+  int ret = 0;
+
+  if (context->mac_journal == NULL) {
+    return 0;
+  }
+
+  if (context->macconn_db == NULL) {
+    log_error("macconn_db is NULL");
+    return -1;
+  }
+
+  // A BATCH command may already hold a transaction on the db
+  transaction = sqlite3_get_autocommit(context->macconn_db) != 0;
+  if (transaction && execute_sqlite_query(context->macconn_db,
+                                          "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on the macconn db");
+    return -1;
+  }
+
+  // The entries are saved in the order they changed. A failed entry doesn't
+  // stop the following ones, so a single bad entry can't block the journal.
+  HASH_ITER(hh, context->mac_journal, entry, tmp) {
+    if (save_mac_journal_entry(context, entry->mac_addr) < 0) {
+      entry->failures++;
+      ret = -1;
+    } else {
+      entry->failures = 0;
+    }
+  }
+
+  if (transaction &&
+      execute_sqlite_query(context->macconn_db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit the mac journal to the macconn db");
+    if (execute_sqlite_query(context->macconn_db, "ROLLBACK TRANSACTION") <
+        0) {
+      log_error("Failed to roll back the macconn db transaction");
+    }
+    return -1;
+  }
+
+  // Keep only the failed entries, in their order
+  HASH_ITER(hh, context->mac_journal, entry, tmp) {
+    if (entry->failures && entry->failures < MAX_MAC_JOURNAL_FAILURES) {
+      continue;
+    }
+
+    if (entry->failures) {
+      log_error("Dropping mac=" MACSTR " from the mac journal after %u fails",
+                MAC2STR(entry->mac_addr), entry->failures);
+    }
+
+    HASH_DEL(context->mac_journal, entry);
+    os_free(entry);
+  }
+
+  return ret;
+}
+
+void free_mac_journal(struct supervisor_context *context) {
+  struct mac_journal_entry *entry = NULL, *tmp = NULL;
+
+  HASH_ITER(hh, context->mac_journal, entry, tmp) {
+    HASH_DEL(context->mac_journal, entry);
+    os_free(entry);
+  }
+}
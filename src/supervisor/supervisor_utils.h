@@ -15,6 +15,24 @@
 
 #include "supervisor_config.h"
 
+#define MAC_JOURNAL_INTERVAL 1 // MAC journal flush period in seconds
+#define MAX_MAC_JOURNAL_SIZE                                                   \
+  1024 // Number of queued MAC addresses that forces a flush
+#define MAX_MAC_JOURNAL_FAILURES                                               \
+  3 // Number of failed saves after which a journal entry is dropped
+
+/**
+ * @brief MAC journal entry structure definition
+ *
+ * The journal is a hashmap keyed by the MAC address, iterated in the order
+ * the entries were queued.
+ */
+struct mac_journal_entry {
+  uint8_t mac_addr[ETHER_ADDR_LEN]; /**< The queued MAC address (key) */
+  unsigned int failures;            /**< Number of consecutive failed saves */
+  UT_hash_handle hh;                /**< hashmap handle */
+};
+
 enum VLAN_ALLOCATION_TYPE { VLAN_ALLOCATE_RANDOM = 0, VLAN_ALLOCATE_HASH };
 
 /**
@@ -38,4 +56,41 @@ int allocate_vlan(struct supervisor_context *context, uint8_t *mac_addr,
  * @return 0 on success, -1 on failure
  */
 int save_mac_mapper(struct supervisor_context *context, struct mac_conn conn);
+
+/**
+ * @brief Save a MAC entry into the mapper and queue it in the MAC journal
+ *
+ * The mapper is updated immediately, while the macconn db and the crypt store
+ * are updated by the next flush_mac_journal(). The journal is flushed
+ * immediately if it has MAX_MAC_JOURNAL_SIZE entries, and a failed flush
+ * leaves the entries queued without failing the call.
+ *
+ * @param context The supervisor context
+ * @param conn The MAC connection structure
+ *
+ * @return 0 on success, -1 on failure
+ */
+int queue_mac_mapper(struct supervisor_context *context, struct mac_conn conn);
+
+/**
+ * @brief Saves the queued MAC entries into the macconn db and the crypt store
+ *
+ * The entries are saved in the order they were queued, within a single
+ * transaction, with their current mapper state. The entries that failed stay
+ * in the journal, unless they failed MAX_MAC_JOURNAL_FAILURES times in a row,
+ * in which case they are dropped. If the transaction fails to commit, it is
+ * rolled back and all the entries stay in the journal.
+ *
+ * @param context The supervisor context
+ *
+ * @return 0 on success, -1 on failure
+ */
+int flush_mac_journal(struct supervisor_context *context);
+
+/**
+ * @brief Frees the MAC journal without saving the queued entries
+ *
+ * @param context The supervisor context
+ */
+void free_mac_journal(struct supervisor_context *context);
 #endif
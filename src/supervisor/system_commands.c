@@ -23,12 +23,15 @@
 #include "../ap/ap_config.h"
 #include "../ap/ap_service.h"
 #include "../capture/capture_service.h"
+#include "../capture/capture_stats.h"
+#include "../firewall/firewall_service.h"
 #include "../utils/allocs.h"
 #include "../utils/base64.h"
 #include "../utils/iface_mapper.h"
 #include "../utils/log.h"
 #include "../utils/os.h"
 #include "../utils/sockctl.h"
+#include "../utils/sqliteu.h"
 
 int set_ip_cmd(struct supervisor_context *context, uint8_t *mac_addr,
                char *ip_addr, enum DHCP_IP_TYPE ip_type) {
@@ -175,3 +178,94 @@ int subscribe_events_cmd(struct supervisor_context *context,
   log_debug("SUBSCRIBE_EVENTS with size=%d and type=%d", addr->len, addr->type);
   return add_events_subscriber(context, addr);
 }
+
+int get_capture_stats_cmd(struct supervisor_context *context,
+                          const char *ifname, char **reply) {
+  struct capture_stats *p = NULL;
+  UT_array *stats_arr = NULL;
+  size_t offset = 0;
+  int count, len;
+
+  *reply = NULL;
+
+  utarray_new(stats_arr, &capture_stats_icd);
+  if ((count = get_capture_stats(context->capture_stats, stats_arr)) < 0) {
+    log_error("get_capture_stats fail");
+    utarray_free(stats_arr);
+    return -1;
+  }
+
+  if (!count) {
+    utarray_free(stats_arr);
+    return 0;
+  }
+
+  // Every line ends with a newline
+  if ((*reply = os_malloc((size_t)count * (MAX_CAPTURE_STATS_LINE_LEN + 1) +
+                          1)) == NULL) {
+    log_errno("os_malloc");
+    utarray_free(stats_arr);
+    return -1;
+  }
+
+  while ((p = (struct capture_stats *)utarray_next(stats_arr, p)) != NULL) {
+    if (ifname != NULL && strcmp(p->ifname, ifname) != 0) {
+      continue;
+    }
+
+    if ((len = format_capture_stats(p, &(*reply)[offset],
+                                    MAX_CAPTURE_STATS_LINE_LEN)) < 0) {
+      log_error("format_capture_stats fail");
+      os_free(*reply);
+      *reply = NULL;
+      utarray_free(stats_arr);
+      return -1;
+    }
+
+    offset += (size_t)len;
+    (*reply)[offset++] = '\n';
+  }
+
+  (*reply)[offset] = '\0';
+  utarray_free(stats_arr);
+
+  if (!offset) {
+    os_free(*reply);
+    *reply = NULL;
+  }
+
+  return 0;
+}
+
+int begin_batch_cmd(struct supervisor_context *context) {
+  if (context->macconn_db != NULL &&
+      execute_sqlite_query(context->macconn_db,
+                           "BEGIN IMMEDIATE TRANSACTION") < 0) {
+    log_error("Failed to capture a lock on the macconn db");
+    return -1;
+  }
+
+  fw_begin_batch(context->fw_ctx);
+  return 0;
+}
+
+int end_batch_cmd(struct supervisor_context *context) {
+  int ret = 0;
+
+  if (fw_end_batch(context->fw_ctx) < 0) {
+    log_error("fw_end_batch fail");
+    ret = -1;
+  }
+
+  if (context->macconn_db != NULL &&
+      execute_sqlite_query(context->macconn_db, "COMMIT TRANSACTION") < 0) {
+    log_error("Failed to commit the batch to the macconn db");
+    if (execute_sqlite_query(context->macconn_db, "ROLLBACK TRANSACTION") <
+        0) {
+      log_error("Failed to roll back the macconn db transaction");
+    }
+    ret = -1;
+  }
+
+  return ret;
+}
@@ -57,4 +57,38 @@ char *ping_cmd(void);
 int subscribe_events_cmd(struct supervisor_context *context,
                          const struct client_address *addr);
 
+/**
+ * @brief GET_CAPTURE_STATS command
+ *
+ * @param context The supervisor structure instance
+ * @param ifname The capture interface, NULL for all the interfaces
+ * @param[out] reply The reply with a statistics line for every interface,
+ * NULL if there are no statistics. You must free this using os_free().
+ * @return int 0 on success, -1 on failure
+ */
+int get_capture_stats_cmd(struct supervisor_context *context,
+                          const char *ifname, char **reply);
+
+/**
+ * @brief Starts the execution of a BATCH command
+ *
+ * The macconn db writes are wrapped in a single transaction and the
+ * firewall changes are committed once by end_batch_cmd().
+ *
+ * @param context The supervisor structure instance
+ * @return int 0 on success, -1 on failure
+ */
+int begin_batch_cmd(struct supervisor_context *context);
+
+/**
+ * @brief Ends the execution of a BATCH command
+ *
+ * Commits the macconn db transaction and the firewall changes. The
+ * transaction is rolled back if the commit fails.
+ *
+ * @param context The supervisor structure instance
+ * @return int 0 on success, -1 on failure
+ */
+int end_batch_cmd(struct supervisor_context *context);
+
 #endif
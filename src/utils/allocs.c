@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdalign.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -33,3 +34,117 @@ char *os_strdup(const char *s) {
 
   return dest;
 }
+
+#define SLAB_ALIGN alignof(max_align_t)
+#define SLAB_ALIGN_SIZE(s) (((s) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+/* The chunk header, aligned so the first object is aligned */
+#define SLAB_CHUNK_HEADER SLAB_ALIGN_SIZE(sizeof(void *))
+
+void free_os_slab(struct os_slab *slab) {
+  void *chunk, *next;
+
+  if (slab != NULL) {
+    chunk = slab->chunks;
+    while (chunk != NULL) {
+      next = *(void **)chunk;
+      os_free(chunk);
+      chunk = next;
+    }
+    os_free(slab);
+  }
+}
+
+struct os_slab *init_os_slab(size_t object_size, size_t chunk_objects) {
+  struct os_slab *slab = NULL;
+
+  if (!object_size || !chunk_objects) {
+    return NULL;
+  }
+
+  if ((slab = os_zalloc(sizeof(struct os_slab))) == NULL) {
+    return NULL;
+  }
+
+  // A free object stores the pointer to the next free object
+  if (object_size < sizeof(void *)) {
+    object_size = sizeof(void *);
+  }
+
+  slab->object_size = SLAB_ALIGN_SIZE(object_size);
+  slab->chunk_objects = chunk_objects;
+
+  return slab;
+}
+
+static int grow_os_slab(struct os_slab *slab) {
+  uint8_t *chunk, *object;
+
+  if (slab->chunk_objects >
+      (~(size_t)0 - SLAB_CHUNK_HEADER) / slab->object_size) {
+    return -1;
+  }
+
+  chunk = os_malloc(SLAB_CHUNK_HEADER + slab->chunk_objects * slab->object_size);
+  if (chunk == NULL) {
+    return -1;
+  }
+
+  *(void **)chunk = slab->chunks;
+  slab->chunks = chunk;
+
+  // Push the objects in reverse, so they are allocated in address order
+  for (size_t idx = slab->chunk_objects; idx > 0; idx--) {
+    object = chunk + SLAB_CHUNK_HEADER + (idx - 1) * slab->object_size;
+    *(void **)object = slab->free_list;
+    slab->free_list = object;
+  }
+
+  slab->capacity += slab->chunk_objects;
+  return 0;
+}
+
+void *os_slab_alloc(struct os_slab *slab) {
+  void *object;
+
+  if (slab == NULL) {
+    return NULL;
+  }
+
+  if (slab->free_list == NULL && grow_os_slab(slab) < 0) {
+    return NULL;
+  }
+
+  object = slab->free_list;
+  slab->free_list = *(void **)object;
+
+  slab->allocs++;
+  if (++slab->in_use > slab->high_water) {
+    slab->high_water = slab->in_use;
+  }
+
+  return object;
+}
+
+void os_slab_free(struct os_slab *slab, void *ptr) {
+  if (slab == NULL || ptr == NULL) {
+    return;
+  }
+
+  *(void **)ptr = slab->free_list;
+  slab->free_list = ptr;
+  slab->in_use--;
+}
+
+void get_os_slab_stats(const struct os_slab *slab,
+                       struct os_slab_stats *stats) {
+  if (slab == NULL || stats == NULL) {
+    return;
+  }
+
+  stats->object_size = slab->object_size;
+  stats->capacity = slab->capacity;
+  stats->in_use = slab->in_use;
+  stats->high_water = slab->high_water;
+  stats->allocs = slab->allocs;
+}
@@ -103,4 +103,94 @@ __must_free static inline void *os_memdup(const void *src, size_t len) {
  * @return char* The dublicate string pointer, NULL on error
  */
 __must_free char *os_strdup(const char *s);
+
+/**
+ * @brief Fixed size object slab allocator structure definition
+ *
+ * Objects are carved from chunks of chunk_objects objects and are recycled
+ * through a free list when freed, so a chunk is never returned to the system
+ * until the slab is freed. The slab is not thread safe.
+ */
+struct os_slab {
+  size_t object_size;   /**< The size of an object (aligned) */
+  size_t chunk_objects; /**< Number of objects in a chunk */
+  void *chunks;         /**< The list of chunks */
+  void *free_list;      /**< The list of free objects */
+  size_t capacity;      /**< Number of objects in all the chunks */
+  size_t in_use;        /**< Number of allocated objects */
+  size_t high_water;    /**< Maximum number of allocated objects */
+  uint64_t allocs;      /**< Number of allocations */
+};
+
+/**
+ * @brief Slab allocator statistics
+ *
+ */
+struct os_slab_stats {
+  size_t object_size; /**< The size of an object */
+  size_t capacity;    /**< Number of objects in all the chunks */
+  size_t in_use;      /**< Number of allocated objects */
+  size_t high_water;  /**< Maximum number of allocated objects */
+  uint64_t allocs;    /**< Number of allocations */
+};
+
+/**
+ * @brief Frees the slab and all the chunks
+ *
+ * All the objects allocated from the slab become invalid.
+ *
+ * @param slab The slab
+ */
+void free_os_slab(struct os_slab *slab);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_os_slab()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_os_slab __attribute__((malloc(free_os_slab, 1))) __must_check
+#else
+#define __must_free_os_slab __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises a fixed size object slab
+ *
+ * @param object_size The object size in bytes
+ * @param chunk_objects Number of objects allocated at once
+ * @return struct os_slab* The slab, NULL on failure.
+ * You must free this using free_os_slab().
+ */
+__must_free_os_slab struct os_slab *init_os_slab(size_t object_size,
+                                                 size_t chunk_objects);
+
+/**
+ * @brief Allocates an object from the slab
+ *
+ * The object is not zeroed.
+ *
+ * @param slab The slab
+ * @return void* The object, NULL on failure.
+ * You must free this using os_slab_free().
+ */
+__must_check void *os_slab_alloc(struct os_slab *slab);
+
+/**
+ * @brief Returns an object to the slab
+ *
+ * @param slab The slab that allocated the object
+ * @param ptr The object, NULL is ignored
+ */
+void os_slab_free(struct os_slab *slab, void *ptr);
+
+/**
+ * @brief Returns the slab statistics
+ *
+ * @param slab The slab
+ * @param[out] stats The slab statistics
+ */
+void get_os_slab_stats(const struct os_slab *slab,
+                       struct os_slab_stats *stats);
 #endif
@@ -136,6 +136,23 @@ const char *inaddr6_2_ip(const struct in6_addr *addr,
   return inet_ntop(AF_INET6, addr, ip, OS_INET6_ADDRSTRLEN);
 }
 
+const char *mac_2_str(const uint8_t mac[static ETHER_ADDR_LEN],
+                      char str[static MACSTR_LEN]) {
+  static const char hex[] = "0123456789abcdef";
+  char *out = str;
+
+  for (int idx = 0; idx < ETHER_ADDR_LEN; idx++) {
+    if (idx) {
+      *out++ = ':';
+    }
+    *out++ = hex[mac[idx] >> 4];
+    *out++ = hex[mac[idx] & 0x0f];
+  }
+  *out = '\0';
+
+  return str;
+}
+
 uint8_t get_short_subnet(const char *subnet_mask) {
   in_addr_t addr;
   uint8_t short_mask = 0;
@@ -112,6 +112,17 @@ const char *inaddr4_2_ip(const struct in_addr *addr,
 const char *inaddr6_2_ip(const struct in6_addr *addr,
                          char ip[static OS_INET6_ADDRSTRLEN]);
 
+/**
+ * @brief Convert a binary MAC address to a MAC string (xx:xx:xx:xx:xx:xx)
+ *
+ * @param mac The binary MAC address
+ * @param[out] str The output buffer to store the MAC string.
+ * Must be at least MACSTR_LEN chars long.
+ * @return Pointer to the returned MAC string (same as @p str)
+ */
+const char *mac_2_str(const uint8_t mac[static ETHER_ADDR_LEN],
+                      char str[static MACSTR_LEN]);
+
 /**
  * @brief Convert from a string subnet mask to a short integer version
  *
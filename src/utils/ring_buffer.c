@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the implementation of the ring buffer utilities.
+ *
+ * The producer owns the tail index and the consumer owns the head index. The
+ * head index is only advanced with a compare and swap, because the producer
+ * also advances it when overwriting the oldest element.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocs.h"
+#include "log.h"
+#include "ring_buffer.h"
+
+/**
+ * Private implementation of free_ring_buffer(), without its compiler
+ * attributes, so init_ring_buffer() can call it on failure.
+ */
+static void __free_ring_buffer(struct ring_buffer *rb) {
+  if (rb != NULL) {
+    os_free(rb->slots);
+    os_free(rb);
+  }
+}
+
+void free_ring_buffer(struct ring_buffer *rb) { __free_ring_buffer(rb); }
+
+struct ring_buffer *init_ring_buffer(size_t size) {
+  struct ring_buffer *rb = NULL;
+  size_t rb_size = 1;
+
+  if (!size) {
+    log_error("size param is zero");
+    return NULL;
+  }
+
+  while (rb_size < size) {
+    rb_size <<= 1;
+  }
+
+  if ((rb = os_zalloc(sizeof(struct ring_buffer))) == NULL) {
+    log_errno("os_zalloc");
+    return NULL;
+  }
+
+  if ((rb->slots = os_calloc(rb_size, sizeof(_Atomic(void *)))) == NULL) {
+    log_errno("os_calloc");
+    __free_ring_buffer(rb);
+    return NULL;
+  }
+
+  rb->size = rb_size;
+  rb->mask = rb_size - 1;
+  atomic_init(&rb->head, 0);
+  atomic_init(&rb->tail, 0);
+
+  return rb;
+}
+
+int push_ring_buffer(struct ring_buffer *rb, void *el) {
+  uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+
+  if (tail - head >= rb->size) {
+    return -1;
+  }
+
+  atomic_store_explicit(&rb->slots[tail & rb->mask], el, memory_order_relaxed);
+  atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+
+  return 0;
+}
+
+void *push_overwrite_ring_buffer(struct ring_buffer *rb, void *el) {
+  void *evicted = NULL;
+  uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+
+  if (tail - head >= rb->size) {
+    // If the exchange fails the consumer popped an element, so there is space
+    if (atomic_compare_exchange_strong_explicit(&rb->head, &head, head + 1,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      evicted = atomic_load_explicit(&rb->slots[head & rb->mask],
+                                     memory_order_relaxed);
+    }
+  }
+
+  atomic_store_explicit(&rb->slots[tail & rb->mask], el, memory_order_relaxed);
+  atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+
+  return evicted;
+}
+
+void *pop_ring_buffer(struct ring_buffer *rb) {
+  void *el = NULL;
+  uint64_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+
+  while (head != atomic_load_explicit(&rb->tail, memory_order_acquire)) {
+    el = atomic_load_explicit(&rb->slots[head & rb->mask],
+                              memory_order_relaxed);
+
+    // Fails only if the producer overwrote the oldest element
+    if (atomic_compare_exchange_weak_explicit(&rb->head, &head, head + 1,
+                                              memory_order_acq_rel,
+                                              memory_order_acquire)) {
+      return el;
+    }
+  }
+
+  return NULL;
+}
+
+size_t get_ring_buffer_length(struct ring_buffer *rb) {
+  uint64_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+
+  return (size_t)(tail - head);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @author Alexandru Mereacre
+ * @date 2022
+ * @copyright
+ * SPDX-FileCopyrightText: © 2022 NQMCyber Ltd and edgesec contributors
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ * @brief File containing the definition of the ring buffer utilities.
+ *
+ * The ring buffer is a bounded lock-free queue of pointers for exactly one
+ * producer thread and one consumer thread.
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./attributes.h"
+
+/**
+ * @brief Cache line size used to keep the producer and consumer indices apart
+ */
+#define RING_BUFFER_CACHE_LINE 64
+
+/**
+ * @brief Single producer single consumer ring buffer structure definition
+ *
+ */
+struct ring_buffer {
+  _Atomic(void *) *slots; /**< The ring slots */
+  size_t size;            /**< The number of slots (a power of two) */
+  size_t mask;            /**< The slot index mask (size - 1) */
+  char pad0[RING_BUFFER_CACHE_LINE];
+  _Atomic uint64_t head; /**< Index of the next element to pop */
+  char pad1[RING_BUFFER_CACHE_LINE];
+  _Atomic uint64_t tail; /**< Index of the next element to push */
+  char pad2[RING_BUFFER_CACHE_LINE];
+};
+
+/**
+ * @brief Frees the ring buffer
+ *
+ * The elements still in the ring buffer are not freed.
+ *
+ * @param rb The ring buffer
+ */
+void free_ring_buffer(struct ring_buffer *rb);
+
+#if __GNUC__ >= 11 // this syntax will throw an error in GCC 10 or Clang, since
+                   // __attribute__((malloc)) accepts no args
+/**
+ * Declares that the attributed function must be free_ring_buffer()-ed.
+ *
+ * @see __must_free
+ */
+#define __must_free_ring_buffer                                                \
+  __attribute__((malloc(free_ring_buffer, 1))) __must_check
+#else
+#define __must_free_ring_buffer __must_check
+#endif /* __GNUC__ >= 11 */
+
+/**
+ * @brief Initialises an empty ring buffer
+ *
+ * @param size The minimum number of elements, rounded up to a power of two
+ * @return struct ring_buffer* The ring buffer, NULL on failure.
+ * You must free this using free_ring_buffer().
+ */
+__must_free_ring_buffer struct ring_buffer *init_ring_buffer(size_t size);
+
+/**
+ * @brief Pushes an element in the ring buffer (producer only)
+ *
+ * @param rb The ring buffer
+ * @param el The element, must not be NULL
+ * @return 0 on success, -1 if the ring buffer is full
+ */
+int push_ring_buffer(struct ring_buffer *rb, void *el);
+
+/**
+ * @brief Pushes an element in the ring buffer, removing the oldest element
+ * if the ring buffer is full (producer only)
+ *
+ * @param rb The ring buffer
+ * @param el The element, must not be NULL
+ * @return void* The removed element, NULL if no element was removed
+ */
+void *push_overwrite_ring_buffer(struct ring_buffer *rb, void *el);
+
+/**
+ * @brief Pops the oldest element from the ring buffer (consumer only)
+ *
+ * @param rb The ring buffer
+ * @return void* The element, NULL if the ring buffer is empty
+ */
+void *pop_ring_buffer(struct ring_buffer *rb);
+
+/**
+ * @brief Returns the number of elements in the ring buffer
+ *
+ * @param rb The ring buffer
+ * @return size_t The number of elements
+ */
+size_t get_ring_buffer_length(struct ring_buffer *rb);
+
+#endif
@@ -57,3 +57,34 @@ int check_table_exists(sqlite3 *db, const char *table_name) {
       return -1;
   }
 }
+
+int check_column_exists(sqlite3 *db, const char *table_name,
+                        const char *column_name) {
+  sqlite3_stmt *res = NULL;
+
+  const char *sql = "SELECT name FROM pragma_table_info(?) WHERE name=?;";
+  if (sqlite3_prepare_v2(db, sql, -1, &res, 0) != SQLITE_OK) {
+    log_trace("Preparing %s failed due to %s", sql, sqlite3_errmsg(db));
+    return -1;
+  }
+
+  if (sqlite3_bind_text(res, 1, table_name, -1, SQLITE_STATIC) != SQLITE_OK ||
+      sqlite3_bind_text(res, 2, column_name, -1, SQLITE_STATIC) != SQLITE_OK) {
+    log_trace("Binding params failed due to %s", sqlite3_errmsg(db));
+    sqlite3_finalize(res);
+    return -1;
+  }
+
+  switch (sqlite3_step(res)) {
+    case SQLITE_ROW:
+      sqlite3_finalize(res);
+      return 1;
+    case SQLITE_DONE:
+      sqlite3_finalize(res);
+      return 0;
+    default:
+      log_error("Failed to get results: %s", sqlite3_errmsg(db));
+      sqlite3_finalize(res);
+      return -1;
+  }
+}
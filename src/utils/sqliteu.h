@@ -33,4 +33,15 @@ int execute_sqlite_query(sqlite3 *db, const char *statement);
  * @return int 0 if it doesn't exist, 1 if it excists and -1 on failure
  */
 int check_table_exists(sqlite3 *db, const char *table_name);
+
+/**
+ * @brief Check if a sqlite table has a column
+ *
+ * @param db The sqlite db structure
+ * @param table_name The table name
+ * @param column_name The column name
+ * @return int 0 if it doesn't exist, 1 if it exists and -1 on failure
+ */
+int check_column_exists(sqlite3 *db, const char *table_name,
+                        const char *column_name);
 #endif
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "capture/middlewares/column_middleware/column_store.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+#define TEST_ROWS (COLUMN_BLOCK_ROWS + 100)
+
+static char *test_column_path = "/tmp";
+
+static void fill_eth_schema(struct eth_schema *eths, size_t idx) {
+  os_memset(eths, 0, sizeof(struct eth_schema));
+  // Out of order timestamps give negative deltas
+  eths->timestamp = 1650000000000000ULL + idx * 1000 - (idx % 3) * 10;
+  eths->id = 1000 + idx;
+  eths->caplen = (uint32_t)(60 + idx);
+  eths->length = (uint32_t)(1500 + idx);
+  os_strlcpy(eths->ifname, "wlan0", IF_NAMESIZE);
+  os_memset(eths->ether_dhost, (int)(idx % 4), ETHER_ADDR_LEN);
+  os_memset(eths->ether_shost, 0xAA, ETHER_ADDR_LEN);
+  eths->ether_type = (idx % 2) ? 0x0800 : 0x86DD;
+}
+
+static void fill_ip4_schema(struct ip4_schema *ip4s, size_t idx) {
+  os_memset(ip4s, 0, sizeof(struct ip4_schema));
+  ip4s->id = 1000 + idx;
+  ip4s->ip_src.s_addr = htonl(0x0A000001 + (uint32_t)(idx % 7));
+  ip4s->ip_dst.s_addr = htonl(0x0A000101);
+  ip4s->ip_ttl = 64;
+  ip4s->ip_p = 6;
+  ip4s->ip_len = (uint16_t)idx;
+}
+
+static void write_test_columns(char *path) {
+  struct eth_schema eths;
+  struct ip4_schema ip4s;
+  struct tuple_packet tp;
+
+  struct column_writer *writer =
+      init_column_writer(test_column_path, "wlan0", UINT64_MAX);
+  assert_non_null(writer);
+
+  for (size_t idx = 0; idx < TEST_ROWS; idx++) {
+    fill_eth_schema(&eths, idx);
+    tp.packet = (uint8_t *)&eths;
+    tp.type = PACKET_ETHERNET;
+    assert_int_equal(append_column_writer(writer, &tp), 0);
+
+    if (idx % 2) {
+      fill_ip4_schema(&ip4s, idx);
+      tp.packet = (uint8_t *)&ip4s;
+      tp.type = PACKET_IP4;
+      assert_int_equal(append_column_writer(writer, &tp), 0);
+    }
+  }
+
+  // Packets without a schema are skipped
+  tp.type = PACKET_NONE;
+  assert_int_equal(append_column_writer(writer, &tp), 0);
+
+  // One full eth block has been written
+  assert_int_equal(writer->blocks, 1);
+  assert_int_equal(flush_column_writer(writer), 0);
+  assert_int_equal(writer->blocks, 3);
+
+  os_strlcpy(path, writer->path, MAX_OS_PATH_LEN);
+  free_column_writer(writer);
+}
+
+static void test_column_store(void **state) {
+  (void)state; /* unused */
+
+  char path[MAX_OS_PATH_LEN];
+  struct column_block block;
+  size_t offset = 0, eth_rows = 0, ip4_rows = 0;
+  int ret;
+
+  write_test_columns(path);
+
+  struct column_file *file = open_column_file(path);
+  assert_non_null(file);
+
+  ssize_t ts_column = get_column_index(PACKET_ETHERNET, "timestamp");
+  ssize_t dhost_column = get_column_index(PACKET_ETHERNET, "ether_dhost");
+  ssize_t ifname_column = get_column_index(PACKET_ETHERNET, "ifname");
+  ssize_t type_column = get_column_index(PACKET_ETHERNET, "ether_type");
+  ssize_t src_column = get_column_index(PACKET_IP4, "ip_src");
+  assert_true(ts_column >= 0 && dhost_column >= 0 && ifname_column >= 0 &&
+              type_column >= 0 && src_column >= 0);
+  assert_int_equal(get_column_index(PACKET_ETHERNET, "unknown"), -1);
+  assert_int_equal(get_column_index(PACKET_NONE, "id"), -1);
+
+  while ((ret = next_column_block(file, &offset, &block)) == 1) {
+    if (block.type == PACKET_ETHERNET) {
+      uint64_t timestamps[COLUMN_BLOCK_ROWS];
+      uint8_t dhosts[COLUMN_BLOCK_ROWS][ETHER_ADDR_LEN];
+      char ifnames[COLUMN_BLOCK_ROWS][IF_NAMESIZE];
+      uint16_t types[COLUMN_BLOCK_ROWS];
+
+      assert_int_equal(read_column_values(&block, ts_column,
+                                          (uint8_t *)timestamps), 0);
+      assert_int_equal(read_column_values(&block, dhost_column,
+                                          (uint8_t *)dhosts), 0);
+      assert_int_equal(read_column_values(&block, ifname_column,
+                                          (uint8_t *)ifnames), 0);
+      assert_int_equal(read_column_values(&block, type_column,
+                                          (uint8_t *)types), 0);
+
+      for (size_t row = 0; row < block.rows; row++) {
+        struct eth_schema eths;
+        fill_eth_schema(&eths, eth_rows + row);
+        assert_int_equal(timestamps[row], eths.timestamp);
+        assert_memory_equal(dhosts[row], eths.ether_dhost, ETHER_ADDR_LEN);
+        assert_string_equal(ifnames[row], "wlan0");
+        assert_int_equal(types[row], eths.ether_type);
+      }
+      eth_rows += block.rows;
+    } else if (block.type == PACKET_IP4) {
+      struct in_addr srcs[COLUMN_BLOCK_ROWS];
+
+      assert_int_equal(
+          read_column_values(&block, src_column, (uint8_t *)srcs), 0);
+      for (size_t row = 0; row < block.rows; row++) {
+        struct ip4_schema ip4s;
+        fill_ip4_schema(&ip4s, 2 * (ip4_rows + row) + 1);
+        assert_int_equal(srcs[row].s_addr, ip4s.ip_src.s_addr);
+      }
+      ip4_rows += block.rows;
+    } else {
+      fail();
+    }
+  }
+
+  assert_int_equal(ret, 0);
+  assert_int_equal(eth_rows, TEST_ROWS);
+  assert_int_equal(ip4_rows, TEST_ROWS / 2);
+  assert_int_equal(read_column_values(&block, COLUMN_MAX_COLUMNS,
+                                      (uint8_t *)&offset), -1);
+
+  close_column_file(file);
+  remove(path);
+}
+
+static void test_column_store_truncated(void **state) {
+  (void)state; /* unused */
+
+  char path[MAX_OS_PATH_LEN];
+  struct column_block block;
+  size_t offset = 0, blocks = 0;
+  int ret;
+
+  write_test_columns(path);
+
+  // A partially written last block is ignored
+  FILE *fp = fopen(path, "r+");
+  assert_non_null(fp);
+  assert_int_equal(fseek(fp, 0, SEEK_END), 0);
+  long size = ftell(fp);
+  fclose(fp);
+  assert_int_equal(truncate(path, size - 10), 0);
+
+  struct column_file *file = open_column_file(path);
+  assert_non_null(file);
+
+  while ((ret = next_column_block(file, &offset, &block)) == 1) {
+    blocks++;
+  }
+
+  assert_int_equal(ret, 0);
+  assert_int_equal(blocks, 2);
+
+  close_column_file(file);
+  remove(path);
+
+  assert_null(open_column_file(path));
+}
+
+static void write_test_file(const char *folder, const char *name,
+                            size_t size, char *path) {
+  char buf[256] = {0};
+
+  snprintf(path, MAX_OS_PATH_LEN, "%s/%s", folder, name);
+  FILE *fp = fopen(path, "w");
+  assert_non_null(fp);
+  assert_int_equal(fwrite(buf, 1, size, fp), size);
+  fclose(fp);
+}
+
+static void test_clean_column_writer(void **state) {
+  (void)state; /* unused */
+
+  char tmp_folder_template[] = "/tmp/test_column_storeXXXXXX";
+  char *tmp_folder = mkdtemp(tmp_folder_template);
+  char name[MAX_OS_PATH_LEN], old_path[MAX_OS_PATH_LEN],
+      prev_path[MAX_OS_PATH_LEN], open_path[MAX_OS_PATH_LEN],
+      other_path[MAX_OS_PATH_LEN], invalid_path[MAX_OS_PATH_LEN];
+  uint64_t timestamp;
+
+  assert_non_null(tmp_folder);
+  assert_int_equal(os_get_timestamp(&timestamp), 0);
+
+  write_test_file(tmp_folder, "wlan0_1.col", 100, old_path);
+  snprintf(name, sizeof(name), "wlan0_%" PRIu64 ".col", timestamp - 2);
+  write_test_file(tmp_folder, name, 100, prev_path);
+  snprintf(name, sizeof(name), "wlan0_%" PRIu64 ".col", timestamp - 1);
+  write_test_file(tmp_folder, name, 100, open_path);
+  // Files of other interfaces or with other names are kept
+  write_test_file(tmp_folder, "wlan1_1.col", 100, other_path);
+  write_test_file(tmp_folder, "wlan0_x.col", 100, invalid_path);
+
+  struct column_writer *writer =
+      init_column_writer(tmp_folder, "wlan0", UINT64_MAX);
+  assert_non_null(writer);
+  os_strlcpy(writer->path, open_path, MAX_OS_PATH_LEN);
+
+  assert_int_equal(clean_column_writer(NULL), -1);
+
+  // No limits
+  assert_int_equal(clean_column_writer(writer), 0);
+
+  writer->store_age = 3600ULL * 1000000;
+  assert_int_equal(clean_column_writer(writer), 1);
+  assert_int_equal(check_file_exists(old_path, NULL), -1);
+
+  // The open file is counted, but never removed
+  writer->store_age = 0;
+  writer->store_size = 150;
+  assert_int_equal(clean_column_writer(writer), 1);
+  assert_int_equal(check_file_exists(prev_path, NULL), -1);
+  writer->store_size = 50;
+  assert_int_equal(clean_column_writer(writer), 0);
+  assert_int_equal(check_file_exists(open_path, NULL), 0);
+  assert_int_equal(check_file_exists(other_path, NULL), 0);
+  assert_int_equal(check_file_exists(invalid_path, NULL), 0);
+
+  writer->path[0] = '\0';
+  free_column_writer(writer);
+
+  remove(open_path);
+  remove(other_path);
+  remove(invalid_path);
+  rmdir(tmp_folder);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_column_store),
+      cmocka_unit_test(test_column_store_truncated),
+      cmocka_unit_test(test_clean_column_writer)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
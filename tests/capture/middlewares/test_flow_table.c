@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "capture/middlewares/header_middleware/flow_table.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+#define IDLE_TIMEOUT 1000
+#define ACTIVE_TIMEOUT 10000
+
+struct emitted_flows {
+  struct flow_record records[64];
+  size_t count;
+};
+
+static void emit_test_flow(const struct flow_record *record, void *ctx) {
+  struct emitted_flows *emitted = (struct emitted_flows *)ctx;
+
+  assert_true(emitted->count < 64);
+  emitted->records[emitted->count++] = *record;
+}
+
+static void make_flow_key(struct flow_key *key, uint16_t source) {
+  os_memset(key, 0, sizeof(struct flow_key));
+  os_strlcpy(key->ifname, "wlan0", IF_NAMESIZE);
+  key->family = AF_INET;
+  key->protocol = 6;
+  inet_pton(AF_INET, "10.0.0.1", key->src);
+  inet_pton(AF_INET, "10.0.0.2", key->dst);
+  key->source = source;
+  key->dest = 443;
+}
+
+static void test_update_flow_table(void **state) {
+  (void)state; /* unused */
+
+  struct emitted_flows emitted = {.count = 0};
+  struct flow_key key, other;
+  struct flow_table *table = init_flow_table(
+      16, IDLE_TIMEOUT, ACTIVE_TIMEOUT, emit_test_flow, &emitted);
+  assert_non_null(table);
+  assert_int_equal(table->size, 16);
+
+  make_flow_key(&key, 50000);
+  make_flow_key(&other, 50001);
+
+  assert_int_equal(update_flow_table(table, &key, 100, 60, FLOW_TCP_SYN), 0);
+  assert_int_equal(update_flow_table(table, &key, 200, 1500, FLOW_TCP_ACK),
+                   0);
+  assert_int_equal(update_flow_table(table, &other, 150, 100, 0), 0);
+  assert_int_equal(table->count, 2);
+  assert_int_equal(table->packets, 3);
+  assert_int_equal(update_flow_table(NULL, &key, 0, 0, 0), -1);
+
+  // Only the other flow is idle
+  assert_int_equal(expire_flow_table(table, 150 + IDLE_TIMEOUT), 1);
+  assert_int_equal(emitted.count, 1);
+  assert_int_equal(emitted.records[0].key.source, 50001);
+  assert_int_equal(emitted.records[0].packets, 1);
+
+  assert_int_equal(flush_flow_table(table), 1);
+  assert_int_equal(table->count, 0);
+  assert_int_equal(emitted.count, 2);
+
+  struct flow_record *record = &emitted.records[1];
+  assert_memory_equal(&record->key, &key, sizeof(struct flow_key));
+  assert_int_equal(record->first_timestamp, 100);
+  assert_int_equal(record->last_timestamp, 200);
+  assert_int_equal(record->packets, 2);
+  assert_int_equal(record->bytes, 1560);
+  assert_int_equal(record->tcp_flags, FLOW_TCP_SYN | FLOW_TCP_ACK);
+
+  free_flow_table(table);
+}
+
+static void test_flow_table_active_timeout(void **state) {
+  (void)state; /* unused */
+
+  struct emitted_flows emitted = {.count = 0};
+  struct flow_key key;
+  struct flow_table *table = init_flow_table(
+      8, IDLE_TIMEOUT, ACTIVE_TIMEOUT, emit_test_flow, &emitted);
+  assert_non_null(table);
+
+  make_flow_key(&key, 50000);
+
+  // A flow that is never idle is emitted every ACTIVE_TIMEOUT
+  for (uint64_t ts = 0; ts <= ACTIVE_TIMEOUT; ts += IDLE_TIMEOUT / 2) {
+    assert_int_equal(update_flow_table(table, &key, ts, 10, 0), 0);
+  }
+
+  assert_int_equal(emitted.count, 1);
+  assert_int_equal(emitted.records[0].first_timestamp, 0);
+  assert_int_equal(emitted.records[0].packets, 20);
+  assert_int_equal(table->count, 1);
+
+  assert_int_equal(flush_flow_table(table), 1);
+  assert_int_equal(emitted.records[1].first_timestamp, ACTIVE_TIMEOUT);
+  assert_int_equal(emitted.records[1].packets, 1);
+
+  free_flow_table(table);
+}
+
+static void test_flow_table_full(void **state) {
+  (void)state; /* unused */
+
+  struct emitted_flows emitted = {.count = 0};
+  struct flow_key key;
+  struct flow_table *table = init_flow_table(
+      8, IDLE_TIMEOUT, ACTIVE_TIMEOUT, emit_test_flow, &emitted);
+  assert_non_null(table);
+
+  // Fill the table to its maximum load
+  for (uint16_t port = 0; port < 6; port++) {
+    make_flow_key(&key, port);
+    assert_int_equal(update_flow_table(table, &key, port, 10, 0), 0);
+  }
+  assert_int_equal(table->count, 6);
+  assert_int_equal(emitted.count, 0);
+
+  // Only the least recently seen flow is emitted
+  make_flow_key(&key, 100);
+  assert_int_equal(update_flow_table(table, &key, 10, 10, 0), 0);
+  assert_int_equal(emitted.count, 1);
+  assert_int_equal(emitted.records[0].key.source, 0);
+  assert_int_equal(table->count, 6);
+
+  // A flow seen again isn't the next one evicted
+  make_flow_key(&key, 1);
+  assert_int_equal(update_flow_table(table, &key, 20, 10, 0), 0);
+  make_flow_key(&key, 200);
+  assert_int_equal(update_flow_table(table, &key, 21, 10, 0), 0);
+  assert_int_equal(emitted.count, 2);
+  assert_int_equal(emitted.records[1].key.source, 2);
+  assert_int_equal(table->count, 6);
+
+  // The remaining flows keep their counters
+  assert_int_equal(flush_flow_table(table), 6);
+  for (size_t idx = 2; idx < emitted.count; idx++) {
+    if (emitted.records[idx].key.source == 1) {
+      assert_int_equal(emitted.records[idx].packets, 2);
+    }
+  }
+
+  free_flow_table(table);
+}
+
+static void test_flow_table_remove(void **state) {
+  (void)state; /* unused */
+
+  struct flow_key key;
+  struct flow_table *table =
+      init_flow_table(64, IDLE_TIMEOUT, ACTIVE_TIMEOUT, NULL, NULL);
+  assert_non_null(table);
+
+  // Half of the flows expire, the rest must still be found after the
+  // backward shifts
+  for (uint16_t port = 0; port < 40; port++) {
+    make_flow_key(&key, port);
+    uint64_t ts = (port % 2) ? 0 : IDLE_TIMEOUT;
+    assert_int_equal(update_flow_table(table, &key, ts, 10, 0), 0);
+  }
+
+  assert_int_equal(expire_flow_table(table, IDLE_TIMEOUT), 20);
+  assert_int_equal(table->count, 20);
+
+  for (uint16_t port = 0; port < 40; port += 2) {
+    make_flow_key(&key, port);
+    assert_int_equal(update_flow_table(table, &key, IDLE_TIMEOUT, 10, 0), 0);
+  }
+
+  // No new flows were added
+  assert_int_equal(table->count, 20);
+  assert_int_equal(table->emitted, 20);
+
+  free_flow_table(table);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_update_flow_table),
+      cmocka_unit_test(test_flow_table_active_timeout),
+      cmocka_unit_test(test_flow_table_full),
+      cmocka_unit_test(test_flow_table_remove)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
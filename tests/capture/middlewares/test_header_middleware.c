@@ -37,7 +37,7 @@ static void test_save_packet_statement(void **state) {
   (void)state; /* unused */
 
   uint8_t packet[1000];
-  struct tuple_packet tp;
+  struct tuple_packet tp = {0};
 
   sqlite3 *db;
   int ret = sqlite3_open(":memory:", &db);
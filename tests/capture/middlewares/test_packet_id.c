@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "capture/middlewares/header_middleware/packet_id.h"
+#include "utils/log.h"
+
+#define SLOT_MASK (MAX_PACKET_ID_SLOTS - 1)
+
+static void test_next_packet_id(void **state) {
+  (void)state; /* unused */
+
+  struct packet_id_gen gen, other;
+  init_packet_id_gen(&gen, 3, 0);
+  init_packet_id_gen(&other, 4, 0);
+
+  uint64_t first = next_packet_id(&gen);
+  uint64_t id = first;
+
+  assert_int_equal(first & SLOT_MASK, 3);
+  // The start time is in the top bits
+  assert_true(first >> (PACKET_ID_COUNTER_BITS + PACKET_ID_SLOT_BITS) > 0);
+
+  for (int idx = 1; idx < 1000; idx++) {
+    uint64_t next = next_packet_id(&gen);
+    assert_true(next > id);
+    assert_int_equal(next & SLOT_MASK, 3);
+    id = next;
+  }
+
+  // Two interfaces never share an id
+  assert_int_not_equal(next_packet_id(&other) & SLOT_MASK, 3);
+
+  // The ids fit in a sqlite3 INTEGER
+  assert_true(id < INT64_MAX);
+}
+
+static void test_packet_id_counter_carry(void **state) {
+  (void)state; /* unused */
+
+  struct packet_id_gen gen;
+  init_packet_id_gen(&gen, 1, 0);
+
+  uint64_t start = atomic_load(&gen.next) >>
+                   (PACKET_ID_COUNTER_BITS + PACKET_ID_SLOT_BITS);
+
+  // Move the counter to its last value
+  atomic_fetch_add(&gen.next, (((uint64_t)1 << PACKET_ID_COUNTER_BITS) - 1)
+                                  << PACKET_ID_SLOT_BITS);
+  uint64_t last = next_packet_id(&gen);
+  uint64_t carry = next_packet_id(&gen);
+
+  assert_true(carry > last);
+  assert_int_equal(carry & SLOT_MASK, 1);
+  assert_int_equal(carry >> (PACKET_ID_COUNTER_BITS + PACKET_ID_SLOT_BITS),
+                   start + 1);
+}
+
+static void test_packet_id_restart(void **state) {
+  (void)state; /* unused */
+
+  struct packet_id_gen gen, restarted;
+  uint64_t last = 0;
+
+  init_packet_id_gen(&gen, 2, 0);
+  for (int idx = 0; idx < 1000; idx++) {
+    last = next_packet_id(&gen);
+  }
+
+  // A capture restarted within the same second continues after the last id
+  init_packet_id_gen(&restarted, 2, last);
+  uint64_t id = next_packet_id(&restarted);
+  assert_true(id > last);
+  assert_int_equal(id & SLOT_MASK, 2);
+
+  // The last id of another slot is also skipped
+  init_packet_id_gen(&restarted, 5, last);
+  id = next_packet_id(&restarted);
+  assert_true(id > last);
+  assert_int_equal(id & SLOT_MASK, 5);
+
+  // Seeding only moves the generator forward
+  seed_packet_id_gen(&restarted, last + 1000);
+  id = next_packet_id(&restarted);
+  assert_true(id > last + 1000);
+  assert_int_equal(id & SLOT_MASK, 5);
+  seed_packet_id_gen(&restarted, last);
+  assert_true(next_packet_id(&restarted) > id);
+}
+
+static void test_packet_id_2_uuid(void **state) {
+  (void)state; /* unused */
+
+  char str[MAX_RANDOM_UUID_LEN];
+
+  assert_ptr_equal(packet_id_2_uuid(0x0123456789abcdefULL, str), str);
+  assert_string_equal(str, "01234567-89ab-8cde-800f-000000000000");
+  assert_int_equal(strlen(str), MAX_RANDOM_UUID_LEN - 1);
+
+  packet_id_2_uuid(UINT64_MAX, str);
+  assert_string_equal(str, "ffffffff-ffff-8fff-800f-000000000000");
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_next_packet_id),
+      cmocka_unit_test(test_packet_id_counter_carry),
+      cmocka_unit_test(test_packet_id_restart),
+      cmocka_unit_test(test_packet_id_2_uuid)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
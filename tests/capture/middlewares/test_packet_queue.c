@@ -34,7 +34,7 @@ static void test_push_packet_queue(void **state) {
 static void test_pop_packet_queue(void **state) {
   (void)state; /* unused */
 
-  struct tuple_packet tp1, tp2;
+  struct tuple_packet tp1 = {0}, tp2 = {0};
   struct packet_queue *queue = init_packet_queue();
 
   tp1.type = PACKET_ETHERNET;
@@ -71,14 +71,68 @@ static void test_pop_pcap_queue(void **state) {
   assert_null(pop_pcap_queue(queue));
 }
 
+static void test_pcap_queue_slab(void **state) {
+  (void)state; /* unused */
+
+  struct pcap_pkthdr header = {0};
+  struct os_slab_stats stats;
+  uint8_t *packet = os_zalloc(PCAP_QUEUE_INLINE_SIZE + 100);
+  struct pcap_queue *queue = init_pcap_queue();
+
+  assert_int_equal(get_pcap_queue_stats(NULL, &stats), -1);
+  assert_int_equal(get_pcap_queue_stats(queue, NULL), -1);
+
+  // Small packets are stored in the element
+  packet[0] = 0xAA;
+  header.caplen = 10;
+  struct pcap_queue *small = push_pcap_queue(queue, &header, packet);
+  assert_non_null(small);
+  assert_ptr_equal(small->packet, (uint8_t *)(small + 1));
+
+  // Large packets are allocated separately
+  packet[PCAP_QUEUE_INLINE_SIZE + 99] = 0xBB;
+  header.caplen = PCAP_QUEUE_INLINE_SIZE + 100;
+  struct pcap_queue *large = push_pcap_queue(queue, &header, packet);
+  assert_non_null(large);
+  assert_ptr_not_equal(large->packet, (uint8_t *)(large + 1));
+  assert_int_equal(large->packet[PCAP_QUEUE_INLINE_SIZE + 99], 0xBB);
+
+  assert_int_equal(get_pcap_queue_stats(queue, &stats), 0);
+  assert_int_equal(stats.in_use, 2);
+  assert_int_equal(stats.capacity, PCAP_QUEUE_SLAB_CHUNK);
+
+  struct pcap_queue *pq = pop_pcap_queue(queue);
+  assert_ptr_equal(pq, small);
+  assert_int_equal(pq->packet[0], 0xAA);
+  free_pcap_queue_el(pq);
+
+  pq = pop_pcap_queue(queue);
+  assert_ptr_equal(pq, large);
+  free_pcap_queue_el(pq);
+
+  // The freed elements are reused
+  header.caplen = 10;
+  assert_ptr_equal(push_pcap_queue(queue, &header, packet), large);
+
+  assert_int_equal(get_pcap_queue_stats(queue, &stats), 0);
+  assert_int_equal(stats.in_use, 1);
+  assert_int_equal(stats.high_water, 2);
+  assert_int_equal(stats.allocs, 3);
+
+  free_pcap_queue(queue);
+  os_free(packet);
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
 
   log_set_quiet(false);
 
-  const struct CMUnitTest tests[] = {cmocka_unit_test(test_push_pcap_queue),
-                                     cmocka_unit_test(test_pop_pcap_queue)};
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_push_pcap_queue),
+      cmocka_unit_test(test_pop_pcap_queue),
+      cmocka_unit_test(test_pcap_queue_slab)};
 
   return cmocka_run_group_tests(tests, NULL, NULL);
 }
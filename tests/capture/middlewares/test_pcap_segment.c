@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "capture/middlewares/pcap_middleware/pcap_segment.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+static char *test_pcap_path = "/tmp";
+
+static void remove_segment_file(char *name) {
+  char *path = construct_path(test_pcap_path, name);
+  assert_non_null(path);
+  remove(path);
+  os_free(path);
+}
+
+static void test_write_pcap_segment(void **state) {
+  (void)state; /* unused */
+
+  struct pcap_pkthdr header;
+  uint8_t packet[100];
+  uint64_t offset = 0, next_offset = 0;
+  char name[MAX_PCAP_FILE_NAME_LENGTH];
+
+  pcap_t *pd = pcap_open_dead(DLT_EN10MB, 65535);
+  assert_non_null(pd);
+
+  struct pcap_segment *segment = init_pcap_segment(pd, test_pcap_path, 0, 0);
+  assert_non_null(segment);
+
+  os_memset(&header, 0, sizeof(struct pcap_pkthdr));
+  os_memset(packet, 0, ARRAY_SIZE(packet));
+  header.caplen = 100;
+  header.len = 100;
+
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  assert_true(strlen(segment->name) > 0);
+  os_strlcpy(name, segment->name, MAX_PCAP_FILE_NAME_LENGTH);
+
+  // The second packet is appended to the same segment
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &next_offset),
+                   0);
+  assert_string_equal(segment->name, name);
+  assert_int_equal(next_offset, offset + PCAP_RECORD_HEADER_SIZE + 100);
+
+  assert_int_equal(flush_pcap_segment(segment), 0);
+  assert_non_null(segment->dumper);
+
+  assert_int_equal(write_pcap_segment(segment, NULL, packet, &offset), -1);
+  assert_int_equal(write_pcap_segment(segment, &header, NULL, &offset), -1);
+  assert_int_equal(write_pcap_segment(NULL, &header, packet, &offset), -1);
+
+  free_pcap_segment(segment);
+  remove_segment_file(name);
+  pcap_close(pd);
+}
+
+static void test_rotate_pcap_segment(void **state) {
+  (void)state; /* unused */
+
+  struct pcap_pkthdr header;
+  uint8_t packet[100];
+  uint64_t offset = 0;
+  char name[MAX_PCAP_FILE_NAME_LENGTH];
+
+  pcap_t *pd = pcap_open_dead(DLT_EN10MB, 65535);
+  assert_non_null(pd);
+
+  // Rotate by size
+  struct pcap_segment *segment =
+      init_pcap_segment(pd, test_pcap_path, 100, 0);
+  assert_non_null(segment);
+
+  os_memset(&header, 0, sizeof(struct pcap_pkthdr));
+  os_memset(packet, 0, ARRAY_SIZE(packet));
+  header.caplen = 100;
+  header.len = 100;
+
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  os_strlcpy(name, segment->name, MAX_PCAP_FILE_NAME_LENGTH);
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  assert_string_not_equal(segment->name, name);
+  remove_segment_file(name);
+  os_strlcpy(name, segment->name, MAX_PCAP_FILE_NAME_LENGTH);
+  free_pcap_segment(segment);
+  remove_segment_file(name);
+
+  // Rotate by age
+  segment = init_pcap_segment(pd, test_pcap_path, 0, 1000000);
+  assert_non_null(segment);
+
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  os_strlcpy(name, segment->name, MAX_PCAP_FILE_NAME_LENGTH);
+  header.ts.tv_usec = 10;
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  assert_string_equal(segment->name, name);
+  header.ts.tv_sec = 1;
+  header.ts.tv_usec = 0;
+  assert_int_equal(write_pcap_segment(segment, &header, packet, &offset), 0);
+  assert_string_not_equal(segment->name, name);
+  remove_segment_file(name);
+
+  // A removed segment is closed on flush
+  os_strlcpy(name, segment->name, MAX_PCAP_FILE_NAME_LENGTH);
+  remove_segment_file(name);
+  assert_int_equal(flush_pcap_segment(segment), 0);
+  assert_null(segment->dumper);
+
+  free_pcap_segment(segment);
+  pcap_close(pd);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_write_pcap_segment),
+      cmocka_unit_test(test_rotate_pcap_segment)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -6,8 +6,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <cmocka.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <net/if.h>
 #include <pthread.h>
 #include <sqlite3.h>
 #include <string.h>
@@ -19,6 +21,7 @@
 #include "capture/middlewares/header_middleware/header_middleware.h"
 #include "capture/middlewares/header_middleware/sqlite_header.h"
 #include "utils/log.h"
+#include "utils/os.h"
 #include "utils/sqliteu.h"
 
 char *test_capture_db = "file::memory:?cache=shared";
@@ -76,6 +79,287 @@ static void test_init_sqlite_header_db(void **state) {
   assert_string_equal(arg3.error_message, "");
 }
 
+static int count_eth_rows(sqlite3 *db) {
+  sqlite3_stmt *res = NULL;
+  int count;
+
+  assert_int_equal(
+      sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM eth;", -1, &res, NULL),
+      SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  count = sqlite3_column_int(res, 0);
+  sqlite3_finalize(res);
+
+  return count;
+}
+
+static void test_sqlite_header_writer(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  struct eth_schema eths = {0};
+  struct tuple_packet tp = {.packet = (uint8_t *)&eths,
+                            .type = PACKET_ETHERNET};
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+
+  struct sqlite_header_writer *writer = init_sqlite_header_writer(db, 2);
+  assert_non_null(writer);
+
+  for (int idx = 0; idx < 3; idx++) {
+    eths.timestamp = idx;
+    eths.id = idx;
+    assert_int_equal(save_sqlite_header_packet(writer, &tp), 0);
+  }
+
+  // The first two packets were committed when the third one was saved
+  assert_true(writer->in_transaction);
+  assert_int_equal(writer->batch_size, 1);
+  assert_int_equal(count_eth_rows(db), 3);
+
+  assert_int_equal(commit_sqlite_header_writer(writer), 0);
+  assert_false(writer->in_transaction);
+  assert_int_equal(writer->batch_size, 0);
+  assert_int_equal(sqlite3_get_autocommit(db), 1);
+
+  // Duplicate primary key
+  assert_int_equal(save_sqlite_header_packet(writer, &tp), -1);
+  tp.type = PACKET_NONE;
+  assert_int_equal(save_sqlite_header_packet(writer, &tp), -1);
+
+  free_sqlite_header_writer(writer);
+  assert_int_equal(sqlite3_get_autocommit(db), 1);
+  assert_int_equal(count_eth_rows(db), 3);
+
+  // No transactions are opened when max_batch_size is 0
+  writer = init_sqlite_header_writer(db, 0);
+  assert_non_null(writer);
+  tp.type = PACKET_ETHERNET;
+  eths.timestamp = 3;
+  assert_int_equal(save_sqlite_header_packet(writer, &tp), 0);
+  assert_false(writer->in_transaction);
+  assert_int_equal(sqlite3_get_autocommit(db), 1);
+  free_sqlite_header_writer(writer);
+
+  assert_int_equal(count_eth_rows(db), 4);
+  sqlite3_close(db);
+}
+
+static void test_get_sqlite_packet_id_slot(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  char ifname[IF_NAMESIZE];
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+
+  // The slots are dense, whatever the interface indexes are
+  assert_int_equal(get_sqlite_packet_id_slot(db, "wlan0"), 1);
+  assert_int_equal(get_sqlite_packet_id_slot(db, "wlan0.257"), 2);
+  assert_int_equal(get_sqlite_packet_id_slot(db, "wlan0"), 1);
+
+  for (unsigned int idx = 3; idx < MAX_PACKET_ID_SLOTS; idx++) {
+    snprintf(ifname, IF_NAMESIZE, "eth%u", idx);
+    assert_int_equal(get_sqlite_packet_id_slot(db, ifname), idx);
+  }
+
+  // No slot is left
+  assert_int_equal(get_sqlite_packet_id_slot(db, "eth0"), -1);
+  assert_int_equal(sqlite3_get_autocommit(db), 1);
+  assert_int_equal(get_sqlite_packet_id_slot(db, "wlan0.257"), 2);
+
+  sqlite3_close(db);
+}
+
+static void test_packet_id_capture_restart(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  struct packet_id_gen ids;
+  struct eth_schema eths = {0};
+  struct tuple_packet tp = {.packet = (uint8_t *)&eths,
+                            .type = PACKET_ETHERNET};
+  uint64_t last_id;
+  int slot;
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+  assert_int_equal(get_sqlite_header_last_id(db, &last_id), 0);
+  assert_int_equal(last_id, 0);
+
+  struct sqlite_header_writer *writer = init_sqlite_header_writer(db, 0);
+  assert_non_null(writer);
+
+  // Two runs of the same capture, started within the same second
+  for (int run = 0; run < 2; run++) {
+    slot = get_sqlite_packet_id_slot(db, "wlan0");
+    assert_int_equal(slot, 1);
+    assert_int_equal(get_sqlite_header_last_id(db, &last_id), 0);
+    init_packet_id_gen(&ids, slot, last_id);
+
+    for (int idx = 0; idx < 10; idx++) {
+      eths.id = next_packet_id(&ids);
+      assert_int_equal(save_sqlite_header_packet(writer, &tp), 0);
+    }
+  }
+
+  assert_int_equal(get_sqlite_header_last_id(db, &last_id), 0);
+  assert_int_equal(last_id, eths.id);
+  assert_int_equal(count_eth_rows(db), 20);
+
+  free_sqlite_header_writer(writer);
+  sqlite3_close(db);
+}
+
+static void test_migrate_sqlite_header_db(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  sqlite3_stmt *res = NULL;
+  uint64_t last_id;
+  // The tables of a db created before the integer packet ids
+  const char *old_db =
+      "CREATE TABLE eth (timestamp INTEGER NOT NULL, id TEXT NOT NULL, "
+      "caplen INTEGER, length INTEGER, ifname TEXT, ether_dhost TEXT, "
+      "ether_shost TEXT, ether_type INTEGER, PRIMARY KEY (timestamp, id));"
+      "CREATE TABLE udp (id TEXT NOT NULL, source INTEGER, dest INTEGER, "
+      "len INTEGER, check_p INTEGER, PRIMARY KEY (id));"
+      "INSERT INTO eth VALUES(20, 'b0c9c1b2-uuid', 60, 60, 'wlan0', '', '', "
+      "2048);"
+      "INSERT INTO eth VALUES(10, 'f3a01d55-uuid', 60, 60, 'wlan0', '', '', "
+      "2048);"
+      "INSERT INTO udp VALUES('b0c9c1b2-uuid', 53, 1000, 40, 0);";
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(execute_sqlite_query(db, old_db), 0);
+
+  // The UUIDs are numbered in the order of the eth timestamps
+  assert_int_equal(init_sqlite_header_db(db), 0);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+  assert_int_equal(get_sqlite_header_last_id(db, &last_id), 0);
+  assert_int_equal(last_id, 2 << PACKET_ID_SLOT_BITS);
+
+  assert_int_equal(
+      sqlite3_prepare_v2(db,
+                         "SELECT eth.timestamp, typeof(eth.id), udp.source "
+                         "FROM eth JOIN udp ON eth.id = udp.id;",
+                         -1, &res, NULL),
+      SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_int_equal(sqlite3_column_int(res, 0), 20);
+  assert_string_equal((const char *)sqlite3_column_text(res, 1), "integer");
+  assert_int_equal(sqlite3_column_int(res, 2), 53);
+  assert_int_equal(sqlite3_step(res), SQLITE_DONE);
+  sqlite3_finalize(res);
+
+  assert_int_equal(count_eth_rows(db), 2);
+  assert_int_equal(check_table_exists(db, "eth_old"), 0);
+
+  sqlite3_close(db);
+}
+
+static void test_save_packet_addresses(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  sqlite3_stmt *res = NULL;
+  struct eth_schema eths = {
+      .id = 1,
+      .ether_dhost = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+      .ether_shost = {0x00, 0x0a, 0xbc, 0xde, 0xf1, 0x02},
+  };
+  struct ip4_schema ip4s = {.id = 2};
+  struct tuple_packet tp = {.packet = (uint8_t *)&eths,
+                            .type = PACKET_ETHERNET};
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+
+  // The binary addresses are stored as text
+  assert_int_equal(save_packet_statement(db, &tp), 0);
+  assert_int_equal(sqlite3_prepare_v2(db,
+                                      "SELECT ether_dhost, ether_shost FROM "
+                                      "eth WHERE id=1;",
+                                      -1, &res, NULL),
+                   SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_string_equal((const char *)sqlite3_column_text(res, 0),
+                      "ff:ff:ff:ff:ff:ff");
+  assert_string_equal((const char *)sqlite3_column_text(res, 1),
+                      "00:0a:bc:de:f1:02");
+  sqlite3_finalize(res);
+
+  assert_int_equal(inet_pton(AF_INET, "10.0.0.1", &ip4s.ip_src), 1);
+  assert_int_equal(inet_pton(AF_INET, "192.168.1.255", &ip4s.ip_dst), 1);
+  tp.packet = (uint8_t *)&ip4s;
+  tp.type = PACKET_IP4;
+  assert_int_equal(save_packet_statement(db, &tp), 0);
+  assert_int_equal(
+      sqlite3_prepare_v2(db, "SELECT ip_src, ip_dst FROM ip4 WHERE id=2;",
+                         -1, &res, NULL),
+      SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_string_equal((const char *)sqlite3_column_text(res, 0),
+                      "10.0.0.1");
+  assert_string_equal((const char *)sqlite3_column_text(res, 1),
+                      "192.168.1.255");
+  sqlite3_finalize(res);
+
+  sqlite3_close(db);
+}
+
+static void test_save_sqlite_header_flow(void **state) {
+  (void)state;
+
+  sqlite3 *db = NULL;
+  sqlite3_stmt *res = NULL;
+  struct flow_record record = {
+      .first_timestamp = 100,
+      .last_timestamp = 200,
+      .packets = 3,
+      .bytes = 1800,
+      .tcp_flags = FLOW_TCP_SYN | FLOW_TCP_ACK,
+  };
+
+  os_strlcpy(record.key.ifname, "wlan0", IF_NAMESIZE);
+  record.key.family = AF_INET6;
+  record.key.protocol = 6;
+  record.key.source = 50000;
+  record.key.dest = 443;
+  assert_int_equal(inet_pton(AF_INET6, "fe80::1", record.key.src), 1);
+  assert_int_equal(inet_pton(AF_INET6, "fe80::2", record.key.dst), 1);
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_header_db(db), 0);
+
+  struct sqlite_header_writer *writer = init_sqlite_header_writer(db, 10);
+  assert_non_null(writer);
+  assert_int_equal(save_sqlite_header_flow(writer, &record), 0);
+  assert_int_equal(save_sqlite_header_flow(writer, NULL), -1);
+  assert_true(writer->in_transaction);
+  free_sqlite_header_writer(writer);
+
+  assert_int_equal(sqlite3_prepare_v2(db,
+                                      "SELECT ifname, ip_src, ip_dst, dest, "
+                                      "packets, bytes, tcp_flags FROM flow;",
+                                      -1, &res, NULL),
+                   SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_string_equal((const char *)sqlite3_column_text(res, 0), "wlan0");
+  assert_string_equal((const char *)sqlite3_column_text(res, 1), "fe80::1");
+  assert_string_equal((const char *)sqlite3_column_text(res, 2), "fe80::2");
+  assert_int_equal(sqlite3_column_int(res, 3), 443);
+  assert_int_equal(sqlite3_column_int(res, 4), 3);
+  assert_int_equal(sqlite3_column_int(res, 5), 1800);
+  assert_int_equal(sqlite3_column_int(res, 6), FLOW_TCP_SYN | FLOW_TCP_ACK);
+  assert_int_equal(sqlite3_step(res), SQLITE_DONE);
+  sqlite3_finalize(res);
+
+  sqlite3_close(db);
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
@@ -83,7 +367,13 @@ int main(int argc, char *argv[]) {
   log_set_quiet(false);
 
   const struct CMUnitTest tests[] = {
-      cmocka_unit_test(test_init_sqlite_header_db)};
+      cmocka_unit_test(test_init_sqlite_header_db),
+      cmocka_unit_test(test_sqlite_header_writer),
+      cmocka_unit_test(test_get_sqlite_packet_id_slot),
+      cmocka_unit_test(test_packet_id_capture_restart),
+      cmocka_unit_test(test_migrate_sqlite_header_db),
+      cmocka_unit_test(test_save_packet_addresses),
+      cmocka_unit_test(test_save_sqlite_header_flow)};
 
   return cmocka_run_group_tests(tests, NULL, NULL);
 }
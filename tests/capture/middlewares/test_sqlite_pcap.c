@@ -61,9 +61,148 @@ static void test_save_sqlite_pcap_entry(void **state) {
   assert_int_equal(ret, SQLITE_OK);
 
   assert_int_equal(init_sqlite_pcap_db(db), 0);
-  assert_int_equal(save_sqlite_pcap_entry(db, "test", 12345, 10, 10), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "test", 12345, 24, 10, 10), 0);
   sqlite3_close(db);
 }
+
+static void test_migrate_sqlite_pcap_db(void **state) {
+  (void)state; /* unused */
+
+  sqlite3 *db;
+  sqlite3_stmt *res = NULL;
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+
+  // The table layout before the segment files
+  assert_int_equal(
+      execute_sqlite_query(db, "CREATE TABLE " PCAP_TABLE_NAME
+                               " (timestamp INTEGER NOT NULL, name TEXT NOT "
+                               "NULL, caplen INTEGER, length INTEGER, "
+                               "PRIMARY KEY (name));"),
+      0);
+  assert_int_equal(execute_sqlite_query(db, "INSERT INTO " PCAP_TABLE_NAME
+                                            " VALUES(100, 'a', 10, 20);"),
+                   0);
+
+  assert_int_equal(init_sqlite_pcap_db(db), 0);
+  assert_int_equal(check_column_exists(db, PCAP_TABLE_NAME, "file_offset"), 1);
+  assert_int_equal(check_table_exists(db, PCAP_OLD_TABLE_NAME), 0);
+
+  assert_int_equal(
+      sqlite3_prepare_v2(db,
+                         "SELECT timestamp,file_offset,caplen,length FROM "
+                         PCAP_TABLE_NAME " WHERE name = 'a';",
+                         -1, &res, 0),
+      SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_int_equal(sqlite3_column_int(res, 0), 100);
+  assert_int_equal(sqlite3_column_int(res, 1), 24);
+  assert_int_equal(sqlite3_column_int(res, 2), 10);
+  assert_int_equal(sqlite3_column_int(res, 3), 20);
+  sqlite3_finalize(res);
+
+  // The new inserts work and the migration runs only once
+  assert_int_equal(save_sqlite_pcap_entry(db, "b", 200, 24, 10, 10), 0);
+  assert_int_equal(init_sqlite_pcap_db(db), 0);
+
+  sqlite3_close(db);
+}
+
+static void test_backfill_sqlite_pcap_segments(void **state) {
+  (void)state; /* unused */
+
+  sqlite3 *db;
+  struct pcap_usage usage;
+  struct pcap_file_meta meta;
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_pcap_db(db), 0);
+
+  // Rows of two old single packet files and of a segment file
+  assert_int_equal(save_sqlite_pcap_entry(db, "a", 100, 24, 10, 10), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "b", 200, 24, 20, 20), 0);
+  assert_int_equal(save_sqlite_pcap_segment(db, "c", "wlan0", 300, 24), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "c", 300, 24, 30, 30), 0);
+
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 0);
+  assert_int_equal(usage.size, 24 + 30 + 16);
+
+  assert_int_equal(backfill_sqlite_pcap_segments(db, "wlan0"), 0);
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 0);
+  assert_int_equal(usage.size, 3 * 24 + (10 + 16) + (20 + 16) + (30 + 16));
+
+  // The old files are the oldest segments
+  assert_int_equal(get_oldest_pcap_segment(db, "wlan0", &meta), 0);
+  assert_string_equal(meta.name, "a");
+  assert_int_equal(meta.timestamp, 100);
+  assert_int_equal(meta.size, 24 + 10 + 16);
+  os_free(meta.name);
+
+  // The segments are added only once
+  assert_int_equal(backfill_sqlite_pcap_segments(db, "wlan1"), 0);
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan1", &usage), 1);
+
+  sqlite3_close(db);
+}
+
+static void test_pcap_usage(void **state) {
+  (void)state; /* unused */
+
+  sqlite3 *db;
+  struct pcap_usage usage;
+  struct pcap_file_meta meta;
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_sqlite_pcap_db(db), 0);
+
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 1);
+  assert_int_equal(save_sqlite_pcap_quota(db, "wlan0", 1000, 5), 0);
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 0);
+  assert_int_equal(usage.size, 0);
+  assert_int_equal(usage.max_size, 1000);
+  assert_int_equal(usage.max_age, 5);
+
+  // Every record adds its 16 bytes header and caplen
+  assert_int_equal(save_sqlite_pcap_segment(db, "a", "wlan0", 100, 24), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "a", 100, 24, 10, 10), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "a", 101, 50, 20, 20), 0);
+  assert_int_equal(save_sqlite_pcap_segment(db, "b", "wlan0", 200, 24), 0);
+  assert_int_equal(save_sqlite_pcap_entry(db, "b", 200, 24, 30, 30), 0);
+  assert_int_equal(save_sqlite_pcap_segment(db, "c", "eth0", 50, 24), 0);
+
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 0);
+  assert_int_equal(usage.size, 24 + 26 + 36 + 24 + 46);
+  assert_int_equal(usage.max_size, 1000);
+
+  // The newest segment is still open, so only "a" can be evicted
+  assert_int_equal(get_oldest_pcap_segment(db, "wlan0", &meta), 0);
+  assert_string_equal(meta.name, "a");
+  assert_int_equal(meta.timestamp, 100);
+  assert_int_equal(meta.size, 24 + 26 + 36);
+  assert_int_equal(delete_pcap_segment(db, meta.name), 0);
+  os_free(meta.name);
+
+  assert_int_equal(get_oldest_pcap_segment(db, "wlan0", &meta), 1);
+  assert_null(meta.name);
+  assert_int_equal(get_sqlite_pcap_usage(db, "wlan0", &usage), 0);
+  assert_int_equal(usage.size, 24 + 46);
+  assert_int_equal(get_sqlite_pcap_usage(db, "eth0", &usage), 0);
+  assert_int_equal(usage.size, 24);
+
+  // The entries of the evicted segment are removed
+  sqlite3_stmt *res = NULL;
+  assert_int_equal(sqlite3_prepare_v2(db,
+                                      "SELECT COUNT(*) FROM " PCAP_TABLE_NAME
+                                      " WHERE name = 'a';",
+                                      -1, &res, 0),
+                   SQLITE_OK);
+  assert_int_equal(sqlite3_step(res), SQLITE_ROW);
+  assert_int_equal(sqlite3_column_int(res, 0), 0);
+  sqlite3_finalize(res);
+
+  sqlite3_close(db);
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
@@ -72,7 +211,10 @@ int main(int argc, char *argv[]) {
 
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_init_sqlite_pcap_db),
-      cmocka_unit_test(test_save_sqlite_pcap_entry)};
+      cmocka_unit_test(test_save_sqlite_pcap_entry),
+      cmocka_unit_test(test_migrate_sqlite_pcap_db),
+      cmocka_unit_test(test_backfill_sqlite_pcap_segments),
+      cmocka_unit_test(test_pcap_usage)};
 
   return cmocka_run_group_tests(tests, NULL, NULL);
 }
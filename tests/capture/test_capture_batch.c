@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <pcap.h>
+#include <string.h>
+
+#include "capture/capture_batch.h"
+#include "capture/middlewares_list.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+
+static size_t processed_packets;
+static size_t processed_batches;
+
+static int process_test_middleware(struct middleware_context *context,
+                                   const char *ltype,
+                                   struct pcap_pkthdr *header, uint8_t *packet,
+                                   char *ifname) {
+  (void)context;
+  (void)ltype;
+  (void)ifname;
+
+  assert_int_equal(packet[0], 0xAA);
+  assert_int_equal(header->caplen, 4);
+  processed_packets++;
+
+  return 0;
+}
+
+static int process_batch_test_middleware(struct middleware_context *context,
+                                         const char *ltype,
+                                         struct middleware_packet *packets,
+                                         size_t count, char *ifname) {
+  (void)context;
+  (void)ltype;
+  (void)ifname;
+  (void)packets;
+
+  processed_packets += count;
+  processed_batches++;
+
+  return 0;
+}
+
+static void test_init_capture_batch(void **state) {
+  (void)state; /* unused */
+
+  assert_null(init_capture_batch(0, 16));
+
+  struct capture_batch *batch = init_capture_batch(4, 16);
+  assert_non_null(batch);
+  assert_int_equal(batch->count, 0);
+  assert_int_equal(batch->max_count, 4);
+  assert_int_equal(batch->data_size, 16);
+  free_capture_batch(batch);
+
+  free_capture_batch(NULL);
+}
+
+static void test_push_capture_batch(void **state) {
+  (void)state; /* unused */
+
+  char ltype[] = "EN10MB";
+  uint8_t packet[8] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF, 0x00, 0x11};
+  struct pcap_pkthdr header = {.caplen = 4, .len = 8};
+  struct capture_batch *batch = init_capture_batch(3, 10);
+
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), 0);
+
+  // The packet data is copied into the batch
+  packet[0] = 0x00;
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), 0);
+  assert_int_equal(batch->count, 2);
+  assert_int_equal(batch->data_len, 8);
+  assert_ptr_equal(batch->ltype, ltype);
+  assert_int_equal(batch->packets[0].packet[0], 0xAA);
+  assert_int_equal(batch->packets[1].packet[0], 0x00);
+  assert_int_equal(batch->packets[1].header.len, 8);
+
+  // No data space left
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), -1);
+  header.caplen = 2;
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), 0);
+
+  // No packet slots left
+  header.caplen = 0;
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), -1);
+
+  reset_capture_batch(batch);
+  assert_int_equal(batch->count, 0);
+  assert_int_equal(batch->data_len, 0);
+  header.caplen = 8;
+  assert_int_equal(push_capture_batch(batch, ltype, &header, packet), 0);
+
+  free_capture_batch(batch);
+}
+
+static void test_push_capture_batch_ref(void **state) {
+  (void)state; /* unused */
+
+  char ltype[] = "EN10MB";
+  uint8_t packet[8] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF, 0x00, 0x11};
+  struct pcap_pkthdr header = {.caplen = 8, .len = 8};
+  struct capture_batch *batch = init_capture_batch(2, 4);
+
+  // The packet data isn't copied, so it isn't bound by the data buffer
+  assert_int_equal(push_capture_batch_ref(batch, ltype, &header, packet), 0);
+  assert_int_equal(push_capture_batch_ref(batch, ltype, &header, packet), 0);
+  assert_int_equal(batch->count, 2);
+  assert_int_equal(batch->data_len, 0);
+  assert_ptr_equal(batch->packets[0].packet, packet);
+  assert_ptr_equal(batch->ltype, ltype);
+
+  // No packet slots left
+  assert_int_equal(push_capture_batch_ref(batch, ltype, &header, packet), -1);
+
+  reset_capture_batch(batch);
+  assert_int_equal(batch->count, 0);
+
+  free_capture_batch(batch);
+}
+
+static void test_process_middlewares_batch(void **state) {
+  (void)state; /* unused */
+
+  char ltype[] = "EN10MB";
+  char ifname[] = "wlan0";
+  uint8_t packet[4] = {0xAA, 0xBB, 0xCC, 0xDD};
+  struct pcap_pkthdr header = {.caplen = 4, .len = 4};
+  struct capture_batch *batch = init_capture_batch(8, 64);
+  UT_array *handlers = NULL;
+
+  const struct capture_middleware legacy_middleware = {
+      .process = process_test_middleware,
+      .name = "legacy middleware",
+  };
+  const struct capture_middleware batch_middleware = {
+      .process = process_test_middleware,
+      .name = "batch middleware",
+      .process_batch = process_batch_test_middleware,
+  };
+  struct middleware_handlers legacy_handler = {.f = legacy_middleware};
+  struct middleware_handlers batch_handler = {.f = batch_middleware};
+
+  utarray_new(handlers, &middleware_icd);
+  utarray_push_back(handlers, &legacy_handler);
+  assert_false(has_batch_middlewares(handlers));
+
+  utarray_push_back(handlers, &batch_handler);
+  assert_true(has_batch_middlewares(handlers));
+
+  for (int idx = 0; idx < 5; idx++) {
+    assert_int_equal(push_capture_batch(batch, ltype, &header, packet), 0);
+  }
+
+  processed_packets = 0;
+  processed_batches = 0;
+  process_middlewares_batch(handlers, batch->ltype, batch->packets,
+                            batch->count, ifname);
+
+  // The legacy middleware is run for every packet of the batch
+  assert_int_equal(processed_packets, 10);
+  assert_int_equal(processed_batches, 1);
+
+  utarray_free(handlers);
+  free_capture_batch(batch);
+}
+
+static void test_get_middlewares_snaplen(void **state) {
+  (void)state; /* unused */
+
+  UT_array *handlers = NULL;
+  const struct capture_middleware header_middleware = {
+      .name = "header middleware",
+      .snaplen = MIDDLEWARE_SNAPLEN_HEADERS,
+  };
+  const struct capture_middleware dns_middleware = {
+      .name = "dns middleware",
+      .snaplen = 1024,
+  };
+  const struct capture_middleware full_middleware = {
+      .name = "full middleware",
+  };
+  struct middleware_handlers header_handler = {.f = header_middleware};
+  struct middleware_handlers dns_handler = {.f = dns_middleware};
+  struct middleware_handlers full_handler = {.f = full_middleware};
+
+  utarray_new(handlers, &middleware_icd);
+  assert_int_equal(get_middlewares_snaplen(handlers), MIDDLEWARE_SNAPLEN_FULL);
+
+  utarray_push_back(handlers, &header_handler);
+  assert_int_equal(get_middlewares_snaplen(handlers),
+                   MIDDLEWARE_SNAPLEN_HEADERS);
+
+  // The largest snaplen is used
+  utarray_push_back(handlers, &dns_handler);
+  assert_int_equal(get_middlewares_snaplen(handlers), 1024);
+
+  utarray_push_back(handlers, &full_handler);
+  assert_int_equal(get_middlewares_snaplen(handlers), MIDDLEWARE_SNAPLEN_FULL);
+
+  utarray_free(handlers);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_init_capture_batch),
+      cmocka_unit_test(test_push_capture_batch),
+      cmocka_unit_test(test_push_capture_batch_ref),
+      cmocka_unit_test(test_process_middlewares_batch),
+      cmocka_unit_test(test_get_middlewares_snaplen)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
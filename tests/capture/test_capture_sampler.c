@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <sqlite3.h>
+#include <string.h>
+
+#include "capture/capture_sampler.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+#define TEST_PACKET_LEN 42 // ethernet, IPv4 and UDP headers
+
+static void make_udp_packet(uint8_t *packet, uint8_t src, uint8_t dst,
+                            uint16_t source, uint16_t dest) {
+  os_memset(packet, 0, TEST_PACKET_LEN);
+  packet[12] = 0x08; // IPv4
+  packet[14] = 0x45;
+  packet[23] = 17; // UDP
+  packet[29] = src;
+  packet[33] = dst;
+  packet[34] = source >> 8;
+  packet[35] = source & 0xFF;
+  packet[36] = dest >> 8;
+  packet[37] = dest & 0xFF;
+}
+
+static void make_header(struct pcap_pkthdr *header, uint64_t timestamp,
+                        uint32_t len) {
+  header->ts.tv_sec = timestamp / 1000000;
+  header->ts.tv_usec = timestamp % 1000000;
+  header->caplen = TEST_PACKET_LEN;
+  header->len = len;
+}
+
+static void test_get_capture_flow_hash(void **state) {
+  (void)state; /* unused */
+
+  uint8_t packet[TEST_PACKET_LEN], reply[TEST_PACKET_LEN];
+  uint32_t hash;
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+  make_udp_packet(reply, 2, 1, 53, 1000);
+
+  hash = get_capture_flow_hash(packet, sizeof(packet));
+  assert_int_not_equal(hash, 0);
+  assert_int_equal(get_capture_flow_hash(reply, sizeof(reply)), hash);
+
+  make_udp_packet(reply, 2, 1, 53, 1001);
+  assert_int_not_equal(get_capture_flow_hash(reply, sizeof(reply)), hash);
+
+  // Truncated and non IP packets have no flow
+  assert_int_equal(get_capture_flow_hash(packet, 20), 0);
+  packet[12] = 0x08;
+  packet[13] = 0x06; // ARP
+  assert_int_equal(get_capture_flow_hash(packet, sizeof(packet)), 0);
+  assert_int_equal(get_capture_flow_hash(NULL, 0), 0);
+}
+
+static void test_sample_capture_rate(void **state) {
+  (void)state; /* unused */
+
+  uint8_t packet[TEST_PACKET_LEN];
+  struct pcap_pkthdr header;
+  int kept = 0;
+  struct capture_sampler *sampler = init_capture_sampler(4, 0, 0, 0);
+  assert_non_null(sampler);
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+  make_header(&header, 1000000, TEST_PACKET_LEN);
+
+  for (int idx = 0; idx < 10; idx++) {
+    bool keep = sample_capture_packet(sampler, "EN10MB", &header, packet);
+    assert_int_equal(keep, (idx % 4) == 0);
+    kept += keep;
+  }
+
+  assert_int_equal(kept, 3);
+  assert_int_equal(sampler->seen, 10);
+  assert_int_equal(sampler->kept, 3);
+
+  free_capture_sampler(sampler);
+}
+
+static void test_sample_capture_flow_head(void **state) {
+  (void)state; /* unused */
+
+  uint8_t packet[TEST_PACKET_LEN], other[TEST_PACKET_LEN];
+  struct pcap_pkthdr header;
+  uint64_t timestamp = 1000000;
+  struct capture_sampler *sampler = init_capture_sampler(0, 250, 0, 0);
+  assert_non_null(sampler);
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+  make_udp_packet(other, 3, 4, 1000, 53);
+
+  // The packets are kept until the flow has 250 bytes
+  make_header(&header, timestamp, 100);
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  // Other flows and other link types are not affected
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, other));
+  assert_true(sample_capture_packet(sampler, "LINUX_SLL", &header, packet));
+
+  // The flow starts again after the idle timeout
+  make_header(&header, timestamp + CAPTURE_SAMPLER_FLOW_TIMEOUT - 1, 100);
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  make_header(&header, timestamp + 2 * CAPTURE_SAMPLER_FLOW_TIMEOUT, 100);
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  assert_int_equal(sampler->seen, 8);
+  assert_int_equal(sampler->kept, 6);
+
+  free_capture_sampler(sampler);
+}
+
+static void test_sample_capture_flow_collision(void **state) {
+  (void)state; /* unused */
+
+  uint8_t packet[TEST_PACKET_LEN], other[TEST_PACKET_LEN];
+  struct pcap_pkthdr header;
+  uint64_t timestamp = 1000000;
+  uint32_t hash, other_hash = 0, mask = CAPTURE_SAMPLER_FLOWS - 1;
+  struct capture_sampler *sampler = init_capture_sampler(0, 250, 0, 0);
+  assert_non_null(sampler);
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+  hash = get_capture_flow_hash(packet, sizeof(packet));
+
+  // Find a flow with the same slot
+  for (uint32_t port = 1; port <= UINT16_MAX; port++) {
+    make_udp_packet(other, 3, 4, (uint16_t)port, 53);
+    other_hash = get_capture_flow_hash(other, sizeof(other));
+    if (other_hash != hash && (other_hash & mask) == (hash & mask)) {
+      break;
+    }
+  }
+  assert_int_equal(other_hash & mask, hash & mask);
+  assert_int_not_equal(other_hash, hash);
+
+  make_header(&header, timestamp, 100);
+  for (int idx = 0; idx < 3; idx++) {
+    assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  }
+
+  // The colliding flow is kept and doesn't reset the slot flow
+  for (int idx = 0; idx < 5; idx++) {
+    assert_true(sample_capture_packet(sampler, "EN10MB", &header, other));
+    assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  }
+
+  // The colliding flow takes the slot once the slot flow is idle
+  make_header(&header, timestamp + 2 * CAPTURE_SAMPLER_FLOW_TIMEOUT, 100);
+  for (int idx = 0; idx < 3; idx++) {
+    assert_true(sample_capture_packet(sampler, "EN10MB", &header, other));
+  }
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, other));
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  free_capture_sampler(sampler);
+}
+
+static void test_sample_capture_packet_rate(void **state) {
+  (void)state; /* unused */
+
+  uint8_t packet[TEST_PACKET_LEN];
+  struct pcap_pkthdr header;
+  uint64_t timestamp = 1000000;
+  struct capture_sampler *sampler = init_capture_sampler(0, 0, 100, 2);
+  assert_non_null(sampler);
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+
+  // The bucket starts with the burst of 2 packets
+  make_header(&header, timestamp, TEST_PACKET_LEN);
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  // A token is refilled every 10 ms at 100 packets per second
+  make_header(&header, timestamp + 5000, TEST_PACKET_LEN);
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  make_header(&header, timestamp + 10000, TEST_PACKET_LEN);
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  // The bucket never holds more than the burst
+  make_header(&header, timestamp + 10000000, TEST_PACKET_LEN);
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_true(sample_capture_packet(sampler, "EN10MB", &header, packet));
+  assert_false(sample_capture_packet(sampler, "EN10MB", &header, packet));
+
+  free_capture_sampler(sampler);
+}
+
+static int get_sampling_row(sqlite3 *db, uint64_t timestamp, uint64_t *seen,
+                            uint64_t *kept) {
+  sqlite3_stmt *res = NULL;
+  int rc;
+
+  const char *query = "SELECT seen,kept FROM " CAPTURE_SAMPLING_TABLE_NAME
+                      " WHERE ifname = 'wlan0' AND timestamp = @timestamp;";
+
+  assert_int_equal(sqlite3_prepare_v2(db, query, -1, &res, 0), SQLITE_OK);
+  sqlite3_bind_int64(res, 1, (sqlite3_int64)timestamp);
+
+  if ((rc = sqlite3_step(res)) == SQLITE_ROW) {
+    *seen = sqlite3_column_int64(res, 0);
+    *kept = sqlite3_column_int64(res, 1);
+  }
+
+  sqlite3_finalize(res);
+  return (rc == SQLITE_ROW) ? 0 : -1;
+}
+
+static void test_save_capture_sampler(void **state) {
+  (void)state; /* unused */
+
+  sqlite3 *db;
+  uint8_t packet[TEST_PACKET_LEN];
+  struct pcap_pkthdr header;
+  uint64_t seen, kept;
+  struct capture_sampler *sampler = init_capture_sampler(2, 0, 0, 0);
+  assert_non_null(sampler);
+
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+  assert_int_equal(init_capture_sampler_db(db), 0);
+
+  make_udp_packet(packet, 1, 2, 1000, 53);
+  make_header(&header, 1000000, TEST_PACKET_LEN);
+  for (int idx = 0; idx < 6; idx++) {
+    sample_capture_packet(sampler, "EN10MB", &header, packet);
+  }
+
+  assert_int_equal(save_capture_sampler(db, sampler, "wlan0", 100), 0);
+  assert_int_equal(get_sampling_row(db, 100, &seen, &kept), 0);
+  assert_int_equal(seen, 6);
+  assert_int_equal(kept, 3);
+
+  // Nothing is saved without new packets
+  assert_int_equal(save_capture_sampler(db, sampler, "wlan0", 200), 0);
+  assert_int_equal(get_sampling_row(db, 200, &seen, &kept), -1);
+
+  // Every row counts the packets since the previous one
+  for (int idx = 0; idx < 3; idx++) {
+    sample_capture_packet(sampler, "EN10MB", &header, packet);
+  }
+  assert_int_equal(save_capture_sampler(db, sampler, "wlan0", 300), 0);
+  assert_int_equal(get_sampling_row(db, 300, &seen, &kept), 0);
+  assert_int_equal(seen, 3);
+  assert_int_equal(kept, 2);
+
+  assert_int_equal(save_capture_sampler(NULL, sampler, "wlan0", 400), -1);
+  assert_int_equal(save_capture_sampler(db, NULL, "wlan0", 400), -1);
+
+  sqlite3_close(db);
+  free_capture_sampler(sampler);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_get_capture_flow_hash),
+      cmocka_unit_test(test_sample_capture_rate),
+      cmocka_unit_test(test_sample_capture_flow_head),
+      cmocka_unit_test(test_sample_capture_flow_collision),
+      cmocka_unit_test(test_sample_capture_packet_rate),
+      cmocka_unit_test(test_save_capture_sampler)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -38,11 +38,12 @@ int __wrap_init_sqlite_pcap_db(sqlite3 *db) {
 }
 
 int __wrap_run_pcap(char *interface, bool immediate, bool promiscuous,
-                    int timeout, char *filter, bool nonblock,
-                    capture_callback_fn pcap_fn, void *fn_ctx,
+                    int timeout, uint32_t snaplen, char *filter,
+                    bool nonblock, capture_callback_fn pcap_fn, void *fn_ctx,
                     struct pcap_context **pctx) {
   (void)fn_ctx;
   (void)pcap_fn;
+  (void)snaplen;
   (void)filter;
 
   assert_string_equal(interface, "wlan0");
@@ -108,7 +109,7 @@ int __wrap_extract_packets(const struct pcap_pkthdr *header,
   (void)hostname;
   (void)interface;
 
-  struct tuple_packet tp;
+  struct tuple_packet tp = {0};
   utarray_new(*tp_array, &tp_list_icd);
 
   tp.packet = NULL;
@@ -158,7 +159,7 @@ static void test_run_capture_thread(void **state) {
 
   pthread_t pid;
   int *thread_return = NULL;
-  run_capture_thread(ifname, &config, &pid);
+  run_capture_thread(ifname, &config, NULL, &pid);
   pthread_join(pid, (void **)&thread_return);
   assert_non_null(thread_return);
   assert_int_equal(*thread_return, -1);
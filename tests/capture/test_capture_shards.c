@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <net/if.h>
+#include <sqlite3.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture/capture_shards.h"
+#include "capture/middlewares/header_middleware/sqlite_header.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+static void write_shard(const char *db_path, uint32_t shard,
+                        const char *statements) {
+  char shard_path[MAX_OS_PATH_LEN];
+  sqlite3 *db = NULL;
+
+  assert_int_equal(get_capture_shard_path(db_path, shard, shard_path), 0);
+  assert_int_equal(sqlite3_open(shard_path, &db), SQLITE_OK);
+  assert_int_equal(sqlite3_exec(db, statements, NULL, NULL, NULL), SQLITE_OK);
+  sqlite3_close(db);
+}
+
+static int count_rows(sqlite3 *db, const char *sql) {
+  sqlite3_stmt *res = NULL;
+  int count = -1;
+
+  assert_int_equal(sqlite3_prepare_v2(db, sql, -1, &res, NULL), SQLITE_OK);
+  if (sqlite3_step(res) == SQLITE_ROW) {
+    count = sqlite3_column_int(res, 0);
+  }
+  sqlite3_finalize(res);
+
+  return count;
+}
+
+static void test_get_capture_shard(void **state) {
+  (void)state; /* unused */
+
+  char shard_path[MAX_OS_PATH_LEN];
+
+  assert_int_equal(get_capture_shard("br0", 0), 0);
+  assert_int_equal(get_capture_shard(NULL, 4), 0);
+
+  for (int idx = 0; idx < 64; idx++) {
+    char ifname[IF_NAMESIZE];
+    snprintf(ifname, sizeof(ifname), "br%d", idx);
+    assert_in_range(get_capture_shard(ifname, 4), 0, 3);
+    assert_int_equal(get_capture_shard(ifname, 4),
+                     get_capture_shard(ifname, 4));
+  }
+
+  assert_int_equal(get_capture_shard_path(NULL, 1, shard_path), -1);
+  assert_int_equal(get_capture_shard_path("/tmp/capture.sqlite", 1, NULL), -1);
+  assert_int_equal(
+      get_capture_shard_path("/tmp/capture.sqlite", 12, shard_path), 0);
+  assert_string_equal(shard_path, "/tmp/capture.sqlite.12");
+}
+
+static void test_open_capture_shards(void **state) {
+  (void)state; /* unused */
+
+  char tmp_folder_template[] = "/tmp/test_capture_shardsXXXXXX";
+  char *tmp_folder = mkdtemp(tmp_folder_template);
+  char db_path[MAX_OS_PATH_LEN];
+  char shard_path[MAX_OS_PATH_LEN];
+
+  assert_non_null(tmp_folder);
+  snprintf(db_path, sizeof(db_path), "%s/capture.sqlite", tmp_folder);
+
+  assert_null(open_capture_shards(NULL, 4));
+
+  write_shard(db_path, 0,
+              "CREATE TABLE eth (id INTEGER, ifname TEXT);"
+              "INSERT INTO eth VALUES (1, 'br0');"
+              "INSERT INTO eth VALUES (2, 'br0');");
+  write_shard(db_path, 2,
+              "CREATE TABLE eth (id INTEGER, ifname TEXT);"
+              "CREATE TABLE dns (id INTEGER);"
+              "INSERT INTO eth VALUES (3, 'br2');"
+              "INSERT INTO dns VALUES (3);");
+
+  // Shards 1 and 3 are missing
+  sqlite3 *db = open_capture_shards(db_path, 4);
+  assert_non_null(db);
+  assert_int_equal(count_rows(db, "SELECT COUNT(*) FROM eth;"), 3);
+  assert_int_equal(count_rows(db, "SELECT COUNT(*) FROM dns;"), 1);
+  assert_int_equal(
+      count_rows(db, "SELECT COUNT(*) FROM eth WHERE ifname='br2';"), 1);
+  sqlite3_close(db);
+
+  // No shards
+  db = open_capture_shards(db_path, 0);
+  assert_non_null(db);
+  sqlite3_close(db);
+
+  for (uint32_t shard = 0; shard < 4; shard++) {
+    get_capture_shard_path(db_path, shard, shard_path);
+    unlink(shard_path);
+  }
+  rmdir(tmp_folder);
+}
+
+static void test_capture_shards_header_db(void **state) {
+  (void)state; /* unused */
+
+  char tmp_folder_template[] = "/tmp/test_capture_shardsXXXXXX";
+  char *tmp_folder = mkdtemp(tmp_folder_template);
+  char db_path[MAX_OS_PATH_LEN];
+  char shard_path[MAX_OS_PATH_LEN];
+  const char *ifnames[] = {"br0", "br1", "br2", "br3"};
+  uint32_t shards = 4;
+  uint64_t last_id = 0;
+
+  assert_non_null(tmp_folder);
+  snprintf(db_path, sizeof(db_path), "%s/capture.sqlite", tmp_folder);
+
+  // Every capture thread writes the headers of its interface to its shard
+  for (uint64_t idx = 0; idx < ARRAY_SIZE(ifnames); idx++) {
+    sqlite3 *db = NULL;
+    uint32_t shard = get_capture_shard(ifnames[idx], shards);
+    char *sql = sqlite3_mprintf(
+        "INSERT INTO eth (timestamp, id, ifname) VALUES (1, %llu, %Q);",
+        (unsigned long long)(idx + 1), ifnames[idx]);
+
+    assert_int_equal(get_capture_shard_path(db_path, shard, shard_path), 0);
+    assert_int_equal(sqlite3_open(shard_path, &db), SQLITE_OK);
+    assert_int_equal(init_sqlite_header_db(db), 0);
+    assert_int_equal(sqlite3_exec(db, sql, NULL, NULL, NULL), SQLITE_OK);
+    sqlite3_free(sql);
+    sqlite3_close(db);
+  }
+
+  // The header db readers work on the views of all the shards
+  sqlite3 *db = open_capture_shards(db_path, shards);
+  assert_non_null(db);
+  assert_int_equal(count_rows(db, "SELECT COUNT(*) FROM eth;"), 4);
+  assert_int_equal(
+      count_rows(db, "SELECT COUNT(*) FROM eth WHERE ifname='br3';"), 1);
+  assert_int_equal(get_sqlite_header_last_id(db, &last_id), 0);
+  assert_int_equal(last_id, ARRAY_SIZE(ifnames));
+  sqlite3_close(db);
+
+  // More shards than the attached db limit
+  assert_null(open_capture_shards(db_path, 1000));
+
+  for (uint32_t shard = 0; shard < shards; shard++) {
+    get_capture_shard_path(db_path, shard, shard_path);
+    unlink(shard_path);
+  }
+  rmdir(tmp_folder);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_get_capture_shard),
+      cmocka_unit_test(test_open_capture_shards),
+      cmocka_unit_test(test_capture_shards_header_db)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
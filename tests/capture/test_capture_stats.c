@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "capture/capture_stats.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+static void test_get_capture_latency_bucket(void **state) {
+  (void)state; /* unused */
+
+  assert_int_equal(get_capture_latency_bucket(0), 0);
+  assert_int_equal(get_capture_latency_bucket(CAPTURE_STATS_LATENCY_BASE - 1),
+                   0);
+  assert_int_equal(get_capture_latency_bucket(CAPTURE_STATS_LATENCY_BASE), 1);
+  assert_int_equal(
+      get_capture_latency_bucket(CAPTURE_STATS_LATENCY_BASE * 2 - 1), 1);
+  assert_int_equal(get_capture_latency_bucket(CAPTURE_STATS_LATENCY_BASE * 2),
+                   2);
+  assert_int_equal(get_capture_latency_bucket(UINT64_MAX),
+                   CAPTURE_STATS_LATENCY_BUCKETS - 1);
+}
+
+static void test_record_capture_stats(void **state) {
+  (void)state; /* unused */
+
+  struct capture_sink_stats sink;
+  struct capture_stats stats;
+
+  os_memset(&sink, 0, sizeof(sink));
+
+  // Nothing is recorded without the thread sink stats
+  assert_null(get_capture_sink_stats());
+  record_capture_commit(10);
+  record_capture_bytes(100);
+
+  set_capture_sink_stats(&sink);
+  assert_ptr_equal(get_capture_sink_stats(), &sink);
+
+  record_capture_commit(10);
+  record_capture_commit(CAPTURE_STATS_LATENCY_BASE);
+  record_capture_commit(CAPTURE_STATS_LATENCY_BASE + 1);
+  record_capture_bytes(100);
+  record_capture_bytes(24);
+
+  set_capture_sink_stats(NULL);
+  record_capture_bytes(1000);
+
+  os_memset(&stats, 0, sizeof(stats));
+  load_capture_sink_stats(&sink, &stats);
+  assert_int_equal(stats.commits, 3);
+  assert_int_equal(stats.latency[0], 1);
+  assert_int_equal(stats.latency[1], 2);
+  assert_int_equal(stats.bytes, 124);
+}
+
+static void test_format_capture_stats(void **state) {
+  (void)state; /* unused */
+
+  struct capture_stats stats;
+  char line[MAX_CAPTURE_STATS_LINE_LEN];
+  char expected[MAX_CAPTURE_STATS_LINE_LEN];
+
+  os_memset(&stats, 0, sizeof(stats));
+  os_strlcpy(stats.ifname, "wlan0", IF_NAMESIZE);
+  stats.timestamp = 1000;
+  stats.ps_recv = 200;
+  stats.ps_drop = 3;
+  stats.ps_ifdrop = 1;
+  stats.queue_length = 42;
+  stats.commits = 5;
+  stats.bytes = 4096;
+  stats.latency[0] = 4;
+  stats.latency[CAPTURE_STATS_LATENCY_BUCKETS - 1] = 1;
+
+  strcpy(expected, "wlan0 1000 200 3 1 42 5 4096 4");
+  for (size_t idx = 1; idx < CAPTURE_STATS_LATENCY_BUCKETS - 1; idx++) {
+    strcat(expected, ",0");
+  }
+  strcat(expected, ",1");
+
+  assert_int_equal(format_capture_stats(&stats, line, sizeof(line)),
+                   strlen(expected));
+  assert_string_equal(line, expected);
+
+  // The buffer is too small
+  assert_int_equal(format_capture_stats(&stats, line, 20), -1);
+  assert_int_equal(format_capture_stats(&stats, line, strlen(expected)), -1);
+  assert_int_equal(format_capture_stats(NULL, line, sizeof(line)), -1);
+}
+
+static void test_publish_capture_stats(void **state) {
+  (void)state; /* unused */
+
+  struct capture_stats stats, *p;
+  UT_array *stats_arr = NULL;
+  struct capture_stats_registry *registry = init_capture_stats_registry();
+  assert_non_null(registry);
+
+  utarray_new(stats_arr, &capture_stats_icd);
+  assert_int_equal(get_capture_stats(registry, stats_arr), 0);
+
+  os_memset(&stats, 0, sizeof(stats));
+  os_strlcpy(stats.ifname, "wlan0", IF_NAMESIZE);
+  stats.ps_recv = 10;
+  assert_int_equal(publish_capture_stats(registry, &stats), 0);
+
+  os_strlcpy(stats.ifname, "wlan1", IF_NAMESIZE);
+  stats.ps_recv = 20;
+  assert_int_equal(publish_capture_stats(registry, &stats), 0);
+
+  // The new snapshot replaces the old one
+  os_strlcpy(stats.ifname, "wlan0", IF_NAMESIZE);
+  stats.ps_recv = 30;
+  assert_int_equal(publish_capture_stats(registry, &stats), 0);
+
+  assert_int_equal(get_capture_stats(registry, stats_arr), 2);
+  p = (struct capture_stats *)utarray_eltptr(stats_arr, 0);
+  assert_string_equal(p->ifname, "wlan0");
+  assert_int_equal(p->ps_recv, 30);
+  p = (struct capture_stats *)utarray_eltptr(stats_arr, 1);
+  assert_string_equal(p->ifname, "wlan1");
+  assert_int_equal(p->ps_recv, 20);
+
+  assert_int_equal(publish_capture_stats(NULL, &stats), -1);
+  assert_int_equal(get_capture_stats(NULL, stats_arr), -1);
+
+  utarray_free(stats_arr);
+  free_capture_stats_registry(registry);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_get_capture_latency_bucket),
+      cmocka_unit_test(test_record_capture_stats),
+      cmocka_unit_test(test_format_capture_stats),
+      cmocka_unit_test(test_publish_capture_stats)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
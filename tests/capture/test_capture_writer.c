@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <pcap.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <eloop.h>
+#include "capture/capture_config.h"
+#include "capture/capture_writer.h"
+#include "capture/middlewares_list.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+#define TEST_PACKETS 1000
+
+static atomic_uint processed_packets;
+static atomic_uint freed_contexts;
+static atomic_uint processed_batches;
+static atomic_uint mixed_batches;
+
+static struct middleware_context *
+init_test_middleware(sqlite3 *db, char *db_path, struct eloop_data *eloop,
+                     struct pcap_context *pc, char *params,
+                     const struct capture_conf *config) {
+  (void)db_path;
+  (void)pc;
+  (void)params;
+  (void)config;
+
+  struct middleware_context *context =
+      os_zalloc(sizeof(struct middleware_context));
+
+  context->db = db;
+  context->eloop = eloop;
+
+  return context;
+}
+
+static int process_test_middleware(struct middleware_context *context,
+                                   const char *ltype,
+                                   struct pcap_pkthdr *header, uint8_t *packet,
+                                   char *ifname) {
+  (void)context;
+
+  // DO NOT USE CMocka assert_* in this function, it runs in the writer thread
+  if (strcmp(ltype, "EN10MB") == 0 && strcmp(ifname, "wlan0") == 0 &&
+      header->caplen == 4 && packet[0] == 0xAA) {
+    atomic_fetch_add(&processed_packets, 1);
+  }
+
+  return 0;
+}
+
+static int process_batch_test_middleware(struct middleware_context *context,
+                                         const char *ltype,
+                                         struct middleware_packet *packets,
+                                         size_t count, char *ifname) {
+  for (size_t idx = 0; idx < count; idx++) {
+    process_test_middleware(context, ltype, &packets[idx].header,
+                            packets[idx].packet, ifname);
+  }
+
+  atomic_fetch_add(&processed_batches, 1);
+  return 0;
+}
+
+static int process_ltype_test_middleware(struct middleware_context *context,
+                                         const char *ltype,
+                                         struct middleware_packet *packets,
+                                         size_t count, char *ifname) {
+  (void)context;
+  (void)ifname;
+
+  // The second byte of a test packet tells its link type
+  uint8_t marker = (strcmp(ltype, "EN10MB") == 0) ? 0x01 : 0x02;
+
+  for (size_t idx = 0; idx < count; idx++) {
+    if (packets[idx].packet[1] != marker) {
+      atomic_fetch_add(&mixed_batches, 1);
+      break;
+    }
+  }
+
+  atomic_fetch_add(&processed_packets, count);
+  atomic_fetch_add(&processed_batches, 1);
+  return 0;
+}
+
+static void free_test_middleware(struct middleware_context *context) {
+  if (context != NULL) {
+    atomic_fetch_add(&freed_contexts, 1);
+    os_free(context);
+  }
+}
+
+static const struct capture_middleware test_middleware = {
+    .init = init_test_middleware,
+    .process = process_test_middleware,
+    .free = free_test_middleware,
+    .name = "test middleware",
+};
+
+static const struct capture_middleware test_batch_middleware = {
+    .init = init_test_middleware,
+    .process = process_test_middleware,
+    .free = free_test_middleware,
+    .name = "test batch middleware",
+    .process_batch = process_batch_test_middleware,
+};
+
+static const struct capture_middleware test_ltype_middleware = {
+    .init = init_test_middleware,
+    .process = process_test_middleware,
+    .free = free_test_middleware,
+    .name = "test ltype middleware",
+    .process_batch = process_ltype_test_middleware,
+};
+
+static UT_array *assign_test_middlewares(size_t count) {
+  UT_array *handlers = NULL;
+  utarray_new(handlers, &middleware_icd);
+
+  for (size_t idx = 0; idx < count; idx++) {
+    // Every other middleware processes batches
+    struct middleware_handlers handler = {
+        .f = (idx % 2) ? test_batch_middleware : test_middleware,
+        .context = NULL,
+    };
+    utarray_push_back(handlers, &handler);
+  }
+
+  return handlers;
+}
+
+static void run_capture_writers(enum WRITER_BACKPRESSURE backpressure,
+                                uint32_t ring_size,
+                                struct capture_writer_stats *stats) {
+  char ltype[] = "EN10MB";
+  char ifname[] = "wlan0";
+  uint8_t packet[4] = {0xAA, 0xBB, 0xCC, 0xDD};
+  struct pcap_pkthdr header = {.caplen = 4, .len = 4};
+  struct capture_conf config = {0};
+  UT_array *handlers = assign_test_middlewares(2);
+
+  os_strlcpy(config.capture_db_path, ":memory:", MAX_OS_PATH_LEN);
+  config.writer_ring_size = ring_size;
+  config.writer_backpressure = backpressure;
+
+  atomic_store(&processed_packets, 0);
+  atomic_store(&freed_contexts, 0);
+  atomic_store(&processed_batches, 0);
+
+  struct capture_writers *writers =
+      init_capture_writers(handlers, &config, NULL, ifname);
+  assert_non_null(writers);
+  assert_int_equal(writers->count, 2);
+
+  for (int idx = 0; idx < TEST_PACKETS; idx++) {
+    assert_int_equal(
+        dispatch_capture_writers(writers, ltype, &header, packet), 0);
+  }
+
+  assert_int_equal(get_capture_writer_stats(writers, 2, stats), -1);
+  assert_int_equal(get_capture_writer_stats(writers, 0, stats), 0);
+
+  free_capture_writers(writers);
+  assert_int_equal(atomic_load(&freed_contexts), 2);
+  utarray_free(handlers);
+}
+
+static void test_capture_writers_block(void **state) {
+  (void)state;
+
+  struct capture_writer_stats stats;
+
+  run_capture_writers(WRITER_BLOCK, 4, &stats);
+
+  assert_int_equal(stats.pushed, TEST_PACKETS);
+  assert_int_equal(stats.dropped, 0);
+  assert_int_equal(atomic_load(&processed_packets), 2 * TEST_PACKETS);
+  assert_in_range(atomic_load(&processed_batches), 1, TEST_PACKETS);
+}
+
+static void test_capture_writers_drop(void **state) {
+  (void)state;
+
+  struct capture_writer_stats stats;
+
+  // Every packet is pushed, but the oldest packets are dropped when the ring
+  // is full
+  run_capture_writers(WRITER_DROP_OLDEST, 1, &stats);
+  assert_int_equal(stats.pushed, TEST_PACKETS);
+  assert_in_range(atomic_load(&processed_packets), 2, 2 * TEST_PACKETS);
+
+  run_capture_writers(WRITER_DROP_NEWEST, 1, &stats);
+  assert_int_equal(stats.pushed + stats.dropped, TEST_PACKETS);
+  assert_in_range(stats.pushed, 1, TEST_PACKETS);
+  assert_in_range(atomic_load(&processed_packets), 2, 2 * TEST_PACKETS);
+}
+
+static void test_dispatch_capture_writers(void **state) {
+  (void)state;
+
+  uint8_t packet[4] = {0};
+  struct pcap_pkthdr header = {.caplen = 4, .len = 4};
+  struct capture_conf config = {0};
+  UT_array *handlers = assign_test_middlewares(0);
+
+  assert_null(init_capture_writers(NULL, &config, NULL, "wlan0"));
+  assert_null(init_capture_writers(handlers, NULL, NULL, "wlan0"));
+
+  os_strlcpy(config.capture_db_path, ":memory:", MAX_OS_PATH_LEN);
+  config.writer_ring_size = 4;
+
+  // No middlewares
+  struct capture_writers *writers =
+      init_capture_writers(handlers, &config, NULL, "wlan0");
+  assert_non_null(writers);
+  assert_int_equal(dispatch_capture_writers(NULL, "EN10MB", &header, packet),
+                   -1);
+  assert_int_equal(dispatch_capture_writers(writers, "EN10MB", NULL, packet),
+                   -1);
+  assert_int_equal(dispatch_capture_writers(writers, "EN10MB", &header, NULL),
+                   -1);
+  assert_int_equal(
+      dispatch_capture_writers(writers, "EN10MB", &header, packet), 0);
+  free_capture_writers(writers);
+
+  utarray_free(handlers);
+}
+
+static void test_capture_writers_ltype(void **state) {
+  (void)state;
+
+  uint8_t eth_packet[4] = {0xAA, 0x01, 0xCC, 0xDD};
+  uint8_t sll_packet[4] = {0xAA, 0x02, 0xCC, 0xDD};
+  struct pcap_pkthdr header = {.caplen = 4, .len = 4};
+  struct capture_conf config = {0};
+  struct middleware_handlers handler = {.f = test_ltype_middleware};
+  UT_array *handlers = NULL;
+
+  utarray_new(handlers, &middleware_icd);
+  utarray_push_back(handlers, &handler);
+
+  os_strlcpy(config.capture_db_path, ":memory:", MAX_OS_PATH_LEN);
+  config.writer_ring_size = TEST_PACKETS;
+  config.writer_backpressure = WRITER_BLOCK;
+
+  atomic_store(&processed_packets, 0);
+  atomic_store(&processed_batches, 0);
+  atomic_store(&mixed_batches, 0);
+
+  struct capture_writers *writers =
+      init_capture_writers(handlers, &config, NULL, "wlan0");
+  assert_non_null(writers);
+
+  // The link type changes every few packets
+  for (int idx = 0; idx < TEST_PACKETS; idx++) {
+    bool eth = (idx / 3) % 2;
+    assert_int_equal(dispatch_capture_writers(
+                         writers, eth ? "EN10MB" : "LINUX_SLL", &header,
+                         eth ? eth_packet : sll_packet),
+                     0);
+  }
+
+  free_capture_writers(writers);
+  utarray_free(handlers);
+
+  assert_int_equal(atomic_load(&processed_packets), TEST_PACKETS);
+  assert_int_equal(atomic_load(&mixed_batches), 0);
+}
+
+static void *pinned_capture_thread(void *arg) {
+  cpu_set_t *writer_cpus = (cpu_set_t *)arg;
+  cpu_set_t cpus;
+  struct capture_conf config = {0};
+  UT_array *handlers = assign_test_middlewares(1);
+  int cpu = 0;
+
+  // Pin the thread that starts the writers to its first allowed core
+  assert_int_equal(sched_getaffinity(0, sizeof(cpus), &cpus), 0);
+  while (!CPU_ISSET(cpu, &cpus)) {
+    cpu++;
+  }
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  assert_int_equal(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus),
+                   0);
+
+  os_strlcpy(config.capture_db_path, ":memory:", MAX_OS_PATH_LEN);
+  config.writer_ring_size = 4;
+  config.pin_threads = true;
+
+  struct capture_writers *writers =
+      init_capture_writers(handlers, &config, NULL, "wlan0");
+  assert_non_null(writers);
+  assert_int_equal(pthread_getaffinity_np(writers->writers[0].id,
+                                          sizeof(cpu_set_t), writer_cpus),
+                   0);
+  free_capture_writers(writers);
+  utarray_free(handlers);
+
+  return NULL;
+}
+
+static void test_capture_writers_affinity(void **state) {
+  (void)state;
+
+  cpu_set_t process_cpus, writer_cpus;
+  pthread_t id;
+
+  assert_int_equal(sched_getaffinity(getpid(), sizeof(process_cpus),
+                                     &process_cpus),
+                   0);
+  assert_int_equal(
+      pthread_create(&id, NULL, pinned_capture_thread, &writer_cpus), 0);
+  assert_int_equal(pthread_join(id, NULL), 0);
+
+  // The writers don't inherit the core of the pinned capture thread
+  assert_true(CPU_EQUAL(&process_cpus, &writer_cpus));
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_capture_writers_block),
+      cmocka_unit_test(test_capture_writers_drop),
+      cmocka_unit_test(test_dispatch_capture_writers),
+      cmocka_unit_test(test_capture_writers_ltype),
+      cmocka_unit_test(test_capture_writers_affinity)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <pcap.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capture/pcap_reader.h"
+#include "utils/log.h"
+
+#define TEST_STREAM_PACKETS 2000 // More data than the stream buffer
+#define TEST_PACKET_SIZE 1500
+
+struct stream_arg {
+  int fd;
+  int read_fd;
+  int npackets;
+  bool truncate;
+  uint32_t magic;
+};
+
+static void write_all(int fd, const void *data, size_t len) {
+  const uint8_t *ptr = data;
+
+  while (len > 0) {
+    ssize_t written = write(fd, ptr, len);
+    if (written <= 0) {
+      return;
+    }
+    ptr += written;
+    len -= (size_t)written;
+  }
+}
+
+static void *write_pcap_stream(void *arg) {
+  // DO NOT USE CMocka assert_* in this function
+  struct stream_arg *sarg = (struct stream_arg *)arg;
+  struct pcap_file_header header = {
+      .magic = sarg->magic,
+      .version_major = 2,
+      .version_minor = 4,
+      .snaplen = 65535,
+      .linktype = DLT_EN10MB,
+  };
+  uint8_t packet[TEST_PACKET_SIZE];
+
+  write_all(sarg->fd, &header, sizeof(header));
+
+  for (int idx = 0; idx < sarg->npackets; idx++) {
+    struct pcap_reader_pkthdr pkt_header = {
+        .ts_sec = (uint32_t)idx,
+        .ts_usec = 1,
+        .caplen = TEST_PACKET_SIZE - (idx % 100),
+        .len = TEST_PACKET_SIZE,
+    };
+
+    memset(packet, idx & 0xFF, sizeof(packet));
+    write_all(sarg->fd, &pkt_header, sizeof(pkt_header));
+    write_all(sarg->fd, packet, pkt_header.caplen);
+  }
+
+  if (sarg->truncate) {
+    struct pcap_reader_pkthdr pkt_header = {.caplen = 100, .len = 100};
+    write_all(sarg->fd, &pkt_header, sizeof(pkt_header));
+    write_all(sarg->fd, packet, 10);
+  }
+
+  close(sarg->fd);
+  return NULL;
+}
+
+static struct pcap_reader *open_stream(struct stream_arg *sarg,
+                                       pthread_t *id) {
+  int fds[2];
+
+  assert_int_equal(pipe(fds), 0);
+  sarg->fd = fds[1];
+  sarg->read_fd = fds[0];
+  assert_int_equal(pthread_create(id, NULL, write_pcap_stream, sarg), 0);
+
+  return open_pcap_reader_fd(fds[0], true);
+}
+
+static void test_open_pcap_reader(void **state) {
+  (void)state; /* unused */
+
+  pthread_t id;
+  struct stream_arg sarg = {.magic = 0x0a0d0d0a}; // pcapng
+
+  assert_null(open_pcap_reader("/tmp/edgesec-no-such-file.pcap"));
+  assert_null(open_pcap_reader_fd(-1, false));
+
+  // The fd is not closed on failure
+  assert_null(open_stream(&sarg, &id));
+  pthread_join(id, NULL);
+  assert_int_equal(close(sarg.read_fd), 0);
+}
+
+static void test_read_pcap_file(void **state) {
+  (void)state; /* unused */
+
+  struct pcap_pkthdr header;
+  const uint8_t *packet = NULL;
+  struct stat sb;
+  int ret, count = 0;
+
+  struct pcap_reader *reader = open_pcap_reader(TEST_PCAP_PATH);
+  assert_non_null(reader);
+  assert_non_null(reader->map);
+  assert_int_equal(reader->header.linktype, DLT_EN10MB);
+
+  while ((ret = next_pcap_reader(reader, &header, &packet)) > 0) {
+    assert_true(header.caplen <= header.len);
+    assert_non_null(packet);
+    count++;
+  }
+
+  assert_int_equal(ret, 0);
+  assert_true(count > 0);
+
+  // The whole file was consumed
+  assert_int_equal(stat(TEST_PCAP_PATH, &sb), 0);
+  assert_int_equal(reader->offset, sb.st_size);
+
+  close_pcap_reader(reader);
+}
+
+static void test_read_pcap_stream(void **state) {
+  (void)state; /* unused */
+
+  pthread_t id;
+  struct pcap_pkthdr header;
+  const uint8_t *packet = NULL;
+  struct stream_arg sarg = {.magic = PCAP_READER_MAGIC,
+                            .npackets = TEST_STREAM_PACKETS,
+                            .truncate = true};
+  int ret, count = 0;
+
+  struct pcap_reader *reader = open_stream(&sarg, &id);
+  assert_non_null(reader);
+  assert_null(reader->map);
+
+  while ((ret = next_pcap_reader(reader, &header, &packet)) > 0) {
+    assert_int_equal(header.ts.tv_sec, count);
+    assert_int_equal(header.caplen, TEST_PACKET_SIZE - (count % 100));
+    assert_int_equal(header.len, TEST_PACKET_SIZE);
+    assert_int_equal(packet[0], count & 0xFF);
+    assert_int_equal(packet[header.caplen - 1], count & 0xFF);
+    count++;
+  }
+
+  // The truncated packet is ignored
+  assert_int_equal(ret, 0);
+  assert_int_equal(count, TEST_STREAM_PACKETS);
+
+  pthread_join(id, NULL);
+  close_pcap_reader(reader);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_open_pcap_reader),
+      cmocka_unit_test(test_read_pcap_file),
+      cmocka_unit_test(test_read_pcap_stream)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
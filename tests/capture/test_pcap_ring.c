@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <pcap.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture/pcap_ring.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+
+#define TEST_RING_ETHER_TYPE 0x88B5 // Local experimental EtherType
+
+struct ring_result {
+  int matched;
+  int blocks;
+  uint32_t caplen;
+};
+
+static void ring_callback(void *ctx, struct pcap_pkthdr *header,
+                          uint8_t *packet) {
+  struct ring_result *result = (struct ring_result *)ctx;
+
+  if (header->caplen >= 14 && packet[12] == (TEST_RING_ETHER_TYPE >> 8) &&
+      packet[13] == (TEST_RING_ETHER_TYPE & 0xFF)) {
+    result->matched++;
+    result->caplen = header->caplen;
+  }
+}
+
+static void ring_block_callback(void *ctx) {
+  struct ring_result *result = (struct ring_result *)ctx;
+
+  result->blocks++;
+}
+
+static void test_open_pcap_ring(void **state) {
+  (void)state; /* unused */
+
+  struct pcap_ring_conf conf = {
+      .block_size = (uint32_t)getpagesize(),
+      .block_count = 4,
+  };
+
+  assert_null(open_pcap_ring(NULL, &conf, NULL));
+  assert_null(open_pcap_ring("lo", NULL, NULL));
+
+  // Block size not a multiple of the page size
+  conf.block_size = (uint32_t)getpagesize() + 1;
+  assert_null(open_pcap_ring("lo", &conf, NULL));
+
+  conf.block_size = (uint32_t)getpagesize();
+  conf.block_count = 0;
+  assert_null(open_pcap_ring("lo", &conf, NULL));
+
+  conf.block_count = 4;
+  assert_null(open_pcap_ring("edgesec-no-such-if", &conf, NULL));
+
+  close_pcap_ring(NULL);
+}
+
+static void test_dispatch_pcap_ring(void **state) {
+  (void)state; /* unused */
+
+  uint8_t frame[64] = {0};
+  struct ring_result result = {0};
+  struct pcap_stat ps;
+  struct pcap_ring_conf conf = {
+      .block_size = (uint32_t)getpagesize(),
+      .block_count = 4,
+      .timeout = 1,
+  };
+
+  struct pcap_ring *ring = open_pcap_ring("lo", &conf, NULL);
+  if (ring == NULL) {
+    // Needs CAP_NET_RAW
+    skip();
+  }
+
+  assert_int_equal(
+      dispatch_pcap_ring(NULL, ring_callback, ring_block_callback, &result),
+      -1);
+
+  frame[12] = TEST_RING_ETHER_TYPE >> 8;
+  frame[13] = TEST_RING_ETHER_TYPE & 0xFF;
+  assert_int_equal(inject_pcap_ring(ring, frame, sizeof(frame)),
+                   sizeof(frame));
+
+  // Wait for the block retire timeout
+  for (int idx = 0; idx < 100 && !result.matched; idx++) {
+    struct pollfd pfd = {.fd = ring->fd, .events = POLLIN};
+    poll(&pfd, 1, 10);
+    assert_true(dispatch_pcap_ring(ring, ring_callback, ring_block_callback,
+                                   &result) >= 0);
+  }
+
+  assert_true(result.matched > 0);
+  // Every retired block is passed to the block callback
+  assert_true(result.blocks > 0);
+  assert_int_equal(result.caplen, sizeof(frame));
+
+  assert_int_equal(get_pcap_ring_stats(ring, &ps), 0);
+  assert_true(ps.ps_recv > 0);
+
+  close_pcap_ring(ring);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_open_pcap_ring),
+      cmocka_unit_test(test_dispatch_pcap_ring)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
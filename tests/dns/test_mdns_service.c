@@ -20,13 +20,14 @@
 #include "utils/os.h"
 
 int __wrap_run_pcap(char *interface, bool immediate, bool promiscuous,
-                    int timeout, char *filter, bool nonblock,
-                    capture_callback_fn pcap_fn, void *fn_ctx,
+                    int timeout, uint32_t snaplen, char *filter,
+                    bool nonblock, capture_callback_fn pcap_fn, void *fn_ctx,
                     struct pcap_context **pctx) {
   (void)interface;
   (void)immediate;
   (void)promiscuous;
   (void)timeout;
+  (void)snaplen;
   (void)filter;
   (void)nonblock;
   (void)pcap_fn;
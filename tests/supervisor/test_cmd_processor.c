@@ -21,13 +21,21 @@
 #include "utils/iptables.h"
 #include "utils/log.h"
 
-ssize_t __wrap_write_socket_data(int sock, char *data, size_t data_len,
-                                 struct sockaddr_un *addr, int addr_len) {
-  (void)sock;
-  (void)data;
-  (void)addr;
-  (void)addr_len;
+static char last_reply[256];
 
+ssize_t __real_write_socket_data(int sock, const char *data, size_t data_len,
+                                 const struct client_address *addr);
+
+ssize_t __wrap_write_socket_data(int sock, const char *data, size_t data_len,
+                                 const struct client_address *addr) {
+  // The batch commands reply to a socket pair
+  if (sock > 0) {
+    return __real_write_socket_data(sock, data, data_len, addr);
+  }
+
+  os_strlcpy(last_reply, data,
+             (data_len < sizeof(last_reply)) ? data_len + 1
+                                             : sizeof(last_reply));
   return data_len;
 }
 
@@ -40,6 +48,22 @@ int __wrap_subscribe_events_cmd(struct supervisor_context *context,
   return 0;
 }
 
+int __wrap_end_batch_cmd(struct supervisor_context *context) {
+  (void)context;
+
+  return mock_type(int);
+}
+
+int __wrap_get_capture_stats_cmd(struct supervisor_context *context,
+                                 const char *ifname, char **reply) {
+  (void)context;
+
+  check_expected(ifname);
+
+  *reply = mock_ptr_type(char *);
+  return 0;
+}
+
 int __wrap_accept_mac_cmd(struct supervisor_context *context, uint8_t *mac_addr,
                           int vlanid) {
   (void)context;
@@ -307,6 +331,145 @@ static void test_process_domain_buffer(void **state) {
   utarray_free(arr);
 }
 
+static void test_split_cmd_buffer(void **state) {
+  (void)state; /* unused */
+
+  struct cmd_buffer cmd_buf = {0};
+  char **p = NULL;
+  const char *cmd = "ACCEPT_MAC 11:22:33:44:55:66  3\n";
+
+  assert_int_equal(reserve_cmd_buffer(&cmd_buf, strlen(cmd)), 0);
+  assert_true(cmd_buf.size > strlen(cmd));
+  os_memcpy(cmd_buf.buf, cmd, strlen(cmd));
+
+  assert_int_equal(split_cmd_buffer(&cmd_buf, strlen(cmd), CMD_DELIMITER), 4);
+  p = (char **)utarray_next(cmd_buf.args, p);
+  assert_string_equal(*p, "ACCEPT_MAC");
+  p = (char **)utarray_next(cmd_buf.args, p);
+  assert_string_equal(*p, "11:22:33:44:55:66");
+  p = (char **)utarray_next(cmd_buf.args, p);
+  assert_string_equal(*p, "");
+  p = (char **)utarray_next(cmd_buf.args, p);
+  assert_string_equal(*p, "3");
+
+  // The buffer is reused for shorter commands
+  char *buf = cmd_buf.buf;
+  assert_int_equal(reserve_cmd_buffer(&cmd_buf, 4), 0);
+  assert_ptr_equal(cmd_buf.buf, buf);
+  os_memcpy(cmd_buf.buf, "PING", 4);
+  assert_int_equal(split_cmd_buffer(&cmd_buf, 4, CMD_DELIMITER), 1);
+  p = (char **)utarray_front(cmd_buf.args);
+  assert_string_equal(*p, "PING");
+
+  assert_int_equal(split_cmd_buffer(&cmd_buf, 0, CMD_DELIMITER), -1);
+  assert_int_equal(split_cmd_buffer(&cmd_buf, cmd_buf.size, CMD_DELIMITER),
+                   -1);
+
+  assert_int_equal(reserve_cmd_buffer(&cmd_buf, 4 * MIN_CMD_BUFFER_SIZE), 0);
+  assert_true(cmd_buf.size > 4 * MIN_CMD_BUFFER_SIZE);
+
+  free_cmd_buffer(&cmd_buf);
+  assert_null(cmd_buf.buf);
+  assert_null(cmd_buf.args);
+}
+
+static void test_get_command_function(void **state) {
+  (void)state; /* unused */
+
+  assert_ptr_equal(get_command_function(CMD_ACCEPT_MAC),
+                   process_accept_mac_cmd);
+  assert_ptr_equal(get_command_function(CMD_ADD_BRIDGE),
+                   process_add_bridge_cmd);
+  assert_ptr_equal(get_command_function(CMD_ADD_NAT), process_add_nat_cmd);
+  assert_ptr_equal(get_command_function(CMD_ASSIGN_PSK),
+                   process_assign_psk_cmd);
+  assert_ptr_equal(get_command_function(CMD_CLEAR_BRIDGES),
+                   process_clear_bridges_cmd);
+  assert_ptr_equal(get_command_function(CMD_CLEAR_PSK), process_clear_psk_cmd);
+  assert_ptr_equal(get_command_function(CMD_DENY_MAC), process_deny_mac_cmd);
+  assert_ptr_equal(get_command_function(CMD_GET_ALL), process_get_all_cmd);
+  assert_ptr_equal(get_command_function(CMD_GET_BRIDGES),
+                   process_get_bridges_cmd);
+  assert_ptr_equal(get_command_function(CMD_GET_CAPTURE_STATS),
+                   process_get_capture_stats_cmd);
+  assert_ptr_equal(get_command_function(CMD_GET_MAP), process_get_map_cmd);
+  assert_ptr_equal(get_command_function(CMD_PING), process_ping_cmd);
+  assert_ptr_equal(get_command_function(CMD_REGISTER_TICKET),
+                   process_register_ticket_cmd);
+  assert_ptr_equal(get_command_function(CMD_REMOVE_BRIDGE),
+                   process_remove_bridge_cmd);
+  assert_ptr_equal(get_command_function(CMD_REMOVE_NAT),
+                   process_remove_nat_cmd);
+  assert_ptr_equal(get_command_function(CMD_SET_IP), process_set_ip_cmd);
+  assert_ptr_equal(get_command_function(CMD_SUBSCRIBE_EVENTS),
+                   process_subscribe_events_cmd);
+#ifdef WITH_CRYPTO_SERVICE
+  assert_ptr_equal(get_command_function(CMD_DECRYPT_BLOB),
+                   process_decrypt_blob_cmd);
+  assert_ptr_equal(get_command_function(CMD_ENCRYPT_BLOB),
+                   process_encrypt_blob_cmd);
+  assert_ptr_equal(get_command_function(CMD_GEN_CERT), process_gen_cert_cmd);
+  assert_ptr_equal(get_command_function(CMD_GEN_PRIVKEY),
+                   process_gen_privkey_cmd);
+  assert_ptr_equal(get_command_function(CMD_GEN_PUBKEY),
+                   process_gen_pubkey_cmd);
+  assert_ptr_equal(get_command_function(CMD_GEN_RANDKEY),
+                   process_gen_randkey_cmd);
+  assert_ptr_equal(get_command_function(CMD_GET_CRYPT), process_get_crypt_cmd);
+  assert_ptr_equal(get_command_function(CMD_PUT_CRYPT), process_put_crypt_cmd);
+  assert_ptr_equal(get_command_function(CMD_SIGN_BLOB), process_sign_blob_cmd);
+#endif
+
+  assert_null(get_command_function("UNKNOWN"));
+  assert_null(get_command_function("GET"));
+  assert_null(get_command_function(""));
+  assert_null(get_command_function(NULL));
+}
+
+static void test_process_batch_cmd(void **state) {
+  (void)state; /* unused */
+
+  struct supervisor_context ctx;
+  struct cmd_buffer cmd_buf = {0};
+  struct client_address claddr = {.type = SOCKET_TYPE_DOMAIN};
+  uint8_t addr[ETHER_ADDR_LEN] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+  const char *cmd = "BATCH\nPING_SUPERVISOR\nACCEPT_MAC 11:22:33:44:55:66 3\n"
+                    "ACCEPT_MAC 11:22 3\n\nUNKNOWN\nSUBSCRIBE_EVENTS\n";
+  const char *reply = "OK\nOK\nFAIL\nFAIL\nFAIL\nBATCH OK\n";
+  const char *fail_reply = "OK\nBATCH FAIL\n";
+
+  os_memset(&ctx, 0, sizeof(struct supervisor_context));
+
+  assert_true(is_batch_cmd(cmd, strlen(cmd)));
+  assert_false(is_batch_cmd("BATCH", 5));
+  assert_false(is_batch_cmd("BATCHES\nPING_SUPERVISOR", 23));
+  assert_false(is_batch_cmd("PING_SUPERVISOR", 15));
+
+  assert_int_equal(reserve_cmd_buffer(&cmd_buf, strlen(cmd)), 0);
+  os_memcpy(cmd_buf.buf, cmd, strlen(cmd));
+
+  expect_memory(__wrap_accept_mac_cmd, mac_addr, addr, ETHER_ADDR_LEN);
+  expect_value(__wrap_accept_mac_cmd, vlanid, 3);
+  will_return(__wrap_end_batch_cmd, 0);
+  assert_int_equal(process_batch_cmd(0, &claddr, &ctx, &cmd_buf, strlen(cmd)),
+                   strlen(reply));
+  assert_string_equal(last_reply, reply);
+
+  // A failed commit keeps the line replies
+  os_memcpy(cmd_buf.buf, "BATCH\nPING_SUPERVISOR\n", 22);
+  will_return(__wrap_end_batch_cmd, -1);
+  assert_int_equal(process_batch_cmd(0, &claddr, &ctx, &cmd_buf, 22),
+                   strlen(fail_reply));
+  assert_string_equal(last_reply, fail_reply);
+
+  // Not a batch command
+  os_memcpy(cmd_buf.buf, "PING_SUPERVISOR", 15);
+  assert_int_equal(process_batch_cmd(0, &claddr, &ctx, &cmd_buf, 15),
+                   strlen(FAIL_REPLY));
+
+  free_cmd_buffer(&cmd_buf);
+}
+
 static void test_process_subscribe_events_cmd(void **state) {
   (void)state; /* unused */
 
@@ -322,6 +485,33 @@ static void test_process_subscribe_events_cmd(void **state) {
   utarray_free(cmd_arr);
 }
 
+static void test_process_get_capture_stats_cmd(void **state) {
+  (void)state; /* unused */
+
+  UT_array *cmd_arr;
+  struct client_address claddr;
+  const char *line = "wlan0 1000 200 3 1 42 5 4096 4,0\n";
+
+  utarray_new(cmd_arr, &ut_str_icd);
+  assert_int_not_equal(
+      split_string_array("GET_CAPTURE_STATS", CMD_DELIMITER, cmd_arr), -1);
+  expect_value(__wrap_get_capture_stats_cmd, ifname, NULL);
+  will_return(__wrap_get_capture_stats_cmd, NULL);
+  assert_int_equal(process_get_capture_stats_cmd(0, &claddr, NULL, cmd_arr),
+                   strlen(OK_REPLY));
+  utarray_free(cmd_arr);
+
+  utarray_new(cmd_arr, &ut_str_icd);
+  assert_int_not_equal(
+      split_string_array("GET_CAPTURE_STATS wlan0", CMD_DELIMITER, cmd_arr),
+      -1);
+  expect_string(__wrap_get_capture_stats_cmd, ifname, "wlan0");
+  will_return(__wrap_get_capture_stats_cmd, os_strdup(line));
+  assert_int_equal(process_get_capture_stats_cmd(0, &claddr, NULL, cmd_arr),
+                   strlen(line));
+  utarray_free(cmd_arr);
+}
+
 static void test_process_accept_mac_cmd(void **state) {
   (void)state; /* unused */
   uint8_t addr[ETHER_ADDR_LEN] = {0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
@@ -537,17 +727,34 @@ static void test_process_get_all_cmd(void **state) {
                        -1);
   os_memset(&p, 0, sizeof(struct mac_conn));
   os_memcpy(p.mac_addr, addr1, ETHER_ADDR_LEN);
-  put_mac_mapper(&(ctx.mac_mapper), p);
+  put_mac_mapper(&(ctx.mac_mapper), &(ctx.ip_mapper), p);
 
   os_memset(&p, 0, sizeof(struct mac_conn));
   os_memcpy(p.mac_addr, addr2, ETHER_ADDR_LEN);
-  put_mac_mapper(&(ctx.mac_mapper), p);
+  put_mac_mapper(&(ctx.mac_mapper), &(ctx.ip_mapper), p);
 
   int ret = process_get_all_cmd(0, &claddr, &ctx, cmd_arr);
   bool comp = ret > (int)(2 * ARRAY_SIZE("11:22:33:44:55:66"));
   assert_true(comp);
   utarray_free(cmd_arr);
+
+  // The second page has the second device only
+  utarray_new(cmd_arr, &ut_str_icd);
+  assert_int_not_equal(split_string_array("GET_ALL 1", CMD_DELIMITER, cmd_arr),
+                       -1);
+  int page_ret = process_get_all_cmd(0, &claddr, &ctx, cmd_arr);
+  assert_true(page_ret > (int)ARRAY_SIZE("11:22:33:44:55:66"));
+  assert_true(page_ret < ret);
+  utarray_free(cmd_arr);
+
+  utarray_new(cmd_arr, &ut_str_icd);
+  assert_int_not_equal(
+      split_string_array("GET_ALL token", CMD_DELIMITER, cmd_arr), -1);
+  assert_int_equal(process_get_all_cmd(0, &claddr, &ctx, cmd_arr),
+                   strlen(FAIL_REPLY));
+  utarray_free(cmd_arr);
   free_mac_mapper(&(ctx.mac_mapper));
+  free_ip_mapper(&(ctx.ip_mapper));
 }
 
 static void test_process_set_ip_cmd(void **state) {
@@ -1180,7 +1387,11 @@ int main(int argc, char *argv[]) {
 
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_process_domain_buffer),
+      cmocka_unit_test(test_split_cmd_buffer),
+      cmocka_unit_test(test_get_command_function),
+      cmocka_unit_test(test_process_batch_cmd),
       cmocka_unit_test(test_process_subscribe_events_cmd),
+      cmocka_unit_test(test_process_get_capture_stats_cmd),
       cmocka_unit_test(test_process_accept_mac_cmd),
       cmocka_unit_test(test_process_deny_mac_cmd),
       cmocka_unit_test(test_process_add_nat_cmd),
@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "supervisor/cmd_reply.h"
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/os.h"
+
+static void test_append_cmd_reply(void **state) {
+  (void)state; /* unused */
+
+  struct cmd_reply reply;
+  char expected[4096] = {0};
+
+  init_cmd_reply(&reply, 0);
+  assert_null(reply.buf);
+  assert_int_equal(reply.len, 0);
+
+  // The buffer grows past its initial size
+  for (int idx = 0; idx < 200; idx++) {
+    assert_int_equal(append_cmd_reply(&reply, "line%d\n", idx), 1);
+    sprintf(&expected[strlen(expected)], "line%d\n", idx);
+  }
+
+  assert_int_equal(reply.len, strlen(expected));
+  assert_string_equal(reply.buf, expected);
+  assert_true(reply.size > CMD_REPLY_INIT_SIZE);
+
+  assert_int_equal(append_cmd_reply(NULL, "line\n"), -1);
+
+  free_cmd_reply(&reply);
+  assert_null(reply.buf);
+  assert_int_equal(reply.len, 0);
+}
+
+static void test_append_cmd_reply_limit(void **state) {
+  (void)state; /* unused */
+
+  struct cmd_reply reply;
+  char line[100];
+
+  os_memset(line, 'a', sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\0';
+
+  // The first line is always appended
+  init_cmd_reply(&reply, 10);
+  assert_int_equal(append_cmd_reply(&reply, "%s", line), 1);
+  assert_int_equal(append_cmd_reply(&reply, "b"), 0);
+  assert_int_equal(reply.len, strlen(line));
+  free_cmd_reply(&reply);
+
+  // Room is left for the continuation line
+  init_cmd_reply(&reply, 2 * strlen(line) + MAX_CMD_REPLY_NEXT_LEN);
+  assert_int_equal(append_cmd_reply(&reply, "%s", line), 1);
+  assert_int_equal(append_cmd_reply(&reply, "%s", line), 1);
+  assert_int_equal(append_cmd_reply(&reply, "b"), 0);
+
+  assert_int_equal(end_cmd_reply(&reply, 42), 0);
+  assert_int_equal(reply.len, 2 * strlen(line) + strlen("NEXT 42\n"));
+  assert_string_equal(&reply.buf[2 * strlen(line)], "NEXT 42\n");
+  assert_int_equal(end_cmd_reply(NULL, 42), -1);
+
+  free_cmd_reply(&reply);
+}
+
+static void test_get_cmd_reply_token(void **state) {
+  (void)state; /* unused */
+
+  size_t offset = 1;
+
+  assert_int_equal(get_cmd_reply_token(NULL, &offset), 0);
+  assert_int_equal(offset, 0);
+  assert_int_equal(get_cmd_reply_token("123", &offset), 0);
+  assert_int_equal(offset, 123);
+
+  assert_int_equal(get_cmd_reply_token("-1", &offset), -1);
+  assert_int_equal(get_cmd_reply_token("12a", &offset), -1);
+  assert_int_equal(get_cmd_reply_token("", &offset), -1);
+  assert_int_equal(get_cmd_reply_token("99999999999999999999999", &offset),
+                   -1);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_append_cmd_reply),
+      cmocka_unit_test(test_append_cmd_reply_limit),
+      cmocka_unit_test(test_get_cmd_reply_token)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
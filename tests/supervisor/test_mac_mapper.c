@@ -72,12 +72,17 @@ static void test_put_mac_mapper(void **state) {
   utarray_new(mac_conn_arr, &mac_conn_icd);
 
   hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
 
   for (int i = 0; i < 6; i++) {
-    assert_true(put_mac_mapper(&hmap, el[i]));
+    assert_true(put_mac_mapper(&hmap, &ip_hmap, el[i]));
   }
 
+  assert_false(put_mac_mapper(NULL, &ip_hmap, el[0]));
+  assert_false(put_mac_mapper(&hmap, NULL, el[0]));
+
   free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
   utarray_free(mac_conn_arr);
 }
 
@@ -86,13 +91,14 @@ static void test_get_mac_mapper(void **state) {
 
   struct mac_conn_info info;
   hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
   assert_int_equal(get_mac_mapper(&hmap, el[0].mac_addr, &info), 0);
   assert_int_equal(get_mac_mapper(NULL, el[0].mac_addr, &info), -1);
   assert_int_equal(get_mac_mapper(&hmap, NULL, &info), -1);
   assert_int_equal(get_mac_mapper(&hmap, el[0].mac_addr, NULL), -1);
 
   for (int i = 0; i < 6; i++) {
-    put_mac_mapper(&hmap, el[i]);
+    put_mac_mapper(&hmap, &ip_hmap, el[i]);
   }
 
   for (int i = 0; i < 6; i++) {
@@ -102,25 +108,173 @@ static void test_get_mac_mapper(void **state) {
   }
 
   free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
+}
+
+static void test_get_ip_mapper(void **state) {
+  (void)state; /* unused */
+
+  uint8_t mac_addr[ETHER_ADDR_LEN];
+  struct mac_conn conn;
+  hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
+
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.1.2", mac_addr), 0);
+  assert_int_equal(get_ip_mapper(NULL, "10.0.1.2", mac_addr), -1);
+  assert_int_equal(get_ip_mapper(&ip_hmap, NULL, mac_addr), -1);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.1.2", NULL), -1);
+
+  for (int i = 0; i < 6; i++) {
+    conn = el[i];
+    sprintf(conn.info.ip_addr, "10.0.%d.2", i);
+    if (i == 1) {
+      os_strlcpy(conn.info.ip_sec_addr, "fd00::1", OS_INET_ADDRSTRLEN);
+    }
+    assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  }
+
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.3.2", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[3].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "fd00:0::1", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[1].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.6.2", mac_addr), 0);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "not an ip", mac_addr), 0);
+
+  // Changing the IP of a MAC removes the old one
+  conn = el[3];
+  os_strlcpy(conn.info.ip_addr, "10.0.3.3", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.3.2", mac_addr), 0);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.3.3", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[3].mac_addr, ETHER_ADDR_LEN);
+
+  // An IP reassigned to another MAC is not removed by the old MAC
+  conn = el[4];
+  os_strlcpy(conn.info.ip_addr, "10.0.3.3", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  conn = el[3];
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.3.3", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[4].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.4.2", mac_addr), 0);
+
+  free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
+}
+
+static void test_reassign_ip_mapper(void **state) {
+  (void)state; /* unused */
+
+  uint8_t mac_addr[ETHER_ADDR_LEN];
+  struct mac_conn conn;
+  struct mac_conn_info info;
+  hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
+
+  conn = el[0];
+  os_strlcpy(conn.info.ip_addr, "10.0.0.2", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+
+  // The IP moves from the first MAC to the second one
+  conn = el[1];
+  os_strlcpy(conn.info.ip_addr, "10.0.0.2", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.2", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[1].mac_addr, ETHER_ADDR_LEN);
+
+  // The first MAC gets a new IP without removing the reassigned one
+  conn = el[0];
+  os_strlcpy(conn.info.ip_addr, "10.0.0.3", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.2", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[1].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.3", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[0].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(get_mac_mapper(&hmap, el[0].mac_addr, &info), 1);
+  assert_string_equal(info.ip_addr, "10.0.0.3");
+
+  // Moving an IP between the primary and secondary slots keeps it mapped
+  conn = el[1];
+  os_strlcpy(conn.info.ip_sec_addr, "10.0.0.2", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.2", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[1].mac_addr, ETHER_ADDR_LEN);
+
+  // The same IP in both slots is mapped once
+  os_strlcpy(conn.info.ip_addr, "10.0.0.4", OS_INET_ADDRSTRLEN);
+  os_strlcpy(conn.info.ip_sec_addr, "10.0.0.4", OS_INET_ADDRSTRLEN);
+  assert_true(put_mac_mapper(&hmap, &ip_hmap, conn));
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.2", mac_addr), 0);
+  assert_int_equal(get_ip_mapper(&ip_hmap, "10.0.0.4", mac_addr), 1);
+  assert_memory_equal(mac_addr, el[1].mac_addr, ETHER_ADDR_LEN);
+  assert_int_equal(HASH_COUNT(ip_hmap), 2);
+
+  free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
 }
 
 static void test_get_mac_list(void **state) {
   (void)state; /* unused */
   int cnt;
   hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
   struct mac_conn *list;
 
   assert_int_equal(get_mac_list(&hmap, &list), 0);
   for (int i = 0; i < 6; i++) {
-    put_mac_mapper(&hmap, el[i]);
+    put_mac_mapper(&hmap, &ip_hmap, el[i]);
   }
 
   cnt = get_mac_list(&hmap, &list);
   assert_int_equal(cnt, 6);
   free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
   os_free(list);
 }
 
+static bool count_mac_conn(const uint8_t mac_addr[ETHER_ADDR_LEN],
+                           const struct mac_conn_info *info, void *args) {
+  (void)mac_addr;
+  (void)info;
+
+  int *count = (int *)args;
+  (*count)--;
+  return *count > 0;
+}
+
+static void test_iter_mac_mapper(void **state) {
+  (void)state; /* unused */
+
+  hmap_mac_conn *hmap = NULL;
+  hmap_ip_conn *ip_hmap = NULL;
+  int count = 10;
+
+  assert_int_equal(iter_mac_mapper(&hmap, 0, count_mac_conn, &count), 0);
+  assert_int_equal(iter_mac_mapper(NULL, 0, count_mac_conn, &count), -1);
+  assert_int_equal(iter_mac_mapper(&hmap, 0, NULL, &count), -1);
+
+  for (int i = 0; i < 6; i++) {
+    put_mac_mapper(&hmap, &ip_hmap, el[i]);
+  }
+
+  // Stops at the callback
+  count = 2;
+  assert_int_equal(iter_mac_mapper(&hmap, 0, count_mac_conn, &count), 1);
+  count = 2;
+  assert_int_equal(iter_mac_mapper(&hmap, 3, count_mac_conn, &count), 4);
+
+  // Iterates to the end
+  count = 10;
+  assert_int_equal(iter_mac_mapper(&hmap, 2, count_mac_conn, &count), 6);
+  assert_int_equal(count, 6);
+  count = 10;
+  assert_int_equal(iter_mac_mapper(&hmap, 8, count_mac_conn, &count), 6);
+  assert_int_equal(count, 10);
+
+  free_mac_mapper(&hmap);
+  free_ip_mapper(&ip_hmap);
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
@@ -129,7 +283,10 @@ int main(int argc, char *argv[]) {
 
   const struct CMUnitTest tests[] = {cmocka_unit_test(test_put_mac_mapper),
                                      cmocka_unit_test(test_get_mac_mapper),
-                                     cmocka_unit_test(test_get_mac_list)};
+                                     cmocka_unit_test(test_get_ip_mapper),
+                                     cmocka_unit_test(test_reassign_ip_mapper),
+                                     cmocka_unit_test(test_get_mac_list),
+                                     cmocka_unit_test(test_iter_mac_mapper)};
 
   return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -69,6 +69,14 @@ static void test_get_mac_conn_cmd(void **state) {
 
   utarray_new(rows, &mac_conn_icd);
 
+  // The db is only updated by the journal flush
+  get_sqlite_macconn_entries(ctx.macconn_db, rows);
+  assert_int_equal(utarray_len(rows), 0);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 1);
+
+  assert_int_equal(flush_mac_journal(&ctx), 0);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 0);
+
   get_sqlite_macconn_entries(ctx.macconn_db, rows);
   const struct mac_conn *p = (const struct mac_conn *)utarray_front(rows);
   assert_non_null(p);
@@ -88,7 +96,9 @@ static void test_get_mac_conn_cmd(void **state) {
   struct mac_conn_info info2 = get_mac_conn_cmd(conn.mac_addr, (void *)&ctx);
   assert_int_equal(info2.vlanid, -1);
 
+  free_mac_journal(&ctx);
   free_mac_mapper(&ctx.mac_mapper);
+  free_ip_mapper(&ctx.ip_mapper);
   free_sqlite_macconn_db(ctx.macconn_db);
   utarray_free(ctx.config_ifinfo_array);
 #ifdef WITH_CRYPTO_SERVICE
@@ -96,6 +106,82 @@ static void test_get_mac_conn_cmd(void **state) {
 #endif
 }
 
+static void test_flush_mac_journal(void **state) {
+  (void)state; /* unused */
+  uint8_t mac_addr[6] = {0x04, 0xf0, 0x21, 0x5a, 0xf4, 0xc4};
+  struct supervisor_context ctx = {0};
+  struct mac_conn conn = {0};
+  UT_array *rows;
+
+#ifdef WITH_CRYPTO_SERVICE
+  uint8_t secret[4] = {'s', 's', 'e', 'r'};
+  ctx.crypt_ctx = load_crypt_service("", "key", secret, ARRAY_SIZE(secret));
+  assert_non_null(ctx.crypt_ctx);
+#endif
+
+  // Nothing to save
+  assert_int_equal(flush_mac_journal(&ctx), 0);
+
+  assert_int_equal(open_sqlite_macconn_db(":memory:", &ctx.macconn_db), 0);
+
+  // Every change of a MAC is coalesced into a single journal entry
+  os_memcpy(conn.mac_addr, mac_addr, ETHER_ADDR_LEN);
+  conn.info.vlanid = 1;
+  assert_int_equal(queue_mac_mapper(&ctx, conn), 0);
+  conn.info.vlanid = 2;
+  assert_int_equal(queue_mac_mapper(&ctx, conn), 0);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 1);
+
+  conn.mac_addr[5] = 0xc5;
+  assert_int_equal(queue_mac_mapper(&ctx, conn), 0);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 2);
+
+  assert_int_equal(flush_mac_journal(&ctx), 0);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 0);
+
+  utarray_new(rows, &mac_conn_icd);
+  get_sqlite_macconn_entries(ctx.macconn_db, rows);
+  assert_int_equal(utarray_len(rows), 2);
+
+  const struct mac_conn *p = NULL;
+  while ((p = (const struct mac_conn *)utarray_next(rows, p)) != NULL) {
+    assert_int_equal(p->info.vlanid, 2);
+  }
+
+  // The entries missing from the mapper stay in the journal, without
+  // blocking the following entries
+  struct mac_journal_entry *entry = os_zalloc(sizeof(*entry));
+  assert_non_null(entry);
+  os_memcpy(entry->mac_addr, conn.mac_addr, ETHER_ADDR_LEN);
+  entry->mac_addr[5] = 0xc6;
+  HASH_ADD(hh, ctx.mac_journal, mac_addr, ETHER_ADDR_LEN, entry);
+  conn.mac_addr[5] = 0xc7;
+  assert_int_equal(queue_mac_mapper(&ctx, conn), 0);
+  assert_int_equal(flush_mac_journal(&ctx), -1);
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 1);
+
+  utarray_clear(rows);
+  get_sqlite_macconn_entries(ctx.macconn_db, rows);
+  assert_int_equal(utarray_len(rows), 3);
+
+  // The entry is dropped after MAX_MAC_JOURNAL_FAILURES failed saves
+  for (int idx = 1; idx < MAX_MAC_JOURNAL_FAILURES; idx++) {
+    assert_int_equal(HASH_COUNT(ctx.mac_journal), 1);
+    assert_int_equal(flush_mac_journal(&ctx), -1);
+  }
+  assert_int_equal(HASH_COUNT(ctx.mac_journal), 0);
+  utarray_free(rows);
+
+  free_mac_journal(&ctx);
+  assert_null(ctx.mac_journal);
+  free_mac_mapper(&ctx.mac_mapper);
+  free_ip_mapper(&ctx.ip_mapper);
+  free_sqlite_macconn_db(ctx.macconn_db);
+#ifdef WITH_CRYPTO_SERVICE
+  free_crypt_service(ctx.crypt_ctx);
+#endif
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
@@ -104,6 +190,7 @@ int main(int argc, char *argv[]) {
 
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_get_mac_conn_cmd),
+      cmocka_unit_test(test_flush_mac_journal),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
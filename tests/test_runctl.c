@@ -185,6 +185,7 @@ static void test_init_context(void **state) {
   free_vlan_mapper(&context.vlan_mapper);
   free_if_mapper(&context.if_mapper);
   free_mac_mapper(&context.mac_mapper);
+  free_ip_mapper(&context.ip_mapper);
   fw_free_context(context.fw_ctx);
   hmap_str_keychar_free(&context.hmap_bin_paths);
 #ifdef WITH_CRYPTO_SERVICE
@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include "utils/allocs.h"
+#include "utils/log.h"
+
+static void test_init_os_slab(void **state) {
+  (void)state; /* unused */
+
+  assert_null(init_os_slab(0, 4));
+  assert_null(init_os_slab(16, 0));
+  assert_null(os_slab_alloc(NULL));
+
+  struct os_slab *slab = init_os_slab(1, 4);
+  assert_non_null(slab);
+  // Objects are big enough to hold the free list pointer
+  assert_true(slab->object_size >= sizeof(void *));
+  assert_int_equal(slab->capacity, 0);
+  free_os_slab(slab);
+
+  free_os_slab(NULL);
+}
+
+static void test_os_slab_alloc(void **state) {
+  (void)state; /* unused */
+
+  struct os_slab_stats stats;
+  uint8_t *objects[10];
+  struct os_slab *slab = init_os_slab(100, 4);
+  assert_non_null(slab);
+
+  for (int idx = 0; idx < 10; idx++) {
+    objects[idx] = os_slab_alloc(slab);
+    assert_non_null(objects[idx]);
+    assert_int_equal((uintptr_t)objects[idx] % alignof(max_align_t), 0);
+    os_memset(objects[idx], idx, 100);
+  }
+
+  get_os_slab_stats(slab, &stats);
+  assert_int_equal(stats.capacity, 12);
+  assert_int_equal(stats.in_use, 10);
+  assert_int_equal(stats.high_water, 10);
+  assert_int_equal(stats.allocs, 10);
+
+  // The objects don't overlap
+  for (int idx = 0; idx < 10; idx++) {
+    assert_int_equal(objects[idx][0], idx);
+    assert_int_equal(objects[idx][99], idx);
+  }
+
+  // A freed object is reused without growing the slab
+  os_slab_free(slab, objects[3]);
+  os_slab_free(slab, NULL);
+  assert_ptr_equal(os_slab_alloc(slab), objects[3]);
+
+  for (int idx = 0; idx < 10; idx++) {
+    os_slab_free(slab, objects[idx]);
+  }
+
+  get_os_slab_stats(slab, &stats);
+  assert_int_equal(stats.capacity, 12);
+  assert_int_equal(stats.in_use, 0);
+  assert_int_equal(stats.high_water, 10);
+  assert_int_equal(stats.allocs, 11);
+
+  free_os_slab(slab);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {cmocka_unit_test(test_init_os_slab),
+                                     cmocka_unit_test(test_os_slab_alloc)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -45,6 +45,15 @@ static void test_ip4_2_buf(void **state) {
   assert_int_equal(ip4_2_buf(ip1, buf), -1);
 }
 
+static void test_mac_2_str(void **state) {
+  (void)state; /* unused */
+  uint8_t mac[ETHER_ADDR_LEN] = {0x00, 0x0a, 0xbc, 0xde, 0xf1, 0xff};
+  char str[MACSTR_LEN];
+
+  assert_ptr_equal(mac_2_str(mac, str), str);
+  assert_string_equal(str, "00:0a:bc:de:f1:ff");
+}
+
 static void test_validate_ipv4_string(void **state) {
   (void)state;
 
@@ -98,6 +107,7 @@ int main(int argc, char *argv[]) {
 
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_ip_2_nbo), cmocka_unit_test(test_ip4_2_buf),
+      cmocka_unit_test(test_mac_2_str),
       cmocka_unit_test(test_validate_ipv4_string),
       cmocka_unit_test(test_get_ip_host)};
 
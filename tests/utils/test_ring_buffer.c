@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "utils/allocs.h"
+#include "utils/log.h"
+#include "utils/ring_buffer.h"
+
+#define TEST_THREAD_PACKETS 100000
+
+static void test_init_ring_buffer(void **state) {
+  (void)state; /* unused */
+
+  assert_null(init_ring_buffer(0));
+
+  struct ring_buffer *rb = init_ring_buffer(5);
+  assert_non_null(rb);
+  assert_int_equal(rb->size, 8);
+  assert_int_equal(get_ring_buffer_length(rb), 0);
+  free_ring_buffer(rb);
+
+  rb = init_ring_buffer(16);
+  assert_non_null(rb);
+  assert_int_equal(rb->size, 16);
+  free_ring_buffer(rb);
+}
+
+static void test_push_pop_ring_buffer(void **state) {
+  (void)state; /* unused */
+
+  int values[5] = {0, 1, 2, 3, 4};
+  struct ring_buffer *rb = init_ring_buffer(4);
+
+  assert_null(pop_ring_buffer(rb));
+
+  for (int idx = 0; idx < 4; idx++) {
+    assert_int_equal(push_ring_buffer(rb, &values[idx]), 0);
+  }
+
+  assert_int_equal(get_ring_buffer_length(rb), 4);
+  assert_int_equal(push_ring_buffer(rb, &values[4]), -1);
+
+  assert_ptr_equal(pop_ring_buffer(rb), &values[0]);
+  assert_int_equal(push_ring_buffer(rb, &values[4]), 0);
+
+  for (int idx = 1; idx < 5; idx++) {
+    assert_ptr_equal(pop_ring_buffer(rb), &values[idx]);
+  }
+
+  assert_null(pop_ring_buffer(rb));
+  assert_int_equal(get_ring_buffer_length(rb), 0);
+
+  free_ring_buffer(rb);
+}
+
+static void test_push_overwrite_ring_buffer(void **state) {
+  (void)state; /* unused */
+
+  int values[4] = {0, 1, 2, 3};
+  struct ring_buffer *rb = init_ring_buffer(2);
+
+  assert_null(push_overwrite_ring_buffer(rb, &values[0]));
+  assert_null(push_overwrite_ring_buffer(rb, &values[1]));
+  assert_ptr_equal(push_overwrite_ring_buffer(rb, &values[2]), &values[0]);
+  assert_ptr_equal(push_overwrite_ring_buffer(rb, &values[3]), &values[1]);
+  assert_int_equal(get_ring_buffer_length(rb), 2);
+
+  assert_ptr_equal(pop_ring_buffer(rb), &values[2]);
+  assert_ptr_equal(pop_ring_buffer(rb), &values[3]);
+  assert_null(pop_ring_buffer(rb));
+
+  free_ring_buffer(rb);
+}
+
+struct consumer_arg {
+  struct ring_buffer *rb;
+  uintptr_t last;
+  uintptr_t count;
+  int ordered;
+};
+
+void *ring_buffer_consumer(void *arg) {
+  // DO NOT USE CMocka assert_* in this function
+  struct consumer_arg *carg = arg;
+  void *el;
+
+  carg->ordered = 1;
+  while (carg->last < TEST_THREAD_PACKETS) {
+    if ((el = pop_ring_buffer(carg->rb)) != NULL) {
+      if ((uintptr_t)el <= carg->last) {
+        carg->ordered = 0;
+      }
+      carg->last = (uintptr_t)el;
+      carg->count++;
+    } else {
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+static void test_ring_buffer_threads(void **state) {
+  (void)state; /* unused */
+
+  pthread_t id;
+  struct consumer_arg carg = {.rb = init_ring_buffer(64)};
+
+  assert_int_equal(pthread_create(&id, NULL, ring_buffer_consumer, &carg), 0);
+
+  // Elements start at 1, since NULL marks an empty ring
+  for (uintptr_t idx = 1; idx <= TEST_THREAD_PACKETS; idx++) {
+    while (push_ring_buffer(carg.rb, (void *)idx) < 0) {
+      sched_yield();
+    }
+  }
+
+  assert_int_equal(pthread_join(id, NULL), 0);
+  assert_int_equal(carg.count, TEST_THREAD_PACKETS);
+  assert_true(carg.ordered);
+  free_ring_buffer(carg.rb);
+
+  // With overwrites the consumer sees an ordered subset of the elements
+  carg = (struct consumer_arg){.rb = init_ring_buffer(8)};
+  assert_int_equal(pthread_create(&id, NULL, ring_buffer_consumer, &carg), 0);
+
+  uintptr_t evicted = 0;
+  for (uintptr_t idx = 1; idx <= TEST_THREAD_PACKETS; idx++) {
+    if (push_overwrite_ring_buffer(carg.rb, (void *)idx) != NULL) {
+      evicted++;
+    }
+  }
+
+  assert_int_equal(pthread_join(id, NULL), 0);
+  assert_int_equal(carg.count + evicted, TEST_THREAD_PACKETS);
+  assert_true(carg.ordered);
+  free_ring_buffer(carg.rb);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  log_set_quiet(false);
+
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_init_ring_buffer),
+      cmocka_unit_test(test_push_pop_ring_buffer),
+      cmocka_unit_test(test_push_overwrite_ring_buffer),
+      cmocka_unit_test(test_ring_buffer_threads)};
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -70,6 +70,21 @@ static void test_check_table_exists(void **state) {
   sqlite3_close(db);
 }
 
+static void test_check_column_exists(void **state) {
+  (void)state; /* unused */
+
+  sqlite3 *db = NULL;
+  assert_int_equal(sqlite3_open(":memory:", &db), SQLITE_OK);
+
+  assert_int_equal(check_column_exists(db, "example", "column"), 0);
+  assert_int_equal(
+      execute_sqlite_query(db, "CREATE TABLE example(id, column);"), 0);
+  assert_int_equal(check_column_exists(db, "example", "column"), 1);
+  assert_int_equal(check_column_exists(db, "example", "other"), 0);
+
+  sqlite3_close(db);
+}
+
 int main(int argc, char *argv[]) {
   (void)argc;
   (void)argv;
@@ -77,6 +92,7 @@ int main(int argc, char *argv[]) {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_check_table_exists),
       cmocka_unit_test(test_execute_sqlite_query),
+      cmocka_unit_test(test_check_column_exists),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);